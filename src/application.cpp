@@ -10,6 +10,10 @@
 #include "prefab.h"
 #include "gltf_loader.h"
 #include "renderer.h"
+#include "jobsystem.h"
+#include "profiler.h"
+#include "renderstats.h"
+#include "vram.h"
 
 #include <cmath>
 #include <string>
@@ -65,6 +69,9 @@ Application::Application(int window_width, int window_height, SDL_Window* window
 	//Example of loading a prefab
 	//prefab = GTR::Prefab::Get("data/prefabs/gmc/scene.gltf");
 
+	//the prefabs and textures of the scene are loaded by the workers while it is already rendering
+	JobSystem::init();
+
 	scene = new GTR::Scene();
 	if (!scene->load("data/scene.json"))
 		exit(1);
@@ -99,6 +106,9 @@ Application::Application(int window_width, int window_height, SDL_Window* window
 //what to do when the image has to be draw
 void Application::render(void)
 {
+	PROFILE_NEW_FRAME();
+	RenderStats::newFrame();
+
 	//be sure no errors present in opengl before start
 	checkGLErrors();
 
@@ -112,12 +122,18 @@ void Application::render(void)
 	else
 		glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
 
-	renderer->renderShadowMaps(scene);
+	{
+		PROFILE_GPU_SCOPE("shadow maps");
+		renderer->renderShadowMaps(scene);
+	}
 
 	//set the camera as default (used by some functions in the framework)
 	camera->enable();
-	renderer->renderScene(scene, camera);
-	renderer->displayShadowMap();
+	{
+		PROFILE_SCOPE("scene"); //the passes measure the GPU
+		renderer->renderScene(scene, camera);
+		renderer->displayShadowMap();
+	}
 
 	//Draw the floor grid, helpful to have a reference point
 	if(render_debug)
@@ -125,15 +141,20 @@ void Application::render(void)
 
     glDisable(GL_DEPTH_TEST);
     //render anything in the gui after this
-	if (renderer->first_it) {
-		renderer->updateReflectionProbes(scene);
-		renderer->first_it = false;
+	{
+		PROFILE_GPU_SCOPE("reflection probes");
+		renderer->updateReflectionProbesBudget(scene, camera);
 	}
 	//the swap buffers is done in the main loop after this function
 }
 
 void Application::update(double seconds_elapsed)
 {
+	PROFILE_SCOPE("update");
+	JobSystem::update(); //assets that have finished loading
+	Texture::updateStreaming();
+	Shader::updatePending(); //atlas shaders compiled in the background
+
 	float speed = seconds_elapsed * cam_speed; //the speed is defined by the seconds_elapsed so it goes constant
 	float orbit_speed = seconds_elapsed * 0.5;
 	
@@ -184,6 +205,12 @@ void Application::update(double seconds_elapsed)
 	}
 }
 
+void Application::setCameraView(const Vector3& eye, const Vector3& center, float fov)
+{
+	camera->lookAt(eye, center, Vector3(0, 1, 0));
+	camera->setPerspective(fov, window_width / (float)window_height, camera->near_plane, camera->far_plane);
+}
+
 void Application::renderDebugGizmo()
 {
 	if (!selected_entity || !render_debug)
@@ -275,6 +302,21 @@ void Application::renderDebugGUI(void)
 		ImGui::TreePop();
 	}
 
+	if (ImGui::TreeNode("Profiler")) {
+		Profiler::renderInMenu();
+		ImGui::TreePop();
+	}
+
+	if (ImGui::TreeNode("Render stats")) {
+		RenderStats::renderInMenu();
+		ImGui::TreePop();
+	}
+
+	if (ImGui::TreeNode("VRAM")) {
+		VRAM::renderInMenu();
+		ImGui::TreePop();
+	}
+
 	ImGui::PushStyleColor(ImGuiCol_Text, ImVec4(0.75f, 0.75f, 0.75f, 1.0f));
 
 	//example to show prefab info: first param must be unique!
@@ -322,6 +364,7 @@ void Application::onKeyDown( SDL_KeyboardEvent event )
 			break;
 		case SDLK_i: renderer->updateIrradianceCache(scene); break;
 		case SDLK_o: renderer->updateReflectionProbes(scene); break;
+		case SDLK_F7: benchmarkSH(); break;
 	}
 }
 
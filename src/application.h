@@ -41,6 +41,8 @@ public:
 	void renderDebugGUI(void);
 	void renderDebugGizmo();
 
+	void setCameraView(const Vector3& eye, const Vector3& center, float fov); //for scripted cameras (the headless benchmark)
+
 	//events
 	void onKeyDown( SDL_KeyboardEvent event );
 	void onKeyUp(SDL_KeyboardEvent event);
@@ -0,0 +1,167 @@
+/*  Offline irradiance baker: ray traces the six faces of every probe on the CPU and writes the same
+	irradiance cache that GTR::IrradianceEntity::read loads. It opens no window and needs no GPU.
+
+	usage: bake_probes [scene.json] [irradiance.bin] [face size] [threads]
+*/
+
+#include "bake_scene.h"
+#include "../sphericalharmonics.h"
+#include "../irradiancecache.h"
+
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+//same default grid than GTR::IrradianceEntity when there is no irradiance.bin
+static void defaultGrid(GTR::sIrrHeader& header)
+{
+	int fact_dist = 10;
+	header.dims = Vector3(20, 10, 20);
+	header.start.set(-60 * fact_dist, 2, -90 * fact_dist);
+	header.end.set(100 * fact_dist, 350, 90 * fact_dist);
+	header.delta = header.end - header.start;
+	header.delta.x /= (header.dims[0] - 1);
+	header.delta.y /= (header.dims[1] - 1);
+	header.delta.z /= (header.dims[2] - 1);
+	header.num_probes = header.dims[0] * header.dims[1] * header.dims[2];
+}
+
+//keeps the grid (and the sparse placement done by the app) of a previous bake so both agree on the layout
+static bool readGrid(const char* filename, GTR::sIrrHeader& header, std::vector<int>& nodes)
+{
+	IrradianceCacheFile cache;
+	if (cache.open(filename))
+	{
+		header.start = cache.header->start;
+		header.end = cache.header->end;
+		header.delta = cache.header->delta;
+		header.dims.set(cache.header->dims[0], cache.header->dims[1], cache.header->dims[2]);
+		header.num_probes = cache.header->num_probes;
+		if (cache.nodes)
+			nodes.assign(cache.nodes, cache.nodes + header.num_probes);
+		return true;
+	}
+
+	//old format, raw sProbe array
+	FILE* f = fopen(filename, "rb");
+	if (!f)
+		return false;
+	bool ok = fread(&header, sizeof(header), 1, f) == 1;
+	fclose(f);
+	return ok && memcmp(&header, IRR_CACHE_MAGIC, 4) != 0 && header.num_probes > 0 && header.num_probes == (int)(header.dims.x * header.dims.y * header.dims.z);
+}
+
+//same order than GTR::IrradianceEntity::placeProbes, only in the given nodes if any
+static void placeProbes(GTR::sIrrHeader& header, const std::vector<int>& nodes, std::vector<GTR::sProbe>& probes)
+{
+	int dx = header.dims.x, dy = header.dims.y;
+	int num_probes = nodes.size() ? nodes.size() : (int)(header.dims.x * header.dims.y * header.dims.z);
+	for (int i = 0; i < num_probes; ++i)
+	{
+		int node = nodes.size() ? nodes[i] : i;
+		int x = node % dx, y = (node / dx) % dy, z = node / (dx * dy);
+		GTR::sProbe p = GTR::sProbe();
+		p.local.set(x, y, z);
+		p.index = node;
+		p.pos = header.start + header.delta * Vector3(x, y, z);
+		probes.push_back(p);
+	}
+}
+
+//one ray per texel, using the same texel to direction mapping than the SH projection
+static void traceProbeFaces(const BakeScene& scene, const Vector3& pos, int size, FloatImage* images)
+{
+	for (int face = 0; face < 6; ++face)
+	{
+		FloatImage& image = images[face];
+		if (image.width != (unsigned int)size)
+			image.resize(size, size, 3);
+		for (int v = 0; v < size; ++v)
+			for (int u = 0; u < size; ++u)
+			{
+				float fU = (2.0 * u / (size - 1.0)) - 1.0;
+				float fV = (2.0 * v / (size - 1.0)) - 1.0;
+				Vector3 dir = normalize(cubemapFaceNormals[face][0] * fU + cubemapFaceNormals[face][1] * fV + cubemapFaceNormals[face][2]);
+				Vector3 color = scene.trace(pos, dir);
+				float* pixel = image.data + (v * size + u) * 3;
+				pixel[0] = color.x;
+				pixel[1] = color.y;
+				pixel[2] = color.z;
+			}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	const char* scene_filename = argc > 1 ? argv[1] : "data/scene.json";
+	const char* output_filename = argc > 2 ? argv[2] : "data/irradianceData/irradiance.bin";
+	int size = argc > 3 ? atoi(argv[3]) : 16;
+	int num_threads = argc > 4 ? atoi(argv[4]) : 0;
+	if (size < 2)
+		size = 2;
+	if (num_threads <= 0)
+		num_threads = std::thread::hardware_concurrency();
+	if (num_threads <= 0)
+		num_threads = 1;
+
+	auto start_time = std::chrono::steady_clock::now();
+
+	BakeScene scene;
+	if (!scene.load(scene_filename))
+		return 1;
+
+	GTR::sIrrHeader header;
+	std::vector<int> nodes;
+	if (!readGrid(output_filename, header, nodes))
+		defaultGrid(header);
+
+	std::vector<GTR::sProbe> probes;
+	placeProbes(header, nodes, probes);
+	std::cout << " + Baking " << probes.size() << " probes (" << size << "x" << size << " per face) with " << num_threads << " threads" << std::endl;
+
+	getSHProjectionTable(size); //build it once before the workers need it
+
+	std::atomic<int> next_probe(0);
+	std::mutex log_mutex;
+	auto worker = [&]() {
+		FloatImage images[6];
+		int i;
+		while ((i = next_probe++) < (int)probes.size())
+		{
+			traceProbeFaces(scene, probes[i].pos, size, images);
+			probes[i].sh = computeSH(images, false);
+			if (i % 100 == 0)
+			{
+				std::lock_guard<std::mutex> lock(log_mutex);
+				std::cout << "Computing probe " << i << " of " << probes.size() << std::endl;
+			}
+		}
+	};
+
+	std::vector<std::thread> threads;
+	for (int i = 1; i < num_threads; ++i)
+		threads.push_back(std::thread(worker));
+	worker();
+	for (size_t i = 0; i < threads.size(); ++i)
+		threads[i].join();
+
+	//same file than GTR::IrradianceEntity::save
+	std::vector<SphericalHarmonics> sh(probes.size());
+	nodes.resize(probes.size());
+	for (size_t i = 0; i < probes.size(); ++i)
+	{
+		sh[i] = probes[i].sh;
+		nodes[i] = probes[i].index;
+	}
+	if (!writeIrradianceCache(output_filename, header.start, header.end, header.delta, header.dims, &sh[0], &nodes[0], sh.size(), IRR_HALF, hashIrradianceScene(scene_filename)))
+		return 1;
+
+	auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start_time).count();
+	std::cout << " + Irradiance saved to " << output_filename << " in " << elapsed << "ms" << std::endl;
+	return 0;
+}
@@ -0,0 +1,488 @@
+#include "bake_scene.h"
+
+#include "../extra/cJSON.h"
+
+#define CGLTF_IMPLEMENTATION
+#include "../extra/cgltf.h"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "../extra/stb_image.h"
+
+#include <cfloat>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+
+//same values than scene.h
+#define INV_GAMMA 0.45
+
+//the forward shaders call this gamma_to_linear
+static Vector3 gammaToLinear(const Vector3& c)
+{
+	return Vector3(powf(c.x, INV_GAMMA), powf(c.y, INV_GAMMA), powf(c.z, INV_GAMMA));
+}
+
+static bool readTextFile(const char* filename, std::string& content)
+{
+	std::ifstream file(filename, std::ios::in | std::ios::binary);
+	if (!file)
+		return false;
+	std::stringstream ss;
+	ss << file.rdbuf();
+	content = ss.str();
+	return true;
+}
+
+static Vector3 readVector3(cJSON* json, const char* name, Vector3 default_value)
+{
+	cJSON* item = cJSON_GetObjectItem(json, name);
+	if (!item || cJSON_GetArraySize(item) < 3)
+		return default_value;
+	return Vector3(cJSON_GetArrayItem(item, 0)->valuedouble, cJSON_GetArrayItem(item, 1)->valuedouble, cJSON_GetArrayItem(item, 2)->valuedouble);
+}
+
+static float readNumber(cJSON* json, const char* name, float default_value)
+{
+	cJSON* item = cJSON_GetObjectItem(json, name);
+	return item ? (float)item->valuedouble : default_value;
+}
+
+BakeScene::~BakeScene()
+{
+	for (auto it = prefabs.begin(); it != prefabs.end(); ++it)
+		delete it->second;
+}
+
+bool BakeScene::load(const char* filename)
+{
+	std::string content;
+	std::cout << " + Reading scene JSON: " << filename << "..." << std::endl;
+	if (!readTextFile(filename, content))
+	{
+		std::cout << "- ERROR: Scene file not found: " << filename << std::endl;
+		return false;
+	}
+
+	cJSON* json = cJSON_Parse(content.c_str());
+	if (!json)
+	{
+		std::cout << "ERROR: Scene JSON has errors: " << filename << std::endl;
+		return false;
+	}
+
+	//assets are relative to the folder of the scene
+	std::string folder = filename;
+	size_t slash = folder.find_last_of('/');
+	folder = slash == std::string::npos ? std::string(".") : folder.substr(0, slash);
+
+	background_color = readVector3(json, "background_color", background_color);
+	ambient_light = readVector3(json, "ambient_light", ambient_light);
+
+	cJSON* entities_json = cJSON_GetObjectItemCaseSensitive(json, "entities");
+	cJSON* entity_json;
+	cJSON_ArrayForEach(entity_json, entities_json)
+	{
+		cJSON* type_json = cJSON_GetObjectItem(entity_json, "type");
+		if (!type_json)
+			continue;
+		std::string type = type_json->valuestring;
+		if (type != "PREFAB" && type != "LIGHT")
+			continue;
+
+		//same transform than GTR::Scene::load
+		Matrix44 model;
+		if (cJSON_GetObjectItem(entity_json, "position"))
+		{
+			model.setIdentity();
+			Vector3 position = readVector3(entity_json, "position", Vector3());
+			model.translate(position.x, position.y, position.z);
+		}
+		if (cJSON_GetObjectItem(entity_json, "angle"))
+		{
+			float angle = cJSON_GetObjectItem(entity_json, "angle")->valuedouble;
+			model.rotate(angle * DEG2RAD, Vector3(0, 1, 0));
+		}
+		if (cJSON_GetObjectItem(entity_json, "rotation"))
+		{
+			cJSON* rotation = cJSON_GetObjectItem(entity_json, "rotation");
+			Quaternion q(cJSON_GetArrayItem(rotation, 0)->valuedouble, cJSON_GetArrayItem(rotation, 1)->valuedouble, cJSON_GetArrayItem(rotation, 2)->valuedouble, cJSON_GetArrayItem(rotation, 3)->valuedouble);
+			Matrix44 R;
+			q.toMatrix(R);
+			model = R * model;
+		}
+		if (cJSON_GetObjectItem(entity_json, "target"))
+		{
+			Vector3 target = readVector3(entity_json, "target", Vector3());
+			model.setFrontAndOrthonormalize(target - model.getTranslation());
+		}
+		if (cJSON_GetObjectItem(entity_json, "scale"))
+		{
+			Vector3 scale = readVector3(entity_json, "scale", Vector3(1, 1, 1));
+			model.scale(scale.x, scale.y, scale.z);
+		}
+
+		if (type == "PREFAB")
+		{
+			cJSON* filename_json = cJSON_GetObjectItem(entity_json, "filename");
+			if (!filename_json)
+				continue;
+			BakePrefab* prefab = loadPrefab((folder + "/" + filename_json->valuestring).c_str());
+			if (prefab)
+				addPrefab(prefab, model);
+		}
+		else
+		{
+			//same defaults and parsing than GTR::LightEntity
+			BakeLight light;
+			light.type = 0;
+			cJSON* light_type = cJSON_GetObjectItem(entity_json, "light_type");
+			if (light_type)
+			{
+				std::string t = light_type->valuestring;
+				if (t == "directional" || t == "DIRECTIONAL")
+					light.type = 2;
+				else if (t == "spot" || t == "SPOT")
+					light.type = 1;
+			}
+			light.color = readVector3(entity_json, "light_color", Vector3());
+			light.intensity = readNumber(entity_json, "intensity", 5.0);
+			light.max_dist = readNumber(entity_json, "max_dist", 5000.0);
+			light.cos_cutoff = cos(readNumber(entity_json, "cone_angle", 30.0) * DEG2RAD);
+			light.spot_exp = readNumber(entity_json, "spot_exp", 20.0);
+			light.position = model.getTranslation();
+			light.direction = normalize(model.frontVector());
+
+			//lights used only to fill the multipass (black) do not contribute
+			if (light.color.x > 0 || light.color.y > 0 || light.color.z > 0)
+				lights.push_back(light);
+		}
+	}
+	cJSON_Delete(json);
+
+	long time = clock();
+	bvh.build(positions);
+	std::cout << " + BVH built: " << triangle_material.size() << " triangles, " << bvh.nodes.size() << " nodes in " << (clock() - time) * 1000 / CLOCKS_PER_SEC << "ms" << std::endl;
+	return true;
+}
+
+//same as parseGLTFTransform
+static void nodeTransform(cgltf_node* node, Matrix44& model)
+{
+	if (node->has_matrix)
+		memcpy(model.m, node->matrix, sizeof(node->matrix));
+	else {
+		if (node->has_translation)
+			model.translate(node->translation[0], node->translation[1], node->translation[2]);
+		if (node->has_rotation)
+		{
+			Quaternion q(node->rotation[0], node->rotation[1], node->rotation[2], node->rotation[3]);
+			Matrix44 R;
+			q.toMatrix(R);
+			model = R * model;
+		}
+		if (node->has_scale)
+			model.scale(node->scale[0], node->scale[1], node->scale[2]);
+	}
+}
+
+static int loadImage(cgltf_image* image, const std::string& folder, std::vector<BakeImage>& images, std::map<cgltf_image*, int>& loaded)
+{
+	if (!image)
+		return -1;
+	auto it = loaded.find(image);
+	if (it != loaded.end())
+		return it->second;
+
+	int w = 0, h = 0, n = 0;
+	unsigned char* pixels = NULL;
+	if (image->uri)
+		pixels = stbi_load((folder + "/" + image->uri).c_str(), &w, &h, &n, 4);
+	else if (image->buffer_view)
+		pixels = stbi_load_from_memory((unsigned char*)image->buffer_view->buffer->data + image->buffer_view->offset, image->buffer_view->size, &w, &h, &n, 4);
+
+	int index = -1;
+	if (pixels)
+	{
+		BakeImage img;
+		img.width = w;
+		img.height = h;
+		img.pixels.assign(pixels, pixels + w * h * 4);
+		stbi_image_free(pixels);
+		index = images.size();
+		images.push_back(img);
+	}
+	else
+		std::cout << "[WARN] image could not be decoded: " << (image->uri ? image->uri : "embedded") << std::endl;
+
+	loaded[image] = index;
+	return index;
+}
+
+BakePrefab* BakeScene::loadPrefab(const char* filename)
+{
+	auto it = prefabs.find(filename);
+	if (it != prefabs.end())
+		return it->second;
+
+	std::cout << " + Loading gltf: " << filename << std::endl;
+	cgltf_options options;
+	memset(&options, 0, sizeof(cgltf_options));
+	cgltf_data* data = NULL;
+	if (cgltf_parse_file(&options, filename, &data) != cgltf_result_success)
+	{
+		std::cout << "[ERROR] gltf not found or invalid: " << filename << std::endl;
+		prefabs[filename] = NULL;
+		return NULL;
+	}
+	if (cgltf_load_buffers(&options, data, filename) != cgltf_result_success)
+	{
+		std::cout << "[ERROR] gltf buffers not found: " << filename << std::endl;
+		cgltf_free(data);
+		prefabs[filename] = NULL;
+		return NULL;
+	}
+
+	std::string folder = filename;
+	folder = folder.substr(0, folder.find_last_of('/'));
+
+	BakePrefab* prefab = new BakePrefab();
+	std::map<cgltf_material*, int> material_index;
+	std::map<cgltf_image*, int> image_index;
+
+	//iterate the node tree keeping the global matrix (child model * parent global, like Node::getGlobalMatrix)
+	std::vector<std::pair<cgltf_node*, Matrix44> > stack;
+	cgltf_scene* scene = data->scene ? data->scene : &data->scenes[0];
+	for (cgltf_size i = 0; i < scene->nodes_count; ++i)
+		stack.push_back(std::make_pair(scene->nodes[i], Matrix44()));
+
+	while (stack.size())
+	{
+		cgltf_node* node = stack.back().first;
+		Matrix44 parent = stack.back().second;
+		stack.pop_back();
+
+		Matrix44 local;
+		nodeTransform(node, local);
+		Matrix44 global = local * parent;
+		for (cgltf_size i = 0; i < node->children_count; ++i)
+			stack.push_back(std::make_pair(node->children[i], global));
+
+		if (!node->mesh)
+			continue;
+
+		for (cgltf_size p = 0; p < node->mesh->primitives_count; ++p)
+		{
+			cgltf_primitive* primitive = &node->mesh->primitives[p];
+			//the renderer skips nodes without material
+			if (!primitive->material || primitive->type != cgltf_primitive_type_triangles)
+				continue;
+
+			cgltf_material* matdata = primitive->material;
+			int material;
+			auto mat_it = material_index.find(matdata);
+			if (mat_it != material_index.end())
+				material = mat_it->second;
+			else
+			{
+				BakeMaterial mat;
+				mat.color = Vector4(1, 1, 1, 1);
+				mat.color_texture = -1;
+				mat.emissive_texture = -1;
+				mat.alpha_mode = (eBakeAlphaMode)matdata->alpha_mode;
+				mat.alpha_cutoff = matdata->alpha_cutoff;
+				mat.two_sided = matdata->double_sided;
+				if (matdata->has_pbr_specular_glossiness && matdata->pbr_specular_glossiness.diffuse_texture.texture)
+					mat.color_texture = loadImage(matdata->pbr_specular_glossiness.diffuse_texture.texture->image, folder, images, image_index);
+				if (matdata->has_pbr_metallic_roughness)
+				{
+					float* c = matdata->pbr_metallic_roughness.base_color_factor;
+					mat.color = Vector4(c[0], c[1], c[2], c[3]);
+					if (matdata->pbr_metallic_roughness.base_color_texture.texture)
+						mat.color_texture = loadImage(matdata->pbr_metallic_roughness.base_color_texture.texture->image, folder, images, image_index);
+				}
+				if (matdata->emissive_texture.texture)
+					mat.emissive_texture = loadImage(matdata->emissive_texture.texture->image, folder, images, image_index);
+				material = materials.size();
+				materials.push_back(mat);
+				material_index[matdata] = material;
+			}
+
+			//blended materials are not rendered when capturing probes
+			if (materials[material].alpha_mode == BAKE_BLEND)
+				continue;
+
+			cgltf_accessor* positions_acc = NULL;
+			cgltf_accessor* normals_acc = NULL;
+			cgltf_accessor* uvs_acc = NULL;
+			for (cgltf_size j = 0; j < primitive->attributes_count; ++j)
+			{
+				cgltf_attribute* attr = &primitive->attributes[j];
+				if (attr->type == cgltf_attribute_type_position)
+					positions_acc = attr->data;
+				else if (attr->type == cgltf_attribute_type_normal)
+					normals_acc = attr->data;
+				else if (attr->type == cgltf_attribute_type_texcoord && attr->index == 0)
+					uvs_acc = attr->data;
+			}
+			if (!positions_acc)
+				continue;
+
+			int num_indices = primitive->indices ? primitive->indices->count : positions_acc->count;
+			for (int i = 0; i + 2 < num_indices; i += 3)
+			{
+				Vector3 tri_pos[3];
+				Vector3 tri_normal[3];
+				Vector2 tri_uv[3];
+				for (int k = 0; k < 3; ++k)
+				{
+					int index = primitive->indices ? cgltf_accessor_read_index(primitive->indices, i + k) : i + k;
+					cgltf_accessor_read_float(positions_acc, index, tri_pos[k].v, 3);
+					tri_pos[k] = global * tri_pos[k];
+					if (normals_acc)
+					{
+						cgltf_accessor_read_float(normals_acc, index, tri_normal[k].v, 3);
+						tri_normal[k] = global.rotateVector(tri_normal[k]);
+					}
+					if (uvs_acc)
+						cgltf_accessor_read_float(uvs_acc, index, tri_uv[k].value, 2);
+				}
+				if (!normals_acc)
+					tri_normal[0] = tri_normal[1] = tri_normal[2] = cross(tri_pos[1] - tri_pos[0], tri_pos[2] - tri_pos[0]);
+				for (int k = 0; k < 3; ++k)
+				{
+					prefab->positions.push_back(tri_pos[k]);
+					prefab->normals.push_back(tri_normal[k]);
+					prefab->uvs.push_back(tri_uv[k]);
+				}
+				prefab->materials.push_back(material);
+			}
+		}
+	}
+
+	cgltf_free(data);
+	prefabs[filename] = prefab;
+	return prefab;
+}
+
+void BakeScene::addPrefab(BakePrefab* prefab, const Matrix44& model)
+{
+	for (size_t i = 0; i < prefab->positions.size(); ++i)
+	{
+		positions.push_back(model * prefab->positions[i]);
+		Vector3 normal = model.rotateVector(prefab->normals[i]);
+		if (normal.x != 0 || normal.y != 0 || normal.z != 0)
+			normal.normalize();
+		normals.push_back(normal);
+		uvs.push_back(prefab->uvs[i]);
+	}
+	triangle_material.insert(triangle_material.end(), prefab->materials.begin(), prefab->materials.end());
+}
+
+Vector4 BakeScene::sample(int image, const Vector2& uv) const
+{
+	const BakeImage& img = images[image];
+	float u = uv.x - floorf(uv.x);
+	float v = uv.y - floorf(uv.y);
+	int x = (int)(u * img.width);
+	int y = (int)(v * img.height);
+	if (x >= img.width) x = img.width - 1;
+	if (y >= img.height) y = img.height - 1;
+	const unsigned char* p = &img.pixels[(y * img.width + x) * 4];
+	return Vector4(p[0] / 255.0f, p[1] / 255.0f, p[2] / 255.0f, p[3] / 255.0f);
+}
+
+//u_color * degamma(albedo texture), alpha in w
+Vector4 BakeScene::surfaceColor(int triangle, float u, float v) const
+{
+	const BakeMaterial& mat = materials[triangle_material[triangle]];
+	Vector4 color = mat.color;
+	if (mat.color_texture != -1)
+	{
+		float w = 1.0f - u - v;
+		Vector2 uv = uvs[triangle * 3] * w + uvs[triangle * 3 + 1] * u + uvs[triangle * 3 + 2] * v;
+		Vector4 texel = sample(mat.color_texture, uv);
+		Vector3 albedo = gammaToLinear(texel.xyz());
+		color = Vector4(color.x * albedo.x, color.y * albedo.y, color.z * albedo.z, color.w * texel.w);
+	}
+	return color;
+}
+
+bool BakeScene::hitFilter(void* user, int triangle, float u, float v, const Vector3& dir)
+{
+	const BakeScene* scene = (const BakeScene*)user;
+	const BakeMaterial& mat = scene->materials[scene->triangle_material[triangle]];
+	if (!mat.two_sided)
+	{
+		Vector3 geometric_normal = cross(scene->bvh.e1[triangle], scene->bvh.e2[triangle]);
+		if (dot(geometric_normal, dir) > 0.0f)
+			return false;
+	}
+	if (mat.alpha_mode == BAKE_MASK && scene->surfaceColor(triangle, u, v).w < mat.alpha_cutoff)
+		return false;
+	return true;
+}
+
+Vector3 BakeScene::trace(const Vector3& origin, const Vector3& dir) const
+{
+	BVHHit hit;
+	if (!bvh.intersect(origin, dir, FLT_MAX, hit, hitFilter, (void*)this))
+		return background_color;
+
+	int t = hit.triangle;
+	const BakeMaterial& mat = materials[triangle_material[t]];
+	float w = 1.0f - hit.u - hit.v;
+	Vector3 position = origin + dir * hit.t;
+	Vector3 N = normals[t * 3] * w + normals[t * 3 + 1] * hit.u + normals[t * 3 + 2] * hit.v;
+	N.normalize();
+	if (dot(N, dir) > 0.0f) //back side of a two sided material
+		N = N * -1.0f;
+
+	//ambient + every light, like the light multipass
+	Vector3 total_light = gammaToLinear(ambient_light);
+	Vector3 shadow_origin = position + N * 0.1f;
+	for (size_t i = 0; i < lights.size(); ++i)
+	{
+		const BakeLight& light = lights[i];
+		Vector3 L;
+		float att_factor = 1.0f;
+		float spot_factor = 1.0f;
+		float light_distance = FLT_MAX;
+		if (light.type == 2) //directional
+			L = light.direction * -1.0f;
+		else
+		{
+			L = light.position - position;
+			light_distance = L.length();
+			L = L * (1.0f / light_distance);
+			att_factor = (light.max_dist - light_distance) / light.max_dist;
+			if (att_factor <= 0.0f)
+				continue;
+			if (light.type == 1) //spot
+			{
+				float spot_cos = dot(light.direction, L * -1.0f);
+				if (spot_cos < light.cos_cutoff)
+					continue;
+				spot_factor = powf(spot_cos, light.spot_exp);
+			}
+		}
+
+		float NdotL = clamp(dot(N, L), 0.0f, 1.0f);
+		if (NdotL <= 0.0f)
+			continue;
+
+		//the renderer only has shadowmaps for spot and directional lights
+		if (light.type != 0 && bvh.occluded(shadow_origin, L, light_distance, hitFilter, (void*)this))
+			continue;
+
+		total_light += gammaToLinear(light.color) * (NdotL * light.intensity * att_factor * spot_factor);
+	}
+
+	Vector4 albedo = surfaceColor(t, hit.u, hit.v);
+	Vector3 color = albedo.xyz() * total_light;
+	if (mat.emissive_texture != -1)
+	{
+		Vector2 uv = uvs[t * 3] * w + uvs[t * 3 + 1] * hit.u + uvs[t * 3 + 2] * hit.v;
+		color += gammaToLinear(sample(mat.emissive_texture, uv).xyz());
+	}
+	return color;
+}
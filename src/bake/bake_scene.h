@@ -0,0 +1,92 @@
+/*  Scene representation for the offline baker: every prefab of the scene JSON flattened into world space triangles
+	plus the lights and the material data needed to shade a hit. It does not touch OpenGL or SDL.
+*/
+#pragma once
+
+#include "../framework.h"
+#include "bvh.h"
+
+#include <string>
+#include <map>
+
+//same meaning than GTR::eAlphaMode
+enum eBakeAlphaMode {
+	BAKE_NO_ALPHA = 0,
+	BAKE_MASK = 1,
+	BAKE_BLEND = 2
+};
+
+struct BakeImage {
+	int width;
+	int height;
+	std::vector<unsigned char> pixels; //RGBA8, first row is the top of the image (gltf convention)
+};
+
+struct BakeMaterial {
+	Vector4 color;			//base color factor
+	int color_texture;		//index in BakeScene::images or -1
+	int emissive_texture;
+	eBakeAlphaMode alpha_mode;
+	float alpha_cutoff;
+	bool two_sided;
+};
+
+//same fields than GTR::LightEntity once updateLights has run
+struct BakeLight {
+	int type; //GTR::eLightType
+	Vector3 position;
+	Vector3 direction;
+	Vector3 color;
+	float intensity;
+	float max_dist;
+	float cos_cutoff;
+	float spot_exp;
+};
+
+//geometry of a gltf in prefab space, shared by all the entities that use it
+struct BakePrefab {
+	std::vector<Vector3> positions; //3 per triangle
+	std::vector<Vector3> normals;
+	std::vector<Vector2> uvs;
+	std::vector<int> materials; //1 per triangle, index in BakeScene::materials
+};
+
+class BakeScene
+{
+public:
+	Vector3 background_color;
+	Vector3 ambient_light;
+
+	std::vector<BakeLight> lights;
+	std::vector<BakeMaterial> materials;
+	std::vector<BakeImage> images;
+
+	//world space triangles
+	std::vector<Vector3> positions; //3 per triangle
+	std::vector<Vector3> normals;
+	std::vector<Vector2> uvs;
+	std::vector<int> triangle_material;
+
+	BVH bvh;
+
+	std::map<std::string, BakePrefab*> prefabs;
+
+	~BakeScene();
+
+	//reads the scene JSON like GTR::Scene::load and builds the BVH
+	bool load(const char* filename);
+
+	//radiance seen along a ray, same terms than the forward light pass
+	Vector3 trace(const Vector3& origin, const Vector3& dir) const;
+
+	//texture lookup (nearest, repeat) in the 0..1 range
+	Vector4 sample(int image, const Vector2& uv) const;
+
+	//ignores backfaces of one sided materials and masked texels, like the rasterizer does
+	static bool hitFilter(void* user, int triangle, float u, float v, const Vector3& dir);
+
+private:
+	BakePrefab* loadPrefab(const char* filename);
+	void addPrefab(BakePrefab* prefab, const Matrix44& model);
+	Vector4 surfaceColor(int triangle, float u, float v) const;
+};
@@ -0,0 +1,293 @@
+#include "bvh.h"
+
+#include <cfloat>
+#include <algorithm>
+
+#define BVH_BINS 16
+#define BVH_LEAF_SIZE 4
+#define BVH_MAX_DEPTH 60
+
+static void growBounds(Vector3& min, Vector3& max, const Vector3& p)
+{
+	if (p.x < min.x) min.x = p.x;
+	if (p.y < min.y) min.y = p.y;
+	if (p.z < min.z) min.z = p.z;
+	if (p.x > max.x) max.x = p.x;
+	if (p.y > max.y) max.y = p.y;
+	if (p.z > max.z) max.z = p.z;
+}
+
+//inlined here, the framework ones live in another translation unit and this is the hot loop
+static inline float dot3(const Vector3& a, const Vector3& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+static inline Vector3 cross3(const Vector3& a, const Vector3& b) { return Vector3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x); }
+
+static float boundsArea(const Vector3& min, const Vector3& max)
+{
+	Vector3 e = max - min;
+	return e.x * e.y + e.y * e.z + e.z * e.x;
+}
+
+void BVH::build(const std::vector<Vector3>& positions)
+{
+	int num_triangles = positions.size() / 3;
+	nodes.clear();
+	indices.resize(num_triangles);
+	v0.resize(num_triangles);
+	e1.resize(num_triangles);
+	e2.resize(num_triangles);
+
+	std::vector<Vector3> centroids(num_triangles);
+	for (int i = 0; i < num_triangles; ++i)
+	{
+		const Vector3& a = positions[i * 3];
+		const Vector3& b = positions[i * 3 + 1];
+		const Vector3& c = positions[i * 3 + 2];
+		v0[i] = a;
+		e1[i] = b - a;
+		e2[i] = c - a;
+		centroids[i] = (a + b + c) * (1.0f / 3.0f);
+		indices[i] = i;
+	}
+
+	if (!num_triangles)
+		return;
+
+	nodes.reserve(num_triangles * 2);
+	BVHNode root;
+	root.left_first = 0;
+	root.count = num_triangles;
+	nodes.push_back(root);
+	subdivide(0, centroids, 0);
+}
+
+void BVH::subdivide(int node_index, std::vector<Vector3>& centroids, int depth)
+{
+	//compute the bounds of the triangles and of their centroids
+	int first = nodes[node_index].left_first;
+	int count = nodes[node_index].count;
+	Vector3 min(FLT_MAX, FLT_MAX, FLT_MAX), max(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	Vector3 cmin = min, cmax = max;
+	for (int i = first; i < first + count; ++i)
+	{
+		int t = indices[i];
+		growBounds(min, max, v0[t]);
+		growBounds(min, max, v0[t] + e1[t]);
+		growBounds(min, max, v0[t] + e2[t]);
+		growBounds(cmin, cmax, centroids[t]);
+	}
+	nodes[node_index].min = min;
+	nodes[node_index].max = max;
+
+	if (count <= BVH_LEAF_SIZE || depth >= BVH_MAX_DEPTH)
+		return;
+
+	//binned SAH over the three axis
+	int best_axis = -1;
+	int best_split = 0;
+	float best_cost = boundsArea(min, max) * count;
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		float bmin = cmin.v[axis];
+		float extent = cmax.v[axis] - bmin;
+		if (extent <= 0.0f)
+			continue;
+
+		int bin_count[BVH_BINS] = { 0 };
+		Vector3 bin_min[BVH_BINS], bin_max[BVH_BINS];
+		for (int b = 0; b < BVH_BINS; ++b)
+		{
+			bin_min[b].set(FLT_MAX, FLT_MAX, FLT_MAX);
+			bin_max[b].set(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+		}
+
+		float scale = BVH_BINS / extent;
+		for (int i = first; i < first + count; ++i)
+		{
+			int t = indices[i];
+			int b = (int)((centroids[t].v[axis] - bmin) * scale);
+			if (b >= BVH_BINS) b = BVH_BINS - 1;
+			bin_count[b]++;
+			growBounds(bin_min[b], bin_max[b], v0[t]);
+			growBounds(bin_min[b], bin_max[b], v0[t] + e1[t]);
+			growBounds(bin_min[b], bin_max[b], v0[t] + e2[t]);
+		}
+
+		//sweep from both sides to get the cost of every split plane
+		float left_area[BVH_BINS - 1], right_area[BVH_BINS - 1];
+		int left_count[BVH_BINS - 1], right_count[BVH_BINS - 1];
+		Vector3 lmin(FLT_MAX, FLT_MAX, FLT_MAX), lmax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+		Vector3 rmin = lmin, rmax = lmax;
+		int lsum = 0, rsum = 0;
+		for (int b = 0; b < BVH_BINS - 1; ++b)
+		{
+			lsum += bin_count[b];
+			left_count[b] = lsum;
+			if (bin_count[b])
+			{
+				growBounds(lmin, lmax, bin_min[b]);
+				growBounds(lmin, lmax, bin_max[b]);
+			}
+			left_area[b] = lsum ? boundsArea(lmin, lmax) : 0.0f;
+
+			int rb = BVH_BINS - 1 - b;
+			rsum += bin_count[rb];
+			right_count[rb - 1] = rsum;
+			if (bin_count[rb])
+			{
+				growBounds(rmin, rmax, bin_min[rb]);
+				growBounds(rmin, rmax, bin_max[rb]);
+			}
+			right_area[rb - 1] = rsum ? boundsArea(rmin, rmax) : 0.0f;
+		}
+
+		for (int b = 0; b < BVH_BINS - 1; ++b)
+		{
+			if (!left_count[b] || !right_count[b])
+				continue;
+			float cost = left_area[b] * left_count[b] + right_area[b] * right_count[b];
+			if (cost < best_cost)
+			{
+				best_cost = cost;
+				best_axis = axis;
+				best_split = b;
+			}
+		}
+	}
+
+	if (best_axis == -1) //no split is better than a leaf
+		return;
+
+	//partition the triangles in place
+	float split_pos = cmin.v[best_axis] + (best_split + 1) * (cmax.v[best_axis] - cmin.v[best_axis]) / BVH_BINS;
+	int i = first;
+	int j = first + count - 1;
+	while (i <= j)
+	{
+		if (centroids[indices[i]].v[best_axis] < split_pos)
+			i++;
+		else
+			std::swap(indices[i], indices[j--]);
+	}
+
+	int left_count = i - first;
+	if (left_count == 0 || left_count == count)
+		return;
+
+	int left_index = nodes.size();
+	BVHNode left, right;
+	left.left_first = first;
+	left.count = left_count;
+	right.left_first = i;
+	right.count = count - left_count;
+	nodes.push_back(left);
+	nodes.push_back(right);
+
+	nodes[node_index].left_first = left_index;
+	nodes[node_index].count = 0;
+
+	subdivide(left_index, centroids, depth + 1);
+	subdivide(left_index + 1, centroids, depth + 1);
+}
+
+//slab test, returns the entry distance or FLT_MAX if missed
+static inline float intersectBounds(const BVHNode& node, const Vector3& origin, const Vector3& inv_dir, float max_t)
+{
+	float tx1 = (node.min.x - origin.x) * inv_dir.x, tx2 = (node.max.x - origin.x) * inv_dir.x;
+	float tmin = tx1 < tx2 ? tx1 : tx2, tmax = tx1 < tx2 ? tx2 : tx1;
+	float ty1 = (node.min.y - origin.y) * inv_dir.y, ty2 = (node.max.y - origin.y) * inv_dir.y;
+	tmin = fmaxf(tmin, fminf(ty1, ty2)); tmax = fminf(tmax, fmaxf(ty1, ty2));
+	float tz1 = (node.min.z - origin.z) * inv_dir.z, tz2 = (node.max.z - origin.z) * inv_dir.z;
+	tmin = fmaxf(tmin, fminf(tz1, tz2)); tmax = fminf(tmax, fmaxf(tz1, tz2));
+	if (tmax >= tmin && tmin < max_t && tmax > 0.0f)
+		return tmin;
+	return FLT_MAX;
+}
+
+bool BVH::traverse(const Vector3& origin, const Vector3& dir, float max_t, BVHHit& hit, bool any_hit, HitFilter filter, void* user) const
+{
+	if (nodes.empty())
+		return false;
+
+	Vector3 inv_dir(1.0f / dir.x, 1.0f / dir.y, 1.0f / dir.z);
+	bool found = false;
+	hit.t = max_t;
+
+	int stack[64];
+	int stack_size = 0;
+	int node_index = 0;
+	if (intersectBounds(nodes[0], origin, inv_dir, hit.t) == FLT_MAX)
+		return false;
+
+	while (true)
+	{
+		const BVHNode& node = nodes[node_index];
+		if (node.count) //leaf
+		{
+			for (int i = node.left_first; i < node.left_first + node.count; ++i)
+			{
+				//moller-trumbore
+				int t = indices[i];
+				Vector3 p = cross3(dir, e2[t]);
+				float det = dot3(e1[t], p);
+				if (fabsf(det) < 1e-12f)
+					continue;
+				float inv_det = 1.0f / det;
+				Vector3 s = origin - v0[t];
+				float u = dot3(s, p) * inv_det;
+				if (u < 0.0f || u > 1.0f)
+					continue;
+				Vector3 q = cross3(s, e1[t]);
+				float v = dot3(dir, q) * inv_det;
+				if (v < 0.0f || u + v > 1.0f)
+					continue;
+				float dist = dot3(e2[t], q) * inv_det;
+				if (dist <= 0.0f || dist >= hit.t)
+					continue;
+				if (filter && !filter(user, t, u, v, dir))
+					continue;
+				hit.t = dist;
+				hit.u = u;
+				hit.v = v;
+				hit.triangle = t;
+				found = true;
+				if (any_hit)
+					return true;
+			}
+		}
+		else //visit the closest child first
+		{
+			int a = node.left_first;
+			int b = a + 1;
+			float da = intersectBounds(nodes[a], origin, inv_dir, hit.t);
+			float db = intersectBounds(nodes[b], origin, inv_dir, hit.t);
+			if (da > db)
+			{
+				std::swap(a, b);
+				std::swap(da, db);
+			}
+			if (da != FLT_MAX)
+			{
+				if (db != FLT_MAX && stack_size < 64)
+					stack[stack_size++] = b;
+				node_index = a;
+				continue;
+			}
+		}
+
+		if (!stack_size)
+			break;
+		node_index = stack[--stack_size];
+	}
+	return found;
+}
+
+bool BVH::intersect(const Vector3& origin, const Vector3& dir, float max_t, BVHHit& hit, HitFilter filter, void* user) const
+{
+	return traverse(origin, dir, max_t, hit, false, filter, user);
+}
+
+bool BVH::occluded(const Vector3& origin, const Vector3& dir, float max_t, HitFilter filter, void* user) const
+{
+	BVHHit hit;
+	return traverse(origin, dir, max_t, hit, true, filter, user);
+}
@@ -0,0 +1,47 @@
+/*  CPU bounding volume hierarchy over world space triangles, used by the offline baker.
+	Built with binned SAH, traversed front to back with a small stack.
+*/
+#pragma once
+
+#include "../framework.h"
+
+struct BVHNode {
+	Vector3 min;
+	Vector3 max;
+	int left_first;	//first child for inner nodes, first triangle (in BVH::indices) for leaves
+	int count;		//number of triangles, 0 means inner node
+};
+
+struct BVHHit {
+	float t;
+	float u, v;		//barycentrics of the hit
+	int triangle;	//index of the triangle as it was passed to build
+};
+
+class BVH
+{
+public:
+	//return false to ignore that hit (alpha mask, backfaces...)
+	typedef bool (*HitFilter)(void* user, int triangle, float u, float v, const Vector3& dir);
+
+	std::vector<BVHNode> nodes;
+	std::vector<int> indices;
+
+	//triangle as first vertex and two edges, ready for moller-trumbore
+	std::vector<Vector3> v0;
+	std::vector<Vector3> e1;
+	std::vector<Vector3> e2;
+
+	//positions must contain 3 vertices per triangle
+	void build(const std::vector<Vector3>& positions);
+
+	//closest hit along the ray
+	bool intersect(const Vector3& origin, const Vector3& dir, float max_t, BVHHit& hit, HitFilter filter = NULL, void* user = NULL) const;
+
+	//any hit along the ray, cheaper than intersect (used for shadows)
+	bool occluded(const Vector3& origin, const Vector3& dir, float max_t, HitFilter filter = NULL, void* user = NULL) const;
+
+private:
+	void subdivide(int node_index, std::vector<Vector3>& centroids, int depth);
+	bool traverse(const Vector3& origin, const Vector3& dir, float max_t, BVHHit& hit, bool any_hit, HitFilter filter, void* user) const;
+};
@@ -0,0 +1,250 @@
+/*  Image decoding benchmark: decodes every png and jpg under a folder with each decoder that supports the
+	format, one thread, and then all of them at once with ImageDecoder::decodeAll on the JobSystem workers.
+	Reports MB/s of compressed input and of decoded pixels. It opens no window and needs no GPU.
+	The decoders are timed flipping the rows, the result of each format says if its preferred decoder fuses the flip.
+
+	usage: decode_bench [folder] [iterations] [threads]
+*/
+
+#include "../imagedecode.h"
+#include "../mappedfile.h"
+#include "../jobsystem.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifdef WIN32
+	#include <windows.h>
+#else
+	#include <dirent.h>
+	#include <sys/stat.h>
+#endif
+
+static bool isImageFile(const std::string& name)
+{
+	std::string ext = name.size() > 4 ? name.substr(name.size() - 4) : "";
+	for (size_t i = 0; i < ext.size(); ++i)
+		ext[i] = tolower(ext[i]);
+	return ext == ".png" || ext == ".jpg" || ext == "jpeg";
+}
+
+static void listImages(const std::string& folder, std::vector<std::string>& files)
+{
+#ifdef WIN32
+	WIN32_FIND_DATAA data;
+	HANDLE find = FindFirstFileA((folder + "/*").c_str(), &data);
+	if (find == INVALID_HANDLE_VALUE)
+		return;
+	do
+	{
+		std::string name = data.cFileName;
+		if (name == "." || name == "..")
+			continue;
+		if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+			listImages(folder + "/" + name, files);
+		else if (isImageFile(name))
+			files.push_back(folder + "/" + name);
+	} while (FindNextFileA(find, &data));
+	FindClose(find);
+#else
+	DIR* dir = opendir(folder.c_str());
+	if (!dir)
+		return;
+	while (dirent* entry = readdir(dir))
+	{
+		std::string name = entry->d_name;
+		if (name == "." || name == "..")
+			continue;
+		std::string path = folder + "/" + name;
+		struct stat info;
+		if (stat(path.c_str(), &info) != 0)
+			continue;
+		if (S_ISDIR(info.st_mode))
+			listImages(path, files);
+		else if (isImageFile(name))
+			files.push_back(path);
+	}
+	closedir(dir);
+#endif
+}
+
+static double now()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct sBenchImage {
+	std::string filename;
+	MappedFile file;
+	eImageFormat format;
+};
+
+struct sBenchResult {
+	double seconds;			//best of the iterations
+	double input_bytes;
+	double output_bytes;
+	int failed;
+};
+
+//decodes all the images of that format with one decoder in this thread, separate_flip flips them after as the old loaders
+static sBenchResult benchDecoder(std::vector<sBenchImage*>& images, eImageFormat format, eImageDecoder decoder, int iterations, bool separate_flip)
+{
+	sBenchResult result = { 0, 0, 0, 0 };
+	for (int it = 0; it < iterations; ++it)
+	{
+		double input = 0, output = 0;
+		int failed = 0;
+		double start = now();
+		for (size_t i = 0; i < images.size(); ++i)
+		{
+			sBenchImage* image = images[i];
+			if (image->format != format)
+				continue;
+			sDecodedImage decoded;
+			if (!ImageDecoder::decode(image->file.data, image->file.size, !separate_flip, decoded, decoder))
+			{
+				failed++;
+				continue;
+			}
+			if (separate_flip)
+			{
+				size_t row_size = (size_t)decoded.width * decoded.num_channels;
+				std::vector<unsigned char> temp_row(row_size);
+				for (int y = 0; y < decoded.height / 2; ++y)
+				{
+					unsigned char* top = decoded.data + y * row_size;
+					unsigned char* bottom = decoded.data + (decoded.height - 1 - y) * row_size;
+					memcpy(&temp_row[0], top, row_size);
+					memcpy(top, bottom, row_size);
+					memcpy(bottom, &temp_row[0], row_size);
+				}
+			}
+			input += image->file.size;
+			output += (double)decoded.width * decoded.height * decoded.num_channels;
+			decoded.clear();
+		}
+		double seconds = now() - start;
+		if (it == 0 || seconds < result.seconds)
+			result.seconds = seconds;
+		result.input_bytes = input;
+		result.output_bytes = output;
+		result.failed = failed;
+	}
+	return result;
+}
+
+static void printResult(const char* format_name, const char* decoder_name, const sBenchResult& result)
+{
+	double mb = 1024.0 * 1024.0;
+	printf("%-5s %-22s %9.1f ms %9.1f MB/s in %9.1f MB/s out", format_name, decoder_name, result.seconds * 1000.0,
+		result.input_bytes / mb / result.seconds, result.output_bytes / mb / result.seconds);
+	if (result.failed)
+		printf("  (%d failed)", result.failed);
+	printf("\n");
+}
+
+int main(int argc, char** argv)
+{
+	const char* folder = argc > 1 ? argv[1] : "data/prefabs";
+	int iterations = argc > 2 ? atoi(argv[2]) : 3;
+	int num_threads = argc > 3 ? atoi(argv[3]) : 0;
+	if (iterations < 1)
+		iterations = 1;
+
+	std::vector<std::string> filenames;
+	listImages(folder, filenames);
+
+	std::vector<sBenchImage*> images;
+	double format_bytes[IMAGE_NUM_FORMATS] = { 0 };
+	int format_count[IMAGE_NUM_FORMATS] = { 0 };
+	for (size_t i = 0; i < filenames.size(); ++i)
+	{
+		sBenchImage* image = new sBenchImage();
+		image->filename = filenames[i];
+		if (!image->file.open(filenames[i].c_str()))
+		{
+			delete image;
+			continue;
+		}
+		image->format = ImageDecoder::detectFormat(image->file.data, image->file.size);
+		format_bytes[image->format] += image->file.size;
+		format_count[image->format]++;
+		images.push_back(image);
+	}
+	if (images.empty())
+	{
+		printf("[ERROR] no png or jpg images found in %s\n", folder);
+		return 1;
+	}
+
+	const char* format_names[IMAGE_NUM_FORMATS] = { "?", "png", "jpg" };
+	printf(" + %d png (%.1f MB), %d jpg (%.1f MB) in %s, best of %d\n\n", format_count[IMAGE_PNG], format_bytes[IMAGE_PNG] / (1024.0 * 1024.0),
+		format_count[IMAGE_JPG], format_bytes[IMAGE_JPG] / (1024.0 * 1024.0), folder, iterations);
+
+	//one thread, every decoder
+	double serial_seconds = 0;
+	eImageDecoder fastest[IMAGE_NUM_FORMATS] = { DECODER_AUTO, DECODER_AUTO, DECODER_AUTO };
+	for (int format = IMAGE_PNG; format < IMAGE_NUM_FORMATS; ++format)
+	{
+		if (!format_count[format])
+			continue;
+		double best = 0;
+		for (int decoder = 0; decoder < NUM_IMAGE_DECODERS; ++decoder)
+		{
+			if (!ImageDecoder::supports((eImageDecoder)decoder, (eImageFormat)format))
+				continue;
+			sBenchResult result = benchDecoder(images, (eImageFormat)format, (eImageDecoder)decoder, iterations, false);
+			printResult(format_names[format], ImageDecoder::getName((eImageDecoder)decoder), result);
+			if (fastest[format] == DECODER_AUTO || result.seconds < best)
+			{
+				fastest[format] = (eImageDecoder)decoder;
+				best = result.seconds;
+			}
+			if (decoder == ImageDecoder::preferred[format])
+				serial_seconds += result.seconds;
+
+			std::string name = std::string(ImageDecoder::getName((eImageDecoder)decoder)) + " + flip pass";
+			printResult(format_names[format], name.c_str(), benchDecoder(images, (eImageFormat)format, (eImageDecoder)decoder, iterations, true));
+		}
+		printf("%-5s fastest: %s (preferred: %s, %s)\n\n", format_names[format], ImageDecoder::getName(fastest[format]),
+			ImageDecoder::getName(ImageDecoder::preferred[format]),
+			ImageDecoder::fusesFlip(ImageDecoder::preferred[format]) ? "flips while decoding" : "does not fuse the flip, it costs an extra copy pass");
+	}
+
+	//all the images at once with the preferred decoders
+	JobSystem::init(num_threads);
+	double best = 0, input = 0, output = 0;
+	for (int it = 0; it < iterations; ++it)
+	{
+		std::vector<sImageDecodeTask> tasks;
+		for (size_t i = 0; i < images.size(); ++i)
+			if (images[i]->format != IMAGE_UNKNOWN)
+				tasks.push_back(sImageDecodeTask(images[i]->filename, true));
+		double start = now();
+		ImageDecoder::decodeAll(tasks);
+		double seconds = now() - start;
+		if (it == 0 || seconds < best)
+			best = seconds;
+		input = output = 0;
+		for (size_t i = 0; i < tasks.size(); ++i)
+		{
+			input += tasks[i].file_size;
+			output += (double)tasks[i].result.width * tasks[i].result.height * tasks[i].result.num_channels;
+			tasks[i].result.clear();
+		}
+	}
+	sBenchResult parallel = { best, input, output, 0 };
+	char name[64];
+	sprintf(name, "decodeAll %d threads", JobSystem::num_workers);
+	printResult("all", name, parallel);
+	printf("speedup over one thread: %.2fx\n", serial_seconds / best);
+	JobSystem::shutdown();
+
+	for (size_t i = 0; i < images.size(); ++i)
+		delete images[i];
+	return 0;
+}
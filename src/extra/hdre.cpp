@@ -3,8 +3,10 @@
 #include <cmath>
 #include <cassert>
 #include <algorithm>
+#include <cstring>
 
 #include "../utils.h"
+#include "../mappedfile.h"
 #include "hdre.h"
 
 std::map<std::string, HDRE*> HDRE::s_loaded_hdres;
@@ -105,16 +107,25 @@ bool HDRE::load(const char* filename)
 {
 	assert(filename);
 
-	FILE *f = fopen(filename,"rb");
-	if (f == nullptr)
+	clean();
+
+	//the faces point straight into the mapped file, nothing is copied
+	if (!file.open(filename))
 		return false;
 
-	sHDREHeader HDREHeader;
+	if (file.size < sizeof(sHDREHeader))
+	{
+		std::cout << "[ERROR] HDRE file too small: " << filename << std::endl;
+		file.close();
+		return false;
+	}
 
-	fread(&HDREHeader, sizeof(sHDREHeader), 1, f);
+	sHDREHeader HDREHeader;
+	memcpy(&HDREHeader, file.data, sizeof(sHDREHeader));
 
 	if (HDREHeader.type != 3) {
         printf("HDRE Header has wrong type: %d\n", HDREHeader.type);
+        file.close();
         throw ("ArrayType not supported. Please export in Float32Array.");
     }
 
@@ -126,7 +137,7 @@ bool HDRE::load(const char* filename)
 	this->width = width;
 	this->height = height;
 
-	int dataSize = 0;
+	size_t dataSize = 0;
 	int w = width;
 
 	// Get number of floats inside the HDRE
@@ -143,18 +154,20 @@ bool HDRE::load(const char* filename)
 			w = (int)(width / pow(2.0, mip_level));
 	}
 
-	this->data = new float[dataSize];
-
-	fseek(f, HDREHeader.headerSize, SEEK_SET);
+	if (HDREHeader.headerSize < 0 || HDREHeader.headerSize % sizeof(float) != 0 ||
+		file.size < HDREHeader.headerSize + dataSize * sizeof(float))
+	{
+		std::cout << "[ERROR] HDRE file truncated or corrupted: " << filename << std::endl;
+		file.close();
+		return false;
+	}
 
-	fread(this->data, sizeof(float) * dataSize, 1, f);
-	fclose(f);
+	this->data = (float*)(file.data + HDREHeader.headerSize);
 
 	// get separated levels
 
 	w = width;
-	int mapOffset = 0;
-    int mapPrevOffset = 0;
+	size_t mapOffset = 0;
 
 	int nFullMips = 0;
 	while (w)
@@ -167,35 +180,16 @@ bool HDRE::load(const char* filename)
 	w = width;
     printf("Load %d mips of HDRE texture\n", nFullMips);
 
-    int i;
-    for (i = 0; i < N_LEVELS; i++)
+    for (int i = 0; i < N_LEVELS; i++)
 	{
 		int mip_level = i + 1;
 		int faceSize = w * w * HDREHeader.numChannels;
-		int mapSize = faceSize * N_FACES;
-
-		int faceOffset = 0;
 
 		for (int j = 0; j < N_FACES; j++)
-		{
-			// allocate memory
-			this->pixels_f[i][j] = new float[faceSize];
-
-			// set data
-			for (int k = 0; k < faceSize; k++) {
-
-				float value = this->data[mapOffset + faceOffset + k];
-
-				this->pixels_f[i][j][k] = value;
-			}
-
-			// update face offset
-			faceOffset += faceSize;
-		}
+			this->pixels_f[i][j] = this->data + mapOffset + j * faceSize;
 
 		// update level offset
-		mapPrevOffset = mapOffset;
-		mapOffset += mapSize;
+		mapOffset += faceSize * N_FACES;
 		// reassign width for next level
 		//w = std::max(8, (int)(width / pow(2.0, mip_level)));
 		w = fmax(8, (int)(width / pow(2.0, mip_level)));
@@ -207,36 +201,27 @@ bool HDRE::load(const char* filename)
 	return true;
 }
 
-bool HDRE::clean()
+void HDRE::release()
 {
-	try
-	{
-		if (data)
-			delete data;
+	clean();
+}
 
-        for (int j = 0; j < N_FACES; j++)
-        {
-            for (int i = 0; i < N_LEVELS; i++)
-            {
-				delete pixels_h[i][j];
-				pixels_h[i][j] = nullptr;
-			}
-            for (int i = 0; i < N_LEVELS; i++)
-            {
-                delete pixels_f[i][j];
-                pixels_f[i][j] = nullptr;
-            }
-		}
+bool HDRE::clean()
+{
+	//all the pointers are views of the mapping
+	file.close();
+	data = nullptr;
 
-		return true;
-	}
-	catch (const std::exception&)
+	for (int j = 0; j < N_FACES; j++)
 	{
-		std::cout << std::endl << "Error cleaning" << std::endl;
-		return false;
+		for (int i = 0; i < N_MAX_LEVELS; i++)
+		{
+			pixels_h[i][j] = nullptr;
+			pixels_f[i][j] = nullptr;
+			pixels_b[i][j] = nullptr;
+		}
 	}
-
-	return false;
+	return true;
 }
 
 HDRE* HDRE::Get(const char* filename)
@@ -7,6 +7,8 @@
 #include <string>
 #include <map>
 
+#include "../mappedfile.h"
+
 typedef unsigned char byte;
 
 typedef struct {
@@ -50,7 +52,8 @@ class HDRE {
 private:
 
     std::string filename;
-	float* data; // only f32 now
+	MappedFile file;
+	float* data; // only f32 now, read only view of the mapped file
 
     float* pixels_f[N_MAX_LEVELS][N_FACES]; // Xpos, Xneg, Ypos, Yneg, Zpos, Zneg
     short* pixels_h[N_MAX_LEVELS][N_FACES]; // Xpos, Xneg, Ypos, Yneg, Zpos, Zneg
@@ -72,6 +75,9 @@ public:
 	~HDRE();
 
 	bool load(const char* filename);
+
+	//unmaps the file, the faces are not valid anymore (call it once they are uploaded)
+	void release();
 	//bool load(void* data, int size);
 
 	// useful methods
@@ -1,6 +1,9 @@
 #include "fbo.h"
 #include <cassert>
 #include "utils.h"
+#include "renderstats.h"
+
+GLuint FBO::default_framebuffer = 0;
 
 FBO::FBO()
 {
@@ -25,6 +28,8 @@ FBO::~FBO()
 		glDeleteRenderbuffersEXT(1, &renderbuffer_color);
 	if (renderbuffer_depth)
 		glDeleteRenderbuffersEXT(1, &renderbuffer_depth);
+	VRAM::untrack(&renderbuffer_color);
+	VRAM::untrack(&renderbuffer_depth);
 }
 
 void FBO::freeTextures()
@@ -47,6 +52,8 @@ void FBO::freeTextures()
 		glDeleteRenderbuffers(1, &renderbuffer_depth);
 
 	renderbuffer_color = renderbuffer_depth = 0;
+	VRAM::untrack(&renderbuffer_color);
+	VRAM::untrack(&renderbuffer_depth);
 	width = height = 0;
 	owns_textures = false;
 }
@@ -76,6 +83,19 @@ bool FBO::create( int width, int height, int num_textures, int format, int type,
 	Texture* depth_texture = NULL;
 	if(use_depth_texture)
 		depth_texture = new Texture(width, height, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, false);
+
+	//counted apart from the textures of the assets
+	std::string name = "render target " + std::to_string(width) + "x" + std::to_string(height);
+	for (int i = 0; i < num_textures; ++i)
+	{
+		textures[i]->filename = name + " color " + std::to_string(i);
+		textures[i]->setVRAMCategory(VRAM_RENDER_TARGETS);
+	}
+	if (depth_texture)
+	{
+		depth_texture->filename = name + " depth";
+		depth_texture->setVRAMCategory(VRAM_RENDER_TARGETS);
+	}
 	owns_textures = true;
 	return setTextures(textures, depth_texture);
 }
@@ -131,6 +151,7 @@ bool FBO::setTextures(std::vector<Texture*> textures, Texture* depth_texture, in
 		glBindRenderbuffer(GL_RENDERBUFFER, renderbuffer_depth);
 		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, width, height);
 		glFramebufferRenderbufferEXT(GL_FRAMEBUFFER_EXT, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, renderbuffer_depth);
+		VRAM::track(&renderbuffer_depth, VRAM_RENDER_TARGETS, (size_t)width * height * 4, "depth renderbuffer " + std::to_string(width) + "x" + std::to_string(height)); //24 bits padded to 32
 	}
 	checkGLErrors();
 
@@ -172,6 +193,7 @@ bool FBO::setTextures(std::vector<Texture*> textures, Texture* depth_texture, in
 		glBindRenderbufferEXT(GL_RENDERBUFFER_EXT, renderbuffer_color);
 		glRenderbufferStorageEXT(GL_RENDERBUFFER_EXT, GL_RGB, width, height);
 		glFramebufferRenderbufferEXT(GL_FRAMEBUFFER_EXT, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER_EXT, renderbuffer_color);
+		VRAM::track(&renderbuffer_color, VRAM_RENDER_TARGETS, (size_t)width * height * 4, "color renderbuffer " + std::to_string(width) + "x" + std::to_string(height)); //RGB padded to 32 bits
 		bufs[0] = GL_COLOR_ATTACHMENT0_EXT;
 	}
     
@@ -186,7 +208,7 @@ bool FBO::setTextures(std::vector<Texture*> textures, Texture* depth_texture, in
 		assert(0);
 		return false;
 	}
-	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, 0);
+	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, default_framebuffer);
 
 	checkGLErrors();
 	return true;
@@ -217,7 +239,7 @@ bool FBO::setDepthOnly(int width, int height)
 		std::cout << "Error: Framebuffer object is not completed" << std::endl;
 		return false;
 	}
-	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, 0);
+	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, default_framebuffer);
 	return true;
 }
 
@@ -226,6 +248,7 @@ void FBO::bind()
 	assert(glGetError() == GL_NO_ERROR);
 	Texture* tex = color_textures[0] ? color_textures[0] : depth_texture;
 	assert(tex && "framebuffer without texture");
+	RenderStats::add(STAT_FBO_BINDS);
 	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, fbo_id);
 	checkGLErrors();
 	glPushAttrib(GL_VIEWPORT_BIT);
@@ -240,7 +263,8 @@ void FBO::unbind()
 {
 	// output goes to the FBO and its attached buffers
 	glPopAttrib();
-	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, 0);
+	RenderStats::add(STAT_FBO_BINDS);
+	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, default_framebuffer);
 	//glDrawBuffers(1, &one_buffer);
 	assert(glGetError() == GL_NO_ERROR);
 }
@@ -21,6 +21,8 @@ public:
 	GLuint renderbuffer_color;
 	GLuint renderbuffer_depth;//not used
 
+	static GLuint default_framebuffer; //where unbind goes back, 0 is the window. the headless mode renders to its own FBO
+
 	FBO();
 	~FBO();
 
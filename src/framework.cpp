@@ -1448,4 +1448,70 @@ bool BoundingBoxSphereOverlap(const BoundingBox& box, const Vector3& center, flo
 	}
 
 	return false; //OUTSIDE;
+}
+
+unsigned short floatToHalf(float value)
+{
+	unsigned int f;
+	memcpy(&f, &value, 4);
+	unsigned int sign = (f >> 16) & 0x8000;
+	int exponent = (int)((f >> 23) & 0xff) - 127 + 15;
+	unsigned int mantissa = f & 0x7fffff;
+
+	if (((f >> 23) & 0xff) == 0xff) //inf or nan
+		return sign | 0x7c00 | (mantissa ? 0x200 : 0);
+	if (exponent >= 31) //too big
+		return sign | 0x7c00;
+	if (exponent <= 0) //denormal or zero
+	{
+		if (exponent < -10)
+			return sign;
+		mantissa |= 0x800000;
+		int shift = 14 - exponent;
+		unsigned int h = mantissa >> shift;
+		unsigned int rest = mantissa & ((1u << shift) - 1);
+		unsigned int halfway = 1u << (shift - 1);
+		if (rest > halfway || (rest == halfway && (h & 1)))
+			h++;
+		return sign | h;
+	}
+
+	unsigned int h = sign | (exponent << 10) | (mantissa >> 13);
+	unsigned int rest = mantissa & 0x1fff;
+	if (rest > 0x1000 || (rest == 0x1000 && (h & 1)))
+		h++; //a carry into the exponent is still the right rounding
+	return h;
+}
+
+float halfToFloat(unsigned short value)
+{
+	unsigned int sign = (value & 0x8000) << 16;
+	int exponent = (value >> 10) & 0x1f;
+	unsigned int mantissa = value & 0x3ff;
+	unsigned int f;
+
+	if (exponent == 0)
+	{
+		if (mantissa == 0)
+			f = sign;
+		else //denormal, normalize it
+		{
+			exponent = 1;
+			while (!(mantissa & 0x400))
+			{
+				mantissa <<= 1;
+				exponent--;
+			}
+			mantissa &= 0x3ff;
+			f = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+		}
+	}
+	else if (exponent == 31)
+		f = sign | 0x7f800000 | (mantissa << 13);
+	else
+		f = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+
+	float result;
+	memcpy(&result, &f, 4);
+	return result;
 }
\ No newline at end of file
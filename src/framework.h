@@ -383,6 +383,10 @@ bool RayBoundingBoxCollision(const BoundingBox& box, const Vector3& ray_origin,
 bool BoundingBoxSphereOverlap(const BoundingBox& box, const Vector3& center, float radius );
 Vector3 reflect(const Vector3& I, const Vector3& N);
 
+//half float conversion, round to nearest
+unsigned short floatToHalf(float value);
+float halfToFloat(unsigned short value);
+
 //value between 0 and 1
 inline float random(float range = 1.0f, int offset = 0) { return ((rand() % 1000) / (1000.0f)) * range + offset; }
 
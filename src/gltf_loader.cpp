@@ -10,8 +10,13 @@
 #include "material.h"
 #include "prefab.h"
 #include "utils.h"
+#include "mappedfile.h"
+#include "jobsystem.h"
 
+#include <atomic>
+#include <cstdio>
 #include <iostream>
+#include <thread>
 
 //** PARSING GLTF IS UGLY
 std::string base_folder;
@@ -22,111 +27,33 @@ std::string base_folder;
 	bool load_textures = true; //must textures be loadead?
 #endif
 
-void parseGLTFBufferVector3(std::vector<Vector3>& container, cgltf_accessor* acc, cgltf_accessor* indices_acc = NULL)
-{
-	int i = 0;
-
-	assert(acc->buffer_view->buffer->data);
-	unsigned char* data = (unsigned char*)(acc->buffer_view->buffer->data) + acc->buffer_view->offset + acc->offset;
-	if (acc->normalized)
-	{
-		//denormalize
-		assert(!"TO DO");
-	}
-	int num_elements = acc->count;
-	std::vector<Vector3> unindexed;
-	unindexed.resize(num_elements);
-	assert(acc->component_type == cgltf_component_type_r_32f && acc->type == cgltf_type_vec3);
-	if (acc->stride == sizeof(Vector3))
-		memcpy(&unindexed[0], data, num_elements * sizeof(Vector3));
-	else
-	{
-		for (int i = 0; i < num_elements; ++i)
-		{
-			memcpy(&unindexed[i], data, sizeof(Vector3));
-			data += acc->stride;
-		}
-	}
+bool use_gltf_cache = true; //store the parsed prefab in a .cache next to the gltf and load it instead while the sources do not change
 
-	if (!indices_acc)
-	{
-		container = unindexed;
-		return;
-	}
+//meshes of every glTF mesh of the file being loaded (one per primitive), parsed before the nodes
+std::map<cgltf_mesh*, std::vector<Mesh*>> gltf_meshes;
 
-	container.resize(indices_acc->count);
+//image every texture came from, the cache stores the embedded ones
+std::map<Texture*, cgltf_image*> gltf_texture_images;
 
-	unsigned char* indices = (unsigned char*)indices_acc->buffer_view->buffer->data + indices_acc->offset;
-	int stride = indices_acc->stride;
-	for (int i = 0; i < indices_acc->count; ++i)
-	{
-		int index = 0;
-		unsigned char* pos = indices + i * stride;
-		switch (indices_acc->component_type)
-		{
-		case cgltf_component_type_r_8u: index = (int)*pos; break;
-		case cgltf_component_type_r_16u: index = (int)*(unsigned short*)pos; break;
-		case cgltf_component_type_r_32u: index = (int)*(unsigned int*)pos; break;
-		}
-		if (index < unindexed.size()) //sometimes indices are out of bounds
-			container[i] = unindexed[index];
-		else
-			std::cout << "index out of bounds:" << index << std::endl;
-	}
-}
+//Texture::hashImageFile of the external images of the file being loaded, by path, read by the load worker
+std::map<std::string, unsigned long long> gltf_image_hashes;
 
-void parseGLTFBufferVector2(std::vector<Vector2>& container, cgltf_accessor* acc, cgltf_accessor* indices_acc = NULL)
+//copies the elements of a float accessor straight to the stream, whatever the stride of the buffer view
+template<typename T> void parseGLTFAccessor(std::vector<T>& container, cgltf_accessor* acc)
 {
-	assert(acc->buffer_view->buffer->data);
-	unsigned char* data = (unsigned char*)(acc->buffer_view->buffer->data) + acc->offset + acc->buffer_view->offset;
-	if (acc->normalized)
-	{
-		//denormalize
-		assert(!"TO DO");
-	}
-	int num_elements = acc->count;
-	std::vector<Vector2> unindexed;
-	unindexed.resize(num_elements);
-	assert(acc->component_type == cgltf_component_type_r_32f && acc->type == cgltf_type_vec2);
-	if (acc->stride == sizeof(Vector2))
-		memcpy(&unindexed[0], data, num_elements * sizeof(Vector2));
-	else
-	{
-		for (int i = 0; i < num_elements; ++i)
-		{
-			memcpy(&unindexed[i], data, sizeof(Vector2));
-			data += acc->stride;
-		}
-	}
+	assert(acc->buffer_view && acc->buffer_view->buffer->data);
+	assert(acc->component_type == cgltf_component_type_r_32f && acc->stride >= sizeof(T));
+	assert(!acc->normalized && acc->sparse.count == 0); //not supported yet
 
-	if (!indices_acc)
-	{
-		container = unindexed;
+	container.resize(acc->count);
+	if (!acc->count)
 		return;
-	}
-
-	container.resize(indices_acc->count);
-
-	assert(indices_acc->sparse.count == 0); //sparse not supported yet
-
-	unsigned char* indices = (unsigned char*)indices_acc->buffer_view->buffer->data + indices_acc->offset;
-	int stride = indices_acc->stride;
-	for (int i = 0; i < indices_acc->count; ++i)
-	{
-		unsigned int index = 0;
-		unsigned char* pos = indices + i * stride;
-		switch (indices_acc->component_type)
-		{
-		case cgltf_component_type_r_8u: index = static_cast<unsigned int>(*pos); break;
-		case cgltf_component_type_r_16u: index = static_cast<unsigned int>(*(unsigned short*)pos); break;
-		case cgltf_component_type_r_32u: index = static_cast<unsigned int>(*(unsigned int*)pos); break;
-		}
-		if (index < unindexed.size())  //sometimes indices are out of bounds
-			container[i] = unindexed[index];
-		else
-			std::cout << "index out of bounds:" << index << std::endl;
-	}
-
+	const unsigned char* data = (const unsigned char*)acc->buffer_view->buffer->data + acc->buffer_view->offset + acc->offset;
+	if (acc->stride == sizeof(T))
+		memcpy(&container[0], data, acc->count * sizeof(T));
+	else
+		for (size_t i = 0; i < acc->count; ++i)
+			memcpy(&container[i], data + i * acc->stride, sizeof(T));
 }
 
 void parseGLTFBufferIndices(std::vector<unsigned int>& container, cgltf_accessor* acc)
@@ -138,6 +65,11 @@ void parseGLTFBufferIndices(std::vector<unsigned int>& container, cgltf_accessor
 
 	unsigned char* indices = (unsigned char*)acc->buffer_view->buffer->data + acc->buffer_view->offset + acc->offset;
 	int stride = acc->stride;
+	if (acc->component_type == cgltf_component_type_r_32u && stride == sizeof(unsigned int))
+	{
+		memcpy(final_indices, indices, acc->count * sizeof(unsigned int));
+		return;
+	}
 	for (int i = 0; i < acc->count; ++i)
 	{
 		unsigned int index = 0;
@@ -152,138 +84,355 @@ void parseGLTFBufferIndices(std::vector<unsigned int>& container, cgltf_accessor
 	}
 }
 
-std::vector<Mesh*> parseGLTFMesh(cgltf_mesh* meshdata)
+//adds the elements of an accessor to the hash, whatever the stride of the buffer view
+static unsigned long long hashGLTFAccessor(cgltf_accessor* acc, unsigned long long hash)
 {
-	std::vector<Mesh*> result;
+	int desc[4] = { acc->type, acc->component_type, acc->normalized, (int)acc->count };
+	hash = hashMemory64(desc, sizeof(desc), hash);
+	if (!acc->count || !acc->buffer_view || !acc->buffer_view->buffer->data)
+		return hash;
+	size_t element_size = cgltf_calc_size(acc->type, acc->component_type);
+	const unsigned char* data = (const unsigned char*)acc->buffer_view->buffer->data + acc->buffer_view->offset + acc->offset;
+	if (acc->stride == element_size)
+		return hashMemory64(data, acc->count * element_size, hash);
+	for (size_t i = 0; i < acc->count; ++i)
+		hash = hashMemory64(data + i * acc->stride, element_size, hash);
+	return hash;
+}
 
-	if (meshdata->name)
-		stdlog( std::string("\t<- MESH: ") + meshdata->name);
+//identifies the geometry of a primitive (only the streams parseGLTFPrimitive reads), the same in any file
+unsigned long long hashGLTFPrimitive(cgltf_primitive* primitive)
+{
+	unsigned long long hash = 0;
+	for (int j = 0; j < primitive->attributes_count; ++j)
+	{
+		cgltf_attribute* attr = &primitive->attributes[j];
+		if (attr->type != cgltf_attribute_type_position && attr->type != cgltf_attribute_type_normal && attr->type != cgltf_attribute_type_texcoord)
+			continue;
+		int type[2] = { attr->type, attr->index };
+		hash = hashGLTFAccessor(attr->data, hashMemory64(type, sizeof(type), hash));
+	}
+	if (primitive->indices)
+		hash = hashGLTFAccessor(primitive->indices, hash);
+	return hash;
+}
 
-    //submeshes
-	for (int i = 0; i < meshdata->primitives_count; ++i)
+//only touches the mesh in RAM, so several primitives can be parsed at the same time
+void parseGLTFPrimitive(cgltf_primitive* primitive, Mesh* mesh)
+{
+	//streams
+	for (int j = 0; j < primitive->attributes_count; ++j)
 	{
-		cgltf_primitive* primitive = &meshdata->primitives[i];
-		Mesh* mesh = NULL;
+		cgltf_attribute* attr = &primitive->attributes[j];
 
-		std::string submesh_name;
-		if (meshdata->name)
+		//std::string attrname = attr->name;
+		if (attr->type == cgltf_attribute_type_position)
 		{
-			submesh_name = std::string(meshdata->name) + std::string("::") + std::to_string(i);
-			mesh = Mesh::Get(submesh_name.c_str(), true);
-			if (mesh)
+			parseGLTFAccessor(mesh->vertices, attr->data);
+			if (attr->data->has_min && attr->data->has_max)
 			{
-				result.push_back(mesh);
-				continue;
+				mesh->aabb_min = attr->data->min;
+				mesh->aabb_max = attr->data->max;
+				mesh->box.center = (mesh->aabb_max + mesh->aabb_min) * 0.5f;
+				mesh->box.halfsize = mesh->aabb_max - mesh->box.center;
 			}
+			else
+				mesh->updateBoundingBox();
 		}
+		else
+		if (attr->type == cgltf_attribute_type_normal)
+			parseGLTFAccessor(mesh->normals, attr->data);
+		else
+		if (attr->type == cgltf_attribute_type_texcoord)
+		{
+			if (strcmp(attr->name,"TEXCOORD_1") == 0) //secondary UV set
+				parseGLTFAccessor(mesh->m_uvs1, attr->data);
+			else
+				parseGLTFAccessor(mesh->uvs, attr->data);
+		}
+	}
+
+	if (primitive->indices && primitive->indices->count)
+		parseGLTFBufferIndices(mesh->m_indices, primitive->indices);
+
+	if (Mesh::optimize_meshes)
+		mesh->optimize(false);
+}
+
+//a glTF being loaded. the files are read and parsed in any thread, the prefab is built in the main thread (buildGLTF)
+struct sGLTFLoad {
+	std::string filename;
+	bool read_cache;
+	bool write_cache;
+	MappedFile cache;		//open when there is a cache valid for the current files
+	size_t cache_start;		//first byte after the header and the sources
+	cgltf_data* data;		//when there is no valid cache
+	cgltf_options options;
 
-		mesh = new Mesh();
+	std::map<cgltf_mesh*, std::vector<Mesh*>> meshes; //one per primitive
+	std::vector<cgltf_primitive*> pending;	//primitives to parse into pending_meshes
+	std::vector<Mesh*> pending_meshes;
+	std::vector<std::string> pending_names;
+	std::vector<unsigned long long> pending_hashes;
+	std::map<std::string, unsigned long long> image_hashes; //see hashGLTFImages
+	int remaining;	//primitives not parsed yet when loading async (main thread)
 
-        //streams
-		for (int j = 0; j < primitive->attributes_count; ++j)
+	sGLTFLoad(const char* filename, bool use_cache) : filename(filename), read_cache(use_cache), write_cache(use_cache), cache_start(0), data(NULL), remaining(0) {
+		memset(&options, 0, sizeof(cgltf_options));
+	}
+	~sGLTFLoad() {
+		for (size_t i = 0; i < pending_meshes.size(); ++i)
+			delete pending_meshes[i];
+		if (data)
+			cgltf_free(data);
+	}
+};
+
+//fills load.meshes creating the meshes that must be parsed. reuse_loaded looks for them by name and content in the loaded ones (main thread only)
+void collectGLTFPrimitives(sGLTFLoad& load, bool reuse_loaded)
+{
+	std::map<std::string, Mesh*> named; //the same mesh can appear twice in the file
+	std::map<unsigned long long, Mesh*> hashed; //or the same geometry in two meshes
+
+	for (int m = 0; m < load.data->meshes_count; ++m)
+	{
+		cgltf_mesh* meshdata = &load.data->meshes[m];
+		std::vector<Mesh*>& result = load.meshes[meshdata];
+		if (meshdata->name)
+			stdlog( std::string("\t<- MESH: ") + meshdata->name);
+
+		//submeshes
+		for (int i = 0; i < meshdata->primitives_count; ++i)
 		{
-			cgltf_attribute* attr = &primitive->attributes[j];
+			Mesh* mesh = NULL;
+			std::string submesh_name;
+			if (meshdata->name)
+			{
+				submesh_name = std::string(meshdata->name) + std::string("::") + std::to_string(i);
+				if (reuse_loaded)
+					mesh = Mesh::Get(submesh_name.c_str(), true, true);
+				if (!mesh && named.count(submesh_name))
+					mesh = named[submesh_name];
+			}
 
-            //std::string attrname = attr->name;
-			if (attr->type == cgltf_attribute_type_position)
+			unsigned long long hash = 0;
+			if (!mesh)
 			{
-				parseGLTFBufferVector3(mesh->vertices, attr->data);
-				if (attr->data->has_min && attr->data->has_max)
+				hash = hashGLTFPrimitive(&meshdata->primitives[i]);
+				if (reuse_loaded)
+					mesh = Mesh::GetDuplicate(hash, submesh_name);
+				if (!mesh && hashed.count(hash))
 				{
-					mesh->aabb_min = attr->data->min;
-					mesh->aabb_max = attr->data->max;
-					mesh->box.center = (mesh->aabb_max + mesh->aabb_min) * 0.5f;
-					mesh->box.halfsize = mesh->aabb_max - mesh->box.center;
+					mesh = hashed[hash];
+					mesh->num_duplicates++;
 				}
-				else
-					mesh->updateBoundingBox();
 			}
-			else
-			if (attr->type == cgltf_attribute_type_normal)
-				parseGLTFBufferVector3(mesh->normals, attr->data);
-			else
-			if (attr->type == cgltf_attribute_type_texcoord)
+
+			if (!mesh)
 			{
-				if (strcmp(attr->name,"TEXCOORD_1") == 0) //secondary UV set
-					parseGLTFBufferVector2(mesh->m_uvs1, attr->data);
-				else
-					parseGLTFBufferVector2(mesh->uvs, attr->data);
+				mesh = new Mesh();
+				load.pending.push_back(&meshdata->primitives[i]);
+				load.pending_meshes.push_back(mesh);
+				load.pending_names.push_back(submesh_name);
+				load.pending_hashes.push_back(hash);
+				if (meshdata->name)
+					named[submesh_name] = mesh;
+				hashed[hash] = mesh;
 			}
+			result.push_back(mesh);
+		}
+	}
+}
 
-			if (primitive->indices && primitive->indices->count)
-				parseGLTFBufferIndices(mesh->m_indices, primitive->indices);
+//every pending primitive in several threads
+void parseGLTFPrimitives(sGLTFLoad& load)
+{
+	int num_threads = std::thread::hardware_concurrency();
+	if (num_threads > (int)load.pending.size())
+		num_threads = load.pending.size();
+	if (num_threads <= 0)
+		num_threads = 1;
+
+	std::atomic<int> next_primitive(0);
+	auto worker = [&]() {
+		int i;
+		while ((i = next_primitive++) < (int)load.pending.size())
+			parseGLTFPrimitive(load.pending[i], load.pending_meshes[i]);
+	};
+
+	std::vector<std::thread> threads;
+	for (int i = 1; i < num_threads; ++i)
+		threads.push_back(std::thread(worker));
+	worker();
+	for (size_t i = 0; i < threads.size(); ++i)
+		threads[i].join();
+}
+
+//main thread: uploads and registers the parsed meshes, the ones loaded meanwhile by someone else (or with the same content) are replaced
+void registerGLTFMeshes(sGLTFLoad& load)
+{
+	for (size_t i = 0; i < load.pending_meshes.size(); ++i)
+	{
+		Mesh* mesh = load.pending_meshes[i];
+		const std::string& name = load.pending_names[i];
+		Mesh* loaded = name.size() ? Mesh::Get(name.c_str(), true, true) : NULL;
+		if (!loaded && (loaded = Mesh::GetDuplicate(load.pending_hashes[i], name)))
+			loaded->num_duplicates += mesh->num_duplicates;
+		if (loaded)
+		{
+			for (auto& it : load.meshes)
+				for (size_t j = 0; j < it.second.size(); ++j)
+					if (it.second[j] == mesh)
+						it.second[j] = loaded;
+			delete mesh;
+			continue;
 		}
 		mesh->uploadToVRAM();
-		if (meshdata->name)
-			mesh->registerMesh(submesh_name);
-		result.push_back(mesh);
+		if (name.size())
+			mesh->registerMesh(name);
+		mesh->registerHash(load.pending_hashes[i]);
 	}
-
-	return result;
+	load.pending.clear();
+	load.pending_meshes.clear();
+	load.pending_names.clear();
+	load.pending_hashes.clear();
 }
 
 int GLTF_TEXTURE_LAST_ID = 1;
 
-Texture* parseGLTFTexture(cgltf_image* image, const char* filename)
+//textures of a material, in the order they are stored in the cache
+enum eGLTFSampler {
+	GLTF_COLOR,
+	GLTF_EMISSIVE,
+	GLTF_OPACITY,
+	GLTF_METALLIC_ROUGHNESS,
+	GLTF_OCCLUSION,
+	GLTF_NORMAL,
+	GLTF_NUM_SAMPLERS
+};
+
+//what is shown while a texture is loading, a value that does not change the material
+Vector4ub getGLTFPlaceholder(int sampler)
 {
-	if (!load_textures || !image )
-		return NULL;
+	if (sampler == GLTF_EMISSIVE)
+		return Vector4ub(0, 0, 0, 255);
+	if (sampler == GLTF_NORMAL)
+		return Vector4ub(128, 128, 255, 255);
+	return Vector4ub(255, 255, 255, 255);
+}
 
-	std::string fullpath = filename ? filename : "";
+//how the texels are filtered and compressed when the texture is cooked
+eTextureUsage getGLTFUsage(int sampler)
+{
+	if (sampler == GLTF_COLOR || sampler == GLTF_EMISSIVE)
+		return TEXTURE_COLOR;
+	if (sampler == GLTF_NORMAL)
+		return TEXTURE_NORMAL;
+	return TEXTURE_DATA;
+}
 
-	if (image->uri)
-		return Texture::Get((std::string(base_folder) + "/" + image->uri).c_str());
-	else
-	if (filename)
+//decodes a png or jpg stored inside the glTF (or the cache), name can be empty. with workers it is decoded by one of them
+Texture* loadGLTFImage(std::vector<unsigned char>& buffer, const char* mime_type, const std::string& name, int sampler)
+{
+	bool png = !strcmp(mime_type, "image/png");
+	if (!png && strcmp(mime_type, "image/jpeg"))
 	{
-		fullpath = std::string(base_folder) + "/" + filename;
-		Texture* tex = Texture::Find(fullpath.c_str());
-		if (tex)
-			return tex;
+		stdlog(std::string("image format not supported: ") + mime_type);
+		return NULL;
 	}
+
+	//the same image in another prefab (or twice in this one)
+	unsigned long long hash = Texture::hashContent(buffer.empty() ? NULL : &buffer[0], buffer.size(), getGLTFUsage(sampler));
+	Texture* tex = Texture::GetDuplicate(hash, name.c_str());
+	if (tex)
+		return tex;
+
+	tex = new Texture();
+	tex->registerHash(hash);
+	if (name.size())
+		stdlog(std::string("\t<- TEXTURE: ") + name);
 	else
-	{
-		std::stringstream ss;
-		ss << GLTF_TEXTURE_LAST_ID++;
-		fullpath = std::string(base_folder) + "/image" + ss.str();
-	}
+		stdlog(std::string(" TEXTURE: UNNAMED ") + mime_type );
 
-	if (image->buffer_view)
+	if (!JobSystem::num_workers)
 	{
 		Image img;
-		std::vector<unsigned char> buffer;
-		buffer.resize(image->buffer_view->size);
-		memcpy(&buffer[0], (char*)image->buffer_view->buffer->data + image->buffer_view->offset, image->buffer_view->size);
-
-		if (!strcmp(image->mime_type, "image/png"))
-			img.loadPNG(buffer);
-		else if (!strcmp(image->mime_type, "image/jpeg"))
-			img.loadJPG(buffer);
-		else
+		if (png ? !img.loadPNG(buffer) : !img.loadJPG(buffer))
 		{
-			stdlog(std::string("image format not supported: ") + image->mime_type);
+			stdlog(std::string("image encoding has error: ") + mime_type);
+			delete tex;
 			return NULL;
 		}
-		if (!img.width)
-		{
-			stdlog(std::string("image encoding has error: ") + image->mime_type);
-			return NULL;
-		}
-		Texture* tex = new Texture();
 		tex->loadFromImage(&img);
+	}
+	else
+	{
+		tex->createPlaceholder(getGLTFPlaceholder(sampler));
+		Image* image = new Image();
+		std::vector<unsigned char>* bytes = new std::vector<unsigned char>();
+		bytes->swap(buffer);
+		std::string type = mime_type;
+		sTextureJob* job = tex->startJob();
+		JobSystem::run([image, bytes, png]() {
+			if (png ? !image->loadPNG(*bytes) : !image->loadJPG(*bytes))
+				image->width = 0;
+			delete bytes;
+		}, [job, image, type]() {
+			Texture* tex = Texture::finishJob(job); //NULL if it was destroyed while decoding
+			if (tex && image->width)
+				tex->uploadFromPBO(image);
+			else if (tex)
+				stdlog(std::string("image encoding has error: ") + type);
+			delete image;
+		});
+	}
+
+	if (name.size())
+		tex->setName(name.c_str());
+	return tex;
+}
+
+Texture* parseGLTFTexture(cgltf_image* image, const char* filename, int sampler)
+{
+	if (!load_textures || !image )
+		return NULL;
+
+	std::string fullpath = filename ? filename : "";
+	Texture* tex = NULL;
+
+	if (image->uri)
+	{
+		std::string path = std::string(base_folder) + "/" + image->uri;
+		tex = Texture::GetAsync(path.c_str(), getGLTFPlaceholder(sampler), true, true, getGLTFUsage(sampler), gltf_image_hashes[path]);
+	}
+	else
+	{
 		if (filename)
 		{
-			tex->setName(fullpath.c_str());
-			stdlog(std::string("\t<- TEXTURE: ") + fullpath);
+			fullpath = std::string(base_folder) + "/" + filename;
+			tex = Texture::Find(fullpath.c_str());
 		}
 		else
-			stdlog(std::string(" TEXTURE: UNNAMED ") + image->mime_type );
+		{
+			std::stringstream ss;
+			ss << GLTF_TEXTURE_LAST_ID++;
+			fullpath = std::string(base_folder) + "/image" + ss.str();
+		}
 
-		return tex;
+		if (!tex && image->buffer_view)
+		{
+			std::vector<unsigned char> buffer;
+			buffer.resize(image->buffer_view->size);
+			memcpy(&buffer[0], (char*)image->buffer_view->buffer->data + image->buffer_view->offset, image->buffer_view->size);
+			tex = loadGLTFImage(buffer, image->mime_type, filename ? fullpath : "", sampler);
+		}
+		else if (!tex)
+			stdlog(std::string(" No texture data") + image->mime_type);
 	}
-	else
-		stdlog(std::string(" No texture data") + image->mime_type);
-	return NULL;
+
+	if (tex)
+		gltf_texture_images[tex] = image;
+	return tex;
 }
 
 GTR::Material* parseGLTFMaterial(cgltf_material* matdata)
@@ -303,7 +452,7 @@ GTR::Material* parseGLTFMaterial(cgltf_material* matdata)
 	//normalmap
 	if (matdata->normal_texture.texture)
 	{
-		material->normal_texture.texture = parseGLTFTexture( matdata->normal_texture.texture->image, matdata->normal_texture.texture->name);
+		material->normal_texture.texture = parseGLTFTexture( matdata->normal_texture.texture->image, matdata->normal_texture.texture->name, GLTF_NORMAL);
 		material->normal_texture.uv_channel = matdata->normal_texture.texcoord;
 	}
 
@@ -311,7 +460,7 @@ GTR::Material* parseGLTFMaterial(cgltf_material* matdata)
 	material->emissive_factor = matdata->emissive_factor;
 	if (matdata->emissive_texture.texture)
 	{
-		material->emissive_texture.texture = parseGLTFTexture(matdata->emissive_texture.texture->image, matdata->emissive_texture.texture->name);
+		material->emissive_texture.texture = parseGLTFTexture(matdata->emissive_texture.texture->image, matdata->emissive_texture.texture->name, GLTF_EMISSIVE);
 		material->emissive_texture.uv_channel = matdata->emissive_texture.texcoord;
 	}
 
@@ -320,7 +469,7 @@ GTR::Material* parseGLTFMaterial(cgltf_material* matdata)
 	if (matdata->has_pbr_specular_glossiness)
 	{
 		if (matdata->pbr_specular_glossiness.diffuse_texture.texture)
-			material->color_texture.texture = parseGLTFTexture(matdata->pbr_specular_glossiness.diffuse_texture.texture->image, matdata->pbr_specular_glossiness.diffuse_texture.texture->name);
+			material->color_texture.texture = parseGLTFTexture(matdata->pbr_specular_glossiness.diffuse_texture.texture->image, matdata->pbr_specular_glossiness.diffuse_texture.texture->name, GLTF_COLOR);
 	}
 	if (matdata->has_pbr_metallic_roughness)
 	{
@@ -332,12 +481,12 @@ GTR::Material* parseGLTFMaterial(cgltf_material* matdata)
 		{
 			if (matdata->pbr_metallic_roughness.base_color_texture.texture)
 			{
-				material->color_texture.texture = parseGLTFTexture(matdata->pbr_metallic_roughness.base_color_texture.texture->image, matdata->pbr_metallic_roughness.base_color_texture.texture->name);
+				material->color_texture.texture = parseGLTFTexture(matdata->pbr_metallic_roughness.base_color_texture.texture->image, matdata->pbr_metallic_roughness.base_color_texture.texture->name, GLTF_COLOR);
 				material->color_texture.uv_channel = matdata->pbr_metallic_roughness.base_color_texture.texcoord;
 			}
 			if (matdata->pbr_metallic_roughness.metallic_roughness_texture.texture)
 			{
-				material->metallic_roughness_texture.texture = parseGLTFTexture(matdata->pbr_metallic_roughness.metallic_roughness_texture.texture->image, matdata->pbr_metallic_roughness.metallic_roughness_texture.texture->name);
+				material->metallic_roughness_texture.texture = parseGLTFTexture(matdata->pbr_metallic_roughness.metallic_roughness_texture.texture->image, matdata->pbr_metallic_roughness.metallic_roughness_texture.texture->name, GLTF_METALLIC_ROUGHNESS);
 				material->metallic_roughness_texture.uv_channel = matdata->pbr_metallic_roughness.metallic_roughness_texture.texcoord;
 			}
 		}
@@ -345,10 +494,11 @@ GTR::Material* parseGLTFMaterial(cgltf_material* matdata)
 
 	if (matdata->occlusion_texture.texture)
 	{
-		material->occlusion_texture.texture = parseGLTFTexture(matdata->occlusion_texture.texture->image, matdata->occlusion_texture.texture->name);
+		material->occlusion_texture.texture = parseGLTFTexture(matdata->occlusion_texture.texture->image, matdata->occlusion_texture.texture->name, GLTF_OCCLUSION);
 		material->occlusion_texture.uv_channel = matdata->occlusion_texture.texcoord;
 	}
 
+	material->updateShaderFeatures();
 	return material;
 }
 
@@ -388,12 +538,12 @@ GTR::Node* parseGLTFNode(cgltf_node* node, GTR::Node* scenenode = NULL)
 
     if (node->mesh)
 	{
+		//already parsed and registered (registerGLTFMeshes)
+		std::vector<Mesh*>& meshes = gltf_meshes[node->mesh];
+
         //split in subnodes
 		if (node->mesh->primitives_count > 1)
 		{
-			std::vector<Mesh*> meshes;
-			meshes = parseGLTFMesh(node->mesh);
-
 			for (int i = 0; i < node->mesh->primitives_count; ++i)
 			{
 				GTR::Node* subnode = new GTR::Node();
@@ -405,18 +555,8 @@ GTR::Node* parseGLTFNode(cgltf_node* node, GTR::Node* scenenode = NULL)
 		}
 		else //single primitive
 		{
-			if (node->mesh->name)
-				scenenode->mesh = Mesh::Get(node->mesh->name, true);
-
-			if (!scenenode->mesh)
-			{
-				std::vector<Mesh*> meshes;
-				meshes = parseGLTFMesh(node->mesh);
-				//printf("Parsed GLTF mesh %s (success)\n", node->name);
-				//return nullptr;
-				if(meshes.size())
-					scenenode->mesh = meshes[0];
-			}
+			if(meshes.size())
+				scenenode->mesh = meshes[0];
 
 			if (node->mesh->primitives->material)
 				scenenode->material = parseGLTFMaterial(node->mesh->primitives->material);
@@ -457,31 +597,519 @@ cgltf_result internalOpenMemory(const struct cgltf_memory_options* memory_option
 	return cgltf_result_success;
 }
 
-GTR::Prefab* loadGLTF(const char *filename, cgltf_data *data, cgltf_options& options)
+/*	glTF cache: the prefab as it is after parsing, so the next runs do not need cgltf.
+	header, the files it was built from, textures (paths, or the bytes of the embedded ones, and the sampler that uses them), materials,
+	meshes (.mbin blocks aligned to 16 bytes) and the nodes in depth first order.
+	It is rebuilt when the hash of the gltf, its buffers and the import settings does not match.
+	A mesh only found in VRAM is stored without its block and must be already loaded when the cache is read.
+*/
+#define GLTF_CACHE_MAGIC "GLTC"
+#define GLTF_CACHE_VERSION 5
+#define GLTF_CACHE_EXTENSION ".cache"
+#define GLTF_CACHE_ALIGNMENT 16
+
+struct sGLTFCacheHeader {
+	char magic[4];
+	int version;
+	int mesh_version;			//MESH_BIN_VERSION of the mesh blocks
+	unsigned int source_hash;	//of the gltf and the files listed after the header
+	int num_sources;
+	int num_textures;
+	int num_materials;
+	int num_meshes;
+	unsigned int file_size;
+};
+
+//the settings that change the meshes of the cache are part of its key
+static unsigned int hashGLTFCacheSettings()
 {
-	cgltf_result result;
+	int settings[] = { GLTF_CACHE_VERSION, MESH_BIN_VERSION, Mesh::optimize_meshes, Mesh::quantize_meshes, Mesh::interleave_meshes };
+	return hashMemory(settings, sizeof(settings));
+}
 
-	if (data->scenes_count > 1)
-		std::cout << "[WARN] more than one scene, skipping the rest" << std::endl;
+static void writeCacheInt(FILE* f, int value)
+{
+	fwrite(&value, sizeof(int), 1, f);
+}
 
-	//get nodes
-	cgltf_scene* scene = &data->scenes[0];
+static void writeCacheString(FILE* f, const std::string& str)
+{
+	writeCacheInt(f, str.size());
+	if (str.size())
+		fwrite(str.c_str(), str.size(), 1, f);
+}
+
+static void alignCacheFile(FILE* f)
+{
+	const char padding[GLTF_CACHE_ALIGNMENT] = { 0 };
+	long pos = ftell(f);
+	if (pos % GLTF_CACHE_ALIGNMENT)
+		fwrite(padding, GLTF_CACHE_ALIGNMENT - pos % GLTF_CACHE_ALIGNMENT, 1, f);
+}
+
+//sequential reads from the mapped cache, a read out of bounds makes it invalid
+struct sGLTFCacheReader {
+	const unsigned char* data;
+	size_t size;
+	size_t pos;
+	bool valid;
+
+	bool read(void* dst, size_t bytes) {
+		if (!valid || pos + bytes > size)
+			return valid = false;
+		memcpy(dst, data + pos, bytes);
+		pos += bytes;
+		return true;
+	}
+	int readInt() {
+		int value = 0;
+		read(&value, sizeof(int));
+		return value;
+	}
+	std::string readString() {
+		int length = readInt();
+		if (!valid || length < 0 || pos + length > size)
+		{
+			valid = false;
+			return "";
+		}
+		std::string str((const char*)data + pos, length);
+		pos += length;
+		return str;
+	}
+	void align() {
+		pos = (pos + GLTF_CACHE_ALIGNMENT - 1) & ~(size_t)(GLTF_CACHE_ALIGNMENT - 1);
+	}
+};
 
-	char folder[1024];
-	strcpy(folder, filename);
-	char* name_start = strrchr(folder, '/');
-	*name_start = '\0';
-	base_folder = folder; //global
+//the buffers in external files, the images are referenced by path so they do not change the cache
+static void getGLTFSources(cgltf_data* data, std::vector<std::string>& sources)
+{
+	for (int i = 0; i < data->buffers_count; ++i)
+	{
+		const char* uri = data->buffers[i].uri;
+		if (uri && strncmp(uri, "data:", 5) != 0)
+			sources.push_back(base_folder + "/" + uri);
+	}
+}
 
+static void collectGLTFCacheNode(GTR::Node* node, std::map<Mesh*, int>& meshes, std::vector<Mesh*>& mesh_list,
+	std::map<GTR::Material*, int>& materials, std::vector<GTR::Material*>& material_list)
+{
+	if (node->mesh && !meshes.count(node->mesh))
 	{
-		result = cgltf_load_buffers(&options, data, filename);
-		if (result != cgltf_result_success) {
-			stdlog(std::string("[BIN NOT FOUND]:") + filename);
-			return NULL;
+		meshes[node->mesh] = mesh_list.size();
+		mesh_list.push_back(node->mesh);
+	}
+	if (node->material && !materials.count(node->material))
+	{
+		materials[node->material] = material_list.size();
+		material_list.push_back(node->material);
+	}
+	for (size_t i = 0; i < node->children.size(); ++i)
+		collectGLTFCacheNode(node->children[i], meshes, mesh_list, materials, material_list);
+}
+
+static void writeGLTFCacheNode(FILE* f, GTR::Node* node, std::map<Mesh*, int>& meshes, std::map<GTR::Material*, int>& materials)
+{
+	writeCacheString(f, node->name);
+	fwrite(&node->model, sizeof(Matrix44), 1, f);
+	writeCacheInt(f, node->mesh ? meshes[node->mesh] : -1);
+	writeCacheInt(f, node->material ? materials[node->material] : -1);
+	writeCacheInt(f, node->children.size());
+	for (size_t i = 0; i < node->children.size(); ++i)
+		writeGLTFCacheNode(f, node->children[i], meshes, materials);
+}
+
+static GTR::Sampler* getCacheSamplers(GTR::Material* material, int i)
+{
+	GTR::Sampler* samplers[] = { &material->color_texture, &material->emissive_texture, &material->opacity_texture,
+		&material->metallic_roughness_texture, &material->occlusion_texture, &material->normal_texture };
+	return samplers[i];
+}
+
+//called before cgltf_free, the embedded images are copied from the glTF buffers
+bool writeGLTFCache(const char* filename, cgltf_data* data, GTR::Prefab* prefab)
+{
+	std::vector<std::string> sources;
+	getGLTFSources(data, sources);
+	unsigned int hash = hashGLTFCacheSettings();
+	bool found = hashFile(filename, hash);
+	for (size_t i = 0; i < sources.size() && found; ++i)
+		found = hashFile(sources[i].c_str(), hash);
+	if (!found)
+		return false;
+
+	std::map<Mesh*, int> meshes;
+	std::vector<Mesh*> mesh_list;
+	std::map<GTR::Material*, int> materials;
+	std::vector<GTR::Material*> material_list;
+	collectGLTFCacheNode(&prefab->root, meshes, mesh_list, materials, material_list);
+
+	std::map<Texture*, int> textures;
+	std::vector<Texture*> texture_list;
+	std::vector<int> samplers; //the first one that uses every texture
+	for (size_t i = 0; i < material_list.size(); ++i)
+		for (int j = 0; j < GLTF_NUM_SAMPLERS; ++j)
+		{
+			Texture* texture = getCacheSamplers(material_list[i], j)->texture;
+			if (!texture || textures.count(texture))
+				continue;
+			textures[texture] = texture_list.size();
+			texture_list.push_back(texture);
+			samplers.push_back(j);
 		}
+
+	std::string cache_filename = std::string(filename) + GLTF_CACHE_EXTENSION;
+	FILE* f = fopen(cache_filename.c_str(), "wb");
+	if (!f)
+	{
+		std::cout << "[WARN] cannot write glTF cache: " << cache_filename << std::endl;
+		return false;
 	}
 
-	GTR::Prefab* prefab = new GTR::Prefab();
+	sGLTFCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, GLTF_CACHE_MAGIC, 4);
+	header.version = GLTF_CACHE_VERSION;
+	header.mesh_version = MESH_BIN_VERSION;
+	header.source_hash = hash;
+	header.num_sources = sources.size();
+	header.num_textures = texture_list.size();
+	header.num_materials = material_list.size();
+	header.num_meshes = mesh_list.size();
+	fwrite(&header, sizeof(header), 1, f); //written again at the end with the size
+
+	for (size_t i = 0; i < sources.size(); ++i)
+		writeCacheString(f, sources[i]);
+
+	bool ok = true;
+	for (size_t i = 0; i < texture_list.size(); ++i)
+	{
+		//textures from files only need the path, the embedded ones keep the png/jpg bytes
+		Texture* texture = texture_list[i];
+		cgltf_image* image = gltf_texture_images.count(texture) ? gltf_texture_images[texture] : NULL;
+		bool embedded = image && !image->uri && image->buffer_view && image->mime_type;
+		if (!embedded && texture->filename.empty())
+			ok = false;
+		//a file shared with another prefab keeps the name of the first one, but this prefab must use its own
+		writeCacheString(f, image && image->uri ? base_folder + "/" + image->uri : texture->filename);
+		writeCacheString(f, embedded ? image->mime_type : "");
+		writeCacheInt(f, samplers[i]);
+		writeCacheInt(f, embedded ? image->buffer_view->size : 0);
+		if (embedded)
+			fwrite((const char*)image->buffer_view->buffer->data + image->buffer_view->offset, image->buffer_view->size, 1, f);
+	}
+
+	for (size_t i = 0; i < material_list.size(); ++i)
+	{
+		GTR::Material* material = material_list[i];
+		writeCacheString(f, material->name);
+		writeCacheInt(f, material->alpha_mode);
+		fwrite(&material->alpha_cutoff, sizeof(float), 1, f);
+		writeCacheInt(f, material->two_sided);
+		fwrite(&material->color, sizeof(Vector4), 1, f);
+		fwrite(&material->roughness_factor, sizeof(float), 1, f);
+		fwrite(&material->metallic_factor, sizeof(float), 1, f);
+		fwrite(&material->emissive_factor, sizeof(Vector3), 1, f);
+		for (int j = 0; j < GLTF_NUM_SAMPLERS; ++j)
+		{
+			GTR::Sampler* sampler = getCacheSamplers(material, j);
+			writeCacheInt(f, sampler->texture ? textures[sampler->texture] : -1);
+			writeCacheInt(f, sampler->uv_channel);
+		}
+	}
+
+	for (size_t i = 0; i < mesh_list.size() && ok; ++i)
+	{
+		writeCacheString(f, mesh_list[i]->name);
+		fwrite(&mesh_list[i]->content_hash, sizeof(unsigned long long), 1, f);
+		long size_pos = ftell(f);
+		writeCacheInt(f, 0);
+		alignCacheFile(f);
+		long start = ftell(f);
+		//without its streams in RAM the block stays empty, it is found by hash or name when reading
+		if (!mesh_list[i]->writeBinData(f))
+			fseek(f, start, SEEK_SET);
+		long end = ftell(f);
+		fseek(f, size_pos, SEEK_SET);
+		writeCacheInt(f, end - start);
+		fseek(f, 0, SEEK_END);
+	}
+
+	writeGLTFCacheNode(f, &prefab->root, meshes, materials);
+
+	header.file_size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	ok = ok && fwrite(&header, sizeof(header), 1, f) == 1;
+	fclose(f);
+	if (!ok)
+	{
+		std::cout << "[WARN] prefab cannot be stored in a glTF cache: " << filename << std::endl;
+		remove(cache_filename.c_str());
+	}
+	return ok;
+}
+
+static bool readGLTFCacheNode(sGLTFCacheReader& reader, GTR::Node* node, std::vector<Mesh*>& meshes, std::vector<GTR::Material*>& materials)
+{
+	node->name = reader.readString();
+	reader.read(&node->model, sizeof(Matrix44));
+	int mesh = reader.readInt();
+	int material = reader.readInt();
+	int num_children = reader.readInt();
+	if (!reader.valid || mesh >= (int)meshes.size() || material >= (int)materials.size() || num_children < 0 || (size_t)num_children > reader.size - reader.pos)
+		return reader.valid = false;
+	node->mesh = mesh >= 0 ? meshes[mesh] : NULL;
+	node->material = material >= 0 ? materials[material] : NULL;
+
+	for (int i = 0; i < num_children; ++i)
+	{
+		GTR::Node* child = new GTR::Node();
+		node->addChild(child);
+		if (!readGLTFCacheNode(reader, child, meshes, materials))
+			return false;
+	}
+	return true;
+}
+
+//maps the cache and checks it is valid for the current files, in any thread
+bool openGLTFCache(sGLTFLoad& load)
+{
+	std::string cache_filename = load.filename + GLTF_CACHE_EXTENSION;
+	MappedFile& file = load.cache;
+	if (!file.open(cache_filename.c_str()))
+		return false;
+
+	sGLTFCacheReader reader = { file.data, file.size, 0, true };
+	sGLTFCacheHeader header;
+	if (!reader.read(&header, sizeof(header)) || memcmp(header.magic, GLTF_CACHE_MAGIC, 4) != 0 || header.version != GLTF_CACHE_VERSION ||
+		header.mesh_version != MESH_BIN_VERSION || header.file_size != file.size)
+	{
+		std::cout << "[WARN] glTF cache is old or corrupted: " << cache_filename << std::endl;
+		file.close();
+		return false;
+	}
+
+	//stale if the gltf, any of its buffers or the import settings have changed
+	unsigned int hash = hashGLTFCacheSettings();
+	bool found = hashFile(load.filename.c_str(), hash);
+	for (int i = 0; i < header.num_sources && found && reader.valid; ++i)
+		found = hashFile(reader.readString().c_str(), hash);
+	if (!found || !reader.valid || hash != header.source_hash)
+	{
+		std::cout << "[WARN] glTF cache is stale, parsing again: " << load.filename << std::endl;
+		file.close();
+		return false;
+	}
+
+	load.cache_start = reader.pos;
+	return true;
+}
+
+//main thread: fills the prefab from a cache opened by openGLTFCache. a corrupted cache is removed
+bool buildGLTFCache(sGLTFLoad& load, GTR::Prefab* prefab)
+{
+	std::string cache_filename = load.filename + GLTF_CACHE_EXTENSION;
+	double time = getTime();
+	sGLTFCacheReader reader = { load.cache.data, load.cache.size, 0, true };
+	sGLTFCacheHeader header;
+	reader.read(&header, sizeof(header));
+	reader.pos = load.cache_start;
+	gltf_image_hashes.swap(load.image_hashes);
+
+	std::vector<Texture*> textures(header.num_textures > 0 ? header.num_textures : 0);
+	for (size_t i = 0; i < textures.size() && reader.valid; ++i)
+	{
+		std::string name = reader.readString();
+		std::string mime_type = reader.readString();
+		int sampler = reader.readInt();
+		int size = reader.readInt();
+		if (!reader.valid || sampler < 0 || sampler >= GLTF_NUM_SAMPLERS || size < 0 || (size_t)size > reader.size - reader.pos)
+		{
+			reader.valid = false;
+			break;
+		}
+		std::vector<unsigned char> buffer(reader.data + reader.pos, reader.data + reader.pos + size);
+		reader.pos += size;
+		if (!load_textures)
+			continue;
+		textures[i] = name.size() ? Texture::Find(name.c_str()) : NULL;
+		if (!textures[i])
+			textures[i] = size ? loadGLTFImage(buffer, mime_type.c_str(), name, sampler) :
+				Texture::GetAsync(name.c_str(), getGLTFPlaceholder(sampler), true, true, getGLTFUsage(sampler), gltf_image_hashes[name]);
+	}
+	gltf_image_hashes.clear();
+
+	std::vector<GTR::Material*> materials(header.num_materials > 0 ? header.num_materials : 0);
+	for (size_t i = 0; i < materials.size() && reader.valid; ++i)
+	{
+		GTR::Material material;
+		material.name = reader.readString();
+		material.alpha_mode = (GTR::eAlphaMode)reader.readInt();
+		reader.read(&material.alpha_cutoff, sizeof(float));
+		material.two_sided = reader.readInt() != 0;
+		reader.read(&material.color, sizeof(Vector4));
+		reader.read(&material.roughness_factor, sizeof(float));
+		reader.read(&material.metallic_factor, sizeof(float));
+		reader.read(&material.emissive_factor, sizeof(Vector3));
+		for (int j = 0; j < GLTF_NUM_SAMPLERS; ++j)
+		{
+			GTR::Sampler* sampler = getCacheSamplers(&material, j);
+			int texture = reader.readInt();
+			sampler->texture = texture >= 0 && texture < (int)textures.size() ? textures[texture] : NULL;
+			sampler->uv_channel = reader.readInt();
+		}
+
+		//same as parseGLTFMaterial, a material with the same name is reused
+		materials[i] = material.name.size() ? GTR::Material::Get(material.name.c_str()) : NULL;
+		if (materials[i])
+			continue;
+		materials[i] = new GTR::Material();
+		*materials[i] = material;
+		materials[i]->name = "";
+		materials[i]->updateShaderFeatures();
+		if (material.name.size())
+			materials[i]->registerMaterial(material.name.c_str());
+	}
+
+	std::vector<Mesh*> meshes(header.num_meshes > 0 ? header.num_meshes : 0);
+	for (size_t i = 0; i < meshes.size() && reader.valid; ++i)
+	{
+		std::string name = reader.readString();
+		unsigned long long hash = 0;
+		reader.read(&hash, sizeof(hash));
+		int size = reader.readInt();
+		reader.align();
+		if (!reader.valid || size < 0 || reader.pos + size > reader.size)
+		{
+			reader.valid = false;
+			break;
+		}
+		const unsigned char* block = reader.data + reader.pos;
+		reader.pos += size;
+
+		//shared meshes are stored with the name of the first prefab, the hash says if it is really shared
+		meshes[i] = hash ? Mesh::GetDuplicate(hash, name) : NULL;
+		if (!meshes[i] && name.size())
+			meshes[i] = Mesh::Get(name.c_str(), true, true);
+		if (meshes[i])
+			continue;
+		if (!size)
+		{
+			std::cout << "[WARN] glTF cache needs a mesh that is not loaded: " << name << std::endl;
+			reader.valid = false;
+			break;
+		}
+		Mesh* mesh = new Mesh();
+		if (!mesh->readBinData(block, size, cache_filename.c_str()))
+		{
+			delete mesh;
+			reader.valid = false;
+			break;
+		}
+		mesh->uploadToVRAM();
+		if (name.size())
+			mesh->registerMesh(name);
+		if (hash)
+			mesh->registerHash(hash);
+		meshes[i] = mesh;
+	}
+
+	bool ok = reader.valid && readGLTFCacheNode(reader, &prefab->root, meshes, materials);
+	load.cache.close();
+	if (!ok)
+	{
+		std::cout << "[WARN] glTF cache is corrupted: " << cache_filename << std::endl;
+		prefab->root.clear();
+		remove(cache_filename.c_str());
+		return false;
+	}
+
+	prefab->updateNodesByName();
+	prefab->updateBounding();
+
+	std::cout << " - Loaded from cache " << load.filename << " Time: " << (getTime() - time) * 0.001 << "sec" << std::endl;
+	return true;
+}
+
+//the gltf and its buffers, in any thread
+bool parseGLTFFile(sGLTFLoad& load)
+{
+	if (!load.options.file.read)
+		load.options.file.read = internalOpenFile;
+	cgltf_result result = cgltf_parse_file(&load.options, load.filename.c_str(), &load.data);
+	if (result != cgltf_result_success) {
+		std::cout << "[NOT FOUND]" << std::endl;
+		return false;
+	}
+
+	result = cgltf_load_buffers(&load.options, load.data, load.filename.c_str());
+	if (result != cgltf_result_success) {
+		stdlog(std::string("[BIN NOT FOUND]:") + load.filename);
+		cgltf_free(load.data);
+		load.data = NULL;
+		return false;
+	}
+	return true;
+}
+
+static std::string getGLTFFolder(const std::string& filename)
+{
+	size_t pos = filename.rfind('/');
+	if (pos == std::string::npos)
+		return ".";
+	return filename.substr(0, pos);
+}
+
+//hashes the image files of the textures in the load worker, so the main thread can share them without reading them again
+static void hashGLTFImages(sGLTFLoad& load)
+{
+	if (!load_textures)
+		return;
+	if (load.data)
+	{
+		std::string folder = getGLTFFolder(load.filename);
+		for (size_t i = 0; i < load.data->images_count; ++i)
+			if (load.data->images[i].uri)
+			{
+				std::string path = folder + "/" + load.data->images[i].uri;
+				load.image_hashes[path] = Texture::hashImageFile(path.c_str());
+			}
+		return;
+	}
+
+	//the cache stores the external images without bytes (see buildGLTFCache)
+	sGLTFCacheReader reader = { load.cache.data, load.cache.size, 0, true };
+	sGLTFCacheHeader header;
+	reader.read(&header, sizeof(header));
+	reader.pos = load.cache_start;
+	for (int i = 0; i < header.num_textures && reader.valid; ++i)
+	{
+		std::string name = reader.readString();
+		reader.readString();
+		reader.readInt();
+		int size = reader.readInt();
+		if (!reader.valid || size < 0 || (size_t)size > reader.size - reader.pos)
+			break;
+		reader.pos += size;
+		if (!size && name.size())
+			load.image_hashes[name] = Texture::hashImageFile(name.c_str());
+	}
+}
+
+//main thread: the nodes, materials and textures, once the meshes are registered
+void buildGLTF(sGLTFLoad& load, GTR::Prefab* prefab)
+{
+	cgltf_data* data = load.data;
+	if (data->scenes_count > 1)
+		std::cout << "[WARN] more than one scene, skipping the rest" << std::endl;
+
+	//get nodes
+	cgltf_scene* scene = &data->scenes[0];
+	base_folder = getGLTFFolder(load.filename); //global
+	gltf_meshes.swap(load.meshes);
+	gltf_image_hashes.swap(load.image_hashes);
 
 	{
 		if (scene->nodes_count > 1)
@@ -521,48 +1149,123 @@ GTR::Prefab* loadGLTF(const char *filename, cgltf_data *data, cgltf_options& opt
 	prefab->updateNodesByName();
 	prefab->updateBounding();
 
+	//the embedded images are still in the buffers
+	if (load.write_cache)
+		writeGLTFCache(load.filename.c_str(), data, prefab);
+	gltf_meshes.clear();
+	gltf_texture_images.clear();
+	gltf_image_hashes.clear();
+
 	//frees all data, including bin
 	cgltf_free(data);
+	load.data = NULL;
+
+    stdlog( std::string(" - Loaded ") + load.filename );
+}
+
+//parses everything in the calling thread, the primitives in several threads
+GTR::Prefab* loadGLTF(sGLTFLoad& load)
+{
+	if (!parseGLTFFile(load))
+		return NULL;
 
-    stdlog( std::string(" - Loaded ") + filename );
+	collectGLTFPrimitives(load, true);
+	parseGLTFPrimitives(load);
+	registerGLTFMeshes(load);
 
-    return prefab;
+	GTR::Prefab* prefab = new GTR::Prefab();
+	buildGLTF(load, prefab);
+	return prefab;
 }
 
 GTR::Prefab* loadGLTF(const std::vector<unsigned char>& dat, const std::string& path)
 {
-	cgltf_options options;
-	memset(&options, 0, sizeof(cgltf_options));
-	cgltf_data *data = NULL;
-
+	sGLTFLoad load(path.c_str(), false);
 	g_buffer = dat;
-	options.file.read = internalOpenMemory;
-	cgltf_result result = cgltf_parse_file(&options, path.c_str(), &data);
-
-	if (result != cgltf_result_success) {
-		std::cout << "[NOT FOUND]" << std::endl;
-		return NULL;
-	}
-	return loadGLTF(path.c_str(), data, options);
+	load.options.file.read = internalOpenMemory;
+	return loadGLTF(load);
 }
 
 GTR::Prefab* loadGLTF(const char* filename)
 {
 	stdlog(std::string("loading gltf... ") + filename);
-	cgltf_options options;
-	memset(&options, 0, sizeof(cgltf_options));
-	cgltf_data *data = NULL;
+	sGLTFLoad load(filename, use_gltf_cache);
 
+	//the prefab cooked by a previous run, cgltf is not needed at all
+	if (load.read_cache && openGLTFCache(load))
 	{
-		options.file.read = internalOpenFile;
-		cgltf_result result = cgltf_parse_file(&options, filename, &data);
+		GTR::Prefab* prefab = new GTR::Prefab();
+		if (buildGLTFCache(load, prefab))
+			return prefab;
+		delete prefab;
+	}
 
-		if (result != cgltf_result_success) {
-			std::cout << "[NOT FOUND]" << std::endl;
-			return NULL;
+	return loadGLTF(load);
+}
+
+//main thread, when every primitive has been parsed
+static void finishGLTFAsync(sGLTFLoad* load, GTR::Prefab* prefab)
+{
+	registerGLTFMeshes(*load);
+	buildGLTF(*load, prefab);
+	delete load;
+}
+
+static void startGLTFAsync(sGLTFLoad* load, GTR::Prefab* prefab)
+{
+	JobSystem::run([load]() {
+		if (load->read_cache && openGLTFCache(*load))
+		{
+			hashGLTFImages(*load);
+			return;
+		}
+		if (parseGLTFFile(*load))
+		{
+			collectGLTFPrimitives(*load, false);
+			hashGLTFImages(*load);
+		}
+	}, [load, prefab]() {
+		if (load->cache.data)
+		{
+			if (buildGLTFCache(*load, prefab))
+			{
+				delete load;
+				return;
+			}
+			//the cache was removed, parse the files
+			sGLTFLoad* retry = new sGLTFLoad(load->filename.c_str(), load->write_cache);
+			retry->read_cache = false;
+			delete load;
+			startGLTFAsync(retry, prefab);
+			return;
+		}
+
+		if (!load->data)
+		{
+			std::cout << "[ERROR] prefab could not be loaded: " << load->filename << std::endl;
+			delete load;
+			return;
 		}
-	}
 
-	return loadGLTF(filename, data, options);
+		//one job per primitive, the last one to finish builds the prefab
+		load->remaining = load->pending.size();
+		if (!load->remaining)
+		{
+			finishGLTFAsync(load, prefab);
+			return;
+		}
+		for (size_t i = 0; i < load->pending.size(); ++i)
+			JobSystem::run([load, i]() {
+				parseGLTFPrimitive(load->pending[i], load->pending_meshes[i]);
+			}, [load, prefab]() {
+				if (--load->remaining == 0)
+					finishGLTFAsync(load, prefab);
+			});
+	});
 }
 
+void loadGLTFAsync(const char* filename, GTR::Prefab* prefab)
+{
+	stdlog(std::string("loading gltf async... ") + filename);
+	startGLTFAsync(new sGLTFLoad(filename, use_gltf_cache), prefab);
+}
@@ -5,3 +5,6 @@
 GTR::Prefab* loadGLTF(const char* filename);
 //GTR::Prefab* loadGLTF(const char* filename, cgltf_data* data, cgltf_options& options);
 GTR::Prefab* loadGLTF(const std::vector<unsigned char>& data, const std::string& path);
+
+//fills an empty prefab using the JobSystem workers, the nodes appear once every mesh has been parsed
+void loadGLTFAsync(const char* filename, GTR::Prefab* prefab);
@@ -0,0 +1,340 @@
+#include "headless.h"
+#include "includes.h"
+#include "application.h"
+#include "fbo.h"
+#include "input.h"
+#include "jobsystem.h"
+#include "profiler.h"
+#include "renderstats.h"
+#include "vram.h"
+#include "shader.h"
+#include "scene.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+//EGL comes with mesa on linux, the other systems only get an error
+#if defined(__linux__) && !defined(NO_EGL)
+	#define USE_EGL
+	#define EGL_NO_X11
+	#define MESA_EGL_NO_X11_HEADERS
+	#include <EGL/egl.h>
+	#include <EGL/eglext.h>
+#endif
+
+#ifndef EGL_PLATFORM_SURFACELESS_MESA
+	#define EGL_PLATFORM_SURFACELESS_MESA 0x31DD
+#endif
+
+#ifndef GL_TIMESTAMP
+	#define GL_TIMESTAMP 0x8E28
+#endif
+
+bool Headless::active = false;
+
+static FBO* s_headless_fbo = NULL;
+#ifdef USE_EGL
+static EGLDisplay s_egl_display = EGL_NO_DISPLAY;
+static EGLContext s_egl_context = EGL_NO_CONTEXT;
+#endif
+
+static double now()
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+bool sBenchmarkSettings::parse(int argc, char** argv)
+{
+	bool benchmark = false;
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string arg = argv[i];
+		bool has_value = i + 1 < argc;
+		if (arg == "--benchmark" && has_value)
+		{
+			camera_path = argv[++i];
+			benchmark = true;
+		}
+		else if (arg == "--frames" && has_value)
+			frames = atoi(argv[++i]);
+		else if (arg == "--csv" && has_value)
+			csv_filename = argv[++i];
+		else if (arg == "--warmup" && has_value)
+			warmup_frames = atoi(argv[++i]);
+		else if (arg == "--warmup-timeout" && has_value)
+			warmup_timeout = atoi(argv[++i]);
+		else if (arg == "--size" && has_value)
+			sscanf(argv[++i], "%dx%d", &width, &height);
+		else if (arg == "--trace" && has_value)
+			trace_filename = argv[++i];
+		else if (arg == "--stats" && has_value)
+			stats_filename = argv[++i];
+	}
+	return benchmark;
+}
+
+bool Headless::createContext(int width, int height)
+{
+#ifdef USE_EGL
+	//the surfaceless platform needs no X server nor GPU, the default display is the fallback
+	PFNEGLGETPLATFORMDISPLAYEXTPROC eglGetPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+	if (eglGetPlatformDisplay)
+		s_egl_display = eglGetPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+	if (s_egl_display == EGL_NO_DISPLAY)
+		s_egl_display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	EGLint major, minor;
+	if (s_egl_display == EGL_NO_DISPLAY || !eglInitialize(s_egl_display, &major, &minor) || !eglBindAPI(EGL_OPENGL_API))
+	{
+		std::cout << "[ERROR] headless: cannot initialize EGL" << std::endl;
+		return false;
+	}
+
+	//compatibility profile, the framework still uses glPushAttrib. no config nor surface, the FBO is the window
+	EGLint attribs[] = { EGL_CONTEXT_MAJOR_VERSION, 3, EGL_CONTEXT_MINOR_VERSION, 3,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_COMPATIBILITY_PROFILE_BIT, EGL_NONE };
+	s_egl_context = eglCreateContext(s_egl_display, (EGLConfig)0, EGL_NO_CONTEXT, attribs);
+	if (s_egl_context == EGL_NO_CONTEXT || !eglMakeCurrent(s_egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, s_egl_context))
+	{
+		std::cout << "[ERROR] headless: cannot create a surfaceless OpenGL 3.3 context" << std::endl;
+		eglTerminate(s_egl_display);
+		s_egl_display = EGL_NO_DISPLAY;
+		return false;
+	}
+	active = true;
+
+	s_headless_fbo = new FBO();
+	if (!s_headless_fbo->create(width, height, 1, GL_RGBA, GL_UNSIGNED_BYTE, true))
+	{
+		destroyContext();
+		return false;
+	}
+	FBO::default_framebuffer = s_headless_fbo->fbo_id;
+	glBindFramebuffer(GL_FRAMEBUFFER, FBO::default_framebuffer);
+	glViewport(0, 0, width, height);
+
+	std::cout << " * Headless size: " << width << " x " << height << std::endl;
+	std::cout << " * OpenGL Version: " << glGetString(GL_VERSION) << " (" << glGetString(GL_RENDERER) << ")" << std::endl;
+	return true;
+#else
+	std::cout << "[ERROR] headless mode needs EGL, it is only built on linux" << std::endl;
+	return false;
+#endif
+}
+
+void Headless::destroyContext()
+{
+	delete s_headless_fbo;
+	s_headless_fbo = NULL;
+	FBO::default_framebuffer = 0;
+#ifdef USE_EGL
+	if (s_egl_display != EGL_NO_DISPLAY)
+	{
+		eglMakeCurrent(s_egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+		if (s_egl_context != EGL_NO_CONTEXT)
+			eglDestroyContext(s_egl_display, s_egl_context);
+		eglTerminate(s_egl_display);
+	}
+	s_egl_display = EGL_NO_DISPLAY;
+	s_egl_context = EGL_NO_CONTEXT;
+#endif
+	active = false;
+}
+
+void* Headless::getProcAddress(const char* name)
+{
+#ifdef USE_EGL
+	if (active)
+		return (void*)eglGetProcAddress(name);
+#endif
+	return NULL;
+}
+
+bool Headless::loadCameraPath(const char* filename, std::vector<sCameraKey>& keys)
+{
+	std::ifstream file(filename);
+	if (!file)
+	{
+		std::cout << "[ERROR] camera path not found: " << filename << std::endl;
+		return false;
+	}
+
+	keys.clear();
+	std::string line;
+	int line_number = 0;
+	while (std::getline(file, line))
+	{
+		line_number++;
+		size_t start = line.find_first_not_of(" \t\r");
+		if (start == std::string::npos || line[start] == '#' || line.compare(start, 2, "//") == 0)
+			continue;
+		sCameraKey key;
+		key.fov = keys.size() ? keys.back().fov : 45.0f;
+		std::istringstream values(line);
+		if (!(values >> key.time >> key.eye.x >> key.eye.y >> key.eye.z >> key.center.x >> key.center.y >> key.center.z))
+		{
+			std::cout << "[ERROR] camera path " << filename << ":" << line_number << ": expected time, eye and center" << std::endl;
+			return false;
+		}
+		values >> key.fov;
+		if (keys.size() && key.time < keys.back().time)
+		{
+			std::cout << "[ERROR] camera path " << filename << ":" << line_number << ": the keys must be sorted by time" << std::endl;
+			return false;
+		}
+		keys.push_back(key);
+	}
+
+	if (keys.empty())
+	{
+		std::cout << "[ERROR] camera path without keys: " << filename << std::endl;
+		return false;
+	}
+	return true;
+}
+
+sCameraKey Headless::sampleCameraPath(const std::vector<sCameraKey>& keys, float time)
+{
+	if (time <= keys.front().time)
+		return keys.front();
+	for (size_t i = 1; i < keys.size(); ++i)
+	{
+		const sCameraKey& a = keys[i - 1];
+		const sCameraKey& b = keys[i];
+		if (time > b.time)
+			continue;
+		float f = b.time > a.time ? (time - a.time) / (b.time - a.time) : 1.0f;
+		sCameraKey key;
+		key.time = time;
+		key.eye = lerp(a.eye, b.eye, f);
+		key.center = lerp(a.center, b.center, f);
+		key.fov = a.fov + (b.fov - a.fov) * f;
+		return key;
+	}
+	return keys.back();
+}
+
+bool Headless::writeCSV(const char* filename, const std::vector<sFrameTiming>& timings)
+{
+	FILE* f = fopen(filename, "w");
+	if (!f)
+	{
+		std::cout << "[ERROR] cannot write " << filename << std::endl;
+		return false;
+	}
+	fprintf(f, "frame,cpu_ms,gpu_ms,frame_ms\n");
+	for (size_t i = 0; i < timings.size(); ++i)
+		fprintf(f, "%d,%.4f,%.4f,%.4f\n", (int)i, timings[i].cpu_ms, timings[i].gpu_ms, timings[i].frame_ms);
+	fclose(f);
+	return true;
+}
+
+//one iteration of the main loop without window nor events
+static void headlessFrame(Application* app, const sCameraKey& key, double& cpu_ms)
+{
+	double start = now();
+	app->setCameraView(key.eye, key.center, key.fov);
+	app->render();
+	app->time += (float)HEADLESS_FRAME_TIME;
+	app->elapsed_time = (float)HEADLESS_FRAME_TIME;
+	app->frame++;
+	app->update(HEADLESS_FRAME_TIME);
+	cpu_ms = now() - start;
+}
+
+int Headless::runBenchmark(const sBenchmarkSettings& settings)
+{
+	std::vector<sCameraKey> keys;
+	if (!loadCameraPath(settings.camera_path.c_str(), keys))
+		return 1;
+	if (!createContext(settings.width, settings.height))
+		return 1;
+
+	Input::init(NULL);
+	Application* app = new Application(settings.width, settings.height, NULL);
+	app->render_gui = false;
+
+	//the assets arrive from the workers and the shaders may compile in the background, none of that is measured
+	//neither are the irradiance probes, placed in the first frame after the assets
+	double start = now();
+	double cpu_ms;
+	int warmup = 0;
+	while (true)
+	{
+		int pending_jobs = JobSystem::getPendingJobs();
+		int pending_shaders = Shader::updatePending();
+		bool pending_probes = GTR::Scene::instance && !GTR::Scene::instance->irradianceEnt;
+		if (warmup >= settings.warmup_frames && !pending_jobs && !pending_shaders && !pending_probes)
+			break;
+		//a load that never finishes would hang the run
+		if (now() - start > settings.warmup_timeout * 1000.0)
+		{
+			std::cout << "[ERROR] benchmark warmup timed out after " << settings.warmup_timeout << "s, still pending: " << pending_jobs << " jobs, " <<
+				pending_shaders << " shaders" << (pending_probes ? ", the irradiance probes" : "") << std::endl;
+			JobSystem::shutdown();
+			destroyContext();
+			return 1;
+		}
+		headlessFrame(app, keys.front(), cpu_ms);
+		glFinish();
+		warmup++;
+	}
+	std::cout << " + Benchmark warmup: " << warmup << " frames in " << (int)(now() - start) << "ms" << std::endl;
+
+	float duration = keys.back().time - keys.front().time;
+	int num_frames = settings.frames > 0 ? settings.frames : (int)(duration / HEADLESS_FRAME_TIME) + 1;
+	//timestamps and not GL_TIME_ELAPSED, the profiler uses those inside the render and they cannot be nested
+	std::vector<GLuint> queries(num_frames * 2);
+	glGenQueries(num_frames * 2, &queries[0]);
+	std::vector<sFrameTiming> timings(num_frames);
+	app->frame = 0;
+	app->time = 0;
+	if (settings.trace_filename.size())
+		Profiler::startCapture(settings.trace_filename.c_str(), num_frames);
+	RenderStats::resetHistory();
+
+	for (int i = 0; i < num_frames; ++i)
+	{
+		//the path is stretched to the frames asked for
+		float time = keys.front().time + (num_frames > 1 ? duration * i / (num_frames - 1) : 0);
+		double frame_start = now();
+		glQueryCounter(queries[i * 2], GL_TIMESTAMP);
+		headlessFrame(app, sampleCameraPath(keys, time), timings[i].cpu_ms);
+		glQueryCounter(queries[i * 2 + 1], GL_TIMESTAMP);
+		glFinish(); //instead of the swap, so every frame is measured alone
+		timings[i].frame_ms = now() - frame_start;
+	}
+	RenderStats::newFrame(); //closes the last one
+
+	//read at the end, they are all finished by now
+	double total_cpu = 0, total_gpu = 0, total_frame = 0;
+	for (int i = 0; i < num_frames; ++i)
+	{
+		GLuint64 start = 0, end = 0;
+		glGetQueryObjectui64v(queries[i * 2], GL_QUERY_RESULT, &start);
+		glGetQueryObjectui64v(queries[i * 2 + 1], GL_QUERY_RESULT, &end);
+		timings[i].gpu_ms = (end - start) / 1000000.0;
+		total_cpu += timings[i].cpu_ms;
+		total_gpu += timings[i].gpu_ms;
+		total_frame += timings[i].frame_ms;
+	}
+	glDeleteQueries(num_frames * 2, &queries[0]);
+
+	printf(" + Benchmark: %d frames, average cpu %.2f ms, gpu %.2f ms, frame %.2f ms (%.1f fps)\n", num_frames,
+		total_cpu / num_frames, total_gpu / num_frames, total_frame / num_frames, 1000.0 * num_frames / total_frame);
+	printf(" + VRAM: %.1f MB (textures %.1f, render targets %.1f, meshes %.1f)\n", VRAM::getTotal() / (1024.0 * 1024.0),
+		VRAM::getCategory(VRAM_TEXTURES) / (1024.0 * 1024.0), VRAM::getCategory(VRAM_RENDER_TARGETS) / (1024.0 * 1024.0), VRAM::getCategory(VRAM_MESHES) / (1024.0 * 1024.0));
+	bool ok = writeCSV(settings.csv_filename.c_str(), timings);
+	if (ok)
+		std::cout << " + Benchmark timings written to " << settings.csv_filename << std::endl;
+	if (settings.stats_filename.size())
+		ok = RenderStats::writeJSON(settings.stats_filename.c_str()) && ok;
+
+	Profiler::shutdown(); //the last frames of the trace are still in flight
+	JobSystem::shutdown();
+	destroyContext();
+	return ok ? 0 : 1;
+}
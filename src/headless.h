@@ -0,0 +1,65 @@
+/*  Headless mode for benchmarks on machines without display or GPU: an OpenGL context with no window (EGL on the Mesa
+	surfaceless platform, so llvmpipe is enough) and Application::render drawn to an offscreen FBO that takes the
+	place of the window framebuffer. The camera follows a path read from a text file, the CPU and GPU time of every
+	frame is written to a CSV and the app exits.
+
+	usage: main --benchmark camera_path.txt [--frames N] [--csv timings.csv] [--size 1024x768] [--trace trace.json] [--stats stats.json]
+		[--warmup N] [--warmup-timeout seconds]
+
+	the camera path has one key per line, the camera is interpolated linearly between them:
+		time(seconds) eye_x eye_y eye_z center_x center_y center_z [fov]
+*/
+#pragma once
+
+#include "framework.h"
+
+#include <string>
+#include <vector>
+
+#define HEADLESS_FRAME_TIME (1.0 / 60.0) //the app time advances the same every frame so runs can be compared
+#define HEADLESS_WARMUP_TIMEOUT 300 //seconds waiting for the assets and the shaders before giving up
+
+struct sCameraKey {
+	float time;
+	Vector3 eye;
+	Vector3 center;
+	float fov;
+};
+
+struct sBenchmarkSettings {
+	std::string camera_path;
+	std::string csv_filename;
+	int frames;				//0 to cover the whole path at HEADLESS_FRAME_TIME
+	int width;
+	int height;
+	int warmup_frames;		//at least, it also waits for the assets and the shaders
+	int warmup_timeout;		//seconds, the benchmark fails if something is still loading after them
+	std::string trace_filename;	//the profiler passes of the measured frames, for chrome://tracing
+	std::string stats_filename;	//render stats of the last frame and percentiles of the measured ones
+
+	sBenchmarkSettings() : csv_filename("benchmark.csv"), frames(0), width(1024), height(768), warmup_frames(10), warmup_timeout(HEADLESS_WARMUP_TIMEOUT) {}
+	bool parse(int argc, char** argv); //false if --benchmark is not there
+};
+
+struct sFrameTiming {
+	double cpu_ms;			//update and render calls
+	double gpu_ms;			//between GL_TIMESTAMP queries around the render
+	double frame_ms;		//until the GPU has finished it
+};
+
+class Headless
+{
+public:
+	static bool active;
+
+	static bool createContext(int width, int height); //also the FBO used as window
+	static void destroyContext();
+	static void* getProcAddress(const char* name); //NULL if there is no headless context
+
+	static bool loadCameraPath(const char* filename, std::vector<sCameraKey>& keys);
+	static sCameraKey sampleCameraPath(const std::vector<sCameraKey>& keys, float time);
+
+	//creates the context and the Application, renders the frames and writes the CSV. returns the exit code
+	static int runBenchmark(const sBenchmarkSettings& settings);
+	static bool writeCSV(const char* filename, const std::vector<sFrameTiming>& timings);
+};
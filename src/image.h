@@ -0,0 +1,84 @@
+/*  CPU images (8 bits and float) used by the textures, the probes and the offline baker.
+	Only depends on the math of the framework, so it can be included without SDL or OpenGL.
+*/
+#pragma once
+
+#include "framework.h"
+#include <vector>
+#include <cstring>
+#include <cassert>
+
+class Texture;
+
+//Simple class to handle images (stores RGBA always)
+template <typename T> class tImage
+{
+public:
+	unsigned int width;
+	unsigned int height;
+	unsigned int num_channels; //bits per pixel
+	bool origin_topleft;
+	T* data; //bytes with the pixel information
+	void (*free_data)(void*); //frees data when it is the buffer of a decoder, NULL if it was allocated with new[]
+
+	tImage() { width = height = 0; data = NULL; free_data = NULL; num_channels = 3; }
+	tImage(int w, int h, int num_channels = 3) { data = NULL; free_data = NULL; resize(w, h, num_channels); }
+	~tImage() { freeData(); }
+
+	void freeData() { if (data) { if (free_data) free_data(data); else delete[] data; } data = NULL; free_data = NULL; }
+	void resize(int w, int h, int num_channels = 3) { freeData(); width = w; height = h; this->num_channels = num_channels; data = new T[w * h * num_channels]; memset(data, 0, w * h * sizeof(T) * num_channels); }
+	void clear() { freeData(); width = height = 0; }
+	void flipY();
+};
+
+class Image : public tImage<uint8>
+{
+public:
+	Color getPixel(int x, int y) {
+		assert(x >= 0 && x < (int)width && y >= 0 && y < (int)height && "reading of memory");
+		int pos = y*width* num_channels + x* num_channels;
+		return Color(data[pos], data[pos + 1], data[pos + 2], num_channels == 4 ? 255 : data[pos + 3]);
+	};
+	void setPixel(int x, int y, Color v) {
+		assert(x >= 0 && x < (int)width && y >= 0 && y < (int)height && "writing of memory");
+		int pos = y*width*num_channels + x* num_channels;
+		data[pos] = v.x; data[pos + 1] = v.y; data[pos + 2] = v.z; if (num_channels == 4) data[pos + 3] = v.w;
+	};
+
+	Color getPixelInterpolated(float x, float y, bool repeat = false);
+	Vector4 getPixelInterpolatedHigh(float x, float y, bool repeat = false); //returns a Vector4 (floats)
+
+	void fromTexture(Texture* texture);
+	void fromScreen(int width, int height);
+
+	bool load(const char* filename); //tga, png or jpg by the extension. false if not found or not supported
+	bool loadTGA(const char* filename);
+	bool loadPNG(const char* filename, bool flip_y = true);
+	bool loadPNG(std::vector<unsigned char>& buffer, bool flip_y = false);
+	bool loadJPG(const char* filename, bool flip_y = false);
+	bool loadJPG(std::vector<unsigned char>& buffer, bool flip_y = false);
+	bool fromDecoded(const unsigned char* bytes, size_t size, bool flip_y = false); //png or jpg with the ImageDecoder, the flip is done while decoding
+	bool saveTGA(const char* filename, bool flip_y = false);
+};
+
+class FloatImage : public tImage<float>
+{
+public:
+	//~FloatImage(); //no need, the tImage dtor is valid
+
+	Vector4 getPixel(int x, int y) {
+		assert(x >= 0 && x < (int)width&& y >= 0 && y < (int)height && "reading of memory");
+		int pos = y * width * num_channels + x * num_channels;
+		return Vector4(data[pos], data[pos + 1], data[pos + 2], num_channels == 3 ? 1 : data[pos + 3]);
+	};
+	void setPixel(int x, int y, Vector4 v) {
+		assert(x >= 0 && x < (int)width&& y >= 0 && y < (int)height && "writing of memory");
+		int pos = y * width * num_channels + x * num_channels;
+		data[pos] = v.x; data[pos + 1] = v.y; data[pos + 2] = v.z;
+		if(num_channels == 4)
+			data[pos + 3] = v.w;
+	};
+	void fromTexture(Texture* texture);
+	bool loadIBIN(const char* filename);
+	bool saveIBIN(const char* filename);
+};
@@ -0,0 +1,69 @@
+/*  Decoding of png and jpg images from memory with the decoders vendored in extra (picopng, jpgd and stb_image).
+	jpgd writes every row straight to its final place, so flipping costs nothing. picopng and stb decode into a
+	buffer of their own: picopng always copies it row by row to the result, stb only when flipping (otherwise the
+	result keeps the buffer of stb). stb, the default decoder, does not fuse the flip: it costs one extra pass.
+	It does not depend on SDL or OpenGL, the offline tools use it too.
+	The default decoder of every format is the fastest one measured with decode_bench.
+*/
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+enum eImageFormat {
+	IMAGE_UNKNOWN = 0,
+	IMAGE_PNG,
+	IMAGE_JPG,
+	IMAGE_NUM_FORMATS
+};
+
+enum eImageDecoder {
+	DECODER_AUTO = -1,	//the preferred one for the format
+	DECODER_PICOPNG = 0,
+	DECODER_JPGD,
+	DECODER_STB,
+	NUM_IMAGE_DECODERS
+};
+
+struct sDecodedImage {
+	unsigned char* data;	//Image takes it as it is, with free_data
+	void (*free_data)(void*); //stbi_image_free for the buffer of stb, NULL if it was allocated with new[]
+	int width;
+	int height;
+	int num_channels;		//4 for png and 3 for jpg, like the old loaders
+
+	sDecodedImage() { data = NULL; free_data = NULL; width = height = num_channels = 0; }
+	void clear() { if (data) { if (free_data) free_data(data); else delete[] data; } data = NULL; free_data = NULL; }
+};
+
+//an image to decode in a batch
+struct sImageDecodeTask {
+	std::string filename;
+	bool flip_y;
+	eImageDecoder decoder;
+	bool ok;
+	size_t file_size;
+	sDecodedImage result;
+
+	sImageDecodeTask(const std::string& filename = "", bool flip_y = false, eImageDecoder decoder = DECODER_AUTO) :
+		filename(filename), flip_y(flip_y), decoder(decoder), ok(false), file_size(0) {}
+};
+
+class ImageDecoder
+{
+public:
+	static eImageDecoder preferred[IMAGE_NUM_FORMATS];
+
+	static eImageFormat detectFormat(const unsigned char* bytes, size_t size); //by the signature, not the extension
+	static const char* getName(eImageDecoder decoder);
+	static bool supports(eImageDecoder decoder, eImageFormat format);
+	static bool fusesFlip(eImageDecoder decoder); //writes the rows flipped while decoding, without an extra pass
+
+	//false if the format is not supported by that decoder or the data is corrupted. flip_y stores the last row first
+	static bool decode(const unsigned char* bytes, size_t size, bool flip_y, sDecodedImage& result, eImageDecoder decoder = DECODER_AUTO);
+	static bool decodeFile(const char* filename, bool flip_y, sDecodedImage& result, eImageDecoder decoder = DECODER_AUTO);
+
+	//decodes the files of all the tasks in the JobSystem workers (here if there are none) and waits for them
+	static void decodeAll(std::vector<sImageDecodeTask>& tasks);
+};
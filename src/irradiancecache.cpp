@@ -0,0 +1,203 @@
+#include "irradiancecache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+unsigned int hashIrradianceData(const void* data, size_t size, unsigned int hash)
+{
+	return hashMemory(data, size, hash);
+}
+
+unsigned int hashIrradianceScene(const char* scene_filename)
+{
+	unsigned int hash = 2166136261u;
+	if (!hashFile(scene_filename, hash))
+		return 0;
+	return hash;
+}
+
+static int irradianceCoeffSize(int encoding)
+{
+	return encoding == IRR_HALF ? sizeof(unsigned short) : sizeof(float);
+}
+
+bool writeIrradianceCache(const char* filename, const Vector3& start, const Vector3& end, const Vector3& delta, const Vector3& dims,
+	const SphericalHarmonics* sh, const int* nodes, int num_probes, eIrrCacheEncoding encoding, unsigned int scene_hash)
+{
+	int num_values = num_probes * 9 * 3;
+
+	//the coefficients as they will be on disk
+	std::vector<unsigned char> data(num_values * irradianceCoeffSize(encoding));
+	if (encoding == IRR_HALF)
+	{
+		unsigned short* dst = (unsigned short*)&data[0];
+		const float* src = (const float*)sh;
+		for (int i = 0; i < num_values; ++i)
+			dst[i] = floatToHalf(src[i]);
+	}
+	else
+		memcpy(&data[0], sh, data.size());
+
+	sIrrCacheHeader header = sIrrCacheHeader(); //zeroed, padding included
+	memcpy(header.magic, IRR_CACHE_MAGIC, 4);
+	header.version = IRR_CACHE_VERSION;
+	header.encoding = encoding;
+	header.num_probes = num_probes;
+	header.start = start;
+	header.end = end;
+	header.delta = delta;
+	header.dims[0] = dims.x;
+	header.dims[1] = dims.y;
+	header.dims[2] = dims.z;
+	header.scene_hash = scene_hash;
+	if (nodes && num_probes == dims.x * dims.y * dims.z)
+		nodes = NULL; //dense grid, the node of every probe is its index
+
+	//the nodes are part of the checksum too
+	int nodes_size = nodes ? num_probes * sizeof(int) : 0;
+	if (nodes_size)
+		data.insert(data.begin(), (const unsigned char*)nodes, (const unsigned char*)nodes + nodes_size);
+
+	header.data_size = data.size();
+	header.checksum = hashIrradianceData(&data[0], data.size());
+
+	FILE* f = fopen(filename, "wb");
+	if (!f)
+	{
+		std::cout << "[ERROR] cannot write irradiance cache: " << filename << std::endl;
+		return false;
+	}
+	bool ok = fwrite(&header, sizeof(header), 1, f) == 1 && fwrite(&data[0], data.size(), 1, f) == 1;
+	fclose(f);
+	return ok;
+}
+
+IrradianceCacheFile::IrradianceCacheFile()
+{
+	header = NULL;
+	nodes = NULL;
+	coeffs = NULL;
+}
+
+bool IrradianceCacheFile::open(const char* filename, unsigned int scene_hash)
+{
+	header = NULL;
+	nodes = NULL;
+	coeffs = NULL;
+	if (!file.open(filename))
+		return false;
+
+	const sIrrCacheHeader* h = (const sIrrCacheHeader*)file.data;
+	if (file.size < sizeof(sIrrCacheHeader) || memcmp(h->magic, IRR_CACHE_MAGIC, 4) != 0)
+	{
+		file.close();
+		return false;
+	}
+	if (h->version < 1 || h->version > IRR_CACHE_VERSION || (h->encoding != IRR_FLOAT32 && h->encoding != IRR_HALF))
+	{
+		std::cout << "[WARN] irradiance cache version not supported: " << filename << std::endl;
+		file.close();
+		return false;
+	}
+	int num_nodes = h->dims[0] > 0 && h->dims[1] > 0 && h->dims[2] > 0 ? h->dims[0] * h->dims[1] * h->dims[2] : 0;
+	bool sparse = h->num_probes < num_nodes;
+	int nodes_size = sparse ? h->num_probes * sizeof(int) : 0;
+	if (h->num_probes <= 0 || h->num_probes > num_nodes || (sparse && h->version < 2) ||
+		h->data_size != (unsigned int)(nodes_size + h->num_probes * 9 * 3 * irradianceCoeffSize(h->encoding)) ||
+		file.size < sizeof(sIrrCacheHeader) + h->data_size)
+	{
+		std::cout << "[WARN] irradiance cache is truncated or corrupted: " << filename << std::endl;
+		file.close();
+		return false;
+	}
+
+	const unsigned char* data = file.data + sizeof(sIrrCacheHeader);
+	if (hashIrradianceData(data, h->data_size) != h->checksum)
+	{
+		std::cout << "[WARN] irradiance cache checksum does not match: " << filename << std::endl;
+		file.close();
+		return false;
+	}
+	if (scene_hash && h->scene_hash != scene_hash)
+	{
+		std::cout << "[WARN] irradiance cache is stale, the scene has changed since it was computed: " << filename << std::endl;
+		file.close();
+		return false;
+	}
+
+	//the checksum only proves the file was written like this, the nodes index the grid later
+	if (sparse)
+		for (int i = 0; i < h->num_probes; ++i)
+		{
+			int node = ((const int*)data)[i];
+			if (node < 0 || node >= num_nodes)
+			{
+				std::cout << "[WARN] irradiance cache has a probe outside of the grid: " << filename << std::endl;
+				file.close();
+				return false;
+			}
+		}
+
+	header = h;
+	nodes = sparse ? (const int*)data : NULL;
+	coeffs = data + nodes_size;
+	return true;
+}
+
+void IrradianceCacheFile::decode(SphericalHarmonics* result) const
+{
+	int num_values = header->num_probes * 9 * 3;
+	if (header->encoding == IRR_HALF)
+	{
+		const unsigned short* src = (const unsigned short*)coeffs;
+		float* dst = (float*)result;
+		for (int i = 0; i < num_values; ++i)
+			dst[i] = halfToFloat(src[i]);
+	}
+	else
+		memcpy(result, coeffs, num_values * sizeof(float));
+}
+
+bool buildIrradianceIndirection(const int dims[3], const int* nodes, int num_probes, std::vector<float>& rows)
+{
+	int num_nodes = dims[0] * dims[1] * dims[2];
+	rows.assign(num_nodes, -1.0f);
+
+	//breadth first from every probe, so empty nodes take the closest one
+	std::vector<int> queue;
+	queue.reserve(num_nodes);
+	for (int i = 0; i < num_probes; ++i)
+	{
+		int node = nodes ? nodes[i] : i;
+		if (node < 0 || node >= num_nodes)
+		{
+			rows.clear();
+			return false;
+		}
+		rows[node] = i;
+		queue.push_back(node);
+	}
+
+	const int steps[6][3] = { {1,0,0}, {-1,0,0}, {0,1,0}, {0,-1,0}, {0,0,1}, {0,0,-1} };
+	for (size_t q = 0; q < queue.size(); ++q)
+	{
+		int node = queue[q];
+		int x = node % dims[0];
+		int y = (node / dims[0]) % dims[1];
+		int z = node / (dims[0] * dims[1]);
+		for (int i = 0; i < 6; ++i)
+		{
+			int nx = x + steps[i][0], ny = y + steps[i][1], nz = z + steps[i][2];
+			if (nx < 0 || ny < 0 || nz < 0 || nx >= dims[0] || ny >= dims[1] || nz >= dims[2])
+				continue;
+			int neighbour = nx + ny * dims[0] + nz * dims[0] * dims[1];
+			if (rows[neighbour] != -1.0f)
+				continue;
+			rows[neighbour] = rows[node];
+			queue.push_back(neighbour);
+		}
+	}
+	return true;
+}
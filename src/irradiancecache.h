@@ -0,0 +1,92 @@
+/*  On disk format of the irradiance probes (data/irradianceData/irradiance.bin).
+	A small header with the grid and a hash of the scene it was baked for, followed only by the
+	9 RGB SH coefficients of every probe in grid order, so the data can be uploaded to the probes
+	texture straight from the mapped file. Shared by the app and the offline baker, together with the
+	probe struct, so it does not depend on SDL or OpenGL.
+	When not every node of the grid has a probe (sparse placement) the grid node of every probe
+	is stored between the header and the coefficients.
+*/
+#pragma once
+
+#include "framework.h"
+#include "sphericalharmonics.h"
+#include "mappedfile.h"
+
+#include <vector>
+
+namespace GTR {
+
+	//struct to store probes
+	struct sProbe {
+		Vector3 pos; //where is located
+		Vector3 local; //its ijk pos in the matrix
+		int index; //its index in the linear array
+		SphericalHarmonics sh; //coeffs
+	};
+
+	//header of the old irradiance.bin (raw sProbe array), only read to convert old caches
+	struct sIrrHeader {
+		Vector3 start;
+		Vector3 end;
+		Vector3 delta;
+		Vector3 dims;
+		int num_probes;
+	};
+
+};
+
+#define IRR_CACHE_MAGIC "IRRC"
+#define IRR_CACHE_VERSION 2
+
+enum eIrrCacheEncoding {
+	IRR_FLOAT32 = 0,	//108 bytes per probe
+	IRR_HALF = 1		//54 bytes per probe, enough precision for diffuse lighting
+};
+
+struct sIrrCacheHeader {
+	char magic[4];
+	int version;
+	int encoding;		//eIrrCacheEncoding
+	int num_probes;		//less than dims[0] * dims[1] * dims[2] if the grid is sparse
+	Vector3 start;
+	Vector3 end;
+	Vector3 delta;
+	int dims[3];
+	unsigned int scene_hash;	//hash of the scene JSON the probes were computed for
+	unsigned int data_size;		//bytes of coefficients after the header
+	unsigned int checksum;		//of the coefficients
+};
+
+//an irradiance.bin opened with mmap, coeffs points inside the mapping
+class IrradianceCacheFile
+{
+public:
+	const sIrrCacheHeader* header;
+	const int* nodes;		//grid node of every probe, NULL if there is a probe in every node
+	const void* coeffs;
+
+	IrradianceCacheFile();
+
+	//validates magic, version, sizes and checksum. if scene_hash is not 0 it must match the one in the file
+	bool open(const char* filename, unsigned int scene_hash = 0);
+
+	//expands the coefficients of every probe to float
+	void decode(SphericalHarmonics* result) const;
+
+private:
+	MappedFile file;
+};
+
+//fnv-1a, used for the checksum and the scene hash
+unsigned int hashIrradianceData(const void* data, size_t size, unsigned int hash = 2166136261u);
+
+//hash of the contents of the scene file, 0 if it cannot be read
+unsigned int hashIrradianceScene(const char* scene_filename);
+
+//nodes can be NULL when there is a probe in every node of the grid
+bool writeIrradianceCache(const char* filename, const Vector3& start, const Vector3& end, const Vector3& delta, const Vector3& dims,
+	const SphericalHarmonics* sh, const int* nodes, int num_probes, eIrrCacheEncoding encoding, unsigned int scene_hash);
+
+//for every node of the grid the row of the nearest probe (in grid steps), as floats ready for a texture
+//false if a probe is outside of the grid
+bool buildIrradianceIndirection(const int dims[3], const int* nodes, int num_probes, std::vector<float>& rows);
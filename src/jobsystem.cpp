@@ -0,0 +1,152 @@
+#include "jobsystem.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+int JobSystem::num_workers = 0;
+double JobSystem::main_thread_budget = 4.0;
+unsigned int JobSystem::completed = 0;
+
+static std::vector<std::thread> workers;
+static std::deque<std::function<void()>> worker_jobs;
+static std::deque<std::function<void()>> main_thread_jobs;
+static std::mutex worker_mutex;
+static std::mutex main_thread_mutex;
+static std::condition_variable worker_signal;
+static std::atomic<int> pending_jobs(0);
+static bool stopping = false;
+
+static void workerLoop()
+{
+	while (true)
+	{
+		std::function<void()> job;
+		{
+			std::unique_lock<std::mutex> lock(worker_mutex);
+			worker_signal.wait(lock, []() { return stopping || !worker_jobs.empty(); });
+			if (stopping)
+				return;
+			job = std::move(worker_jobs.front());
+			worker_jobs.pop_front();
+		}
+		job();
+		pending_jobs--;
+	}
+}
+
+void JobSystem::init(int num_threads)
+{
+	if (num_workers)
+		return;
+	if (num_threads <= 0)
+		num_threads = (int)std::thread::hardware_concurrency() - 1;
+	if (num_threads <= 0)
+		num_threads = 1;
+
+	stopping = false;
+	for (int i = 0; i < num_threads; ++i)
+		workers.push_back(std::thread(workerLoop));
+	num_workers = num_threads;
+}
+
+void JobSystem::shutdown()
+{
+	{
+		std::lock_guard<std::mutex> lock(worker_mutex);
+		stopping = true;
+		pending_jobs -= worker_jobs.size();
+		worker_jobs.clear();
+	}
+	worker_signal.notify_all();
+	for (size_t i = 0; i < workers.size(); ++i)
+		workers[i].join();
+	workers.clear();
+	num_workers = 0;
+
+	std::lock_guard<std::mutex> lock(main_thread_mutex);
+	pending_jobs -= main_thread_jobs.size();
+	main_thread_jobs.clear();
+}
+
+void JobSystem::run(std::function<void()> job, std::function<void()> done)
+{
+	if (!num_workers)
+	{
+		job();
+		if (done)
+			done();
+		return;
+	}
+
+	pending_jobs++;
+	std::function<void()> task = job;
+	if (done)
+		task = [job, done]() {
+			job();
+			JobSystem::runOnMainThread(done);
+		};
+	{
+		std::lock_guard<std::mutex> lock(worker_mutex);
+		worker_jobs.push_back(task);
+	}
+	worker_signal.notify_one();
+}
+
+void JobSystem::runOnMainThread(std::function<void()> job)
+{
+	if (!num_workers)
+	{
+		job();
+		completed++;
+		return;
+	}
+
+	pending_jobs++;
+	std::lock_guard<std::mutex> lock(main_thread_mutex);
+	main_thread_jobs.push_back(job);
+}
+
+static bool runMainThreadJob()
+{
+	std::function<void()> job;
+	{
+		std::lock_guard<std::mutex> lock(main_thread_mutex);
+		if (main_thread_jobs.empty())
+			return false;
+		job = std::move(main_thread_jobs.front());
+		main_thread_jobs.pop_front();
+	}
+	job();
+	JobSystem::completed++;
+	pending_jobs--;
+	return true;
+}
+
+void JobSystem::update()
+{
+	auto start = std::chrono::steady_clock::now();
+	while (runMainThreadJob())
+	{
+		double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		if (elapsed >= main_thread_budget)
+			break;
+	}
+}
+
+int JobSystem::getPendingJobs()
+{
+	return pending_jobs;
+}
+
+void JobSystem::waitAll()
+{
+	//sleeps instead of spinning, the workers may share the core with the main thread
+	while (pending_jobs > 0)
+		if (!runMainThreadJob())
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+}
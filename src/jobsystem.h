@@ -0,0 +1,32 @@
+/*  Worker threads for the slow part of loading assets (reading files, decoding images and meshes) and a queue of
+	jobs for the main thread, where everything that touches OpenGL must run. The main thread queue is processed
+	once per frame with a time budget, so loading does not stall the rendering.
+	Until init is called there are no workers and the jobs run at once in the thread that submits them.
+*/
+#pragma once
+
+#include <functional>
+
+class JobSystem
+{
+public:
+	static int num_workers;
+	static double main_thread_budget;	//ms per frame for the main thread jobs
+	static unsigned int completed;		//main thread jobs done, changes whenever some asset has arrived
+
+	static void init(int num_threads = 0);	//0 uses every core but the main one
+	static void shutdown();					//waits for the running jobs, the pending ones are dropped
+
+	//job runs in a worker and then done (if any) is queued for the main thread
+	static void run(std::function<void()> job, std::function<void()> done = nullptr);
+	static void runOnMainThread(std::function<void()> job);
+
+	//main thread: runs queued jobs until the budget is spent (at least one)
+	static void update();
+
+	//jobs submitted and not finished yet, including the main thread ones
+	static int getPendingJobs();
+
+	//blocks until everything is loaded, running the main thread jobs without budget
+	static void waitAll();
+};
@@ -15,6 +15,9 @@
 #include "utils.h"
 #include "input.h"
 #include "application.h"
+#include "jobsystem.h"
+#include "headless.h"
+#include "profiler.h"
 
 #include <iostream> //to output
 
@@ -130,7 +133,10 @@ void mainLoop(SDL_Window* window)
 		//render frame
 		app->render();
 		if (app->render_gui)
+		{
+			PROFILE_GPU_SCOPE("gui");
 			renderDebug(window, app);
+		}
 		// swap between front buffer and back buffer
 		SDL_GL_SwapWindow(window);
 
@@ -210,6 +216,11 @@ int main(int argc, char **argv)
 {
 	std::cout << "Initiating app..." << std::endl;
 
+	//no window, renders the camera path offscreen and writes the timings
+	sBenchmarkSettings benchmark;
+	if (benchmark.parse(argc, argv))
+		return Headless::runBenchmark(benchmark);
+
 	//prepare SDL
 	SDL_Init(SDL_INIT_EVERYTHING);
 
@@ -249,6 +260,8 @@ int main(int argc, char **argv)
 
 	//main loop, application gets inside here till user closes it
 	mainLoop(window);
+	Profiler::shutdown();
+	JobSystem::shutdown();
 
 	//save state and free memory
 	// Cleanup
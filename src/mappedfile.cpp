@@ -0,0 +1,190 @@
+#include "mappedfile.h"
+
+#ifdef WIN32
+	#include <windows.h>
+#else
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+#endif
+
+#include <cstring>
+
+MappedFile::MappedFile()
+{
+	data = NULL;
+	size = 0;
+	file_handle = NULL;
+	mapping_handle = NULL;
+}
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+bool MappedFile::open(const char* filename)
+{
+	close();
+
+#ifdef WIN32
+	HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0)
+	{
+		CloseHandle(file);
+		return false;
+	}
+	HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	void* view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+	if (!view)
+	{
+		if (mapping)
+			CloseHandle(mapping);
+		CloseHandle(file);
+		return false;
+	}
+	file_handle = file;
+	mapping_handle = mapping;
+	size = (size_t)file_size.QuadPart;
+	data = (const unsigned char*)view;
+#else
+	int fd = ::open(filename, O_RDONLY);
+	if (fd == -1)
+		return false;
+	struct stat info;
+	if (fstat(fd, &info) != 0 || info.st_size == 0)
+	{
+		::close(fd);
+		return false;
+	}
+	void* view = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd); //the mapping keeps the file alive
+	if (view == MAP_FAILED)
+		return false;
+	size = (size_t)info.st_size;
+	data = (const unsigned char*)view;
+#endif
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (!data)
+		return;
+#ifdef WIN32
+	UnmapViewOfFile(data);
+	CloseHandle((HANDLE)mapping_handle);
+	CloseHandle((HANDLE)file_handle);
+	file_handle = NULL;
+	mapping_handle = NULL;
+#else
+	munmap((void*)data, size);
+#endif
+	data = NULL;
+	size = 0;
+}
+
+unsigned int hashMemory(const void* data, size_t size, unsigned int hash)
+{
+	const unsigned char* bytes = (const unsigned char*)data;
+	for (size_t i = 0; i < size; ++i)
+	{
+		hash ^= bytes[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+#define HASH64_PRIME1 11400714785074694791ULL
+#define HASH64_PRIME2 14029467366897019727ULL
+#define HASH64_PRIME3 1609587929392839161ULL
+#define HASH64_PRIME4 9650029242287828579ULL
+#define HASH64_PRIME5 2870177450012600261ULL
+
+static inline unsigned long long rotl64(unsigned long long x, int r)
+{
+	return (x << r) | (x >> (64 - r));
+}
+
+static inline unsigned long long read64(const unsigned char* p)
+{
+	unsigned long long v;
+	memcpy(&v, p, 8);
+	return v;
+}
+
+static inline unsigned long long round64(unsigned long long acc, unsigned long long input)
+{
+	acc += input * HASH64_PRIME2;
+	return rotl64(acc, 31) * HASH64_PRIME1;
+}
+
+static inline unsigned long long merge64(unsigned long long acc, unsigned long long val)
+{
+	acc ^= round64(0, val);
+	return acc * HASH64_PRIME1 + HASH64_PRIME4;
+}
+
+unsigned long long hashMemory64(const void* data, size_t size, unsigned long long seed)
+{
+	const unsigned char* p = (const unsigned char*)data;
+	const unsigned char* end = p + size;
+	unsigned long long hash;
+
+	if (size >= 32)
+	{
+		//four independent lanes
+		unsigned long long v1 = seed + HASH64_PRIME1 + HASH64_PRIME2;
+		unsigned long long v2 = seed + HASH64_PRIME2;
+		unsigned long long v3 = seed;
+		unsigned long long v4 = seed - HASH64_PRIME1;
+		for (; p + 32 <= end; p += 32)
+		{
+			v1 = round64(v1, read64(p));
+			v2 = round64(v2, read64(p + 8));
+			v3 = round64(v3, read64(p + 16));
+			v4 = round64(v4, read64(p + 24));
+		}
+		hash = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+		hash = merge64(hash, v1);
+		hash = merge64(hash, v2);
+		hash = merge64(hash, v3);
+		hash = merge64(hash, v4);
+	}
+	else
+		hash = seed + HASH64_PRIME5;
+
+	hash += (unsigned long long)size;
+	for (; p + 8 <= end; p += 8)
+		hash = rotl64(hash ^ round64(0, read64(p)), 27) * HASH64_PRIME1 + HASH64_PRIME4;
+	if (p + 4 <= end)
+	{
+		unsigned int v;
+		memcpy(&v, p, 4);
+		hash = rotl64(hash ^ (v * HASH64_PRIME1), 23) * HASH64_PRIME2 + HASH64_PRIME3;
+		p += 4;
+	}
+	for (; p < end; ++p)
+		hash = rotl64(hash ^ (*p * HASH64_PRIME5), 11) * HASH64_PRIME1;
+
+	//avalanche
+	hash ^= hash >> 33;
+	hash *= HASH64_PRIME2;
+	hash ^= hash >> 29;
+	hash *= HASH64_PRIME3;
+	hash ^= hash >> 32;
+	return hash;
+}
+
+bool hashFile(const char* filename, unsigned int& hash)
+{
+	MappedFile file;
+	if (!filename || !file.open(filename))
+		return false;
+	hash = hashMemory(file.data, file.size, hash);
+	return true;
+}
@@ -0,0 +1,36 @@
+/*  Read only view of a whole file mapped in memory, so big binary caches can be used without copying them.
+	It does not depend on SDL or OpenGL, the offline tools use it too.
+*/
+#pragma once
+
+#include <cstddef>
+
+class MappedFile
+{
+public:
+	const unsigned char* data;
+	size_t size;
+
+	MappedFile();
+	~MappedFile();
+
+	//maps the file, returns false if it does not exist or is empty
+	bool open(const char* filename);
+	void close();
+
+private:
+	void* file_handle;		//only used under windows
+	void* mapping_handle;
+
+	MappedFile(const MappedFile&);
+	MappedFile& operator=(const MappedFile&);
+};
+
+//fnv-1a, pass the previous result as hash to chain several blocks
+unsigned int hashMemory(const void* data, size_t size, unsigned int hash = 2166136261u);
+
+//64 bits, 8 bytes at a time (the xxhash64 rounds), to find identical assets. pass the previous result as seed to chain blocks
+unsigned long long hashMemory64(const void* data, size_t size, unsigned long long seed = 0);
+
+//adds the contents of the file to hash, false if it cannot be read
+bool hashFile(const char* filename, unsigned int& hash);
@@ -3,6 +3,7 @@
 
 #include "includes.h"
 #include "texture.h"
+#include "shader.h"
 
 using namespace GTR;
 
@@ -40,6 +41,17 @@ Material::~Material()
 	}
 }
 
+void Material::updateShaderFeatures()
+{
+	shader_features = 0;
+	if (normal_texture.texture)
+		shader_features |= SHADER_NORMAL_MAP;
+	if (metallic_roughness_texture.texture)
+		shader_features |= SHADER_OMR_MAP;
+	if (emissive_texture.texture)
+		shader_features |= SHADER_EMISSIVE_MAP;
+}
+
 void Material::Release()
 {
 	std::vector<Material *>mats;
@@ -73,5 +85,17 @@ void Material::renderInMenu()
 		ImGui::Image((void*)(intptr_t)color_texture.texture->texture_id, ImVec2(w, w * aspect));
 		ImGui::TreePop();
 	}
+	if (ImGui::TreeNode("Textures"))
+	{
+		Sampler* samplers[] = { &color_texture, &emissive_texture, &opacity_texture, &metallic_roughness_texture, &occlusion_texture, &normal_texture };
+		const char* names[] = { "Color", "Emissive", "Opacity", "Metallic roughness", "Occlusion", "Normal" };
+		for (int i = 0; i < 6; ++i)
+			if (samplers[i]->texture)
+			{
+				ImGui::Text("%s", names[i]);
+				samplers[i]->texture->debugInMenu();
+			}
+		ImGui::TreePop();
+	}
 #endif
 }
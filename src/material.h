@@ -64,8 +64,10 @@ namespace GTR {
 		Sampler occlusion_texture;	//which areas receive ambient light
 		Sampler normal_texture;	//normalmap
 
+		unsigned int shader_features; //eShaderFeature of the maps it has, to pick the shader variants
+
 		//ctors
-		Material() : alpha_mode(NO_ALPHA), alpha_cutoff(0.5), color(1, 1, 1, 1), _zMin(0.0f), _zMax(1.0f), two_sided(false), roughness_factor(1), metallic_factor(0) {
+		Material() : alpha_mode(NO_ALPHA), alpha_cutoff(0.5), color(1, 1, 1, 1), _zMin(0.0f), _zMax(1.0f), two_sided(false), roughness_factor(1), metallic_factor(0), shader_features(0) {
 			//color_texture = emissive_texture = metallic_roughness_texture = occlusion_texture = normal_texture = NULL;
 		}
 		Material(Texture* texture) : Material() { color_texture.texture = texture; }
@@ -73,6 +75,8 @@ namespace GTR {
 
 		static void Release();
 
+		void updateShaderFeatures(); //after the textures are set
+
 		void renderInMenu();
 	};
 };
\ No newline at end of file
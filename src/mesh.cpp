@@ -4,8 +4,14 @@
 #include "shader.h"
 #include "includes.h"
 #include "framework.h"
+#include "mappedfile.h"
+#include "meshoptimize.h"
+#include "renderstats.h"
+#include "vram.h"
 
 #include <cassert>
+#include <cfloat>
+#include <cstddef>
 #include <iostream>
 #include <limits>
 #include <sys/stat.h>
@@ -20,8 +26,11 @@
 bool Mesh::use_binary = false;			//checks if there is .wbin, it there is one tries to read it instead of the other file
 bool Mesh::auto_upload_to_vram = true;	//uploads the mesh to the GPU VRAM to speed up rendering
 bool Mesh::interleave_meshes = true;	//places the geometry in an interleaved array
+bool Mesh::quantize_meshes = false;	//compressed vertices in VRAM, half the bandwidth
+bool Mesh::optimize_meshes = true;	//index, vertex cache and overdraw order when importing (stored in the .mbin)
 
 std::map<std::string, Mesh*> Mesh::sMeshesLoaded;
+std::map<unsigned long long, Mesh*> Mesh::sMeshesByHash;
 long Mesh::num_meshes_rendered = 0;
 long Mesh::num_triangles_rendered = 0;
 
@@ -30,11 +39,53 @@ long Mesh::num_triangles_rendered = 0;
 #define FORMAT_MBIN 3
 #define FORMAT_MESH 4
 
+//streams of a .mbin, in the order they are stored
+enum eMeshBinStream {
+	MBIN_VERTICES, //or interleaved
+	MBIN_NORMALS,
+	MBIN_UVS,
+	MBIN_COLORS,
+	MBIN_INDICES,
+	MBIN_BONES,
+	MBIN_WEIGHTS,
+	MBIN_UVS1,
+	MBIN_BONES_INFO,
+	MBIN_SUBMESHES,
+	MBIN_NUM_STREAMS
+};
+
+#define MBIN_ALIGNMENT 16
+
+typedef struct 
+{
+	int version;
+	int header_bytes;
+	int size;
+	int num_indices;
+	Vector3 aabb_min;
+	Vector3	aabb_max;
+	Vector3	center;
+	Vector3	halfsize;
+	float radius;
+	float uv_density;
+	int num_bones;
+	int num_submeshes;
+	Matrix44 bind_matrix;
+	char streams[8]; //Vertex/Interlaved|Normal|Uvs|Color|Indices|Bones|Weights|Extra|Uvs1
+	unsigned int stream_offsets[MBIN_NUM_STREAMS]; //from the start of the file, aligned to MBIN_ALIGNMENT, 0 if not present
+	unsigned int file_size;
+	char extra[28]; //unused
+} sMeshInfo;
+
 Mesh::Mesh()
 {
 	radius = 0;
+	uv_density = 0;
 	vertices_vbo_id = uvs_vbo_id = uvs1_vbo_id = normals_vbo_id = colors_vbo_id = interleaved_vbo_id = indices_vbo_id = bones_vbo_id = weights_vbo_id = 0;
 	collision_model = NULL;
+	bin_file = NULL;
+	content_hash = 0;
+	num_duplicates = 0;
 
 	clear();
 }
@@ -91,6 +142,7 @@ void Mesh::clear()
 
 	//VBOs ids
 	vertices_vbo_id = uvs_vbo_id = normals_vbo_id = colors_vbo_id = interleaved_vbo_id = indices_vbo_id = weights_vbo_id = bones_vbo_id = uvs1_vbo_id = 0;
+	VRAM::untrack(this);
 
 	//buffers
 	vertices.clear();
@@ -105,6 +157,22 @@ void Mesh::clear()
 
 	if (collision_model)
 		delete (CollisionModel3D*)collision_model;
+	collision_model = NULL;
+
+	delete bin_file;
+	bin_file = NULL;
+	num_vram_vertices = num_vram_indices = 0;
+	quantized = false;
+	index_type = GL_UNSIGNED_INT;
+
+	if (content_hash)
+	{
+		auto it = sMeshesByHash.find(content_hash);
+		if (it != sMeshesByHash.end() && it->second == this)
+			sMeshesByHash.erase(it);
+		content_hash = 0;
+	}
+	num_duplicates = 0;
 }
 
 int vertex_location = -1;
@@ -124,68 +192,103 @@ void Mesh::enableBuffers(Shader* sh)
 		return;
 	*/
 
-	int spacing = 0;
-	int offset_normal = 0;
-	int offset_uv = 0;
-
-	if (interleaved.size())
+	//tells the vertex shader how to decode the vertex
+	sh->setUniform1("u_quantized", quantized);
+	if (quantized)
 	{
-		spacing = sizeof(tInterleaved);
-		offset_normal = sizeof(Vector3);
-		offset_uv = sizeof(Vector3) + sizeof(Vector3);
+		sh->setUniform3("u_quantize_min", quantize_min);
+		sh->setUniform3("u_quantize_range", quantize_range);
 	}
 
-	if (vertex_location != -1)
+	normal_location = -1;
+	uv_location = -1;
+	if (quantized)
 	{
-		glEnableVertexAttribArray(vertex_location);
-		if (vertices_vbo_id || interleaved_vbo_id)
+		glBindBuffer(GL_ARRAY_BUFFER, interleaved_vbo_id);
+		if (vertex_location != -1)
 		{
-			glBindBuffer(GL_ARRAY_BUFFER, interleaved_vbo_id ? interleaved_vbo_id : vertices_vbo_id);
-			glVertexAttribPointer(vertex_location, 3, GL_FLOAT, GL_FALSE, spacing, 0);
+			glEnableVertexAttribArray(vertex_location);
+			glVertexAttribPointer(vertex_location, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(tQuantized), (void*)offsetof(tQuantized, position));
 		}
-		else
-			glVertexAttribPointer(vertex_location, 3, GL_FLOAT, GL_FALSE, spacing, interleaved.size() ? &interleaved[0].vertex : &vertices[0]);
-		checkGLErrors();
-	}
-
-	normal_location = -1;
-	if (normals.size() || spacing)
-	{
 		normal_location = sh->getAttribLocation("a_normal");
 		if (normal_location != -1)
 		{
 			glEnableVertexAttribArray(normal_location);
-			if (normals_vbo_id || interleaved_vbo_id)
-			{
-				glBindBuffer(GL_ARRAY_BUFFER, interleaved_vbo_id ? interleaved_vbo_id : normals_vbo_id);
-				glVertexAttribPointer(normal_location, 3, GL_FLOAT, GL_FALSE, spacing, (void*)offset_normal);
-			}
-			else
-				glVertexAttribPointer(normal_location, 3, GL_FLOAT, GL_FALSE, spacing, interleaved.size() ? &interleaved[0].normal : &normals[0]);
+			glVertexAttribPointer(normal_location, 2, GL_SHORT, GL_TRUE, sizeof(tQuantized), (void*)offsetof(tQuantized, normal));
 		}
-		checkGLErrors();
-	}
-
-	uv_location = -1;
-	if (uvs.size() || spacing)
-	{
 		uv_location = sh->getAttribLocation("a_coord");
 		if (uv_location != -1)
 		{
 			glEnableVertexAttribArray(uv_location);
-			if (uvs_vbo_id || interleaved_vbo_id)
+			glVertexAttribPointer(uv_location, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(tQuantized), (void*)offsetof(tQuantized, uv));
+		}
+		checkGLErrors();
+	}
+	else
+	{
+		int spacing = 0;
+		int offset_normal = 0;
+		int offset_uv = 0;
+
+		if (interleaved.size() || interleaved_vbo_id)
+		{
+			spacing = sizeof(tInterleaved);
+			offset_normal = sizeof(Vector3);
+			offset_uv = sizeof(Vector3) + sizeof(Vector3);
+		}
+
+		if (vertex_location != -1)
+		{
+			glEnableVertexAttribArray(vertex_location);
+			if (vertices_vbo_id || interleaved_vbo_id)
 			{
-				glBindBuffer(GL_ARRAY_BUFFER, interleaved_vbo_id ? interleaved_vbo_id : uvs_vbo_id);
-				glVertexAttribPointer(uv_location, 2, GL_FLOAT, GL_FALSE, spacing, (void*)offset_uv);
+				glBindBuffer(GL_ARRAY_BUFFER, interleaved_vbo_id ? interleaved_vbo_id : vertices_vbo_id);
+				glVertexAttribPointer(vertex_location, 3, GL_FLOAT, GL_FALSE, spacing, 0);
 			}
 			else
-				glVertexAttribPointer(uv_location, 2, GL_FLOAT, GL_FALSE, spacing, interleaved.size() ? &interleaved[0].uv : &uvs[0]);
+				glVertexAttribPointer(vertex_location, 3, GL_FLOAT, GL_FALSE, spacing, interleaved.size() ? &interleaved[0].vertex : &vertices[0]);
+			checkGLErrors();
+		}
+
+		normal_location = -1;
+		if (normals.size() || normals_vbo_id || spacing)
+		{
+			normal_location = sh->getAttribLocation("a_normal");
+			if (normal_location != -1)
+			{
+				glEnableVertexAttribArray(normal_location);
+				if (normals_vbo_id || interleaved_vbo_id)
+				{
+					glBindBuffer(GL_ARRAY_BUFFER, interleaved_vbo_id ? interleaved_vbo_id : normals_vbo_id);
+					glVertexAttribPointer(normal_location, 3, GL_FLOAT, GL_FALSE, spacing, (void*)offset_normal);
+				}
+				else
+					glVertexAttribPointer(normal_location, 3, GL_FLOAT, GL_FALSE, spacing, interleaved.size() ? &interleaved[0].normal : &normals[0]);
+			}
+			checkGLErrors();
+		}
+
+		uv_location = -1;
+		if (uvs.size() || uvs_vbo_id || spacing)
+		{
+			uv_location = sh->getAttribLocation("a_coord");
+			if (uv_location != -1)
+			{
+				glEnableVertexAttribArray(uv_location);
+				if (uvs_vbo_id || interleaved_vbo_id)
+				{
+					glBindBuffer(GL_ARRAY_BUFFER, interleaved_vbo_id ? interleaved_vbo_id : uvs_vbo_id);
+					glVertexAttribPointer(uv_location, 2, GL_FLOAT, GL_FALSE, spacing, (void*)offset_uv);
+				}
+				else
+					glVertexAttribPointer(uv_location, 2, GL_FLOAT, GL_FALSE, spacing, interleaved.size() ? &interleaved[0].uv : &uvs[0]);
+			}
+			checkGLErrors();
 		}
-		checkGLErrors();
 	}
 
 	uv1_location = -1;
-	if (m_uvs1.size())
+	if (m_uvs1.size() || uvs1_vbo_id)
 	{
 		uv1_location = sh->getAttribLocation("a_coord1");
 		if (uv1_location != -1)
@@ -203,7 +306,7 @@ void Mesh::enableBuffers(Shader* sh)
 	}
 
 	color_location = -1;
-	if (colors.size())
+	if (colors.size() || colors_vbo_id)
 	{
 		color_location = sh->getAttribLocation("a_color");
 		if (color_location != -1)
@@ -221,7 +324,7 @@ void Mesh::enableBuffers(Shader* sh)
 	}
 
 	bones_location = -1;
-	if (bones.size())
+	if (bones.size() || bones_vbo_id)
 	{
 		bones_location = sh->getAttribLocation("a_bones");
 		if (bones_location != -1)
@@ -237,7 +340,7 @@ void Mesh::enableBuffers(Shader* sh)
 		}
 	}
 	weights_location = -1;
-	if (weights.size())
+	if (weights.size() || weights_vbo_id)
 	{
 		weights_location = sh->getAttribLocation("a_weights");
 		if (weights_location != -1)
@@ -265,7 +368,7 @@ void Mesh::render(unsigned int primitive, int submesh_id, int num_instances)
 		assert(0 && "no shader or shader not compiled or enabled");
 		return;
 	}
-	assert((interleaved.size() || vertices.size()) && "No vertices in this mesh");
+	assert(getNumVertices() && "No vertices in this mesh");
 
 	//bind buffers to attribute locations
 	enableBuffers(shader);
@@ -282,31 +385,28 @@ void Mesh::render(unsigned int primitive, int submesh_id, int num_instances)
 
 void Mesh::drawCall(unsigned int primitive, int submesh_id, int num_instances)
 {
-	int start = 0; //in primitives
-	int size = (int)vertices.size();
-	if (m_indices.size())
-		size = (int)m_indices.size();
-	else
-	if (interleaved.size())
-		size = (int)interleaved.size();
+	int start = 0; //in indices, or vertices when there are no indices
+	int num_indices = getNumIndices();
+	int size = num_indices ? num_indices : getNumVertices();
+	int index_bytes = index_type == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int);
 
 	if (submesh_id > -1)
 	{
 		assert(submesh_id < submeshes.size() && "this mesh doesnt have as many submeshes");
 		sSubmeshInfo& submesh = submeshes[submesh_id];
 		start = submesh.start;
-		size = submesh.start + submesh.length;
+		size = submesh.length;
 	}
 
 	//DRAW
-	if (m_indices.size())
+	if (num_indices)
 	{
 		if (num_instances > 0)
 		{
 			assert(indices_vbo_id && "indices must be uploaded to the GPU");
 			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indices_vbo_id);
 			#ifdef OPENGL_ES3
-				glDrawElementsInstanced(primitive, size, GL_UNSIGNED_INT, (void*)(start + sizeof(Vector3u)), num_instances);
+				glDrawElementsInstanced(primitive, size, index_type, (void*)((size_t)start * index_bytes), num_instances);
             #else
 				assert(0 && "not supported in OpenGL ES2");
             #endif
@@ -318,13 +418,13 @@ void Mesh::drawCall(unsigned int primitive, int submesh_id, int num_instances)
 			{
 				/*if (size != 90)*/ {
 					glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indices_vbo_id);
-					glDrawElements(primitive, size, GL_UNSIGNED_INT,(void *) (start * sizeof(Vector3u)));
+					glDrawElements(primitive, size, index_type, (void*)((size_t)start * index_bytes));
 					glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 				}
 				checkGLErrors();
 			}
 			else
-				glDrawElements(primitive, size, GL_UNSIGNED_INT, (void*)(&m_indices[0] + start)); //no multiply, its a vector3u pointer)
+				glDrawElements(primitive, size, GL_UNSIGNED_INT, (void*)(&m_indices[0] + start)); //no multiply, its an unsigned int pointer
 		}
 	}
 	else
@@ -343,6 +443,8 @@ void Mesh::drawCall(unsigned int primitive, int submesh_id, int num_instances)
 
 	num_triangles_rendered += (size / 3) * (num_instances ? num_instances : 1);
 	num_meshes_rendered++;
+	RenderStats::add(STAT_DRAW_CALLS);
+	RenderStats::add(STAT_TRIANGLES, (size / 3) * (num_instances ? num_instances : 1));
 }
 
 void Mesh::disableBuffers(Shader* shader)
@@ -499,6 +601,98 @@ void Mesh::renderAnimated( unsigned int primitive, Skeleton* skeleton )
 #define GL_ARRAY_BUFFER_ARB GL_ARRAY_BUFFER
 #define GL_STATIC_DRAW_ARB GL_STATIC_DRAW
 
+//16 bits indices when every vertex can be addressed with them, returns the index type
+static unsigned int uploadMeshIndices(unsigned int& vbo_id, const unsigned int* indices, int num_indices, int num_vertices)
+{
+	unsigned int type = GL_UNSIGNED_INT;
+	if (vbo_id == 0)
+		glGenBuffersARB(1, &vbo_id);
+	glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER, vbo_id);
+	if (num_vertices <= 65536)
+	{
+		std::vector<unsigned short> short_indices(indices, indices + num_indices);
+		glBufferDataARB(GL_ELEMENT_ARRAY_BUFFER, num_indices * sizeof(unsigned short), &short_indices[0], GL_STATIC_DRAW_ARB);
+		type = GL_UNSIGNED_SHORT;
+	}
+	else
+		glBufferDataARB(GL_ELEMENT_ARRAY_BUFFER, num_indices * sizeof(unsigned int), indices, GL_STATIC_DRAW_ARB);
+	glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER, 0);
+	return type;
+}
+
+static void deleteMeshBuffer(unsigned int& vbo_id)
+{
+	if (vbo_id)
+		glDeleteBuffers(1, &vbo_id);
+	vbo_id = 0;
+}
+
+bool Mesh::uploadQuantized()
+{
+	bool is_interleaved = interleaved.size() > 0;
+	int num_vertices = is_interleaved ? interleaved.size() : vertices.size();
+	if (!is_interleaved && normals.size() != vertices.size())
+		return false;
+
+	//positions are stored relative to their bounds
+	Vector3 min_pos(FLT_MAX, FLT_MAX, FLT_MAX);
+	Vector3 max_pos(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	for (int i = 0; i < num_vertices; ++i)
+	{
+		const Vector3& pos = is_interleaved ? interleaved[i].vertex : vertices[i];
+		for (int k = 0; k < 3; ++k)
+		{
+			min_pos.v[k] = pos.v[k] < min_pos.v[k] ? pos.v[k] : min_pos.v[k];
+			max_pos.v[k] = pos.v[k] > max_pos.v[k] ? pos.v[k] : max_pos.v[k];
+		}
+	}
+	quantize_min = min_pos;
+	quantize_range = max_pos - min_pos;
+
+	std::vector<tQuantized> data(num_vertices);
+	for (int i = 0; i < num_vertices; ++i)
+	{
+		const Vector3& pos = is_interleaved ? interleaved[i].vertex : vertices[i];
+		Vector3 normal = is_interleaved ? interleaved[i].normal : normals[i];
+		Vector2 uv = is_interleaved ? interleaved[i].uv : (uvs.size() ? uvs[i] : Vector2());
+		tQuantized& q = data[i];
+
+		for (int k = 0; k < 3; ++k)
+		{
+			float t = quantize_range.v[k] > 0.0f ? (pos.v[k] - quantize_min.v[k]) / quantize_range.v[k] : 0.0f;
+			q.position[k] = (unsigned short)(clamp(t, 0.0f, 1.0f) * 65535.0f + 0.5f);
+		}
+		q.position[3] = 0;
+
+		//octahedral encoding, the lower hemisphere is folded into the corners
+		float l1 = fabs(normal.x) + fabs(normal.y) + fabs(normal.z);
+		float ox = l1 > 0.0f ? normal.x / l1 : 0.0f;
+		float oy = l1 > 0.0f ? normal.y / l1 : 0.0f;
+		if (normal.z < 0.0f)
+		{
+			float fx = (1.0f - fabs(oy)) * (ox >= 0.0f ? 1.0f : -1.0f);
+			float fy = (1.0f - fabs(ox)) * (oy >= 0.0f ? 1.0f : -1.0f);
+			ox = fx;
+			oy = fy;
+		}
+		q.normal[0] = (short)floor(clamp(ox, -1.0f, 1.0f) * 32767.0f + 0.5f);
+		q.normal[1] = (short)floor(clamp(oy, -1.0f, 1.0f) * 32767.0f + 0.5f);
+
+		q.uv[0] = floatToHalf(uv.x);
+		q.uv[1] = floatToHalf(uv.y);
+	}
+
+	if (interleaved_vbo_id == 0)
+		glGenBuffersARB(1, &interleaved_vbo_id);
+	glBindBufferARB(GL_ARRAY_BUFFER_ARB, interleaved_vbo_id);
+	glBufferDataARB(GL_ARRAY_BUFFER_ARB, data.size() * sizeof(tQuantized), &data[0], GL_STATIC_DRAW_ARB);
+	deleteMeshBuffer(vertices_vbo_id);
+	deleteMeshBuffer(normals_vbo_id);
+	deleteMeshBuffer(uvs_vbo_id);
+	quantized = true;
+	return true;
+}
+
 void Mesh::uploadToVRAM()
 {
 	assert(vertices.size() || interleaved.size());
@@ -509,7 +703,16 @@ void Mesh::uploadToVRAM()
 		exit(0);
 	}
 
-	if (interleaved.size())
+	//the streams are final here, so the .mbin written after this stores it too
+	updateUVDensity();
+
+	//it can be uploaded again after changing quantize_meshes
+	quantized = false;
+	if (quantize_meshes && uploadQuantized())
+	{
+		//position, normal and uv are in one compressed buffer
+	}
+	else if (interleaved.size())
 	{
 		// Vertex,Normal,UV
 		if (interleaved_vbo_id == 0)
@@ -524,6 +727,7 @@ void Mesh::uploadToVRAM()
 			glGenBuffersARB(1, &vertices_vbo_id);
 		glBindBufferARB(GL_ARRAY_BUFFER_ARB, vertices_vbo_id);
 		glBufferDataARB(GL_ARRAY_BUFFER_ARB, vertices.size() * sizeof(Vector3), &vertices[0], GL_STATIC_DRAW_ARB);
+		deleteMeshBuffer(interleaved_vbo_id);
 
 		// UVs
 		if (uvs.size())
@@ -581,18 +785,31 @@ void Mesh::uploadToVRAM()
 
 	// Indices
 	if (m_indices.size())
-	{
-		if (indices_vbo_id == 0)
-			glGenBuffersARB(1, &indices_vbo_id);
-		glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER, indices_vbo_id);
-		glBufferDataARB(GL_ELEMENT_ARRAY_BUFFER, m_indices.size() * sizeof(unsigned int), &m_indices[0], GL_STATIC_DRAW_ARB);
-	}
-	glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER, 0);
+		index_type = uploadMeshIndices(indices_vbo_id, &m_indices[0], m_indices.size(), getNumVertices());
 
 	checkGLErrors();
+	updateVRAM();
 	//clear buffers to save memory
 }
 
+void Mesh::updateVRAM()
+{
+	//the size of the buffers as GL has them, whatever the layout or the quantization
+	GLuint ids[] = { vertices_vbo_id, uvs_vbo_id, uvs1_vbo_id, normals_vbo_id, colors_vbo_id, interleaved_vbo_id, indices_vbo_id, bones_vbo_id, weights_vbo_id };
+	size_t bytes = 0;
+	for (int i = 0; i < (int)(sizeof(ids) / sizeof(GLuint)); ++i)
+	{
+		if (!ids[i])
+			continue;
+		GLint size = 0;
+		glBindBuffer(GL_ARRAY_BUFFER, ids[i]);
+		glGetBufferParameteriv(GL_ARRAY_BUFFER, GL_BUFFER_SIZE, &size);
+		bytes += size;
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	VRAM::track(this, VRAM_MESHES, bytes, name);
+}
+
 bool Mesh::createCollisionModel(bool is_static)
 {
 	if (collision_model)
@@ -643,6 +860,24 @@ bool Mesh::createCollisionModel(bool is_static)
 			collision_model->addTriangle(v1.v, v2.v, v3.v);
 		}
 	}
+	else if (bin_file) //the streams are only in VRAM, take the positions from the mapped file
+	{
+		sMeshInfo info;
+		memcpy(&info, bin_file->data + 4, sizeof(sMeshInfo));
+		const unsigned char* positions = bin_file->data + info.stream_offsets[MBIN_VERTICES];
+		int stride = info.streams[0] == 'I' ? sizeof(tInterleaved) : sizeof(Vector3);
+		const unsigned int* indices = info.streams[4] == 'I' ? (const unsigned int*)(bin_file->data + info.stream_offsets[MBIN_INDICES]) : NULL;
+		int num = indices ? info.num_indices : info.size;
+
+		collision_model->setTriangleNumber(num / 3);
+		for (int i = 0; i + 2 < num; i += 3)
+		{
+			const float* v1 = (const float*)(positions + (indices ? indices[i + 0] : i + 0) * stride);
+			const float* v2 = (const float*)(positions + (indices ? indices[i + 1] : i + 1) * stride);
+			const float* v3 = (const float*)(positions + (indices ? indices[i + 2] : i + 2) * stride);
+			collision_model->addTriangle(v1[0], v1[1], v1[2], v2[0], v2[1], v2[2], v3[0], v3[1], v3[2]);
+		}
+	}
 	else
 	{
 		assert(0 && "mesh without vertices, cannot create collision model");
@@ -712,6 +947,89 @@ bool Mesh::testSphereCollision(Matrix44 model, Vector3 center, float radius, Vec
 	return true;
 }
 
+//copies every element of a stream to its place in the packed vertices
+template<typename T> static void packVertexStream(std::vector<unsigned char>& packed, int stride, int& offset, const std::vector<T>& stream)
+{
+	if (stream.empty())
+		return;
+	for (size_t i = 0; i < stream.size(); ++i)
+		memcpy(&packed[i * stride + offset], &stream[i], sizeof(T));
+	offset += sizeof(T);
+}
+
+bool Mesh::optimize(bool verbose)
+{
+	int num_vertices = interleaved.size() ? interleaved.size() : vertices.size();
+	if (num_vertices < 3)
+		return false;
+
+	std::vector<unsigned int> remap;
+	if (m_indices.empty())
+	{
+		//triangle soup, the vertices with all the attributes equal become one
+		int stride = (interleaved.size() ? sizeof(tInterleaved) : 0) + (vertices.size() ? sizeof(Vector3) : 0) + (normals.size() ? sizeof(Vector3) : 0) +
+			(uvs.size() ? sizeof(Vector2) : 0) + (m_uvs1.size() ? sizeof(Vector2) : 0) + (colors.size() ? sizeof(Vector4) : 0) +
+			(bones.size() ? sizeof(Vector4ub) : 0) + (weights.size() ? sizeof(Vector4) : 0);
+		std::vector<unsigned char> packed(num_vertices * stride, 0);
+		int offset = 0;
+		packVertexStream(packed, stride, offset, interleaved);
+		packVertexStream(packed, stride, offset, vertices);
+		packVertexStream(packed, stride, offset, normals);
+		packVertexStream(packed, stride, offset, uvs);
+		packVertexStream(packed, stride, offset, m_uvs1);
+		packVertexStream(packed, stride, offset, colors);
+		packVertexStream(packed, stride, offset, bones);
+		packVertexStream(packed, stride, offset, weights);
+
+		int unique = weldVertices(&packed[0], stride, num_vertices, remap);
+		m_indices = remap;
+		remapVertexStream(interleaved, remap, unique);
+		remapVertexStream(vertices, remap, unique);
+		remapVertexStream(normals, remap, unique);
+		remapVertexStream(uvs, remap, unique);
+		remapVertexStream(m_uvs1, remap, unique);
+		remapVertexStream(colors, remap, unique);
+		remapVertexStream(bones, remap, unique);
+		remapVertexStream(weights, remap, unique);
+		num_vertices = unique;
+	}
+
+	int num_indices = m_indices.size();
+	float acmr_before = computeACMR(&m_indices[0], num_indices, num_vertices);
+
+	//triangles only move inside their submesh. if a range is broken the triangles stay where they are,
+	//the submeshes still point at them
+	const float* positions = interleaved.size() ? interleaved[0].vertex.v : vertices[0].v;
+	int position_stride = interleaved.size() ? sizeof(tInterleaved) : sizeof(Vector3);
+	bool valid_submeshes = true;
+	for (size_t i = 0; i < submeshes.size(); ++i)
+		if (submeshes[i].start < 0 || submeshes[i].length < 0 || submeshes[i].start % 3 || submeshes[i].length % 3 ||
+			submeshes[i].start + submeshes[i].length > num_indices)
+			valid_submeshes = false;
+	if (submeshes.empty())
+		optimizeTriangleOrder(&m_indices[0], num_indices, num_vertices, positions, position_stride);
+	else if (valid_submeshes)
+		for (size_t i = 0; i < submeshes.size(); ++i)
+			optimizeTriangleOrder(&m_indices[submeshes[i].start], submeshes[i].length, num_vertices, positions, position_stride);
+	else if (verbose)
+		std::cout << "[WARN submeshes out of range, triangle order kept] ";
+
+	//vertices in the order they are used
+	optimizeVertexFetch(&m_indices[0], num_indices, num_vertices, remap);
+	remapVertexStream(interleaved, remap, num_vertices);
+	remapVertexStream(vertices, remap, num_vertices);
+	remapVertexStream(normals, remap, num_vertices);
+	remapVertexStream(uvs, remap, num_vertices);
+	remapVertexStream(m_uvs1, remap, num_vertices);
+	remapVertexStream(colors, remap, num_vertices);
+	remapVertexStream(bones, remap, num_vertices);
+	remapVertexStream(weights, remap, num_vertices);
+
+	if (verbose)
+		std::cout << "[OPT ACMR " << acmr_before << " -> " << computeACMR(&m_indices[0], num_indices, num_vertices) << "] ";
+	return true;
+}
+
 bool Mesh::interleaveBuffers()
 {
 	if (!vertices.size() || !normals.size() || !uvs.size())
@@ -735,143 +1053,143 @@ bool Mesh::interleaveBuffers()
 	return true;
 }
 
-typedef struct 
+//uploads a buffer straight from memory (the mapped file), used by readBin
+static void uploadMeshStream(unsigned int& vbo_id, unsigned int target, const void* data, size_t bytes)
 {
-	int version;
-	int header_bytes;
-	int size;
-	int num_indices;
-	Vector3 aabb_min;
-	Vector3	aabb_max;
-	Vector3	center;
-	Vector3	halfsize;
-	float radius;
-	int num_bones;
-	int num_submeshes;
-	Matrix44 bind_matrix;
-	char streams[8]; //Vertex/Interlaved|Normal|Uvs|Color|Indices|Bones|Weights|Extra|Uvs1
-	char extra[32]; //unused
-} sMeshInfo;
+	if (vbo_id == 0)
+		glGenBuffersARB(1, &vbo_id);
+	glBindBufferARB(target, vbo_id);
+	glBufferDataARB(target, bytes, data, GL_STATIC_DRAW_ARB);
+	glBindBufferARB(target, 0);
+}
 
 bool Mesh::readBin(const char* filename, bool bFromNetwork)
 {
-	FILE *f;
 	assert(filename);
 
-	struct stat stbuffer;
-
-	stat(filename,&stbuffer);
-	f = fopen(filename,"rb");
-	if (f == NULL)
+	//the streams are read from the mapping, nothing is loaded in a temporary buffer
+	MappedFile* file = new MappedFile();
+	if (!file->open(filename))
+	{
+		delete file;
 		return false;
+	}
 
-	unsigned int size = (unsigned int)stbuffer.st_size;
-	char* data = new char[size];
-	fread(data,size,1,f);
-	fclose(f);
+	bool loaded = readBinData(file->data, file->size, filename, file);
+
+	//the collision model is created the first time it is needed
+	if (file != bin_file)
+		delete file;
+	return loaded;
+}
 
+bool Mesh::readBinData(const unsigned char* data, size_t size, const char* name, MappedFile* file)
+{
 	//watermark
-	if ( memcmp(data,"MBIN",4) != 0 )
+	if (size < 4 + sizeof(sMeshInfo) || memcmp(data,"MBIN",4) != 0 )
 	{
-		std::cout << "[ERROR] loading BIN: invalid content: " << filename << std::endl;
+		std::cout << "[ERROR] loading BIN: invalid content: " << name << std::endl;
 		return false;
 	}
 
-	char* pos = data + 4;
 	sMeshInfo info;
-	memcpy(&info,pos,sizeof(sMeshInfo));
-	pos += sizeof(sMeshInfo);
+	memcpy(&info, data + 4, sizeof(sMeshInfo));
 
 	if(info.version != MESH_BIN_VERSION || info.header_bytes != sizeof(sMeshInfo) )
 	{
-		std::cout << "[WARN] loading BIN: old version: " << filename << std::endl;
+		std::cout << "[WARN] loading BIN: old version: " << name << std::endl;
 		return false;
 	}
-
-	if (info.streams[0] == 'I')
-	{
-		interleaved.resize(info.size);
-		memcpy((void*)&interleaved[0], pos, sizeof(tInterleaved) * info.size);
-		pos += sizeof(tInterleaved) * info.size;
-	}
-	else if (info.streams[0] == 'V')
-	{
-		vertices.resize(info.size);
-		memcpy((void*)&vertices[0], pos, sizeof(Vector3) * info.size);
-		pos += sizeof(Vector3) * info.size;
-	}
-
-	if (info.streams[1] == 'N')
-	{
-		normals.resize(info.size);
-		memcpy((void*)&normals[0],pos,sizeof(Vector3) * info.size);
-		pos += sizeof(Vector3) * info.size;
-	}
-
-	if (info.streams[2] == 'U')
+	if (file ? info.file_size != size : info.file_size > size)
 	{
-		uvs.resize(info.size);
-		memcpy((void*)&uvs[0],pos,sizeof(Vector2) * info.size);
-		pos += sizeof(Vector2) * info.size;
+		std::cout << "[WARN] loading BIN: truncated file: " << name << std::endl;
+		return false;
 	}
 
-	if (info.streams[3] == 'C')
-	{
-		colors.resize(info.size);
-		memcpy((void*)&colors[0],pos,sizeof(Vector4) * info.size);
-		pos += sizeof(Vector4) * info.size;
-	}
+	bool interleaved_stream = info.streams[0] == 'I';
+	int vertex_bytes = interleaved_stream ? sizeof(tInterleaved) : sizeof(Vector3);
+	const unsigned int* offsets = info.stream_offsets;
 
-	if (info.streams[4] == 'I')
+	//if no interleaving has to be done in RAM the streams go to VRAM as they are in the file
+	if (file && auto_upload_to_vram && !quantize_meshes && (interleaved_stream || !interleave_meshes))
 	{
-		m_indices.resize(info.num_indices);
-		memcpy((void*)&m_indices[0], pos, sizeof(unsigned int) * info.num_indices);
-		pos += sizeof(Vector3u) * info.num_indices;
-	}
-
-	if (info.streams[5] == 'B')
-	{
-		bones.resize(info.size);
-		memcpy((void*)&bones[0], pos, sizeof(Vector4ub) * info.size);
-		pos += sizeof(Vector4ub) * info.size;
-	}
+		if (glGenBuffersARB == nullptr)
+		{
+			std::cout << "Error: your graphics cards dont support VBOs. Sorry." << std::endl;
+			exit(0);
+		}
+		uploadMeshStream(interleaved_stream ? interleaved_vbo_id : vertices_vbo_id, GL_ARRAY_BUFFER, data + offsets[MBIN_VERTICES], vertex_bytes * info.size);
+		if (info.streams[1] == 'N')
+			uploadMeshStream(normals_vbo_id, GL_ARRAY_BUFFER, data + offsets[MBIN_NORMALS], sizeof(Vector3) * info.size);
+		if (info.streams[2] == 'U')
+			uploadMeshStream(uvs_vbo_id, GL_ARRAY_BUFFER, data + offsets[MBIN_UVS], sizeof(Vector2) * info.size);
+		if (info.streams[3] == 'C')
+			uploadMeshStream(colors_vbo_id, GL_ARRAY_BUFFER, data + offsets[MBIN_COLORS], sizeof(Vector4) * info.size);
+		if (info.streams[4] == 'I')
+			index_type = uploadMeshIndices(indices_vbo_id, (const unsigned int*)(data + offsets[MBIN_INDICES]), info.num_indices, info.size);
+		if (info.streams[5] == 'B')
+			uploadMeshStream(bones_vbo_id, GL_ARRAY_BUFFER, data + offsets[MBIN_BONES], sizeof(Vector4ub) * info.size);
+		if (info.streams[6] == 'W')
+			uploadMeshStream(weights_vbo_id, GL_ARRAY_BUFFER, data + offsets[MBIN_WEIGHTS], sizeof(Vector4) * info.size);
+		if (info.streams[7] == 'u')
+			uploadMeshStream(uvs1_vbo_id, GL_ARRAY_BUFFER, data + offsets[MBIN_UVS1], sizeof(Vector2) * info.size);
+		checkGLErrors();
 
-	if (info.streams[6] == 'W')
-	{
-		weights.resize(info.size);
-		memcpy((void*)&weights[0], pos, sizeof(Vector4) * info.size);
-		pos += sizeof(Vector4) * info.size;
+		num_vram_vertices = info.size;
+		num_vram_indices = info.streams[4] == 'I' ? info.num_indices : 0;
+		bin_file = file;
+		updateVRAM();
 	}
-
-	if (info.streams[7] == 'u')
+	else
 	{
-		m_uvs1.resize(info.size);
-		memcpy((void*)&m_uvs1[0], pos, sizeof(Vector2) * info.size);
-		pos += sizeof(Vector2) * info.size;
+		if (interleaved_stream)
+			interleaved.assign((const tInterleaved*)(data + offsets[MBIN_VERTICES]), (const tInterleaved*)(data + offsets[MBIN_VERTICES]) + info.size);
+		else
+			vertices.assign((const Vector3*)(data + offsets[MBIN_VERTICES]), (const Vector3*)(data + offsets[MBIN_VERTICES]) + info.size);
+		if (info.streams[1] == 'N')
+			normals.assign((const Vector3*)(data + offsets[MBIN_NORMALS]), (const Vector3*)(data + offsets[MBIN_NORMALS]) + info.size);
+		if (info.streams[2] == 'U')
+			uvs.assign((const Vector2*)(data + offsets[MBIN_UVS]), (const Vector2*)(data + offsets[MBIN_UVS]) + info.size);
+		if (info.streams[3] == 'C')
+			colors.assign((const Vector4*)(data + offsets[MBIN_COLORS]), (const Vector4*)(data + offsets[MBIN_COLORS]) + info.size);
+		if (info.streams[4] == 'I')
+			m_indices.assign((const unsigned int*)(data + offsets[MBIN_INDICES]), (const unsigned int*)(data + offsets[MBIN_INDICES]) + info.num_indices);
+		if (info.streams[5] == 'B')
+			bones.assign((const Vector4ub*)(data + offsets[MBIN_BONES]), (const Vector4ub*)(data + offsets[MBIN_BONES]) + info.size);
+		if (info.streams[6] == 'W')
+			weights.assign((const Vector4*)(data + offsets[MBIN_WEIGHTS]), (const Vector4*)(data + offsets[MBIN_WEIGHTS]) + info.size);
+		if (info.streams[7] == 'u')
+			m_uvs1.assign((const Vector2*)(data + offsets[MBIN_UVS1]), (const Vector2*)(data + offsets[MBIN_UVS1]) + info.size);
 	}
 
 	if (info.num_bones)
-	{
-		bones_info.resize(info.num_bones);
-		memcpy((void*)&bones_info[0], pos, sizeof(BoneInfo) * info.num_bones);
-		pos += sizeof(BoneInfo) * info.num_bones;
-	}
+		bones_info.assign((const BoneInfo*)(data + offsets[MBIN_BONES_INFO]), (const BoneInfo*)(data + offsets[MBIN_BONES_INFO]) + info.num_bones);
 
 	aabb_max = info.aabb_max;
 	aabb_min = info.aabb_min;
 	box.center = info.center;
 	box.halfsize = info.halfsize;
 	radius = info.radius;
+	uv_density = info.uv_density;
 	bind_matrix = info.bind_matrix;
 
-	submeshes.resize(info.num_submeshes);
-	memcpy(&submeshes[0], pos, sizeof(sSubmeshInfo) * info.num_submeshes);
-	pos += sizeof(sSubmeshInfo) * info.num_submeshes;
-
-	createCollisionModel();
+	submeshes.assign((const sSubmeshInfo*)(data + offsets[MBIN_SUBMESHES]), (const sSubmeshInfo*)(data + offsets[MBIN_SUBMESHES]) + info.num_submeshes);
 	return true;
 }
 
+//writes a stream at the next aligned position, returns its offset from start
+static unsigned int writeMeshStream(FILE* f, long start, const void* data, size_t bytes)
+{
+	const char padding[MBIN_ALIGNMENT] = { 0 };
+	long pos = ftell(f);
+	if (pos % MBIN_ALIGNMENT)
+		fwrite(padding, MBIN_ALIGNMENT - pos % MBIN_ALIGNMENT, 1, f);
+	unsigned int offset = (unsigned int)(ftell(f) - start);
+	if (bytes)
+		fwrite(data, bytes, 1, f);
+	return offset;
+}
+
 bool Mesh::writeBin(const char* filename)
 {
 	assert( vertices.size() || interleaved.size() );
@@ -885,8 +1203,18 @@ bool Mesh::writeBin(const char* filename)
 		return false;
 	}
 
-	//watermark
-	fwrite("MBIN",sizeof(char),4,f);
+	bool written = writeBinData(f);
+	fclose(f);
+	return written;
+}
+
+bool Mesh::writeBinData(FILE* f)
+{
+	//only in VRAM, the .mbin it was read from is still mapped and has the same layout
+	if (!vertices.size() && !interleaved.size())
+		return bin_file && fwrite(bin_file->data, bin_file->size, 1, f) == 1;
+	long start = ftell(f);
+	assert(start % MBIN_ALIGNMENT == 0);
 
 	sMeshInfo info;
 	memset(&info, 0, sizeof(info));
@@ -899,53 +1227,55 @@ bool Mesh::writeBin(const char* filename)
 	info.center = box.center;
 	info.halfsize = box.halfsize;
 	info.radius = radius;
+	info.uv_density = uv_density;
 	info.num_bones = bones_info.size();
 	info.bind_matrix = bind_matrix;
 	info.num_submeshes = submeshes.size();
 
 	info.streams[0] = interleaved.size() ? 'I' : 'V';
-	info.streams[1] = normals.size() ? 'N' : ' ';
-	info.streams[2] = uvs.size() ? 'U' : ' ';
+	info.streams[1] = !interleaved.size() && normals.size() ? 'N' : ' ';
+	info.streams[2] = !interleaved.size() && uvs.size() ? 'U' : ' ';
 	info.streams[3] = colors.size() ? 'C' : ' ';
 	info.streams[4] = m_indices.size() ? 'I' : ' ';
 	info.streams[5] = bones.size() ? 'B' : ' ';
 	info.streams[6] = weights.size() ? 'W' : ' ';
 	info.streams[7] = m_uvs1.size() ? 'u' : ' '; //uv second set
 
-	//write info
+	//watermark and room for the info, it is written again at the end with the offsets
+	fwrite("MBIN",sizeof(char),4,f);
 	fwrite((void*)&info, sizeof(sMeshInfo),1, f);
 
 	//write streams
+	unsigned int* offsets = info.stream_offsets;
 	if (interleaved.size())
-		fwrite((void*)&interleaved[0], interleaved.size() * sizeof(tInterleaved), 1, f);
+		offsets[MBIN_VERTICES] = writeMeshStream(f, start, &interleaved[0], interleaved.size() * sizeof(tInterleaved));
 	else
 	{
-		fwrite((void*)&vertices[0], vertices.size() * sizeof(Vector3), 1, f);
+		offsets[MBIN_VERTICES] = writeMeshStream(f, start, &vertices[0], vertices.size() * sizeof(Vector3));
 		if (normals.size())
-			fwrite((void*)&normals[0], normals.size() * sizeof(Vector3), 1, f);
+			offsets[MBIN_NORMALS] = writeMeshStream(f, start, &normals[0], normals.size() * sizeof(Vector3));
 		if (uvs.size())
-			fwrite((void*)&uvs[0], uvs.size() * sizeof(Vector2), 1, f);
+			offsets[MBIN_UVS] = writeMeshStream(f, start, &uvs[0], uvs.size() * sizeof(Vector2));
 	}
-
 	if (colors.size())
-		fwrite((void*)&colors[0], colors.size() * sizeof(Vector4), 1, f);
-
+		offsets[MBIN_COLORS] = writeMeshStream(f, start, &colors[0], colors.size() * sizeof(Vector4));
 	if (m_indices.size())
-		fwrite((void*)&m_indices[0], m_indices.size() * sizeof(unsigned int), 1, f);
-
+		offsets[MBIN_INDICES] = writeMeshStream(f, start, &m_indices[0], m_indices.size() * sizeof(unsigned int));
 	if (bones.size())
-		fwrite((void*)&bones[0], bones.size() * sizeof(Vector4ub), 1, f);
+		offsets[MBIN_BONES] = writeMeshStream(f, start, &bones[0], bones.size() * sizeof(Vector4ub));
 	if (weights.size())
-		fwrite((void*)&weights[0], weights.size() * sizeof(Vector4), 1, f);
-	if (bones_info.size())
-		fwrite((void*)&bones_info[0], bones_info.size() * sizeof(BoneInfo), 1, f);
+		offsets[MBIN_WEIGHTS] = writeMeshStream(f, start, &weights[0], weights.size() * sizeof(Vector4));
 	if (m_uvs1.size())
-		fwrite((void*)&m_uvs1[0], m_uvs1.size() * sizeof(Vector2), 1, f);
-
-	fwrite((void*)&submeshes[0], submeshes.size() * sizeof(sSubmeshInfo), 1, f);
-
-	fclose(f);
-	return true;
+		offsets[MBIN_UVS1] = writeMeshStream(f, start, &m_uvs1[0], m_uvs1.size() * sizeof(Vector2));
+	if (bones_info.size())
+		offsets[MBIN_BONES_INFO] = writeMeshStream(f, start, &bones_info[0], bones_info.size() * sizeof(BoneInfo));
+	offsets[MBIN_SUBMESHES] = writeMeshStream(f, start, submeshes.size() ? &submeshes[0] : NULL, submeshes.size() * sizeof(sSubmeshInfo));
+
+	info.file_size = (unsigned int)(ftell(f) - start);
+	fseek(f, start + 4, SEEK_SET);
+	bool written = fwrite((void*)&info, sizeof(sMeshInfo), 1, f) == 1;
+	fseek(f, 0, SEEK_END);
+	return written;
 }
 
 bool Mesh::loadASE(const char* filename)
@@ -1505,6 +1835,35 @@ void Mesh::updateBoundingBox()
 	box.halfsize = aabb_max - box.center;
 }
 
+void Mesh::updateUVDensity()
+{
+	uv_density = 0;
+	bool use_interleaved = interleaved.size() != 0;
+	size_t num_vertices = use_interleaved ? interleaved.size() : vertices.size();
+	if (!num_vertices || (!use_interleaved && uvs.size() != num_vertices))
+		return;
+
+	//the sum of both areas, so the big triangles weigh more than the slivers
+	double area = 0, uv_area = 0;
+	size_t num = m_indices.size() ? m_indices.size() : num_vertices;
+	for (size_t i = 0; i + 2 < num; i += 3)
+	{
+		size_t a = m_indices.size() ? m_indices[i] : i;
+		size_t b = m_indices.size() ? m_indices[i + 1] : i + 1;
+		size_t c = m_indices.size() ? m_indices[i + 2] : i + 2;
+		const Vector3& va = use_interleaved ? interleaved[a].vertex : vertices[a];
+		const Vector3& vb = use_interleaved ? interleaved[b].vertex : vertices[b];
+		const Vector3& vc = use_interleaved ? interleaved[c].vertex : vertices[c];
+		const Vector2& ta = use_interleaved ? interleaved[a].uv : uvs[a];
+		const Vector2& tb = use_interleaved ? interleaved[b].uv : uvs[b];
+		const Vector2& tc = use_interleaved ? interleaved[c].uv : uvs[c];
+		area += (vb - va).cross(vc - va).length();
+		uv_area += fabs((tb.x - ta.x) * (tc.y - ta.y) - (tc.x - ta.x) * (tb.y - ta.y));
+	}
+	if (area > 0)
+		uv_density = (float)sqrt(uv_area / area);
+}
+
 Mesh* wire_box = NULL;
 
 void Mesh::renderBounding( const Matrix44& model, bool world_bounding )
@@ -1603,13 +1962,14 @@ Mesh* Mesh::Get(const char* filename, bool bFromNetwork, bool skip_load)
 			m->interleaveBuffers();
 		}
 
-		if (auto_upload_to_vram)
+		//readBin already uploaded the streams if they did not need to be interleaved
+		if (auto_upload_to_vram && !m->bin_file)
 		{
 			std::cout << "[VRAM] ";
 			m->uploadToVRAM();
 		}
 
-		std::cout << "[OK BIN]  Faces: " << (m->interleaved.size() ? m->interleaved.size() : m->vertices.size()) / 3 << " Time: " << (getTime() - time) * 0.001 << "sec" << std::endl;
+		std::cout << "[OK BIN]  Faces: " << (m->getNumIndices() ? m->getNumIndices() : m->getNumVertices()) / 3 << " Time: " << (getTime() - time) * 0.001 << "sec" << std::endl;
 		sMeshesLoaded[filename] = m;
 		return m;
 	}
@@ -1632,6 +1992,10 @@ Mesh* Mesh::Get(const char* filename, bool bFromNetwork, bool skip_load)
 		return NULL;
 	}
 
+	//triangle order for the vertex cache, before writing the .mbin so it is done only once
+	if (optimize_meshes)
+		m->optimize();
+
 	//to optimize, interleave the meshes
 	if (interleave_meshes)
 	{
@@ -1646,7 +2010,7 @@ Mesh* Mesh::Get(const char* filename, bool bFromNetwork, bool skip_load)
 		m->uploadToVRAM();
 	}
 
-	std::cout << "[OK]  Faces: " << m->vertices.size() / 3 << " Time: " << (getTime() - time) * 0.001 << "sec" << std::endl;
+	std::cout << "[OK]  Faces: " << (m->m_indices.size() ? m->m_indices.size() : m->getNumVertices()) / 3 << " Time: " << (getTime() - time) * 0.001 << "sec" << std::endl;
 	if (use_binary)
 	{
 		std::cout << "\t\t Writing .BIN ... ";
@@ -1662,6 +2026,49 @@ void Mesh::registerMesh( std::string name )
 {
 	this->name = name;
 	sMeshesLoaded[name] = this;
+	VRAM::rename(this, name);
+}
+
+Mesh* Mesh::GetDuplicate(unsigned long long hash, const std::string& name)
+{
+	auto it = sMeshesByHash.find(hash);
+	if (it == sMeshesByHash.end())
+		return NULL;
+	Mesh* mesh = it->second;
+	mesh->num_duplicates++;
+	stdlog(" + Mesh shared: " + (name.size() ? name : std::string("unnamed")) + " is " + (mesh->name.size() ? mesh->name : std::string("unnamed")));
+	return mesh;
+}
+
+void Mesh::registerHash(unsigned long long hash)
+{
+	content_hash = hash;
+	sMeshesByHash[hash] = this;
+}
+
+void Mesh::getDuplicateStats(int& count, size_t& bytes)
+{
+	count = 0;
+	bytes = 0;
+	for (auto it : sMeshesByHash)
+	{
+		count += it.second->num_duplicates;
+		bytes += it.second->num_duplicates * it.second->getMemorySize();
+	}
+}
+
+size_t Mesh::getMemorySize()
+{
+	size_t bytes = vertices.size() * sizeof(Vector3) + normals.size() * sizeof(Vector3) + uvs.size() * sizeof(Vector2) + m_uvs1.size() * sizeof(Vector2) +
+		colors.size() * sizeof(Vector4) + interleaved.size() * sizeof(tInterleaved) + m_indices.size() * sizeof(unsigned int);
+	if (vertices_vbo_id || interleaved_vbo_id)
+	{
+		bytes += getNumVertices() * (quantized ? sizeof(tQuantized) : sizeof(tInterleaved));
+		if (m_uvs1.size())
+			bytes += m_uvs1.size() * sizeof(Vector2);
+		bytes += getNumIndices() * (index_type == GL_UNSIGNED_SHORT ? 2 : 4);
+	}
+	return bytes;
 }
 
 void Mesh::Release()
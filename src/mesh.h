@@ -10,9 +10,10 @@
 class Shader; //for binding
 class Image; //for displace
 class Skeleton; //for skinned meshes
+class MappedFile;
 
-//version from 11/5/2020
-#define MESH_BIN_VERSION 11 //this is used to regenerate bins if the format changes
+//version 12: streams at 16 bytes aligned offsets stored in the header, so they can be used from the mapped file
+#define MESH_BIN_VERSION 14 //this is used to regenerate bins if the format changes
 
 struct BoneInfo {
 	char name[32]; //max 32 chars per bone name
@@ -23,22 +24,29 @@ struct sSubmeshInfo
 {
 	char name[64];
 	char material[64];
-	int start;//in primitive
-	int length;//in primitive
+	int start;//in indices (vertices if the mesh has no indices)
+	int length;//in indices (vertices if the mesh has no indices)
 };
 
 class Mesh
 {
 public:
 	static std::map<std::string, Mesh*> sMeshesLoaded;
+	static std::map<unsigned long long, Mesh*> sMeshesByHash; //by the source geometry, shared by every prefab that ships it
 	static bool use_binary; //always load the binary version of a mesh when possible
 	static bool interleave_meshes; //loaded meshes will me automatically interleaved
 	static bool auto_upload_to_vram; //loaded meshes will be stored in the VRAM
+	static bool quantize_meshes; //uploadToVRAM stores position, normal and uv compressed (tQuantized)
+	static bool optimize_meshes; //imported meshes are indexed and reordered for the vertex cache
 	static long num_meshes_rendered;
 	static long num_triangles_rendered;
 
 	std::string name;
 
+	//deduplication: hash of the data it was parsed from and times it has been reused instead of parsing it again
+	unsigned long long content_hash;
+	int num_duplicates;
+
 	std::vector<sSubmeshInfo> submeshes; //contains info about every submesh
 
 	std::vector< Vector3 > vertices; //here we store the vertices
@@ -55,6 +63,16 @@ public:
 
 	std::vector< tInterleaved > interleaved; //to render interleaved
 
+	//vertex in VRAM when quantized, 16 bytes instead of 32. decoded in basic.vs
+	struct tQuantized {
+		unsigned short position[4]; //unorm16 inside quantize_min + quantize_range, w unused
+		short normal[2]; //octahedral, snorm16
+		unsigned short uv[2]; //half float
+	};
+	bool quantized;
+	Vector3 quantize_min;
+	Vector3 quantize_range;
+
 	std::vector<unsigned int> m_indices; //for indexed meshes
 
 	//for animated meshes
@@ -68,6 +86,7 @@ public:
 	BoundingBox box;
 
 	float radius;
+	float uv_density; //uv units per unit of the mesh, 0 without uvs. with the distance it says the texels needed (see updateUVDensity)
 
 	unsigned int vertices_vbo_id;
 	unsigned int uvs_vbo_id;
@@ -79,6 +98,7 @@ public:
 	unsigned int bones_vbo_id;
 	unsigned int weights_vbo_id;
 	unsigned int uvs1_vbo_id;
+	unsigned int index_type; //GL_UNSIGNED_SHORT if the indices in VRAM fit in 16 bits
 
 	Mesh();
 	~Mesh();
@@ -98,8 +118,19 @@ public:
 	bool readBin(const char* filename, bool bFromNetwork);
 	bool writeBin(const char* filename);
 
+	//a .mbin stored inside another file (glTF cache). offsets are from data, which must be aligned to 16 bytes.
+	//when file is not NULL the streams can be uploaded straight from it and it is kept, otherwise they are copied
+	bool readBinData(const unsigned char* data, size_t size, const char* name, MappedFile* file = NULL);
+	bool writeBinData(FILE* f); //at the current position, that must be aligned to 16 bytes
+
 	unsigned int getNumSubmeshes() { return (unsigned int)submeshes.size(); }
-	unsigned int getNumVertices() { return (unsigned int)interleaved.size() ? (unsigned int)interleaved.size() : (unsigned int)vertices.size(); }
+	unsigned int getNumVertices() { return (unsigned int)interleaved.size() ? (unsigned int)interleaved.size() : vertices.size() ? (unsigned int)vertices.size() : (unsigned int)num_vram_vertices; }
+	unsigned int getNumIndices() { return m_indices.size() ? (unsigned int)m_indices.size() : (unsigned int)num_vram_indices; }
+
+	//meshes read from a .mbin can have their streams only in VRAM (uploaded straight from the mapped file)
+	int num_vram_vertices;
+	int num_vram_indices;
+	MappedFile* bin_file; //kept mapped to build the collision model on demand
 
 	//collision testing
 	void* collision_model;
@@ -113,6 +144,11 @@ public:
 	static void Release();
 	void registerMesh(std::string name);
 
+	static Mesh* GetDuplicate(unsigned long long hash, const std::string& name); //the mesh with that content if any, counting the reuse
+	void registerHash(unsigned long long hash);
+	static void getDuplicateStats(int& count, size_t& bytes); //meshes reused and the memory they would have taken
+	size_t getMemorySize(); //streams in RAM plus the estimated VRAM
+
 	//create help meshes
 	void createQuad(float center_x, float center_y, float w, float h, bool flip_uvs);
 	void createPlane(float size);
@@ -124,15 +160,19 @@ public:
 	static Mesh* getQuad(); //get global quad
 
 	void updateBoundingBox();
+	void updateUVDensity(); //sqrt of the uv area over the area of the triangles, uploadToVRAM calls it
 
 	//optimize meshes
 	void uploadToVRAM();
+	void updateVRAM(); //registers the size of the buffers in VRAM
 	bool interleaveBuffers();
+	bool optimize(bool verbose = true); //welds into an index buffer, reorders triangles (vertex cache and overdraw) and vertices (fetch)
 
 private:
 	bool loadASE(const char* filename);
 	bool loadOBJ(const char* filename);
 	bool loadMESH(const char* filename); //personal format used for animations
+	bool uploadQuantized(); //false if the mesh has no normals
 };
 
 #endif
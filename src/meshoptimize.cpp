@@ -0,0 +1,252 @@
+#include "meshoptimize.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+float computeACMR(const unsigned int* indices, int num_indices, int num_vertices, int cache_size)
+{
+	if (num_indices < 3)
+		return 0.0f;
+
+	//the time every vertex entered the cache, it is still there if it entered less than cache_size misses ago
+	std::vector<int> timestamps(num_vertices, -cache_size - 1);
+	int misses = 0;
+	for (int i = 0; i < num_indices; ++i)
+	{
+		unsigned int v = indices[i];
+		if (misses - timestamps[v] > cache_size)
+		{
+			timestamps[v] = misses;
+			misses++;
+		}
+	}
+	return misses / (float)(num_indices / 3);
+}
+
+static unsigned int hashVertex(const unsigned char* data, int stride)
+{
+	unsigned int hash = 2166136261u;
+	for (int i = 0; i < stride; ++i)
+	{
+		hash ^= data[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+int weldVertices(const unsigned char* vertices, int stride, int num_vertices, std::vector<unsigned int>& remap)
+{
+	remap.resize(num_vertices);
+
+	//open addressing table with the first vertex of every different value
+	size_t table_size = 1;
+	while (table_size < (size_t)num_vertices * 2)
+		table_size <<= 1;
+	std::vector<int> table(table_size, -1);
+	std::vector<unsigned int> unique; //original vertex of every new index
+
+	for (int i = 0; i < num_vertices; ++i)
+	{
+		const unsigned char* vertex = vertices + (size_t)i * stride;
+		size_t slot = hashVertex(vertex, stride) & (table_size - 1);
+		while (table[slot] != -1 && memcmp(vertices + (size_t)unique[table[slot]] * stride, vertex, stride) != 0)
+			slot = (slot + 1) & (table_size - 1);
+		if (table[slot] == -1)
+		{
+			table[slot] = unique.size();
+			unique.push_back(i);
+		}
+		remap[i] = table[slot];
+	}
+	return unique.size();
+}
+
+//tipsify, Sander et al. 2007. the triangles are emitted fanning around vertices that are still in the cache
+//and every jump to a vertex out of the cache starts a new cluster
+static void tipsify(const unsigned int* indices, int num_triangles, int num_vertices, int cache_size, std::vector<unsigned int>& order, std::vector<int>& clusters)
+{
+	//triangles of every vertex
+	std::vector<int> offsets(num_vertices + 1, 0);
+	for (int i = 0; i < num_triangles * 3; ++i)
+		offsets[indices[i] + 1]++;
+	for (int v = 0; v < num_vertices; ++v)
+		offsets[v + 1] += offsets[v];
+	std::vector<int> adjacency(num_triangles * 3);
+	std::vector<int> fill(offsets.begin(), offsets.end() - 1);
+	for (int i = 0; i < num_triangles * 3; ++i)
+		adjacency[fill[indices[i]]++] = i / 3;
+
+	std::vector<int> live(num_vertices);
+	for (int v = 0; v < num_vertices; ++v)
+		live[v] = offsets[v + 1] - offsets[v];
+	std::vector<int> cache_time(num_vertices, 0);
+	std::vector<bool> emitted(num_triangles, false);
+	std::vector<unsigned int> dead_end;
+	std::vector<unsigned int> candidates;
+
+	order.clear();
+	clusters.clear();
+	clusters.push_back(0);
+	int time = cache_size + 1;
+	int cursor = 0;
+	int fanning = num_vertices ? 0 : -1;
+	while (fanning >= 0)
+	{
+		candidates.clear();
+		for (int k = offsets[fanning]; k < offsets[fanning + 1]; ++k)
+		{
+			int t = adjacency[k];
+			if (emitted[t])
+				continue;
+			emitted[t] = true;
+			order.push_back(t);
+			for (int j = 0; j < 3; ++j)
+			{
+				unsigned int v = indices[t * 3 + j];
+				dead_end.push_back(v);
+				candidates.push_back(v);
+				live[v]--;
+				if (time - cache_time[v] > cache_size)
+					cache_time[v] = time++;
+			}
+		}
+
+		//the candidate that will still be in the cache after emitting its triangles
+		int next = -1;
+		int best = -1;
+		for (size_t i = 0; i < candidates.size(); ++i)
+		{
+			unsigned int v = candidates[i];
+			if (live[v] <= 0)
+				continue;
+			int priority = 0;
+			if (time - cache_time[v] + 2 * live[v] <= cache_size)
+				priority = time - cache_time[v];
+			if (priority > best)
+			{
+				best = priority;
+				next = v;
+			}
+		}
+		if (next != -1)
+		{
+			fanning = next;
+			continue;
+		}
+
+		//dead end, the recently used vertices first and then the input order
+		clusters.push_back(order.size());
+		while (!dead_end.empty() && next == -1)
+		{
+			unsigned int v = dead_end.back();
+			dead_end.pop_back();
+			if (live[v] > 0)
+				next = v;
+		}
+		while (next == -1 && cursor < num_vertices)
+		{
+			if (live[cursor] > 0)
+				next = cursor;
+			cursor++;
+		}
+		fanning = next;
+	}
+}
+
+static inline const float* vertexPosition(const float* positions, int stride, unsigned int vertex)
+{
+	return (const float*)((const unsigned char*)positions + (size_t)vertex * stride);
+}
+
+struct sTriangleCluster {
+	int start;
+	int end;
+	float sort_key;
+};
+
+static bool compareClusters(const sTriangleCluster& a, const sTriangleCluster& b)
+{
+	return a.sort_key > b.sort_key;
+}
+
+void optimizeTriangleOrder(unsigned int* indices, int num_indices, int num_vertices, const float* positions, int position_stride, int cache_size)
+{
+	int num_triangles = num_indices / 3;
+	if (num_triangles < 2)
+		return;
+
+	std::vector<unsigned int> order;
+	std::vector<int> boundaries;
+	tipsify(indices, num_triangles, num_vertices, cache_size, order, boundaries);
+
+	//center of the mesh
+	double center[3] = { 0, 0, 0 };
+	for (int t = 0; t < num_triangles; ++t)
+		for (int j = 0; j < 3; ++j)
+			for (int k = 0; k < 3; ++k)
+				center[k] += vertexPosition(positions, position_stride, indices[t * 3 + j])[k];
+	for (int k = 0; k < 3; ++k)
+		center[k] /= num_triangles * 3.0;
+
+	//clusters that face outwards can occlude the rest, they go first (Sander et al. overdraw ordering)
+	std::vector<sTriangleCluster> clusters;
+	for (size_t c = 0; c < boundaries.size(); ++c)
+	{
+		sTriangleCluster cluster;
+		cluster.start = boundaries[c];
+		cluster.end = c + 1 < boundaries.size() ? boundaries[c + 1] : (int)order.size();
+		if (cluster.start == cluster.end)
+			continue;
+
+		float centroid[3] = { 0, 0, 0 };
+		float normal[3] = { 0, 0, 0 };
+		for (int i = cluster.start; i < cluster.end; ++i)
+		{
+			const float* a = vertexPosition(positions, position_stride, indices[order[i] * 3 + 0]);
+			const float* b = vertexPosition(positions, position_stride, indices[order[i] * 3 + 1]);
+			const float* c2 = vertexPosition(positions, position_stride, indices[order[i] * 3 + 2]);
+			float e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+			float e2[3] = { c2[0] - a[0], c2[1] - a[1], c2[2] - a[2] };
+			normal[0] += e1[1] * e2[2] - e1[2] * e2[1]; //area weighted
+			normal[1] += e1[2] * e2[0] - e1[0] * e2[2];
+			normal[2] += e1[0] * e2[1] - e1[1] * e2[0];
+			for (int k = 0; k < 3; ++k)
+				centroid[k] += (a[k] + b[k] + c2[k]) / 3.0f;
+		}
+		float length = sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+		int count = cluster.end - cluster.start;
+		cluster.sort_key = 0.0f;
+		if (length > 0.0f)
+			for (int k = 0; k < 3; ++k)
+				cluster.sort_key += (centroid[k] / count - (float)center[k]) * normal[k] / length;
+		clusters.push_back(cluster);
+	}
+	std::stable_sort(clusters.begin(), clusters.end(), compareClusters);
+
+	std::vector<unsigned int> result;
+	result.reserve(num_triangles * 3);
+	for (size_t c = 0; c < clusters.size(); ++c)
+		for (int i = clusters[c].start; i < clusters[c].end; ++i)
+			for (int j = 0; j < 3; ++j)
+				result.push_back(indices[order[i] * 3 + j]);
+	memcpy(indices, &result[0], result.size() * sizeof(unsigned int));
+}
+
+void optimizeVertexFetch(unsigned int* indices, int num_indices, int num_vertices, std::vector<unsigned int>& remap)
+{
+	remap.assign(num_vertices, (unsigned int)-1);
+	unsigned int next = 0;
+	for (int i = 0; i < num_indices; ++i)
+	{
+		unsigned int& v = indices[i];
+		if (remap[v] == (unsigned int)-1)
+			remap[v] = next++;
+		v = remap[v];
+	}
+
+	//vertices not used by any triangle keep their relative order at the end
+	for (int v = 0; v < num_vertices; ++v)
+		if (remap[v] == (unsigned int)-1)
+			remap[v] = next++;
+}
@@ -0,0 +1,33 @@
+/*  Import time optimizations of indexed triangle lists: welding of duplicated vertices, triangle order
+	for the post-transform vertex cache (tipsify) with clusters sorted against overdraw, and vertex order
+	for fetch locality. Works on raw arrays so it does not depend on Mesh or OpenGL.
+*/
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#define MESHOPT_CACHE_SIZE 16
+
+//average cache misses per triangle simulating a FIFO cache, 3 is the worst and 0.5 the ideal on big meshes
+float computeACMR(const unsigned int* indices, int num_indices, int num_vertices, int cache_size = MESHOPT_CACHE_SIZE);
+
+//vertices whose stride bytes are identical get the same index, remap[old] = new. returns the number of unique vertices
+int weldVertices(const unsigned char* vertices, int stride, int num_vertices, std::vector<unsigned int>& remap);
+
+//reorders the triangles in place, positions are needed to sort the clusters from the outside in
+void optimizeTriangleOrder(unsigned int* indices, int num_indices, int num_vertices, const float* positions, int position_stride, int cache_size = MESHOPT_CACHE_SIZE);
+
+//renumbers the vertices in order of first use and updates the indices, remap[old] = new
+void optimizeVertexFetch(unsigned int* indices, int num_indices, int num_vertices, std::vector<unsigned int>& remap);
+
+//moves every element to its new position, new_count is the number of different positions in remap
+template<typename T> void remapVertexStream(std::vector<T>& stream, const std::vector<unsigned int>& remap, int new_count)
+{
+	if (stream.empty())
+		return;
+	std::vector<T> result(new_count);
+	for (size_t i = 0; i < remap.size(); ++i)
+		result[remap[i]] = stream[i];
+	stream.swap(result);
+}
@@ -8,6 +8,7 @@
 #include "camera.h"
 
 #include "gltf_loader.h"
+#include "jobsystem.h"
 #include "utils.h"
 #include "framework.h"
 #include "application.h"
@@ -221,6 +222,21 @@ Prefab* Prefab::Get(const char* filename)
 	return prefab;
 }
 
+Prefab* Prefab::GetAsync(const char* filename)
+{
+	assert(filename);
+	std::map<std::string, Prefab*>::iterator it = sPrefabsLoaded.find(filename);
+	if (it != sPrefabsLoaded.end())
+		return it->second;
+	if (!JobSystem::num_workers)
+		return Get(filename);
+
+	Prefab* prefab = new Prefab();
+	prefab->registerPrefab(filename);
+	loadGLTFAsync(filename, prefab);
+	return prefab;
+}
+
 void Prefab::registerPrefab(std::string name)
 {
 	this->name = name;
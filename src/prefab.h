@@ -113,6 +113,7 @@ namespace GTR {
 				//Manager to cache loaded prefabs
 		static std::map<std::string, Prefab*> sPrefabsLoaded;
 		static Prefab* Get(const char* filename);
+		static Prefab* GetAsync(const char* filename); //returns an empty prefab at once, the nodes are added when loaded
 		void registerPrefab(std::string name);
 	};
 
@@ -0,0 +1,283 @@
+#include "profiler.h"
+
+#include <chrono>
+#include <cstdio>
+
+bool Profiler::enabled = true;
+
+static sProfileFrame s_frames[PROFILER_FRAMES_IN_FLIGHT];
+static sProfileFrame* s_current = NULL;	//being recorded
+static sProfileFrame s_last;				//the last one read, with the GPU times
+static int s_frame_number = 0;
+static int s_depth = 0;
+static bool s_gpu_open = false;				//GL_TIME_ELAPSED queries cannot be nested
+
+//values shown in the menu, by position in the frame since the same passes come in the same order
+struct sProfileAverage {
+	const char* name;
+	double cpu_ms;
+	double gpu_ms;
+};
+static std::vector<sProfileAverage> s_averages;
+
+static std::string s_capture_filename;
+static int s_capture_frames = 0;
+static int s_capture_first = 0;		//the frames in flight when it started are not in the capture
+static std::vector<sProfileFrame> s_capture;
+
+static double now()
+{
+	static std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+//reads the queries of a frame that was sent PROFILER_FRAMES_IN_FLIGHT frames ago
+static void resolveFrame(sProfileFrame& frame)
+{
+	for (size_t i = 0; i < frame.samples.size(); ++i)
+	{
+		sProfileSample& sample = frame.samples[i];
+		if (sample.query < 0)
+			continue;
+		GLuint available = 0;
+		glGetQueryObjectuiv(frame.queries[sample.query], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available)
+			continue; //not waiting for it, the query is reused anyway
+		GLuint64 elapsed = 0;
+		glGetQueryObjectui64v(frame.queries[sample.query], GL_QUERY_RESULT, &elapsed);
+		sample.gpu_ms = elapsed / 1000000.0;
+	}
+
+	if (s_averages.size() != frame.samples.size())
+		s_averages.resize(frame.samples.size());
+	for (size_t i = 0; i < frame.samples.size(); ++i)
+	{
+		const sProfileSample& sample = frame.samples[i];
+		sProfileAverage& average = s_averages[i];
+		if (average.name != sample.name)
+		{
+			//a pass was enabled or disabled, start again from this frame
+			average.name = sample.name;
+			average.cpu_ms = sample.cpu_ms;
+			average.gpu_ms = sample.gpu_ms;
+			continue;
+		}
+		average.cpu_ms += (sample.cpu_ms - average.cpu_ms) * PROFILER_AVERAGE_WEIGHT;
+		average.gpu_ms = sample.gpu_ms < 0 ? sample.gpu_ms : average.gpu_ms + (sample.gpu_ms - average.gpu_ms) * PROFILER_AVERAGE_WEIGHT;
+	}
+
+	s_last.number = frame.number;
+	s_last.samples = frame.samples;
+
+	if (s_capture_frames > 0 && frame.number >= s_capture_first)
+	{
+		s_capture.push_back(s_last);
+		if ((int)s_capture.size() >= s_capture_frames)
+		{
+			Profiler::writeTrace(s_capture_filename.c_str(), s_capture);
+			s_capture.clear();
+			s_capture_frames = 0;
+		}
+	}
+}
+
+static void closeFrame()
+{
+	if (!s_current)
+		return;
+	//the frame sample covers everything until now: render, gui and swap
+	s_current->samples[0].cpu_ms = now() - s_current->samples[0].start;
+	s_current = NULL;
+}
+
+void Profiler::newFrame()
+{
+	closeFrame();
+	if (!enabled)
+		return;
+
+	sProfileFrame& frame = s_frames[s_frame_number % PROFILER_FRAMES_IN_FLIGHT];
+	if (frame.number >= 0)
+		resolveFrame(frame);
+
+	frame.number = s_frame_number++;
+	frame.samples.clear();
+	frame.used_queries = 0;
+	s_current = &frame;
+	s_depth = 0;
+	s_gpu_open = false;
+	begin("frame", false);
+}
+
+void Profiler::flush()
+{
+	closeFrame();
+	glFinish();
+	//the oldest first, it is the slot the next frame would use
+	for (int i = 0; i < PROFILER_FRAMES_IN_FLIGHT; ++i)
+	{
+		sProfileFrame& frame = s_frames[(s_frame_number + i) % PROFILER_FRAMES_IN_FLIGHT];
+		if (frame.number < 0)
+			continue;
+		resolveFrame(frame);
+		frame.number = -1; //already read
+	}
+}
+
+void Profiler::shutdown()
+{
+	flush();
+	if (s_capture_frames > 0 && s_capture.size())
+		writeTrace(s_capture_filename.c_str(), s_capture);
+	s_capture.clear();
+	s_capture_frames = 0;
+	for (int i = 0; i < PROFILER_FRAMES_IN_FLIGHT; ++i)
+	{
+		sProfileFrame& frame = s_frames[i];
+		if (frame.queries.size())
+			glDeleteQueries((GLsizei)frame.queries.size(), &frame.queries[0]);
+		frame = sProfileFrame();
+	}
+	s_current = NULL;
+}
+
+int Profiler::begin(const char* name, bool gpu)
+{
+	if (!s_current)
+		return -1; //outside of a frame, loading or disabled
+
+	sProfileSample sample;
+	sample.name = name;
+	sample.depth = s_depth++;
+	sample.cpu_ms = 0;
+	sample.gpu_ms = -1;
+	sample.query = -1;
+	if (gpu && !s_gpu_open)
+	{
+		if (s_current->used_queries == (int)s_current->queries.size())
+		{
+			GLuint query = 0;
+			glGenQueries(1, &query);
+			s_current->queries.push_back(query);
+		}
+		sample.query = s_current->used_queries++;
+		glBeginQuery(GL_TIME_ELAPSED, s_current->queries[sample.query]);
+		s_gpu_open = true;
+	}
+	sample.start = now();
+	s_current->samples.push_back(sample);
+	return (int)s_current->samples.size() - 1;
+}
+
+void Profiler::end(int index)
+{
+	if (!s_current || index < 0)
+		return;
+	sProfileSample& sample = s_current->samples[index];
+	sample.cpu_ms = now() - sample.start;
+	if (sample.query >= 0)
+	{
+		glEndQuery(GL_TIME_ELAPSED);
+		s_gpu_open = false;
+	}
+	s_depth--;
+}
+
+const sProfileFrame* Profiler::getLastFrame()
+{
+	return s_last.number >= 0 ? &s_last : NULL;
+}
+
+bool Profiler::startCapture(const char* filename, int num_frames)
+{
+	if (isCapturing() || num_frames <= 0)
+		return false;
+	s_capture_filename = filename;
+	s_capture_frames = num_frames;
+	s_capture_first = s_frame_number;
+	s_capture.clear();
+	s_capture.reserve(num_frames);
+	return true;
+}
+
+bool Profiler::isCapturing()
+{
+	return s_capture_frames > 0;
+}
+
+bool Profiler::writeTrace(const char* filename, const std::vector<sProfileFrame>& frames)
+{
+	FILE* f = fopen(filename, "w");
+	if (!f)
+	{
+		std::cout << "[ERROR] cannot write profiler trace: " << filename << std::endl;
+		return false;
+	}
+
+	//complete events in microseconds, the CPU in one row and the GPU in another
+	fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	fprintf(f, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"CPU\"}},\n");
+	fprintf(f, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\"args\":{\"name\":\"GPU\"}}");
+	for (size_t i = 0; i < frames.size(); ++i)
+	{
+		//the queries only give durations, the passes are placed one after the other from their CPU start
+		double gpu_end = 0;
+		for (size_t j = 0; j < frames[i].samples.size(); ++j)
+		{
+			const sProfileSample& sample = frames[i].samples[j];
+			fprintf(f, ",\n{\"name\":\"%s\",\"cat\":\"cpu\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"frame\":%d}}",
+				sample.name, sample.start * 1000.0, sample.cpu_ms * 1000.0, frames[i].number);
+			if (sample.gpu_ms < 0)
+				continue;
+			double start = sample.start > gpu_end ? sample.start : gpu_end;
+			gpu_end = start + sample.gpu_ms;
+			fprintf(f, ",\n{\"name\":\"%s\",\"cat\":\"gpu\",\"ph\":\"X\",\"pid\":1,\"tid\":2,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"frame\":%d}}",
+				sample.name, start * 1000.0, sample.gpu_ms * 1000.0, frames[i].number);
+		}
+	}
+	fprintf(f, "\n]}\n");
+	bool ok = ferror(f) == 0;
+	fclose(f);
+	if (ok)
+		std::cout << " + Profiler trace: " << frames.size() << " frames written to " << filename << std::endl;
+	else
+		std::cout << "[ERROR] cannot write profiler trace: " << filename << std::endl;
+	return ok;
+}
+
+void Profiler::renderInMenu()
+{
+#ifndef SKIP_IMGUI
+#ifdef NO_PROFILER
+	ImGui::Text("Built with NO_PROFILER");
+#else
+	ImGui::Checkbox("Enabled", &enabled);
+	if (isCapturing())
+		ImGui::Text("Capturing %d frames...", s_capture_frames - (int)s_capture.size());
+	else if (ImGui::Button("Capture trace"))
+		startCapture("profiler_trace.json", PROFILER_TRACE_FRAMES);
+
+	const sProfileFrame* frame = getLastFrame();
+	if (!frame || !enabled)
+		return;
+
+	ImGui::Columns(3, "profiler");
+	ImGui::Text("Scope"); ImGui::NextColumn();
+	ImGui::Text("CPU ms"); ImGui::NextColumn();
+	ImGui::Text("GPU ms"); ImGui::NextColumn();
+	ImGui::Separator();
+	for (size_t i = 0; i < frame->samples.size() && i < s_averages.size(); ++i)
+	{
+		const sProfileAverage& average = s_averages[i];
+		ImGui::Text("%*s%s", frame->samples[i].depth * 2, "", average.name); ImGui::NextColumn();
+		ImGui::Text("%.3f", average.cpu_ms); ImGui::NextColumn();
+		if (average.gpu_ms >= 0)
+			ImGui::Text("%.3f", average.gpu_ms);
+		else
+			ImGui::Text("-");
+		ImGui::NextColumn();
+	}
+	ImGui::Columns(1);
+#endif
+#endif
+}
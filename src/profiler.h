@@ -0,0 +1,86 @@
+/*  Profiler for the main thread: CPU time of scopes (an object that measures until it is destroyed) and GPU time of
+	the render passes with GL_TIME_ELAPSED queries. The queries of a frame are read two frames later, when the GPU
+	has already finished them, so it never stalls. The results are shown in the debug menu and a number of frames
+	can be captured to a JSON for chrome://tracing (or ui.perfetto.dev).
+	GL_TIME_ELAPSED queries cannot be nested, a GPU scope inside another one only measures the CPU.
+
+	usage:	{ PROFILE_GPU_SCOPE("ssao"); ssao.compute(...); }
+	building with NO_PROFILER removes the scopes, the profiler is not even called.
+*/
+#pragma once
+
+#include "includes.h"
+#include "renderstats.h"
+
+#include <string>
+#include <vector>
+
+#define PROFILER_FRAMES_IN_FLIGHT 2		//the query objects are double buffered
+#define PROFILER_AVERAGE_WEIGHT 0.1		//of the last frame in the values shown in the menu
+#define PROFILER_TRACE_FRAMES 60		//captured by the menu button
+
+struct sProfileSample {
+	const char* name;	//a literal, it is not copied
+	int depth;			//0 is the whole frame
+	double start;		//ms since the profiler started
+	double cpu_ms;
+	double gpu_ms;		//-1 if the scope has no query or the result never arrived
+	int query;			//index in the queries of the frame, -1 for CPU only scopes
+};
+
+struct sProfileFrame {
+	int number;
+	std::vector<sProfileSample> samples;
+	std::vector<GLuint> queries;		//created the first time they are needed and reused
+	int used_queries;
+
+	sProfileFrame() : number(-1), used_queries(0) {}
+};
+
+class Profiler
+{
+public:
+	static bool enabled;
+
+	//closes the frame being recorded, reads the one that used the same queries and starts a new one
+	static void newFrame();
+	static void flush();	//closes the frame being recorded and waits for the GPU to read every frame in flight
+	static void shutdown(); //deletes the queries, writes the capture if there is one running
+
+	//use the scopes instead, they return and take the index of the sample (-1 if not recorded)
+	static int begin(const char* name, bool gpu);
+	static void end(int sample);
+
+	//the last frame with its GPU times, NULL until there is one
+	static const sProfileFrame* getLastFrame();
+
+	//records the next frames and writes them to a chrome trace JSON when done
+	static bool startCapture(const char* filename, int num_frames);
+	static bool isCapturing();
+	static bool writeTrace(const char* filename, const std::vector<sProfileFrame>& frames);
+
+	static void renderInMenu();
+};
+
+//measures from the constructor to the destructor, the GPU scopes are also the passes of the render stats
+class ProfileScope
+{
+public:
+	ProfileScope(const char* name, bool gpu) : gpu(gpu) { sample = Profiler::begin(name, gpu); if (gpu) RenderStats::pushPass(name); }
+	~ProfileScope() { if (gpu) RenderStats::popPass(); Profiler::end(sample); }
+private:
+	int sample;
+	bool gpu;
+};
+
+#ifndef NO_PROFILER
+	#define PROFILE_CONCAT_(a, b) a ## b
+	#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+	#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profile_scope_, __LINE__)(name, false)
+	#define PROFILE_GPU_SCOPE(name) ProfileScope PROFILE_CONCAT(profile_scope_, __LINE__)(name, true)
+	#define PROFILE_NEW_FRAME() Profiler::newFrame()
+#else
+	#define PROFILE_SCOPE(name)
+	#define PROFILE_GPU_SCOPE(name)
+	#define PROFILE_NEW_FRAME()
+#endif
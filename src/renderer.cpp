@@ -11,6 +11,9 @@
 #include "fbo.h"
 #include "application.h"
 #include "extra/hdre.h"
+#include "jobsystem.h"
+#include "profiler.h"
+#include "renderstats.h"
 #include <algorithm>
 
 
@@ -82,6 +85,7 @@ Renderer::Renderer() {
 
 	irr_fbo = NULL;
 	cRefl_fbo = NULL;
+	cRefl_cam = NULL;
 	show_irr_tex = false;
 	showProbesGrid = false;
 	apply_irr = true;
@@ -89,7 +93,15 @@ Renderer::Renderer() {
 
 	currentReflection = NULL;
 	apply_reflections = true;
-	first_it = true;
+	reflection_faces_per_frame = 2;
+	reflection_continuous = false;
+	reflection_scene_hash = 0;
+	reflection_frame = 0;
+	reflection_atlas = NULL;
+	reflection_atlas_fbo = NULL;
+	reflection_atlas_capacity = 0;
+	reflection_probes_data = NULL;
+	reflection_tiles = NULL;
 
 	applyAA = true;
 
@@ -114,6 +126,11 @@ Renderer::Renderer() {
 
 void Renderer::collectRenderCalls(GTR::Scene* scene, Camera* camera)
 {
+	//the calls of the previous collect are not used anymore (probe faces collect several times per frame)
+	for (int i = 0; i < renderCalls.size(); ++i)
+		delete renderCalls[i];
+	for (int i = 0; i < renderCalls_Blending.size(); ++i)
+		delete renderCalls_Blending[i];
 	renderCalls.clear();
 	renderCalls_Blending.clear();
 	//render entities
@@ -140,7 +157,46 @@ void Renderer::collectRenderCalls(GTR::Scene* scene, Camera* camera)
 	
 }
 
+void Renderer::requestTextureLevels(Camera* camera)
+{
+	//pixels covered by one unit at distance one
+	float pixels_per_unit = camera->type == Camera::ORTHOGRAPHIC ? Application::instance->window_height / (camera->top - camera->bottom) :
+		Application::instance->window_height / (2.0 * tan(camera->fov * 0.5 * DEG2RAD));
+
+	std::vector<RenderCall*>* lists[] = { &renderCalls, &renderCalls_Blending };
+	for (int l = 0; l < 2; ++l)
+		for (int i = 0; i < lists[l]->size(); ++i)
+		{
+			RenderCall* rc = (*lists[l])[i];
+			BoundingBox box = transformBoundingBox(rc->model, rc->mesh->box);
+			float radius = box.halfsize.length();
+			float distance = box.center.distance(camera->eye) - radius;
+			if (camera->type == Camera::ORTHOGRAPHIC)
+				distance = 1.0;
+			else if (distance < camera->near_plane)
+				distance = camera->near_plane;
+			//the pixels one repeat of the textures covers, from the uvs of the mesh. without them the whole object is one repeat
+			float pixels = 2.0 * radius * pixels_per_unit / distance;
+			if (rc->mesh->uv_density > 0)
+			{
+				//the most stretched axis of the model, so the texture is never too coarse
+				float scale = std::max(rc->model.rotateVector(Vector3(1, 0, 0)).length(),
+					std::max(rc->model.rotateVector(Vector3(0, 1, 0)).length(), rc->model.rotateVector(Vector3(0, 0, 1)).length()));
+				pixels = pixels_per_unit / distance * scale / rc->mesh->uv_density;
+			}
+
+			GTR::Material* material = rc->material;
+			Texture* textures[] = { material->color_texture.texture, material->emissive_texture.texture, material->opacity_texture.texture,
+				material->metallic_roughness_texture.texture, material->occlusion_texture.texture, material->normal_texture.texture };
+			for (int t = 0; t < 6; ++t)
+				if (textures[t])
+					textures[t]->requestResolution(pixels);
+		}
+}
+
 void Renderer::renderSkybox(Texture* skybox, Camera* camera, bool isforward) {
+	if (!skybox)
+		return; //the environment file was not found
 	//render
 	Mesh* mesh = Mesh::Get("data/meshes/sphere.obj", false);
 	Shader* shader = Shader::Get("skybox");
@@ -167,7 +223,12 @@ void Renderer::renderSkybox(Texture* skybox, Camera* camera, bool isforward) {
 
 void Renderer::renderScene(GTR::Scene* scene, Camera* camera)
 {
-	collectRenderCalls(scene, camera);
+	{
+		PROFILE_SCOPE("render calls");
+		collectRenderCalls(scene, camera);
+		if (!renderingShadows)
+			requestTextureLevels(camera);
+	}
 
 	if (pipeline_mode == FORWARD || renderingShadows) {
 		if (!renderingShadows) {
@@ -253,7 +314,9 @@ void Renderer::renderNode(const Matrix44& prefab_model, GTR::Node* node, Camera*
 		BoundingBox world_bounding = transformBoundingBox(node_model,node->mesh->box);
 		
 		//if bounding box is inside the camera frustum then the object is probably visible
-		if (!camera || camera->testBoxInFrustum(world_bounding.center, world_bounding.halfsize) )	//lazy evaluation, si es compleix !camera, entra
+		bool visible = !camera || camera->testBoxInFrustum(world_bounding.center, world_bounding.halfsize);	//lazy evaluation, si es compleix !camera, entra
+		RenderStats::add(visible ? STAT_NODES_VISIBLE : STAT_NODES_CULLED);
+		if (visible)
 		{
 			
 			RenderCall* rc = new RenderCall(node_model, node->mesh, node->material);
@@ -303,6 +366,7 @@ void Renderer::renderMeshWithMaterial(eRenderMode mode, const Matrix44 model, Me
 		glDisable(GL_CULL_FACE);
 	else
 		glEnable(GL_CULL_FACE);
+	RenderStats::add(STAT_STATE_CHANGES, 2); //blending and culling
     assert(glGetError() == GL_NO_ERROR);
 	if (!renderingShadows) {
 		if (mode == GTR::eRenderMode::TEXTURE) {
@@ -315,38 +379,30 @@ void Renderer::renderMeshWithMaterial(eRenderMode mode, const Matrix44 model, Me
 			shader->disable();
 		}
 		else if (mode == GTR::eRenderMode::LIGHT_MULTI) {
-			shader = Shader::Get("multi_pass");
-			if (shader == NULL)
-				return;
-			shader->enable();
 			multipassRendering(shader, model, material, camera, mesh, cubemap);
 			//disable shader
-			shader->disable();
+			if (shader)
+				shader->disable();
 		}
 		else if (mode == GTR::eRenderMode::LIGHT_SINGLE) {
-			shader = Shader::Get("single_pass");
+			shader = Shader::GetVariant("single_pass", material->shader_features);
 			if (shader == NULL)
 				return;
 			shader->enable();
 			singlepassUniforms(shader, model, material, camera, mesh);
 			shader->disable();
 		}else if (mode == GTR::eRenderMode::GBUFFERS) {
-			shader = Shader::Get("g_buffers");
+			shader = Shader::GetVariant("g_buffers", material->shader_features);
 			if (shader == NULL)
 				return;
 			shader->enable();
 			Texture* texture = material->metallic_roughness_texture.texture;
-			uploadExtraMap(shader, texture, "u_omr", "u_has_omr", 1);
+			uploadExtraMap(shader, texture, "u_omr", 1);
 			texture = material->emissive_texture.texture;
-			uploadExtraMap(shader, texture, "u_emissive", "u_has_emissive", 2);
+			uploadExtraMap(shader, texture, "u_emissive", 2);
 			texture = material->normal_texture.texture;
-			uploadExtraMap(shader, texture, "u_normal_map", "u_has_normal", 3);
+			uploadExtraMap(shader, texture, "u_normal_map", 3);
 			commonUniforms(shader, model, material, camera, mesh, false);
-			bool blending_mat = false;
-			if (material->alpha_mode == GTR::eAlphaMode::BLEND) {
-				blending_mat = true;
-			}
-			shader->setUniform("u_blending_mat", blending_mat);
 			shader->disable();
 		}
 	}
@@ -389,23 +445,14 @@ void Renderer::commonUniforms(Shader*& shader, const Matrix44 model, GTR::Materi
 		mesh->render(GL_TRIANGLES);
 }
 
-void Renderer::uploadExtraMap(Shader*& shader, Texture* texture, const char* uniform_name, const char* bool_name, int tex_slot) {
-	if (texture) {
-		shader->setUniform(bool_name, true);
-		shader->setUniform(uniform_name, texture, tex_slot);
-	}
-	else {
-		if (pipeline_mode == GTR::ePipelineMode::DEFERRED) {
-			texture = Texture::Get("data/textures/omr_aux.png");
-			
-			if (uniform_name == "u_emissive")
-				texture = Texture::getBlackTexture();
+unsigned int Renderer::getIlumFeatures() {
+	return ilum_mode == GTR::eIlumMode::PBR ? SHADER_PBR : 0;
+}
 
-			shader->setUniform(uniform_name, texture, tex_slot);
-		}
-		shader->setUniform(bool_name, false);
-	}
-	
+void Renderer::uploadExtraMap(Shader*& shader, Texture* texture, const char* uniform_name, int tex_slot) {
+	//without texture the variant of the material does not read it (Material::shader_features)
+	if (texture)
+		shader->setUniform(uniform_name, texture, tex_slot);
 }
 
 void Renderer::multipassUniforms(GTR::LightEntity* light, Shader*& shader, const Matrix44 model, GTR::Material* material, Camera* camera, Mesh* mesh, int iteration, Texture* cubemap) {
@@ -417,20 +464,16 @@ void Renderer::multipassUniforms(GTR::LightEntity* light, Shader*& shader, const
 	commonUniforms(shader, model, material, camera, mesh, true);//upload common uniforms
 
 	texture = material->emissive_texture.texture;
-	uploadExtraMap(shader, texture, "u_emissive", "u_has_emissive", 1);
-	shader->setUniform("u_iteration", iteration);
-
-	int max_iter = Scene::instance->lights.size() - 1;
-	shader->setUniform("u_max_iter", max_iter);
+	uploadExtraMap(shader, texture, "u_emissive", 1);
 
-	shader->setTexture("u_environment_texture", cubemap, 9);
+	if (shader->features & SHADER_LAST_PASS)
+		shader->setTexture("u_environment_texture", cubemap, 9);
 
 	texture = material->normal_texture.texture;
-	uploadExtraMap(shader, texture, "u_normal_map", "u_has_normal", 2);
+	uploadExtraMap(shader, texture, "u_normal_map", 2);
 
 	texture = material->metallic_roughness_texture.texture;
-	uploadExtraMap(shader, texture, "u_omr", "u_has_omr", 3);
-	shader->setUniform("u_ilum_mode", ilum_mode);
+	uploadExtraMap(shader, texture, "u_omr", 3);
 	
 	//this is used to say which is the alpha threshold to what we should not paint a pixel on the screen (to cut polygons according to texture alpha)
 	shader->setUniform("u_alpha_cutoff", material->alpha_mode == GTR::eAlphaMode::MASK ? material->alpha_cutoff : 0);
@@ -464,6 +507,18 @@ void Renderer::multipassRendering(Shader*& shader, const Matrix44 model, GTR::Ma
 		if (i == 0 && material->alpha_mode == GTR::eAlphaMode::BLEND && i!= Scene::instance->lights.size()-1) {
 			glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 		}
+		RenderStats::add(STAT_STATE_CHANGES); //blending of the light pass
+
+		//ambient and emissive in the first pass, reflections in the last
+		unsigned int features = material->shader_features | getIlumFeatures();
+		if (i == 0)
+			features |= SHADER_FIRST_PASS;
+		if (i == Scene::instance->lights.size() - 1)
+			features |= SHADER_LAST_PASS;
+		shader = Shader::GetVariant("multi_pass", features);
+		if (shader == NULL)
+			return;
+		shader->enable();
 		multipassUniforms(Scene::instance->lights[i], shader, model, material, camera, mesh, i, cubemap);
 	}
 	glDisable(GL_BLEND);
@@ -475,13 +530,13 @@ void Renderer::singlepassUniforms(Shader*& shader, const Matrix44 model, GTR::Ma
 	commonUniforms(shader, model, material, camera, mesh, true);//upload common uniforms
 
 	texture = material->emissive_texture.texture;
-	uploadExtraMap(shader, texture, "u_emissive_color", "u_has_emissive", 1);
+	uploadExtraMap(shader, texture, "u_emissive", 1);
 
 	texture = material->normal_texture.texture;
-	uploadExtraMap(shader, texture, "u_normal_map", "u_has_normal", 2);
+	uploadExtraMap(shader, texture, "u_normal_map", 2);
 
 	texture = material->metallic_roughness_texture.texture;
-	uploadExtraMap(shader, texture, "u_omr", "u_has_ao", 3);
+	uploadExtraMap(shader, texture, "u_omr", 3);
 
 	if (Scene::instance != NULL) {
 
@@ -599,27 +654,33 @@ void Renderer::renderDeferred(Scene* scene, std::vector<RenderCall*>& rc, Camera
 	int w = fbo_gbuffers.width; int h = fbo_gbuffers.height;
 
 	//render gbuffers
-	fbo_gbuffers.bind();
+	{
+		PROFILE_GPU_SCOPE("gbuffers");
+		fbo_gbuffers.bind();
 
-	glClearColor(scene->background_color.x, scene->background_color.y, scene->background_color.z, 1.0);
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-	checkGLErrors();
-	if (scene->environment)
-		renderSkybox(scene->environment, camera, false);
+		glClearColor(scene->background_color.x, scene->background_color.y, scene->background_color.z, 1.0);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		checkGLErrors();
+		if (scene->environment)
+			renderSkybox(scene->environment, camera, false);
 
-	for (int i = 0; i < rc.size(); i++) {
-		renderMeshWithMaterial(GTR::eRenderMode::GBUFFERS,rc[i]->model, rc[i]->mesh, rc[i]->material, camera);
-	}
+		for (int i = 0; i < rc.size(); i++) {
+			renderMeshWithMaterial(GTR::eRenderMode::GBUFFERS,rc[i]->model, rc[i]->mesh, rc[i]->material, camera);
+		}
 
-	fbo_gbuffers.unbind();
+		fbo_gbuffers.unbind();
+	}
 
-	updateFBO(decals_fbo, 4, true, 1.0);
-	copyFboTextures(fbo_gbuffers, decals_fbo, 3);
-	decals_fbo.bind();
-	fbo_gbuffers.depth_texture->copyTo(NULL);
-	renderDecals(scene, camera);
-	decals_fbo.unbind();
-	copyFboTextures(decals_fbo, fbo_gbuffers, 3);
+	{
+		PROFILE_GPU_SCOPE("decals");
+		updateFBO(decals_fbo, 4, true, 1.0);
+		copyFboTextures(fbo_gbuffers, decals_fbo, 3);
+		decals_fbo.bind();
+		fbo_gbuffers.depth_texture->copyTo(NULL);
+		renderDecals(scene, camera);
+		decals_fbo.unbind();
+		copyFboTextures(decals_fbo, fbo_gbuffers, 3);
+	}
 
 	//ssao+
 	if (ao_map == NULL || ao_map->width != w || ao_map->height != h) {
@@ -634,11 +695,15 @@ void Renderer::renderDeferred(Scene* scene, std::vector<RenderCall*>& rc, Camera
 
 	fbo_gbuffers.depth_texture->unbind();
 
-	if(apply_ssao)
+	if(apply_ssao) {
+		PROFILE_GPU_SCOPE("ssao");
 		ssao.compute(fbo_gbuffers.depth_texture, fbo_gbuffers.color_textures[1], camera, ao_map);
+	}
 
-	if(scene->irradianceEnt && scene->irradianceEnt->active)
+	if(scene->irradianceEnt && scene->irradianceEnt->active) {
+		PROFILE_GPU_SCOPE("irradiance");
 		irradianceMap(fbo_gbuffers.depth_texture, fbo_gbuffers.color_textures[1], camera);
+	}
 
 	updateFBO(scene_fbo, 2, true, 1.0);
 
@@ -653,7 +718,10 @@ void Renderer::renderDeferred(Scene* scene, std::vector<RenderCall*>& rc, Camera
 	glDisable(GL_BLEND);
 	glDisable(GL_DEPTH_TEST);
 
-	multipassDeferred(camera);
+	{
+		PROFILE_GPU_SCOPE("lighting");
+		multipassDeferred(camera);
+	}
 
 	glDisable(GL_BLEND);
 	glDisable(GL_DEPTH_TEST);
@@ -662,17 +730,21 @@ void Renderer::renderDeferred(Scene* scene, std::vector<RenderCall*>& rc, Camera
 	glEnable(GL_BLEND);
 	glEnable(GL_DEPTH_TEST);
 
-	renderForward(scene, renderCalls_Blending, camera);
+	{
+		PROFILE_GPU_SCOPE("blending");
+		renderForward(scene, renderCalls_Blending, camera);
+	}
 
 	glDisable(GL_BLEND);
 	//glDisable(GL_DEPTH_TEST);
 
 	//temporal test probes
-	if (scene->irradianceEnt == NULL) {
+	//created once every prefab has arrived, the adaptive placement needs their geometry
+	if (scene->irradianceEnt == NULL && JobSystem::getPendingJobs() == 0) {
 		scene->irradianceEnt = new IrradianceEntity();
 	} 
 	//temporal test probes
-	if (showProbesGrid) {
+	if (showProbesGrid && scene->irradianceEnt) {
 		for (int i = 0; i < scene->irradianceEnt->probes.size(); i++) {
 			sProbe probe2 = scene->irradianceEnt->probes[i];
 			renderProbe(probe2.pos, 3.0, probe2.sh.coeffs[0].v);
@@ -686,20 +758,25 @@ void Renderer::renderDeferred(Scene* scene, std::vector<RenderCall*>& rc, Camera
 
 	scene_fbo.unbind();
 
-	if (apply_chromatic_aberration)
+	if (apply_chromatic_aberration) {
+		PROFILE_GPU_SCOPE("chromatic aberration");
 		chromatic_aberration();
+	}
 	
 
 	Texture* bloomFX = NULL;
 	if (apply_bloom) {
+		PROFILE_GPU_SCOPE("bloom");
 		bloomFX = bloom_effect(scene_fbo.color_textures[1], w, h);
 		renderFinal(bloomFX);
 	}
 	else {
+		PROFILE_GPU_SCOPE("final");
 		renderFinal(scene_fbo.color_textures[0]);
 	}
 	
 	if (apply_reflections) {
+		PROFILE_GPU_SCOPE("reflections");
 		glDisable(GL_BLEND);
 		glDisable(GL_DEPTH_TEST);
 		addReflectionsToScene(camera);
@@ -711,6 +788,7 @@ void Renderer::renderDeferred(Scene* scene, std::vector<RenderCall*>& rc, Camera
 	}
 	
 	if (apply_fog) {
+		PROFILE_GPU_SCOPE("fog");
 		glDisable(GL_BLEND);
 		glDisable(GL_DEPTH_TEST);
 		render_fog(scene, camera);
@@ -723,12 +801,15 @@ void Renderer::renderDeferred(Scene* scene, std::vector<RenderCall*>& rc, Camera
 
 	Texture* rendered_scene = NULL;
 
-	if (applyAA)
+	if (applyAA) {
+		PROFILE_GPU_SCOPE("antialiasing");
 		rendered_scene = AAFX(final_render_fbo.color_textures[0]);
+	}
 	else
 		rendered_scene = final_render_fbo.color_textures[0];
 
 	if (apply_dof) {
+		PROFILE_GPU_SCOPE("depth of field");
 		Texture* blurred_scene = blur_image(rendered_scene, 10);
 		depthOfField(rendered_scene, blurred_scene, camera);
 	}
@@ -782,14 +863,17 @@ void GTR::Renderer::multipassUniformsDeferred(LightEntity* light, Camera* camera
 	Mesh* mesh = NULL;
 	Shader* shader = NULL;
 
+	//the ambient light in the first pass
+	unsigned int features = DEFERRED_FEATURES | getIlumFeatures() | (iteration == 0 ? SHADER_FIRST_PASS : 0);
 	if (iteration == 0 || light->light_type == DIRECTIONAL) {
-		shader = Shader::Get("deferred_multi_pass");
+		shader = Shader::GetVariant("deferred_multi_pass", features);
 		mesh = Mesh::getQuad();
 	}
 	else {
-		shader = Shader::Get("deferred_geometry");
+		shader = Shader::GetVariant("deferred_geometry", features);
 		mesh = Mesh::Get("data/meshes/sphere.obj", false);
 		glEnable(GL_CULL_FACE);
+		RenderStats::add(STAT_STATE_CHANGES);
 	}
 	
 	if (shader == NULL) return;
@@ -801,11 +885,8 @@ void GTR::Renderer::multipassUniformsDeferred(LightEntity* light, Camera* camera
 	shader->setUniform("u_omr", fbo_gbuffers.color_textures[2], 2);
 	shader->setUniform("u_depth_texture", fbo_gbuffers.depth_texture, 3);
 	shader->setUniform("u_emissive", fbo_gbuffers.color_textures[3], 4);
-	shader->setUniform("u_ilum_mode", ilum_mode);
-	shader->setUniform("u_has_omr", true);
 	shader->setUniform("u_ssao", ao_map, 5);//apply_ssao
 	shader->setUniform("u_apply_ssao", apply_ssao);
-	shader->setUniform("u_iteration", iteration);
 	shader->setUniform("u_bloom_thr", bloom_threshold);
 	shader->setUniform("u_irr_int", irradiance_intensity);
 	Matrix44 vp_inv = camera->viewprojection_matrix;
@@ -841,6 +922,7 @@ void GTR::Renderer::multipassUniformsDeferred(LightEntity* light, Camera* camera
 	shader->disable();
 
 	glFrontFace(GL_CCW);
+	RenderStats::add(STAT_STATE_CHANGES);
 }
 
 void GTR::Renderer::multipassDeferred(Camera* camera) {
@@ -850,6 +932,7 @@ void GTR::Renderer::multipassDeferred(Camera* camera) {
 	}
 	glEnable(GL_BLEND);
 	glBlendFunc(GL_ONE, GL_ONE);
+	RenderStats::add(STAT_STATE_CHANGES, 2);
 	for (int i = 0; i < Scene::instance->lights.size(); i++) {
 		LightEntity* light = Scene::instance->lights[i];
 		multipassUniformsDeferred(light, camera, i);		
@@ -857,7 +940,7 @@ void GTR::Renderer::multipassDeferred(Camera* camera) {
 }
 
 void GTR::Renderer::renderAmbient(Camera* camera){
-	Shader* shader = Shader::Get("deferred_ambient");
+	Shader* shader = Shader::GetVariant("deferred_ambient", DEFERRED_FEATURES);
 	if (shader == NULL) return;
 	Mesh* quad = Mesh::getQuad();
 	shader->enable();
@@ -866,7 +949,6 @@ void GTR::Renderer::renderAmbient(Camera* camera){
 	shader->setUniform("u_omr", fbo_gbuffers.color_textures[2], 2);
 	shader->setUniform("u_depth_texture", fbo_gbuffers.depth_texture, 3);
 	shader->setUniform("u_emissive", fbo_gbuffers.color_textures[3], 4);
-	shader->setUniform("u_has_omr", true);
 	shader->setUniform("u_ssao", ao_map, 5);//apply_ssao
 	shader->setUniform("u_apply_ssao", apply_ssao);
 	shader->setUniform("u_apply_irradiance", apply_irr);
@@ -890,6 +972,7 @@ void GTR::Renderer::renderAmbient(Camera* camera){
 
 /********************************************************************************************************************/
 void GTR::Renderer::renderInMenu(){
+#ifndef SKIP_IMGUI
 	ImGui::Combo("Pipeline Mode", &current_mode_pipeline, optionsTextPipeline, IM_ARRAYSIZE(optionsTextPipeline));
 	//apply_bloom
 	ImGui::Checkbox("Anti Aliasing", &applyAA);
@@ -899,6 +982,32 @@ void GTR::Renderer::renderInMenu(){
 	ImGui::Combo("Ilumination Mode", &current_mode_ilum, optionsTextIlum, IM_ARRAYSIZE(optionsTextIlum));
 	changeRenderMode();
 	ImGui::Checkbox("Update Shadows", &cast_shadows);
+	if (ImGui::Checkbox("Quantized meshes", &Mesh::quantize_meshes)) {
+		//upload again the meshes that still have their data in RAM
+		for (auto it : Mesh::sMeshesLoaded)
+			if (it.second->vertices.size() || it.second->interleaved.size())
+				it.second->uploadToVRAM();
+	}
+	if (ImGui::TreeNode("Texture streaming")) {
+		ImGui::Checkbox("Enabled", &Texture::use_streaming);
+		ImGui::SliderInt("Budget (MB)", &Texture::streaming_budget, 8, 1024);
+		size_t resident = 0;
+		for (auto it : Texture::sTexturesLoaded)
+			if (it.second->stream_file)
+				resident += it.second->getStreamingBytes(it.second->resident_level);
+		ImGui::Text("Resident: %.1f MB", resident / (1024.0 * 1024.0));
+		ImGui::TreePop();
+	}
+	if (ImGui::TreeNode("Shared assets")) {
+		//same content found in several prefabs, loaded once
+		int textures, meshes;
+		size_t texture_bytes, mesh_bytes;
+		Texture::getDuplicateStats(textures, texture_bytes);
+		Mesh::getDuplicateStats(meshes, mesh_bytes);
+		ImGui::Text("Textures: %d reused, %.1f MB saved", textures, texture_bytes / (1024.0 * 1024.0));
+		ImGui::Text("Meshes: %d reused, %.1f MB saved", meshes, mesh_bytes / (1024.0 * 1024.0));
+		ImGui::TreePop();
+	}
 	if (current_mode_pipeline == GTR::ePipelineMode::DEFERRED) {
 		//apply_reflections
 		ImGui::Checkbox("Show gbuffers", &showGbuffers);
@@ -908,6 +1017,8 @@ void GTR::Renderer::renderInMenu(){
 		if (ImGui::TreeNode("Reflections")) {
 			ImGui::Checkbox("Show reflection probes", &show_reflection_probes);
 			ImGui::Checkbox("Apply reflections", &apply_reflections);
+			ImGui::SliderInt("Faces per frame", &reflection_faces_per_frame, 0, 12);
+			ImGui::Checkbox("Continuous update", &reflection_continuous);
 			ImGui::TreePop();
 		}
 		if (current_mode_pipeline == GTR::ePipelineMode::DEFERRED) {
@@ -928,6 +1039,14 @@ void GTR::Renderer::renderInMenu(){
 				ImGui::Checkbox("Apply irradiance", &apply_irr);
 				ImGui::Checkbox("Show irradianceTex", &show_irr_tex);
 				ImGui::Checkbox("Show Probes Grid", &showProbesGrid);
+				Scene* scene = Scene::instance;
+				if (scene->irradianceEnt) {
+					ImGui::Checkbox("Adaptive probes", &scene->irradianceEnt->adaptive);
+					if (ImGui::Button("Place probes")) {
+						scene->irradianceEnt->placeProbes();
+						scene->irradianceEnt->probesToTexture();
+					}
+				}
 				ImGui::SliderFloat("Irradiance density", &irradiance_intensity, 0.01, 1.0);
 				ImGui::TreePop();
 			}
@@ -967,6 +1086,7 @@ void GTR::Renderer::renderInMenu(){
 		}
 		ImGui::TreePop();
 	}
+#endif
 }
 
 void GTR::Renderer::renderFinal(Texture* tex){
@@ -1035,6 +1155,15 @@ void GTR::Renderer::renderProbe(Vector3 pos, float size, float* coeffs)
 
 void GTR::Renderer::computeProbe(Scene* scene,  sProbe& p, int iteration){
 	FloatImage images[6]; //here we will store the six views
+
+	collectRenderCalls(scene, NULL);	//agafara tots els rc, independentment del que vegi la camera
+	renderProbeFaces(scene, p, images);
+
+	//compute the coefficients given the six images
+	p.sh = computeSH(images,false);	
+}
+
+void GTR::Renderer::renderProbeFaces(Scene* scene, sProbe& p, FloatImage* images) {
 	Camera cam;
 
 	//set the fov to 90 and the aspect to 1
@@ -1048,8 +1177,6 @@ void GTR::Renderer::computeProbe(Scene* scene,  sProbe& p, int iteration){
 
 	}		
 
-	collectRenderCalls(scene, NULL);	//agafara tots els rc, independentment del que vegi la camera
-
 	for (int i = 0; i < 6; ++i) //for every cubemap face
 	{
 		//compute camera orientation using defined vectors
@@ -1068,16 +1195,30 @@ void GTR::Renderer::computeProbe(Scene* scene,  sProbe& p, int iteration){
 		//read the pixels back and store in a FloatImage
 		images[i].fromTexture(irr_fbo->color_textures[0]);
 	}
-
-	//compute the coefficients given the six images
-	p.sh = computeSH(images,false);	
 }
 
 void GTR::Renderer::computeProbes(Scene* scene) {
-	for (int i = 0; i < scene->irradianceEnt->probes.size(); i++) {
-		std::cout << "Computing probe " << i << " of " << scene->irradianceEnt->probes.size() << std::endl;
-		computeProbe(scene, scene->irradianceEnt->probes[i], i);
+	std::vector<sProbe>& probes = scene->irradianceEnt->probes;
+
+	//the gpu renders a chunk of probes and the SH projection of the whole chunk runs in parallel
+	const int chunk_size = 64;
+	std::vector<FloatImage> images(chunk_size * 6);
+	std::vector<SphericalHarmonics> sh(chunk_size);
+
+	collectRenderCalls(scene, NULL);	//agafara tots els rc, independentment del que vegi la camera
+
+	long time = getTime();
+	for (int start = 0; start < probes.size(); start += chunk_size) {
+		int count = probes.size() - start < chunk_size ? probes.size() - start : chunk_size;
+		std::cout << "Computing probes " << start << " to " << start + count << " of " << probes.size() << std::endl;
+		for (int i = 0; i < count; i++)
+			renderProbeFaces(scene, probes[start + i], &images[i * 6]);
+		computeSHBatch(&images[0], count, &sh[0]);
+		for (int i = 0; i < count; i++)
+			probes[start + i].sh = sh[i];
 	}
+	std::cout << " + Probes computed in " << (getTime() - time) << "ms" << std::endl;
+
 	scene->irradianceEnt->probesToTexture();
 	scene->irradianceEnt->save();
 }
@@ -1085,7 +1226,8 @@ void GTR::Renderer::computeProbes(Scene* scene) {
 void GTR::Renderer::updateIrradianceCache(GTR::Scene* scene) {	//actualitza les probes
 
 	//probe.pos = Vector3(0, 1, 0); 
-	computeProbes(scene);
+	if (scene->irradianceEnt) //not while the scene is loading
+		computeProbes(scene);
 
 }
 
@@ -1127,42 +1269,128 @@ void GTR::Renderer::updateReflectionProbes(Scene* scene){
 	}
 }
 
-void GTR::Renderer::captureReflectionProbe(Scene* scene, reflectionProbeEntity*& probe) {
-	Camera* cam = new Camera();
-	//set the fov to 90 and the aspect to 1
-	cam->setPerspective(90, 1, 0.1, 1000);
+//fnv-1a of whatever can change what the probes see
+static unsigned int hashReflectionInputs(GTR::Scene* scene) {
+	unsigned int hash = 2166136261u;
+	for (int i = 0; i < scene->entities.size(); ++i) {
+		GTR::BaseEntity* ent = scene->entities[i];
+		const unsigned char* bytes = (const unsigned char*)ent->model.m;
+		for (int j = 0; j < sizeof(ent->model.m); ++j)
+			hash = (hash ^ bytes[j]) * 16777619u;
+		hash = (hash ^ (unsigned int)ent->visible) * 16777619u;
+	}
+	for (int i = 0; i < scene->lights.size(); ++i) {
+		GTR::LightEntity* light = scene->lights[i];
+		float values[5] = { light->color.x, light->color.y, light->color.z, light->intensity, light->max_dist };
+		const unsigned char* bytes = (const unsigned char*)values;
+		for (int j = 0; j < sizeof(values); ++j)
+			hash = (hash ^ bytes[j]) * 16777619u;
+	}
+	//a prefab or texture that has just arrived changes what the probes see
+	hash = (hash ^ JobSystem::completed) * 16777619u;
+	return hash;
+}
+
+void GTR::Renderer::updateReflectionProbesBudget(Scene* scene, Camera* camera) {
+	reflection_frame++;
+	if (scene->reflectionProbes.empty())
+		return;
+
+	//any change in the scene invalidates every probe, a moved probe only itself
+	unsigned int hash = hashReflectionInputs(scene);
+	bool scene_changed = hash != reflection_scene_hash;
+	reflection_scene_hash = hash;
+	for (int i = 0; i < scene->reflectionProbes.size(); i++) {
+		reflectionProbeEntity* probe = scene->reflectionProbes[i];
+		if (scene_changed || probe->captured_position.distance(probe->model.getTranslation()) > 0.01)
+			probe->dirty = true;
+	}
+
+	for (int budget = reflection_faces_per_frame; budget > 0; budget--) {
+		//a probe half done goes first so the cubemap does not stay mixed, then the closest dirty one, then the oldest weighted by distance
+		reflectionProbeEntity* best = NULL;
+		float best_score = 0;
+		for (int i = 0; i < scene->reflectionProbes.size(); i++) {
+			reflectionProbeEntity* probe = scene->reflectionProbes[i];
+			float dist = camera->eye.distance(probe->model.getTranslation());
+			float score = 0;
+			if (probe->next_face != 0)
+				score = 1e20;
+			else if (probe->dirty)
+				score = 1e10 / (1.0 + dist);
+			else if (reflection_continuous)
+				score = (reflection_frame - probe->last_update) / (1.0 + dist);
+			if (score > best_score) {
+				best_score = score;
+				best = probe;
+			}
+		}
+		if (!best)
+			break;
+
+		if (best->next_face == 0) {
+			best->dirty = false;
+			best->captured_position = best->model.getTranslation();
+		}
+		captureReflectionFace(scene, best, best->next_face);
+		best->next_face = (best->next_face + 1) % 6;
+		if (best->next_face == 0) {
+			best->cubemap->generateMipmaps();
+			best->last_update = reflection_frame;
+			storeReflectionProbe(scene, best);
+		}
+	}
+}
+
+void GTR::Renderer::captureReflectionFace(Scene* scene, reflectionProbeEntity* probe, int face) {
+	//created once and reused by every face of every probe
+	if (!cRefl_cam) {
+		cRefl_cam = new Camera();
+		//set the fov to 90 and the aspect to 1
+		cRefl_cam->setPerspective(90, 1, 0.1, 1000);
+	}
 	if (!cRefl_fbo) {
 		cRefl_fbo = new FBO();
 		cRefl_fbo->create(64, 64, 1, GL_RGB, GL_FLOAT);
 	}
-	collectRenderCalls(scene, NULL);
-	//render the view from every side
-	for (int i = 0; i < 6; ++i)
-	{
-		//assign cubemap face to FBO
-		cRefl_fbo->setTexture(probe->cubemap, i);
 
-		//bind FBO
-		cRefl_fbo->bind();
+	//render view
+	Vector3 eye = probe->model.getTranslation();
+	Vector3 center = probe->model.getTranslation() + cubemapFaceNormals[face][2];
+	Vector3 up = cubemapFaceNormals[face][1];
+	cRefl_cam->lookAt(eye, center, up);
 
-		//render view
-		Vector3 eye = probe->model.getTranslation();
-		Vector3 center = probe->model.getTranslation() + cubemapFaceNormals[i][2];
-		Vector3 up = cubemapFaceNormals[i][1];
-		cam->lookAt(eye, center, up);
-		cam->enable();
-		glDisable(GL_BLEND);
-		glClearColor(0, 0, 0, 1.0);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-		checkGLErrors();
-		renderSkybox(Scene::instance->environment, cam, true);
-		renderForward(scene, renderCalls, cam);
-		cRefl_fbo->unbind();
-	}
+	//only what this face can see
+	collectRenderCalls(scene, cRefl_cam);
+
+	//assign cubemap face to FBO
+	cRefl_fbo->setTexture(probe->cubemap, face);
+
+	//bind FBO
+	cRefl_fbo->bind();
+	cRefl_cam->enable();
+	glDisable(GL_BLEND);
+	glClearColor(0, 0, 0, 1.0);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	checkGLErrors();
+	renderSkybox(Scene::instance->environment, cRefl_cam, true);
+	renderForward(scene, renderCalls, cRefl_cam);
+	cRefl_fbo->unbind();
+}
+
+void GTR::Renderer::captureReflectionProbe(Scene* scene, reflectionProbeEntity*& probe) {
+	//render the view from every side
+	for (int i = 0; i < 6; ++i)
+		captureReflectionFace(scene, probe, i);
 
 	//generate the mipmaps
 	probe->cubemap->generateMipmaps();
 
+	probe->next_face = 0;
+	probe->dirty = false;
+	probe->captured_position = probe->model.getTranslation();
+	probe->last_update = reflection_frame;
+	storeReflectionProbe(scene, probe);
 }
 
 void GTR::Renderer::renderReflectionProbes(Scene* scene, Camera* camera){
@@ -1189,15 +1417,129 @@ void GTR::Renderer::renderReflectionProbes(Scene* scene, Camera* camera){
 	glDisable(GL_CULL_FACE);
 }
 
-void GTR::Renderer::addReflectionsToScene(Camera* camera){
-	Texture* cubemap = NULL;
-	Vector3 positions[4];
-	for (int i = 0; i < Scene::instance->reflectionProbes.size(); i++) {
-		positions[i] = Scene::instance->reflectionProbes[i]->model.getTranslation();
+void GTR::Renderer::storeReflectionProbe(Scene* scene, reflectionProbeEntity* probe) {
+	Shader* shader = Shader::Get("reflection_octa");
+	if (shader == NULL) return;
+
+	//grow the atlas by rows of probes, the ones already captured are copied again
+	int num_probes = scene->reflectionProbes.size();
+	if (num_probes > reflection_atlas_capacity || !reflection_atlas) {
+		int rows = (num_probes + REFLECTION_ATLAS_COLUMNS - 1) / REFLECTION_ATLAS_COLUMNS;
+		rows = rows > 0 ? rows : 1;
+		reflection_atlas_capacity = rows * REFLECTION_ATLAS_COLUMNS;
+		delete reflection_atlas_fbo;
+		delete reflection_atlas;
+		reflection_atlas = new Texture(REFLECTION_ATLAS_COLUMNS * REFLECTION_OCTA_SIZE * 2, rows * REFLECTION_OCTA_SIZE, GL_RGB, GL_HALF_FLOAT, false);
+		reflection_atlas_fbo = new FBO();
+		reflection_atlas_fbo->setTexture(reflection_atlas);
+		for (int i = 0; i < num_probes; i++)
+			if (scene->reflectionProbes[i] != probe && scene->reflectionProbes[i]->last_update >= 0)
+				storeReflectionProbe(scene, scene->reflectionProbes[i]);
+	}
+	if (!probe)
+		return;
+
+	int slot = 0;
+	while (slot < num_probes && scene->reflectionProbes[slot] != probe)
+		slot++;
+	int x = (slot % REFLECTION_ATLAS_COLUMNS) * REFLECTION_OCTA_SIZE * 2;
+	int y = (slot / REFLECTION_ATLAS_COLUMNS) * REFLECTION_OCTA_SIZE;
+
+	Mesh* quad = Mesh::getQuad();
+	reflection_atlas_fbo->bind();
+	glDisable(GL_DEPTH_TEST);
+	glDisable(GL_BLEND);
+	shader->enable();
+	shader->setUniform("u_texture", probe->cubemap, 0);
+	//every level is a smaller tile to the right of the previous one
+	for (int level = 0; level < REFLECTION_OCTA_LEVELS; level++) {
+		int size = REFLECTION_OCTA_SIZE >> level;
+		glViewport(x + REFLECTION_OCTA_SIZE * 2 - ((REFLECTION_OCTA_SIZE * 2) >> level), y, size, size);
+		shader->setUniform("u_level", (float)level);
+		quad->render(GL_TRIANGLES);
 	}
+	shader->disable();
+	reflection_atlas_fbo->unbind();
+	glEnable(GL_DEPTH_TEST);
+}
+
+void GTR::Renderer::buildReflectionTiles(Scene* scene, Camera* camera, int width, int height) {
+	int tiles_x = (width + REFLECTION_TILE_SIZE - 1) / REFLECTION_TILE_SIZE;
+	int tiles_y = (height + REFLECTION_TILE_SIZE - 1) / REFLECTION_TILE_SIZE;
+	int stride = REFLECTION_PROBES_PER_TILE + 1; //count and indices
+	reflection_tiles_data.assign(tiles_x * tiles_y * stride, 0.0f);
+	std::vector<Vector4> probes_data(scene->reflectionProbes.size() ? scene->reflectionProbes.size() : 1);
+
+	for (int i = 0; i < scene->reflectionProbes.size(); i++) {
+		reflectionProbeEntity* probe = scene->reflectionProbes[i];
+		Vector3 center = probe->model.getTranslation();
+		float radius = probe->radius;
+		probes_data[i] = Vector4(center.x, center.y, center.z, radius);
+		if (probe->last_update < 0 || !camera->testSphereInFrustum(center, radius))
+			continue;
+
+		//screen rect of the box around the influence sphere, the whole screen if the camera is inside or it crosses the near plane
+		int x0 = 0, y0 = 0, x1 = tiles_x - 1, y1 = tiles_y - 1;
+		if (camera->eye.distance(center) > radius * 1.8) {
+			float min_x = 1, min_y = 1, max_x = -1, max_y = -1;
+			bool behind = false;
+			for (int k = 0; k < 8 && !behind; k++) {
+				Vector3 corner = center + Vector3(k & 1 ? radius : -radius, k & 2 ? radius : -radius, k & 4 ? radius : -radius);
+				Vector4 clip = camera->viewprojection_matrix * Vector4(corner.x, corner.y, corner.z, 1.0);
+				if (clip.w <= 0.0) {
+					behind = true;
+					break;
+				}
+				float nx = clip.x / clip.w, ny = clip.y / clip.w;
+				min_x = nx < min_x ? nx : min_x;
+				max_x = nx > max_x ? nx : max_x;
+				min_y = ny < min_y ? ny : min_y;
+				max_y = ny > max_y ? ny : max_y;
+			}
+			if (!behind) {
+				x0 = clamp((int)floor((min_x * 0.5 + 0.5) * width / REFLECTION_TILE_SIZE), 0, tiles_x - 1);
+				x1 = clamp((int)floor((max_x * 0.5 + 0.5) * width / REFLECTION_TILE_SIZE), 0, tiles_x - 1);
+				y0 = clamp((int)floor((min_y * 0.5 + 0.5) * height / REFLECTION_TILE_SIZE), 0, tiles_y - 1);
+				y1 = clamp((int)floor((max_y * 0.5 + 0.5) * height / REFLECTION_TILE_SIZE), 0, tiles_y - 1);
+			}
+		}
+
+		for (int ty = y0; ty <= y1; ty++)
+			for (int tx = x0; tx <= x1; tx++) {
+				float* tile = &reflection_tiles_data[(tx + ty * tiles_x) * stride];
+				int count = tile[0];
+				if (count >= REFLECTION_PROBES_PER_TILE)
+					continue;
+				tile[count + 1] = i;
+				tile[0] = count + 1;
+			}
+	}
+
+	//recreated only when the size changes
+	if (!reflection_tiles || reflection_tiles->height != tiles_x * tiles_y) {
+		delete reflection_tiles;
+		reflection_tiles = new Texture(stride, tiles_x * tiles_y, GL_RED, GL_FLOAT, false, (Uint8*)&reflection_tiles_data[0], GL_R32F);
+	}
+	else
+		reflection_tiles->upload(GL_RED, GL_FLOAT, false, (Uint8*)&reflection_tiles_data[0], GL_R32F);
+
+	if (!reflection_probes_data || reflection_probes_data->width != probes_data.size()) {
+		delete reflection_probes_data;
+		reflection_probes_data = new Texture(probes_data.size(), 1, GL_RGBA, GL_FLOAT, false, (Uint8*)&probes_data[0]);
+	}
+	else
+		reflection_probes_data->upload(GL_RGBA, GL_FLOAT, false, (Uint8*)&probes_data[0]);
+}
+
+void GTR::Renderer::addReflectionsToScene(Camera* camera){
+	Scene* scene = Scene::instance;
 	Shader* shader = Shader::Get("add_reflections");
 	if (shader == NULL) return;
 	Mesh* mesh = Mesh::getQuad();
+	int width = Application::instance->window_width;
+	int height = Application::instance->window_height;
+	buildReflectionTiles(scene, camera, width, height);
+
 	updateFBO(reflection_fbo, 1, false, 1.0);
 	reflection_fbo.bind();
 	glClearColor(0, 0, 0, 1.0);
@@ -1205,28 +1547,25 @@ void GTR::Renderer::addReflectionsToScene(Camera* camera){
 	checkGLErrors();
 	shader->enable();
 
-	shader->setUniform3Array("u_probes_positions", (float*)positions, 4);
-
 	shader->setUniform("u_texture", fbo_gbuffers.color_textures[0],0);
 	shader->setUniform("u_normal_texture", fbo_gbuffers.color_textures[1], 1);
 	shader->setUniform("u_depth_texture", fbo_gbuffers.depth_texture, 2);
 	shader->setUniform("u_omr", fbo_gbuffers.color_textures[2], 3);
 	shader->setUniform("u_camera_position", camera->eye);
 
-	cubemap = Scene::instance->reflectionProbes[0]->cubemap;
-	shader->setTexture("u_environment_texture1", cubemap, 4);
-
-	cubemap = Scene::instance->reflectionProbes[1]->cubemap;
-	shader->setTexture("u_environment_texture2", cubemap, 4);
-
-	cubemap = Scene::instance->reflectionProbes[2]->cubemap;
-	shader->setTexture("u_environment_texture3", cubemap, 6);
-
-	cubemap = Scene::instance->reflectionProbes[3]->cubemap;
-	shader->setTexture("u_environment_texture4", cubemap, 7);
+	//no probe captured yet, the tiles are all empty but the atlas has to exist
+	if (!reflection_atlas)
+		storeReflectionProbe(scene, NULL);
+	shader->setUniform("u_reflection_atlas", reflection_atlas, 4);
+	shader->setUniform("u_atlas_size", Vector2(reflection_atlas->width, reflection_atlas->height));
+	shader->setUniform("u_probes_data", reflection_probes_data, 5);
+	shader->setUniform("u_tiles", reflection_tiles, 6);
+	shader->setUniform("u_tiles_x", (width + REFLECTION_TILE_SIZE - 1) / REFLECTION_TILE_SIZE);
+	if (scene->environment)
+		shader->setTexture("u_environment", scene->environment, 7);
+	else
+		shader->setUniform("u_environment", 7); //nothing bound samples black, but not the 2D slot 0
 
-	int width = Application::instance->window_width;
-	int height = Application::instance->window_height;
 	shader->setUniform("u_iRes", Vector2(1.0 / (float)width, 1.0 / (float)height));
 	Matrix44 inv_vp = camera->viewprojection_matrix;
 	inv_vp.inverse();
@@ -1258,9 +1597,10 @@ void GTR::Renderer::render_fog(Scene* scene, Camera* camera){
 			shader = Shader::Get("volume_ambient");
 		}
 		else {
-			Mesh::Get("data/meshes/sphere.obj", false);
+			mesh = Mesh::Get("data/meshes/sphere.obj", false);
 			shader = Shader::Get("volume_geo");
 		}
+		shader->enable();
 		light->uploadUniforms(shader);
 		shader->setUniform("u_iteration", i);
 		shader->setUniform("u_max_iterations", vol_iterations);
@@ -1457,11 +1797,11 @@ std::vector<Vector3> generateSpherePoints(int num, float radius, bool hemi)
 	for (int i = 0; i < num; i += 3)
 	{
 		Vector3& p = points[i];
-		float u = random();
-		float v = random();
+		float u = random(1.0f);
+		float v = random(1.0f);
 		float theta = u * 2.0 * PI;
 		float phi = acos(2.0 * v - 1.0);
-		float r = cbrt(random() * 0.9 + 0.1) * radius;
+		float r = cbrt(random(1.0f) * 0.9 + 0.1) * radius;
 		float sinTheta = sin(theta);
 		float cosTheta = cos(theta);
 		float sinPhi = sin(phi);
@@ -1531,6 +1871,9 @@ Texture* GTR::CubemapFromHDRE(const char* filename)
 	HDRE* hdre = HDRE::Get(filename);
 	if (!hdre)
 		return NULL;
+	//released after a previous upload, map it again
+	if (!hdre->getData() && !hdre->load(filename))
+		return NULL;
 
 	Texture* texture = new Texture();
 	if (hdre->getFacesf(0))
@@ -1550,5 +1893,8 @@ Texture* GTR::CubemapFromHDRE(const char* filename)
 				texture->uploadCubemap(texture->format, texture->type, false,
 					(Uint8**)hdre->getFacesh(i), GL_RGBA16F, i);
 		}
+
+	//the pixels are on the GPU now, only the header and SH coefficients are kept
+	hdre->release();
 	return texture;
 }
\ No newline at end of file
@@ -9,6 +9,16 @@ class Shader;
 class Texture;
 class HDRE;
 
+//reflection probes atlas, must match add_reflections.fs
+#define REFLECTION_TILE_SIZE 32 //pixels of a screen tile
+#define REFLECTION_PROBES_PER_TILE 8
+#define REFLECTION_OCTA_SIZE 128 //octahedral tile of the sharpest level
+#define REFLECTION_OCTA_LEVELS 6
+#define REFLECTION_ATLAS_COLUMNS 4
+
+//the deferred passes read the gbuffers, which always have occlusion, metalness, roughness and emission (see eShaderFeature)
+#define DEFERRED_FEATURES (SHADER_OMR_MAP | SHADER_EMISSIVE_MAP)
+
 namespace GTR {
 
 	enum eRenderMode {
@@ -114,8 +124,20 @@ namespace GTR {
 		Texture* currentReflection;
 		FBO reflection_fbo;
 		FBO* cRefl_fbo;
+		Camera* cRefl_cam;
 		bool apply_reflections;
-		bool first_it;
+		int reflection_faces_per_frame; //budget of cubemap faces rendered every frame
+		bool reflection_continuous; //keep refreshing the probes even if nothing changed
+		unsigned int reflection_scene_hash; //of the lights and entities, to detect changes
+		long reflection_frame;
+
+		//all the probes as octahedral tiles in one texture, and the probes that reach every screen tile
+		Texture* reflection_atlas;
+		FBO* reflection_atlas_fbo;
+		int reflection_atlas_capacity;
+		Texture* reflection_probes_data;
+		Texture* reflection_tiles;
+		std::vector<float> reflection_tiles_data;
 
 		//bools
 		bool renderingShadows;
@@ -160,9 +182,10 @@ namespace GTR {
 
 		void multipassUniforms(LightEntity* light, Shader*& shader, const Matrix44 model, GTR::Material* material, Camera* camera, Mesh* mesh, int iteration, Texture* cubemap); //multipass
 
-		void multipassRendering(Shader*& shader, const Matrix44 model, GTR::Material* material, Camera* camera, Mesh* mesh, Texture* cubemap); //multipass renderer
+		void multipassRendering(Shader*& shader, const Matrix44 model, GTR::Material* material, Camera* camera, Mesh* mesh, Texture* cubemap); //multipass renderer, a shader variant for every pass
+		unsigned int getIlumFeatures(); //eShaderFeature of the ilum_mode
 
-		void uploadExtraMap(Shader*& shader, Texture* texture, const char* uniform_name, const char* bool_name, int tex_slot);
+		void uploadExtraMap(Shader*& shader, Texture* texture, const char* uniform_name, int tex_slot); //only if there is one, the shader variant knows it
 
 		void singlepassUniforms(Shader*& shader, const Matrix44 model, GTR::Material* material, Camera* camera, Mesh* mesh);
 
@@ -193,6 +216,9 @@ namespace GTR {
 		//deferred
 		void collectRenderCalls(GTR::Scene* scene, Camera* camera);
 
+		//tells the streamed textures of the render calls how big they are on screen
+		void requestTextureLevels(Camera* camera);
+
 		void renderDeferred(Scene* scene, std::vector<RenderCall*>& rc, Camera* camera);
 
 		void showgbuffers(Camera* camera);
@@ -212,6 +238,9 @@ namespace GTR {
 		//irradiance
 		void computeProbe(Scene* scene, sProbe& p, int iteration);
 
+		//renders the 6 faces seen from the probe into images (expects renderCalls already collected)
+		void renderProbeFaces(Scene* scene, sProbe& p, FloatImage* images);
+
 		void updateIrradianceCache(GTR::Scene* scene);
 
 		void renderProbe(Vector3 pos, float size, float* coeffs);
@@ -224,7 +253,15 @@ namespace GTR {
 		//reflections
 		void updateReflectionProbes(Scene* scene);
 
+		//renders at most reflection_faces_per_frame faces, dirty and close probes first
+		void updateReflectionProbesBudget(Scene* scene, Camera* camera);
+
 		void captureReflectionProbe(Scene* scene, reflectionProbeEntity*& probe);
+		void captureReflectionFace(Scene* scene, reflectionProbeEntity* probe, int face);
+
+		//copies the cubemap of a probe (every roughness level) to its tile in the atlas
+		void storeReflectionProbe(Scene* scene, reflectionProbeEntity* probe);
+		void buildReflectionTiles(Scene* scene, Camera* camera, int width, int height);
 
 		void renderReflectionProbes(Scene* scene, Camera* camera);
 
@@ -0,0 +1,203 @@
+#include "renderstats.h"
+#include "includes.h"
+#include "mesh.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+static const char* s_stat_names[NUM_RENDER_STATS] = { "draw_calls", "triangles", "shader_switches", "uniforms",
+	"texture_binds", "fbo_binds", "state_changes", "nodes_visible", "nodes_culled" };
+
+sRenderCounters RenderStats::frame;
+std::vector<sRenderCounters> RenderStats::passes;
+int RenderStats::current_pass = -1;
+
+static sRenderCounters s_last_frame;
+static std::vector<sRenderCounters> s_last_passes;
+static std::vector<int> s_pass_stack;
+
+static double s_frame_times[RENDER_STATS_HISTORY];	//ms, a ring
+static int s_num_frame_times = 0;
+static int s_next_frame_time = 0;
+static double s_frame_start = -1;
+
+static double now()
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+sRenderCounters::sRenderCounters(const char* name)
+{
+	this->name = name;
+	memset(values, 0, sizeof(values));
+}
+
+void RenderStats::pushPass(const char* name)
+{
+	s_pass_stack.push_back(current_pass);
+	//a pass done twice in the frame adds to the same counters
+	for (size_t i = 0; i < passes.size(); ++i)
+		if (passes[i].name == name)
+		{
+			current_pass = (int)i;
+			return;
+		}
+	passes.push_back(sRenderCounters(name));
+	current_pass = (int)passes.size() - 1;
+}
+
+void RenderStats::popPass()
+{
+	if (s_pass_stack.empty())
+		return;
+	current_pass = s_pass_stack.back();
+	s_pass_stack.pop_back();
+}
+
+void RenderStats::newFrame()
+{
+	double time = now();
+	if (s_frame_start >= 0)
+	{
+		s_frame_times[s_next_frame_time] = time - s_frame_start;
+		s_next_frame_time = (s_next_frame_time + 1) % RENDER_STATS_HISTORY;
+		s_num_frame_times = std::min(s_num_frame_times + 1, RENDER_STATS_HISTORY);
+	}
+	s_frame_start = time;
+
+	s_last_frame = frame;
+	s_last_passes.swap(passes);
+	frame = sRenderCounters();
+	passes.clear();
+	s_pass_stack.clear();
+	current_pass = -1;
+
+	//the old counters of the meshes, now they are per frame too
+	Mesh::num_meshes_rendered = 0;
+	Mesh::num_triangles_rendered = 0;
+}
+
+void RenderStats::resetHistory()
+{
+	s_num_frame_times = 0;
+	s_next_frame_time = 0;
+	s_frame_start = -1;
+}
+
+const sRenderCounters& RenderStats::getLastFrame()
+{
+	return s_last_frame;
+}
+
+const std::vector<sRenderCounters>& RenderStats::getLastPasses()
+{
+	return s_last_passes;
+}
+
+sFrameTimePercentiles RenderStats::getFrameTimes()
+{
+	sFrameTimePercentiles result;
+	memset(&result, 0, sizeof(result));
+	result.frames = s_num_frame_times;
+	if (!s_num_frame_times)
+		return result;
+
+	//a few hundred values, sorting a copy is cheap enough for the menu
+	std::vector<double> times(s_frame_times, s_frame_times + s_num_frame_times);
+	std::sort(times.begin(), times.end());
+	double total = 0;
+	for (size_t i = 0; i < times.size(); ++i)
+		total += times[i];
+	int last = (int)times.size() - 1;
+	result.average = total / times.size();
+	result.min = times[0];
+	result.p50 = times[(int)(last * 0.50 + 0.5)];
+	result.p95 = times[(int)(last * 0.95 + 0.5)];
+	result.p99 = times[(int)(last * 0.99 + 0.5)];
+	result.max = times[last];
+	return result;
+}
+
+static void writeCounters(FILE* f, const sRenderCounters& counters)
+{
+	fprintf(f, "{\"name\":\"%s\"", counters.name);
+	for (int i = 0; i < NUM_RENDER_STATS; ++i)
+		fprintf(f, ",\"%s\":%ld", s_stat_names[i], counters.values[i]);
+	fprintf(f, "}");
+}
+
+bool RenderStats::writeJSON(const char* filename)
+{
+	FILE* f = fopen(filename, "w");
+	if (!f)
+	{
+		std::cout << "[ERROR] cannot write render stats: " << filename << std::endl;
+		return false;
+	}
+
+	sFrameTimePercentiles times = getFrameTimes();
+	fprintf(f, "{\n\"frame_times_ms\":{\"frames\":%d,\"average\":%.4f,\"min\":%.4f,\"p50\":%.4f,\"p95\":%.4f,\"p99\":%.4f,\"max\":%.4f},\n",
+		times.frames, times.average, times.min, times.p50, times.p95, times.p99, times.max);
+	fprintf(f, "\"frame\":");
+	writeCounters(f, s_last_frame);
+	fprintf(f, ",\n\"passes\":[");
+	for (size_t i = 0; i < s_last_passes.size(); ++i)
+	{
+		fprintf(f, i ? ",\n\t" : "\n\t");
+		writeCounters(f, s_last_passes[i]);
+	}
+	fprintf(f, "\n],\n\"history_ms\":[");
+	//oldest first
+	int first = s_num_frame_times < RENDER_STATS_HISTORY ? 0 : s_next_frame_time;
+	for (int i = 0; i < s_num_frame_times; ++i)
+		fprintf(f, i ? ",%.4f" : "%.4f", s_frame_times[(first + i) % RENDER_STATS_HISTORY]);
+	fprintf(f, "]\n}\n");
+	bool ok = ferror(f) == 0;
+	fclose(f);
+	if (ok)
+		std::cout << " + Render stats written to " << filename << std::endl;
+	else
+		std::cout << "[ERROR] cannot write render stats: " << filename << std::endl;
+	return ok;
+}
+
+void RenderStats::renderInMenu()
+{
+#ifndef SKIP_IMGUI
+	sFrameTimePercentiles times = getFrameTimes();
+	ImGui::Text("Frame ms: avg %.2f  p50 %.2f  p95 %.2f  p99 %.2f  max %.2f", times.average, times.p50, times.p95, times.p99, times.max);
+
+	float history[RENDER_STATS_HISTORY];
+	int first = s_num_frame_times < RENDER_STATS_HISTORY ? 0 : s_next_frame_time;
+	for (int i = 0; i < s_num_frame_times; ++i)
+		history[i] = (float)s_frame_times[(first + i) % RENDER_STATS_HISTORY];
+	if (s_num_frame_times)
+		ImGui::PlotLines("##frame_times", history, s_num_frame_times, 0, "frame ms", 0.0f, (float)times.p99 * 1.5f, ImVec2(0, 60));
+
+	if (ImGui::Button("Dump to JSON"))
+		writeJSON("render_stats.json");
+
+	static const char* headers[] = { "Pass", "Draws", "Tris", "Shaders", "Uniforms", "Textures", "FBOs", "States", "Visible", "Culled" };
+	ImGui::Columns(NUM_RENDER_STATS + 1, "render_stats");
+	for (int i = 0; i <= NUM_RENDER_STATS; ++i)
+	{
+		ImGui::Text("%s", headers[i]);
+		ImGui::NextColumn();
+	}
+	ImGui::Separator();
+	for (int i = -1; i < (int)s_last_passes.size(); ++i)
+	{
+		const sRenderCounters& counters = i < 0 ? s_last_frame : s_last_passes[i];
+		ImGui::Text("%s", counters.name);
+		ImGui::NextColumn();
+		for (int j = 0; j < NUM_RENDER_STATS; ++j)
+		{
+			ImGui::Text("%ld", counters.values[j]);
+			ImGui::NextColumn();
+		}
+	}
+	ImGui::Columns(1);
+#endif
+}
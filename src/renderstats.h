@@ -0,0 +1,72 @@
+/*  Counters of the work sent to OpenGL every frame (draw calls, triangles, shader switches, uniforms, textures,
+	FBOs and state changes, and the nodes that passed or failed the frustum test), split by render pass, and a
+	history of the frame times to get the percentiles. The passes are the GPU scopes of the profiler, so a build
+	with NO_PROFILER only has the totals of the frame. Everything is counted in the main thread.
+	The last frame is shown in the debug menu and can be written to a JSON.
+*/
+#pragma once
+
+#include <string>
+#include <vector>
+
+#define RENDER_STATS_HISTORY 300 //frames kept for the percentiles, 5 seconds at 60fps
+
+enum eRenderStat {
+	STAT_DRAW_CALLS = 0,
+	STAT_TRIANGLES,
+	STAT_SHADER_SWITCHES,
+	STAT_UNIFORMS,
+	STAT_TEXTURE_BINDS,
+	STAT_FBO_BINDS,
+	STAT_STATE_CHANGES,		//blending, culling and depth of the materials and the light passes
+	STAT_NODES_VISIBLE,
+	STAT_NODES_CULLED,
+	NUM_RENDER_STATS
+};
+
+struct sRenderCounters {
+	const char* name;		//of the pass, a literal
+	long values[NUM_RENDER_STATS];
+
+	sRenderCounters(const char* name = "frame");
+};
+
+struct sFrameTimePercentiles {
+	int frames;				//in the history
+	double average;
+	double min;
+	double p50;
+	double p95;
+	double p99;
+	double max;
+};
+
+class RenderStats
+{
+public:
+	static sRenderCounters frame;					//being counted
+	static std::vector<sRenderCounters> passes;		//of the frame being counted
+	static int current_pass;						//index in passes, -1 outside of them
+
+	static void add(eRenderStat stat, long amount = 1)
+	{
+		frame.values[stat] += amount;
+		if (current_pass >= 0)
+			passes[current_pass].values[stat] += amount;
+	}
+
+	//the nested passes count apart from the outer one
+	static void pushPass(const char* name);
+	static void popPass();
+
+	//keeps the frame counted until now and its time, then starts a new one
+	static void newFrame();
+	static void resetHistory(); //the frame being counted is not timed either
+
+	static const sRenderCounters& getLastFrame();
+	static const std::vector<sRenderCounters>& getLastPasses();
+	static sFrameTimePercentiles getFrameTimes();
+
+	static bool writeJSON(const char* filename);
+	static void renderInMenu();
+};
@@ -7,13 +7,16 @@
 #include "renderer.h"
 
 #include "prefab.h"
+#include "mesh.h"
 #include "extra/cJSON.h"
 #include "extra/hdre.h"
+#include "scenecache.h"
 
 
 /************************************************************************************************************/
 
 GTR::Scene* GTR::Scene::instance = NULL;
+bool GTR::Scene::use_snapshot = true;
 
 GTR::Scene::Scene()
 {
@@ -31,6 +34,9 @@ void GTR::Scene::clear(){
 		delete ent;
 	}
 	entities.resize(0);
+	lights.clear();
+	reflectionProbes.clear();
+	focus_point = NULL;
 }
 
 
@@ -51,6 +57,13 @@ bool GTR::Scene::load(const char* filename)
 		return false;
 	}
 
+	//the JSON has not changed since the snapshot was written
+	unsigned long long json_hash = hashMemory64(content.c_str(), content.size());
+	std::string snapshot_filename = std::string(filename) + SCENE_CACHE_EXTENSION;
+	if (use_snapshot && loadSnapshot(snapshot_filename.c_str(), json_hash))
+		return true;
+	long time = getTime();
+
 	//parse json string 
 	cJSON* json = cJSON_Parse(content.c_str());
 	if (!json)
@@ -60,11 +73,8 @@ bool GTR::Scene::load(const char* filename)
 	}
 
 	//read global properties
-
-	//HDRE* hdre = new HDRE();
-	//if (hdre->load((cJSON_GetObjectItem(json, "environment")->valuestring)))	//Falta el lector de chars?
-
-	environment = GTR::CubemapFromHDRE("data/night.hdre");
+	environment_filename = std::string("data/") + readJSONString(json, "environment", "night.hdre");
+	environment = GTR::CubemapFromHDRE(environment_filename.c_str());
 
 	background_color = readJSONVector3(json, "background_color", background_color);
 	ambient_light = readJSONVector3(json, "ambient_light", ambient_light );
@@ -135,10 +145,159 @@ bool GTR::Scene::load(const char* filename)
 
 	//free memory
 	cJSON_Delete(json);
+	std::cout << " + Scene JSON: " << entities.size() << " entities in " << (getTime() - time) << "ms" << std::endl;
 
+	if (use_snapshot)
+		saveSnapshot(snapshot_filename.c_str(), json_hash);
 	return true;
 }
 
+bool GTR::Scene::loadSnapshot(const char* filename, unsigned long long json_hash)
+{
+	long time = getTime();
+	SceneCacheFile cache;
+	if (!cache.open(filename, json_hash))
+		return false;
+
+	const sSceneCacheHeader* header = cache.header;
+	background_color = header->background_color;
+	ambient_light = header->ambient_light;
+	main_camera.eye = header->camera_eye;
+	main_camera.center = header->camera_center;
+	main_camera.fov = header->camera_fov;
+
+	//every file is resolved once, the entities only point to them
+	std::vector<void*> assets(header->num_assets);
+	for (size_t i = 0; i < assets.size(); ++i)
+	{
+		const char* path = cache.getString(cache.assets[i].path);
+		switch (cache.assets[i].type)
+		{
+			case SCENE_ASSET_PREFAB: assets[i] = GTR::Prefab::GetAsync((std::string("data/") + path).c_str()); break;
+			case SCENE_ASSET_TEXTURE: assets[i] = Texture::Get(path, false, false); break;
+			case SCENE_ASSET_ENVIRONMENT: assets[i] = GTR::CubemapFromHDRE(path); break;
+		}
+	}
+	environment_filename = header->environment >= 0 ? cache.getString(cache.assets[header->environment].path) : "";
+	environment = header->environment >= 0 ? (Texture*)assets[header->environment] : NULL;
+
+	for (unsigned int i = 0; i < header->num_entities; ++i)
+	{
+		const sSceneCacheEntity& e = cache.entities[i];
+		BaseEntity* ent = NULL;
+		switch (e.type)
+		{
+			case PREFAB: ent = new PrefabEntity(); break;
+			case LIGHT: ent = new LightEntity(); break;
+			case REFLECTION_PROBE: ent = new reflectionProbeEntity(); break;
+			case DECALL: ent = new DecalEntity(); break;
+			default: ent = new BaseEntity(); break;
+		}
+		addEntity(ent);
+		ent->name = cache.getString(e.name);
+		ent->model = e.model;
+		ent->visible = (e.flags & SCENE_ENTITY_VISIBLE) != 0;
+		ent->render_gui = (e.flags & SCENE_ENTITY_RENDER_GUI) != 0;
+		if (e.flags & SCENE_ENTITY_FOCUS_POINT)
+			focus_point = ent;
+
+		if (e.type == PREFAB && e.assets[0] >= 0)
+		{
+			PrefabEntity* prefab_ent = (PrefabEntity*)ent;
+			prefab_ent->filename = cache.getString(cache.assets[e.assets[0]].path);
+			prefab_ent->prefab = (Prefab*)assets[e.assets[0]];
+		}
+		else if (e.type == LIGHT)
+		{
+			LightEntity* light = (LightEntity*)ent;
+			light->light_type = (eLightType)e.light_type;
+			light->color = e.color;
+			light->intensity = e.intensity;
+			light->max_dist = e.max_dist;
+			light->cone_angle = e.cone_angle;
+			light->spotExp = e.spot_exp;
+			light->area_size = e.area_size;
+			light->useful = (e.flags & SCENE_ENTITY_USEFUL) != 0;
+			light->init();
+		}
+		else if (e.type == REFLECTION_PROBE)
+		{
+			reflectionProbeEntity* probe = (reflectionProbeEntity*)ent;
+			probe->radius = e.radius;
+			reflectionProbes.push_back(probe);
+		}
+		else if (e.type == DECALL)
+		{
+			DecalEntity* decal = (DecalEntity*)ent;
+			Texture** textures[SCENE_CACHE_MAX_ASSETS] = { &decal->albedo, &decal->omr, &decal->normal };
+			std::string* filenames[SCENE_CACHE_MAX_ASSETS] = { &decal->albedo_filename, &decal->omr_filename, &decal->normal_filename };
+			for (int j = 0; j < SCENE_CACHE_MAX_ASSETS; ++j)
+				if (e.assets[j] >= 0)
+				{
+					*textures[j] = (Texture*)assets[e.assets[j]];
+					*filenames[j] = cache.getString(cache.assets[e.assets[j]].path);
+				}
+			decal->has_albedo = decal->albedo != NULL;
+			decal->has_omr = decal->omr != NULL;
+			decal->has_normal = decal->normal != NULL;
+		}
+	}
+
+	std::cout << " + Scene snapshot: " << entities.size() << " entities, " << assets.size() << " assets in " << (getTime() - time) << "ms from " << filename << std::endl;
+	return true;
+}
+
+bool GTR::Scene::saveSnapshot(const char* filename, unsigned long long json_hash)
+{
+	sSceneCacheData data;
+	data.header.background_color = background_color;
+	data.header.ambient_light = ambient_light;
+	data.header.camera_eye = main_camera.eye;
+	data.header.camera_center = main_camera.center;
+	data.header.camera_fov = main_camera.fov;
+	data.header.environment = data.addAsset(SCENE_ASSET_ENVIRONMENT, environment_filename);
+
+	for (size_t i = 0; i < entities.size(); ++i)
+	{
+		BaseEntity* ent = entities[i];
+		sSceneCacheEntity e = sSceneCacheEntity(); //zeroed, padding included
+		e.type = ent->entity_type;
+		e.flags = (ent->visible ? SCENE_ENTITY_VISIBLE : 0) | (ent->render_gui ? SCENE_ENTITY_RENDER_GUI : 0) | (ent == focus_point ? SCENE_ENTITY_FOCUS_POINT : 0);
+		e.name = data.addString(ent->name);
+		e.model = ent->model;
+		for (int j = 0; j < SCENE_CACHE_MAX_ASSETS; ++j)
+			e.assets[j] = -1;
+
+		if (ent->entity_type == PREFAB)
+			e.assets[0] = data.addAsset(SCENE_ASSET_PREFAB, ((PrefabEntity*)ent)->filename);
+		else if (ent->entity_type == LIGHT)
+		{
+			LightEntity* light = (LightEntity*)ent;
+			e.light_type = light->light_type;
+			e.color = light->color;
+			e.intensity = light->intensity;
+			e.max_dist = light->max_dist;
+			e.cone_angle = light->cone_angle;
+			e.spot_exp = light->spotExp;
+			e.area_size = light->area_size;
+			if (light->useful)
+				e.flags |= SCENE_ENTITY_USEFUL;
+		}
+		else if (ent->entity_type == REFLECTION_PROBE)
+			e.radius = ((reflectionProbeEntity*)ent)->radius;
+		else if (ent->entity_type == DECALL)
+		{
+			DecalEntity* decal = (DecalEntity*)ent;
+			e.assets[0] = data.addAsset(SCENE_ASSET_TEXTURE, decal->albedo_filename);
+			e.assets[1] = data.addAsset(SCENE_ASSET_TEXTURE, decal->omr_filename);
+			e.assets[2] = data.addAsset(SCENE_ASSET_TEXTURE, decal->normal_filename);
+		}
+		data.entities.push_back(e);
+	}
+
+	return writeSceneCache(filename, json_hash, data);
+}
+
 void GTR::Scene::updateLights() {
 	for (int i = 0; i < lights.size(); i++) {
 
@@ -172,7 +331,7 @@ GTR::BaseEntity* GTR::Scene::createEntity(std::string type)
 		focus_point = new GTR::BaseEntity();
 		return focus_point;
 	}
-		
+	return NULL;
 }
 
 void GTR::BaseEntity::renderInMenu()
@@ -199,7 +358,7 @@ void GTR::PrefabEntity::configure(cJSON* json)
 	if (cJSON_GetObjectItem(json, "filename"))
 	{
 		filename = cJSON_GetObjectItem(json, "filename")->valuestring;
-		prefab = GTR::Prefab::Get( (std::string("data/") + filename).c_str());
+		prefab = GTR::Prefab::GetAsync( (std::string("data/") + filename).c_str());
 	}
 }
 
@@ -309,6 +468,10 @@ void GTR::LightEntity::configure(cJSON* json) {
 		useful = true;
 	}
 
+	init();
+}
+
+void GTR::LightEntity::init() {
 	if (Scene::instance != NULL) {
 		Scene::instance->lights.push_back(this);
 	}
@@ -415,6 +578,10 @@ GTR::IrradianceEntity::IrradianceEntity(){
 	probes_texture = NULL;
 	size = 2;
 	normal_dist = 1.0;
+	indirection_texture = NULL;
+	adaptive = true;
+	encoding = IRR_HALF;
+	scene_hash = hashIrradianceScene(Scene::instance ? Scene::instance->filename.c_str() : NULL);
 	bool read_irr_info = read("data/irradianceData/irradiance.bin");
 	if (!read_irr_info) {
 		int fact_dist = 10;
@@ -437,30 +604,180 @@ GTR::IrradianceEntity::~IrradianceEntity(){
 }
 
 void GTR::IrradianceEntity::placeProbes() {
+	probes.clear();
 
 	//lets compute the centers
 	//pay attention at the order at which we add them
 	for (int z = 0; z < dimensions[2]; ++z)
 		for (int y = 0; y < dimensions[1]; ++y)
 			for (int x = 0; x < dimensions[0]; ++x)
-			{
-				sProbe p;
-				p.local.set(x, y, z);
+				addProbe(x, y, z);
+
+	if (adaptive)
+		adaptProbes();
+	buildIndirection();
+
+	init();
+}
+
+void GTR::IrradianceEntity::addProbe(int x, int y, int z) {
+	sProbe p = sProbe();
+	p.local.set(x, y, z);
 
-				//index in the linear array
-				p.index = x + y * dimensions[0] + z * dimensions[0] * dimensions[1];
+	//index in the linear array
+	p.index = x + y * dimensions[0] + z * dimensions[0] * dimensions[1];
 
-				//and its position
-				p.pos = start_pos + delta * Vector3(x, y, z);
-				probes.push_back(p);
+	//and its position
+	p.pos = start_pos + delta * Vector3(x, y, z);
+	probes.push_back(p);
+}
+
+//a mesh of the scene in world space, to test the probes against
+struct sProbeCollider {
+	Mesh* mesh;
+	Matrix44 model;
+	Vector3 min;
+	Vector3 max;
+};
+
+static void collectProbeColliders(GTR::Node* node, const Matrix44& prefab_model, std::vector<sProbeCollider>& colliders) {
+	if (!node->visible)
+		return;
+
+	Matrix44 node_model = node->getGlobalMatrix(true) * prefab_model;
+	//blended objects do not block the light in the probes either
+	if (node->mesh && node->material && node->material->alpha_mode != GTR::eAlphaMode::BLEND) {
+		BoundingBox box = transformBoundingBox(node_model, node->mesh->box);
+		sProbeCollider collider;
+		collider.mesh = node->mesh;
+		collider.model = node_model;
+		collider.min = box.center - box.halfsize;
+		collider.max = box.center + box.halfsize;
+		colliders.push_back(collider);
+	}
+
+	for (size_t i = 0; i < node->children.size(); ++i)
+		collectProbeColliders(node->children[i], prefab_model, colliders);
+}
+
+static float distanceToBox2(const Vector3& p, const sProbeCollider& c) {
+	float dist = 0;
+	for (int i = 0; i < 3; ++i) {
+		float d = p.v[i] < c.min.v[i] ? c.min.v[i] - p.v[i] : (p.v[i] > c.max.v[i] ? p.v[i] - c.max.v[i] : 0);
+		dist += d * d;
+	}
+	return dist;
+}
+
+//casts a ray along every axis, a probe that sees the back of the faces in most of them is inside a closed object
+static bool probeInsideGeometry(const Vector3& pos, std::vector<sProbeCollider>& colliders) {
+	const Vector3 dirs[6] = { Vector3(1,0,0), Vector3(-1,0,0), Vector3(0,1,0), Vector3(0,-1,0), Vector3(0,0,1), Vector3(0,0,-1) };
+	int backfaces = 0;
+	for (int i = 0; i < 6; ++i) {
+		const Vector3& dir = dirs[i];
+		float closest = 3.4e+38F;
+		bool backface = false;
+		for (size_t j = 0; j < colliders.size(); ++j) {
+			sProbeCollider& c = colliders[j];
+			//skip the boxes behind the ray or further than the closest hit
+			int axis = i / 2;
+			float to_box = dir.v[axis] > 0 ? c.min.v[axis] - pos.v[axis] : pos.v[axis] - c.max.v[axis];
+			if (to_box > closest || (dir.v[axis] > 0 ? c.max.v[axis] < pos.v[axis] : c.min.v[axis] > pos.v[axis]))
+				continue;
+			int a1 = (axis + 1) % 3, a2 = (axis + 2) % 3;
+			if (pos.v[a1] < c.min.v[a1] || pos.v[a1] > c.max.v[a1] || pos.v[a2] < c.min.v[a2] || pos.v[a2] > c.max.v[a2])
+				continue;
+
+			Vector3 collision, normal;
+			if (!c.mesh->testRayCollision(c.model, pos, dir, collision, normal, closest))
+				continue;
+			float dist = pos.distance(collision);
+			if (dist < closest) {
+				closest = dist;
+				backface = normal.dot(dir) > 0;
 			}
+		}
+		if (backface)
+			backfaces++;
+	}
+	return backfaces >= 4;
+}
 
-	init();
+void GTR::IrradianceEntity::adaptProbes() {
+	std::vector<sProbeCollider> colliders;
+	Scene* scene = Scene::instance;
+	for (size_t i = 0; scene && i < scene->entities.size(); ++i) {
+		BaseEntity* ent = scene->entities[i];
+		if (ent->visible && ent->entity_type == PREFAB && ((PrefabEntity*)ent)->prefab)
+			collectProbeColliders(&((PrefabEntity*)ent)->prefab->root, ent->model, colliders);
+	}
+	if (colliders.empty())
+		return;
+
+	long time = getTime();
+	//any corner of a cell crossed by a surface is closer than the cell diagonal, so those keep full density
+	float near_radius = delta.length();
+	float min_delta = delta.x < delta.y ? (delta.x < delta.z ? delta.x : delta.z) : (delta.y < delta.z ? delta.y : delta.z);
+	float embed_radius = min_delta * 0.05;
+
+	std::vector<sProbe> kept;
+	int inside = 0;
+	int thinned = 0;
+	for (size_t i = 0; i < probes.size(); ++i) {
+		sProbe& p = probes[i];
+		Vector3 collision, normal;
+		bool near_surface = false;
+		bool embedded = false;
+		for (size_t j = 0; j < colliders.size(); ++j) {
+			sProbeCollider& c = colliders[j];
+			if (distanceToBox2(p.pos, c) > near_radius * near_radius)
+				continue;
+			if (!c.mesh->testSphereCollision(c.model, p.pos, near_radius, collision, normal))
+				continue;
+			near_surface = true;
+			if (c.mesh->testSphereCollision(c.model, p.pos, embed_radius, collision, normal)) {
+				embedded = true;
+				break;
+			}
+		}
+
+		if (!near_surface) {
+			//far from every surface the light changes slowly, keep one of every 2x2x2 nodes
+			if ((int)p.local.x % 2 || (int)p.local.y % 2 || (int)p.local.z % 2) {
+				thinned++;
+				continue;
+			}
+		}
+		else if (embedded || probeInsideGeometry(p.pos, colliders)) {
+			inside++;
+			continue;
+		}
+		kept.push_back(p);
+	}
+
+	if (kept.empty())
+		return;
+	std::cout << " + Probes placed: " << kept.size() << " of " << probes.size() << " (" << inside << " inside geometry, " << thinned << " far from surfaces) in " << (getTime() - time) << "ms" << std::endl;
+	probes = kept;
+}
+
+bool GTR::IrradianceEntity::buildIndirection() {
+	std::vector<int> nodes(probes.size());
+	for (size_t i = 0; i < probes.size(); ++i)
+		nodes[i] = probes[i].index;
+	int dims[3] = { (int)dimensions.x, (int)dimensions.y, (int)dimensions.z };
+	return buildIrradianceIndirection(dims, nodes.size() ? &nodes[0] : NULL, (int)nodes.size(), indirection);
 }
 
-void GTR::IrradianceEntity::probesToTexture() {
+void GTR::IrradianceEntity::probesToTexture(const void* coeffs, eIrrCacheEncoding coeffs_encoding) {
 
 
+	//the number of probes changes when they are placed again
+	if (probes_texture && probes_texture->height != probes.size()) {
+		delete probes_texture;
+		probes_texture = NULL;
+	}
+
 	if (!probes_texture) {
 		int p_size = probes.size();
 		probes_texture = new Texture(
@@ -471,14 +788,28 @@ void GTR::IrradianceEntity::probesToTexture() {
 	}
 
 	//we must create the color information for the texture. because every SH are 27 floats in the RGB,RGB,... order, we can create an array of SphericalHarmonics and use it as pixels of the texture
-	SphericalHarmonics* sh_data =  new SphericalHarmonics[ (dimensions[0] * dimensions[1] * dimensions[2]) ];
-
-	for (int i = 0; i < probes.size(); ++i)
-	{
-		sh_data[i] = probes[i].sh;
+	SphericalHarmonics* sh_data = NULL;
+	if (!coeffs) {
+		sh_data = new SphericalHarmonics[probes.size()];
+		for (size_t i = 0; i < probes.size(); ++i)
+		{
+			sh_data[i] = probes[i].sh;
+		}
+		coeffs = sh_data;
+		coeffs_encoding = IRR_FLOAT32;
 	}
 
-	probes_texture->upload(GL_RGB, GL_FLOAT, false, (uint8*)sh_data);
+	//rows of 9 half RGB texels are not 4 bytes aligned
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	probes_texture->upload(GL_RGB, coeffs_encoding == IRR_HALF ? GL_HALF_FLOAT : GL_FLOAT, false, (uint8*)coeffs);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+	//sparse grid, every node reads the row of its probe from the indirection texture (x, y + z * dimy)
+	if (indirection.size() && probes.size() < indirection.size()) {
+		if (!indirection_texture)
+			indirection_texture = new Texture();
+		indirection_texture->create(dimensions.x, dimensions.y * dimensions.z, GL_RED, GL_FLOAT, false, (Uint8*)&indirection[0], GL_R32F);
+	}
 	//disable any texture filtering when reading
 	probes_texture->bind();
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
@@ -503,36 +834,82 @@ void GTR::IrradianceEntity::uploadUniforms(Shader*& shader){
 	shader->setUniform("u_irr_active", active);
 	if(probes_texture != NULL)
 		shader->setUniform("u_probes_texture", probes_texture, 9);
+	bool sparse = indirection_texture != NULL && probes.size() < indirection.size();
+	shader->setUniform("u_irr_sparse", sparse);
+	if (sparse)
+		shader->setUniform("u_irr_indirection", indirection_texture, 10);
 }
 
 void GTR::IrradianceEntity::save(){
 	// saveIrradianceToDisk ---------------------------------
-	//fill header structure
-	sIrrHeader header;
+	//only the coeffs and the nodes are stored, positions come from the grid
+	std::vector<SphericalHarmonics> sh(probes.size());
+	std::vector<int> nodes(probes.size());
+	for (size_t i = 0; i < probes.size(); ++i) {
+		sh[i] = probes[i].sh;
+		nodes[i] = probes[i].index;
+	}
 
-	header.start = start_pos;
-	header.end = end_pos;
-	header.dims = dimensions;
-	header.delta = delta;
-	header.num_probes = probes.size();
+	writeIrradianceCache("data/irradianceData/irradiance.bin", start_pos, end_pos, delta, dimensions, &sh[0], &nodes[0], sh.size(), encoding, scene_hash);
+}
 
-	//write to file header and probes data
-	FILE* f = fopen("data/irradianceData/irradiance.bin", "wb");
-	fwrite(&header, sizeof(header), 1, f);
-	fwrite(&(probes[0]), sizeof(sProbe), probes.size(), f);
+bool GTR::IrradianceEntity::read(const char* filename){
+	//load probes info from disk
+	FILE* f = fopen(filename, "rb");
+	if (!f)
+		return false;
+	char magic[4] = { 0 };
+	fread(magic, 1, 4, f);
 	fclose(f);
 
+	//caches saved before the header existed
+	if (memcmp(magic, IRR_CACHE_MAGIC, 4) != 0)
+		return readLegacy(filename);
+
+	IrradianceCacheFile cache;
+	if (!cache.open(filename, scene_hash))
+		return false;
+
+	//copy info from header to our local vars
+	const sIrrCacheHeader* header = cache.header;
+	start_pos = header->start;
+	end_pos = header->end;
+	dimensions.set(header->dims[0], header->dims[1], header->dims[2]);
+	delta = header->delta;
+	encoding = (eIrrCacheEncoding)header->encoding;
+
+	//positions come from the grid
+	probes.clear();
+	int dx = header->dims[0], dy = header->dims[1];
+	for (int i = 0; i < header->num_probes; ++i) {
+		int node = cache.nodes ? cache.nodes[i] : i;
+		addProbe(node % dx, (node / dx) % dy, node / (dx * dy));
+	}
+	buildIndirection(); //the nodes were checked when the cache was opened
+
+	std::vector<SphericalHarmonics> sh(probes.size());
+	cache.decode(&sh[0]);
+	for (size_t i = 0; i < probes.size(); ++i)
+		probes[i].sh = sh[i];
+
+	//the texture is filled straight from the mapped file
+	probesToTexture(cache.coeffs, encoding);
+	std::cout << "+ Irradiance uploaded" << std::endl;
+	return true;
 }
 
-bool GTR::IrradianceEntity::read(const char* filename){
-	//load probes info from disk
+bool GTR::IrradianceEntity::readLegacy(const char* filename){
 	FILE* f = fopen(filename, "rb");
 	if (!f)
 		return false;
 
 	//read header
 	sIrrHeader header;
-	fread(&header, sizeof(header), 1, f);
+	if (fread(&header, sizeof(header), 1, f) != 1 || header.num_probes <= 0 || header.num_probes != header.dims.x * header.dims.y * header.dims.z) {
+		fclose(f);
+		std::cout << "[WARN] irradiance cache is not valid: " << filename << std::endl;
+		return false;
+	}
 
 	//copy info from header to our local vars
 	start_pos = header.start;
@@ -545,10 +922,21 @@ bool GTR::IrradianceEntity::read(const char* filename){
 	probes.resize(num_probes);
 
 	//read from disk directly to our probes container in memory
-	fread(&probes[0], sizeof(sProbe), probes.size(), f);
+	bool ok = fread(&probes[0], sizeof(sProbe), probes.size(), f) == probes.size();
 	fclose(f);
+	if (!ok) {
+		std::cout << "[WARN] irradiance cache is truncated: " << filename << std::endl;
+		probes.clear();
+		return false;
+	}
+	std::cout << "[WARN] irradiance cache uses the old format, it cannot be checked against the scene: " << filename << std::endl;
+	if (!buildIndirection()) {
+		std::cout << "[WARN] irradiance cache has a probe outside of the grid: " << filename << std::endl;
+		probes.clear();
+		return false;
+	}
 
-	//build the texture again
+	//build the texture again
 	probesToTexture();
 	std::cout << "+ Irradiance uploaded" << std::endl;
 	return true;
@@ -557,6 +945,10 @@ bool GTR::IrradianceEntity::read(const char* filename){
 /************************************************************************************************************/
 GTR::reflectionProbeEntity::reflectionProbeEntity(){
 	this->entity_type = REFLECTION_PROBE;
+	radius = 400;
+	next_face = 0;
+	dirty = true;
+	last_update = -1;
 	cubemap = new Texture();
 	cubemap->createCubemap(
 		512, 512,
@@ -565,12 +957,15 @@ GTR::reflectionProbeEntity::reflectionProbeEntity(){
 }
 
 void GTR::reflectionProbeEntity::configure(cJSON* json){
+	radius = readJSONNumber(json, "radius", radius);
 	Scene::instance->reflectionProbes.push_back(this);
 }
 
 GTR::DecalEntity::DecalEntity(){
 	this->entity_type = DECALL;
 	this->albedo = NULL;
+	this->omr = NULL;
+	this->normal = NULL;
 	has_albedo = false;
 	has_omr = false;
 	has_normal = false;
@@ -580,18 +975,21 @@ void GTR::DecalEntity::configure(cJSON* json){
 	if (cJSON_GetObjectItem(json, "albedo"))
 	{
 		const char* filename = cJSON_GetObjectItem(json, "albedo")->valuestring;
+		albedo_filename = filename;
 		albedo = Texture::Get(filename, false, false);
 		if (albedo != NULL) has_albedo = true;
 	}
 	if (cJSON_GetObjectItem(json, "normal"))
 	{
 		const char* filename = cJSON_GetObjectItem(json, "normal")->valuestring;
+		normal_filename = filename;
 		normal = Texture::Get(filename, false, false);
 		if (normal != NULL) has_normal = true;
 	}
 	if (cJSON_GetObjectItem(json, "omr"))
 	{
 		const char* filename = cJSON_GetObjectItem(json, "omr")->valuestring;
+		omr_filename = filename;
 		omr = Texture::Get(filename, false, false);
 		if (omr != NULL) has_omr = true;
 	}
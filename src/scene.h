@@ -8,6 +8,7 @@
 #include "framework.h"
 #include "camera.h"
 #include "sphericalharmonics.h"
+#include "irradiancecache.h"
 #include <string>
 
 //forward declaration
@@ -91,30 +92,23 @@ namespace GTR {
 		virtual void renderInMenu();
 		virtual void configure(cJSON* json);
 		virtual void setColor(vec3 color);
+		void init(); //adds it to the lights of the scene and creates the shadowmap, once the parameters are set
 		virtual void uploadUniforms(Shader*& shader);
 		virtual void lightVisible();
 		virtual void orientCam();
 	};
 
-	//struct to store probes
-	struct sProbe {
-		Vector3 pos; //where is located
-		Vector3 local; //its ijk pos in the matrix
-		int index; //its index in the linear array
-		SphericalHarmonics sh; //coeffs
-	};
-
-	struct sIrrHeader {
-		Vector3 start;
-		Vector3 end;
-		Vector3 delta;
-		Vector3 dims;
-		int num_probes;
-	};
-
 	class reflectionProbeEntity : public BaseEntity {
 	public:
 		Texture* cubemap = NULL;
+		float radius; //distance at which its reflection fades out
+
+		//state of the progressive update
+		int next_face; //face to render next, the cubemap is complete when it goes back to 0
+		bool dirty; //something changed since the last complete capture
+		Vector3 captured_position;
+		long last_update; //frame of the last complete capture, -1 if never captured
+
 		reflectionProbeEntity();
 		void configure(cJSON* json);
 	};
@@ -134,17 +128,29 @@ namespace GTR {
 		std::vector<sProbe> probes;
 		Texture* probes_texture;
 
+		bool adaptive; //drop probes inside geometry and keep only one of every 8 far from surfaces
+		std::vector<float> indirection; //row of the probe used by every node of the grid
+		Texture* indirection_texture;
+
+		eIrrCacheEncoding encoding; //used when saving
+		unsigned int scene_hash; //of the scene JSON, to detect stale caches
+
 		IrradianceEntity();
 		~IrradianceEntity();
 
 		void init();
 		void placeProbes();
+		void addProbe(int x, int y, int z);
+		void adaptProbes();
+		bool buildIndirection(); //false if a probe is outside of the grid
 
-		void probesToTexture();
+		//uploads the SH of the probes, or the coefficients given in grid order (for example straight from the cache file)
+		void probesToTexture(const void* coeffs = NULL, eIrrCacheEncoding coeffs_encoding = IRR_FLOAT32);
 		void uploadUniforms(Shader*& shader);
 
 		void save();
 		bool read(const char* filename);
+		bool readLegacy(const char* filename);
 	};
 
 	class DecalEntity : public BaseEntity {
@@ -152,6 +158,9 @@ namespace GTR {
 		Texture* albedo;
 		Texture* omr;
 		Texture* normal;
+		std::string albedo_filename;
+		std::string omr_filename;
+		std::string normal_filename;
 
 		bool has_albedo;
 		bool has_omr;
@@ -167,8 +176,10 @@ namespace GTR {
 	{
 	public:
 		static Scene* instance;
+		static bool use_snapshot; //load the .bscn next to the JSON if it was made from the same JSON, write it if not
 
 		Texture* environment;
+		std::string environment_filename;
 
 		Vector3 background_color;
 		Vector3 ambient_light;
@@ -202,6 +213,10 @@ namespace GTR {
 		bool load(const char* filename);
 		BaseEntity* createEntity(std::string type);
 
+		//binary copy of what the JSON produced, see scenecache.h
+		bool loadSnapshot(const char* filename, unsigned long long json_hash);
+		bool saveSnapshot(const char* filename, unsigned long long json_hash);
+
 		void updateLights(); //for singlePass
 	};
 
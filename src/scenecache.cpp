@@ -0,0 +1,123 @@
+#include "scenecache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+SceneCacheFile::SceneCacheFile()
+{
+	header = NULL;
+	assets = NULL;
+	entities = NULL;
+	strings = NULL;
+}
+
+bool SceneCacheFile::open(const char* filename, unsigned long long json_hash)
+{
+	close();
+	if (!file.open(filename))
+		return false;
+
+	const sSceneCacheHeader* h = (const sSceneCacheHeader*)file.data;
+	if (file.size < sizeof(sSceneCacheHeader) || memcmp(h->magic, SCENE_CACHE_MAGIC, 4) != 0)
+	{
+		file.close();
+		return false;
+	}
+	if (h->version != SCENE_CACHE_VERSION || h->json_hash != json_hash)
+	{
+		file.close();
+		return false; //stale, it will be written again
+	}
+
+	size_t tables_size = sizeof(sSceneCacheHeader) + (size_t)h->num_assets * sizeof(sSceneCacheAsset) + (size_t)h->num_entities * sizeof(sSceneCacheEntity);
+	bool valid = h->file_size == file.size && tables_size + h->strings_size == file.size;
+	const sSceneCacheAsset* asset_table = (const sSceneCacheAsset*)(file.data + sizeof(sSceneCacheHeader));
+	const sSceneCacheEntity* entity_table = (const sSceneCacheEntity*)(asset_table + h->num_assets);
+	for (unsigned int i = 0; i < h->num_entities && valid; ++i)
+		for (int j = 0; j < SCENE_CACHE_MAX_ASSETS; ++j)
+			valid = valid && entity_table[i].assets[j] < (int)h->num_assets;
+	valid = valid && h->environment < (int)h->num_assets && (h->strings_size == 0 || file.data[file.size - 1] == 0);
+	if (!valid)
+	{
+		std::cout << "[WARN] scene snapshot is truncated or corrupted: " << filename << std::endl;
+		file.close();
+		return false;
+	}
+
+	header = h;
+	assets = asset_table;
+	entities = entity_table;
+	strings = (const char*)(file.data + tables_size);
+	return true;
+}
+
+void SceneCacheFile::close()
+{
+	header = NULL;
+	assets = NULL;
+	entities = NULL;
+	strings = NULL;
+	file.close();
+}
+
+sSceneCacheData::sSceneCacheData() : header() //zeroed, padding included
+{
+	header.environment = -1;
+}
+
+unsigned int sSceneCacheData::addString(const std::string& str)
+{
+	unsigned int offset = (unsigned int)strings.size();
+	strings.append(str.c_str(), str.size() + 1);
+	return offset;
+}
+
+int sSceneCacheData::addAsset(eSceneAssetType type, const std::string& path)
+{
+	if (path.empty())
+		return -1;
+	//a handful of files, the same prefab is usually placed many times
+	for (size_t i = 0; i < assets.size(); ++i)
+		if (assets[i].type == type && path == strings.c_str() + assets[i].path)
+			return (int)i;
+	sSceneCacheAsset asset;
+	asset.type = type;
+	asset.path = addString(path);
+	assets.push_back(asset);
+	return (int)assets.size() - 1;
+}
+
+bool writeSceneCache(const char* filename, unsigned long long json_hash, sSceneCacheData& data)
+{
+	FILE* f = fopen(filename, "wb");
+	if (!f)
+	{
+		std::cout << "[WARN] cannot write scene snapshot: " << filename << std::endl;
+		return false;
+	}
+
+	sSceneCacheHeader& header = data.header;
+	memcpy(header.magic, SCENE_CACHE_MAGIC, 4);
+	header.version = SCENE_CACHE_VERSION;
+	header.json_hash = json_hash;
+	header.num_assets = (unsigned int)data.assets.size();
+	header.num_entities = (unsigned int)data.entities.size();
+	header.strings_size = (unsigned int)data.strings.size();
+	header.file_size = (unsigned int)(sizeof(sSceneCacheHeader) + data.assets.size() * sizeof(sSceneCacheAsset) + data.entities.size() * sizeof(sSceneCacheEntity) + data.strings.size());
+
+	bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+	if (ok && data.assets.size())
+		ok = fwrite(&data.assets[0], sizeof(sSceneCacheAsset), data.assets.size(), f) == data.assets.size();
+	if (ok && data.entities.size())
+		ok = fwrite(&data.entities[0], sizeof(sSceneCacheEntity), data.entities.size(), f) == data.entities.size();
+	if (ok && data.strings.size())
+		ok = fwrite(data.strings.c_str(), data.strings.size(), 1, f) == 1;
+	fclose(f);
+	if (!ok)
+	{
+		std::cout << "[WARN] cannot write scene snapshot: " << filename << std::endl;
+		remove(filename);
+	}
+	return ok;
+}
@@ -0,0 +1,106 @@
+/*  Binary snapshot of a scene (.bscn next to the scene JSON), so the next launch does not parse the JSON again.
+	A header with the global properties, a table of the assets used (every file only once, the entities point to
+	them by index), a table of entities with their final model and parameters, and the strings at the end.
+	It is read with a single mmap. The JSON is still the source of truth: the snapshot stores a hash of it and
+	is written again when it does not match. It does not depend on OpenGL, Scene resolves the assets.
+*/
+#pragma once
+
+#include "framework.h"
+#include "mappedfile.h"
+
+#include <string>
+#include <vector>
+
+#define SCENE_CACHE_MAGIC "BSCN"
+#define SCENE_CACHE_VERSION 1
+#define SCENE_CACHE_EXTENSION ".bscn"
+#define SCENE_CACHE_MAX_ASSETS 3 //per entity
+
+enum eSceneAssetType {
+	SCENE_ASSET_PREFAB = 0,
+	SCENE_ASSET_TEXTURE = 1,
+	SCENE_ASSET_ENVIRONMENT = 2
+};
+
+enum eSceneEntityFlags {
+	SCENE_ENTITY_VISIBLE = 1 << 0,
+	SCENE_ENTITY_RENDER_GUI = 1 << 1,
+	SCENE_ENTITY_FOCUS_POINT = 1 << 2,	//the BASIC entity
+	SCENE_ENTITY_USEFUL = 1 << 3		//lights shown in the menu
+};
+
+struct sSceneCacheAsset {
+	int type;			//eSceneAssetType
+	unsigned int path;	//offset in the strings, as written in the JSON
+};
+
+struct sSceneCacheEntity {
+	int type;			//GTR::eEntityType
+	unsigned int flags;	//eSceneEntityFlags
+	unsigned int name;	//offset in the strings
+	Matrix44 model;		//with position, angle, rotation, target and scale applied
+	int assets[SCENE_CACHE_MAX_ASSETS];	//index in the assets table or -1. prefab: the prefab, decal: albedo, omr and normal
+
+	//lights
+	int light_type;
+	Vector3 color;
+	float intensity;
+	float max_dist;
+	float cone_angle;
+	float spot_exp;
+	float area_size;
+
+	//reflection probes
+	float radius;
+};
+
+struct sSceneCacheHeader {
+	char magic[4];
+	int version;
+	unsigned long long json_hash;	//of the contents of the scene JSON
+	Vector3 background_color;
+	Vector3 ambient_light;
+	Vector3 camera_eye;
+	Vector3 camera_center;
+	float camera_fov;
+	int environment;				//index in the assets table or -1
+	unsigned int num_assets;		//the table follows the header
+	unsigned int num_entities;		//after the assets
+	unsigned int strings_size;		//after the entities, every string ends with \0
+	unsigned int file_size;
+};
+
+//a .bscn opened with mmap, the tables point inside the mapping
+class SceneCacheFile
+{
+public:
+	const sSceneCacheHeader* header;
+	const sSceneCacheAsset* assets;
+	const sSceneCacheEntity* entities;
+
+	SceneCacheFile();
+
+	//validates magic, version and sizes, and that it was made from a JSON with that hash
+	bool open(const char* filename, unsigned long long json_hash);
+	void close();
+	const char* getString(unsigned int offset) const { return offset < header->strings_size ? strings + offset : ""; }
+
+private:
+	MappedFile file;
+	const char* strings;
+};
+
+//a snapshot being filled before writing it
+struct sSceneCacheData {
+	sSceneCacheHeader header;
+	std::vector<sSceneCacheAsset> assets;
+	std::vector<sSceneCacheEntity> entities;
+	std::string strings;
+
+	sSceneCacheData();
+	unsigned int addString(const std::string& str);
+	int addAsset(eSceneAssetType type, const std::string& path); //the index of the same file if it was already added, -1 if path is empty
+};
+
+bool writeSceneCache(const char* filename, unsigned long long json_hash, sSceneCacheData& data);
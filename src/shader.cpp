@@ -6,11 +6,43 @@
 #include <functional> 
 #include <cctype>
 #include <locale>
+#include <set>
+#include <sys/stat.h>
 
 #include "texture.h"
+#include "shadercache.h"
+#include "renderstats.h"
+
+#ifndef GL_COMPLETION_STATUS_KHR
+	#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+#define SHADER_COMPILE_FRAME_BUDGET 8 //ms compiling every frame when the driver cannot do it in parallel
+#define SHADER_ATLAS_WATCH_INTERVAL 250 //ms between checks of the modification time of the atlas
 
 std::string Shader::s_shader_atlas_filename;
 std::map<std::string, std::string> Shader::s_shaders_atlas;
+bool Shader::use_program_cache = true;
+bool Shader::use_async_compile = true;
+int Shader::s_num_binary_formats = 0;
+bool Shader::s_parallel_compile = false;
+bool Shader::watch_atlas = true;
+
+//the program cache of the atlas, open while the app runs for the variants. written when the last program is linked
+static ShaderCacheFile s_atlas_cache;
+static std::vector<sShaderBinary> s_atlas_binaries; //linked since it was written
+static std::string s_atlas_cache_filename;
+static unsigned long long s_atlas_driver_hash = 0;
+static bool s_atlas_cache_enabled = false;
+static bool s_atlas_cache_dirty = false;
+static bool s_atlas_prune_cache = false;
+
+//what every block of the atlas includes and the hash of its own text, to know which programs change after a reload
+static std::map<std::string, std::set<std::string> > s_atlas_includes;
+static std::map<std::string, unsigned long long> s_atlas_block_hashes;
+static time_t s_atlas_modified = 0;
+static long s_atlas_size = 0; //the time has seconds, two saves in the same second differ in the size
+static long s_atlas_last_check = 0;
 
 
 //typedef unsigned int GLhandle;
@@ -61,13 +93,20 @@ Shader::Shader()
 {
 	if(!Shader::s_ready)
 		Shader::init();
-	vs = fs = 0;
+	vs = fs = program = 0;
 	compiled = false;
 	from_atlas = false;
+	pending = false;
+	pending_vs = pending_fs = pending_program = 0;
+	cache_key = 0;
+	features = 0;
 }
 
 Shader::~Shader()
 {
+	for (auto it = variants.begin(); it != variants.end(); ++it)
+		delete it->second;
+	cancelCompile();
 	release();
 }
 
@@ -120,7 +159,7 @@ Shader* Shader::Get(const char* vsf, const char* psf, const char* macros)
 		name = vsf;
 	std::map<std::string,Shader*>::iterator it = s_Shaders.find(name);
 	if (it != s_Shaders.end())
-		return it->second;
+		return it->second->compiled ? it->second : getDefaultShader("fallback"); //still compiling or it has errors
 
 	if (!psf)
 		return NULL;
@@ -154,6 +193,16 @@ static inline std::string trim(std::string str) {
 	return str;
 }
 
+static bool getFileInfo(const char* filename, time_t& modified, long& size)
+{
+	struct stat info;
+	if (stat(filename, &info) != 0)
+		return false;
+	modified = info.st_mtime;
+	size = (long)info.st_size;
+	return true;
+}
+
 void Shader::setMacros(const char* macros)
 {
 	this->macros = macros;
@@ -169,11 +218,16 @@ bool Shader::LoadAtlas(const char* filename)
 		return false;
 	}
 
-	//separate subfiles
+	//separate subfiles, in a new map so an #include of a block that is not above fails as in the first load
 	s_shader_atlas_filename = filename;
+	getFileInfo(filename, s_atlas_modified, s_atlas_size);
+	std::map<std::string, std::string> blocks;
+	std::map<std::string, std::set<std::string> > includes;
+	std::map<std::string, unsigned long long> block_hashes;
 	std::vector<std::string> lines = tokenize(content, "\n");
 	std::string subfile_name = "";
 	std::string subfile_content = "";
+	unsigned long long subfile_hash = 0;
 
 	for (int i = 0; i < lines.size(); ++i)
 	{
@@ -181,12 +235,15 @@ bool Shader::LoadAtlas(const char* filename)
 		std::string line_trimmed = trim(line);
 		if(line[0] == '\\')
 		{
-			s_shaders_atlas[ subfile_name ] = subfile_content; //store previous one
+			blocks[ subfile_name ] = subfile_content; //store previous one
+			block_hashes[ subfile_name ] = subfile_hash;
 			subfile_name = trim(line.substr(1,std::string::npos));
 			subfile_content = "";
+			subfile_hash = 0;
 			continue;
 		}
-		else if (line_trimmed[0] == '#')
+		subfile_hash = hashMemory64(line.c_str(), line.size() + 1, subfile_hash); //its own lines, the included ones are in the graph
+		if (line_trimmed[0] == '#')
 		{
 			int pos = line_trimmed.find_first_of(' ');
 			if (pos != std::string::npos)
@@ -197,8 +254,9 @@ bool Shader::LoadAtlas(const char* filename)
 				{
 					if (param[0] == '\"')
 						param = param.substr(1, param.size() - 2);
-					auto it = s_shaders_atlas.find(param);
-					if (it != s_shaders_atlas.end())
+					includes[ subfile_name ].insert(param);
+					auto it = blocks.find(param);
+					if (it != blocks.end())
 						subfile_content += it->second + "\n";
 					else
 						std::cout << " - Error: Shader #include not found: " << param << std::endl;
@@ -208,7 +266,50 @@ bool Shader::LoadAtlas(const char* filename)
 		}
 		subfile_content += line + "\n";
 	}
-	s_shaders_atlas[ subfile_name ] = subfile_content;
+	blocks[ subfile_name ] = subfile_content;
+	block_hashes[ subfile_name ] = subfile_hash;
+
+	//the blocks that changed since the last load and the ones that include them, directly or not
+	std::set<std::string> changed;
+	for (auto it = block_hashes.begin(); it != block_hashes.end(); ++it)
+	{
+		auto old = s_atlas_block_hashes.find(it->first);
+		if (old == s_atlas_block_hashes.end() || old->second != it->second || includes[it->first] != s_atlas_includes[it->first])
+			changed.insert(it->first);
+	}
+	for (bool grown = true; grown; ) //the graph is small, repeat until nothing new is reached
+	{
+		grown = false;
+		for (auto it = includes.begin(); it != includes.end(); ++it)
+		{
+			if (changed.count(it->first))
+				continue;
+			for (auto inc = it->second.begin(); inc != it->second.end(); ++inc)
+				if (changed.count(*inc) || !blocks.count(*inc))
+				{
+					changed.insert(it->first);
+					grown = true;
+					break;
+				}
+		}
+	}
+	bool first_load = s_atlas_block_hashes.empty();
+	s_shaders_atlas.swap(blocks);
+	s_atlas_includes.swap(includes);
+	s_atlas_block_hashes.swap(block_hashes);
+
+	//programs linked in previous launches
+	if (!s_ready)
+		init();
+	s_atlas_cache.close();
+	s_atlas_cache_enabled = use_program_cache && s_num_binary_formats > 0;
+	s_atlas_cache_filename = std::string(filename) + SHADER_CACHE_EXTENSION;
+	s_atlas_driver_hash = hashDriver((const char*)glGetString(GL_VENDOR), (const char*)glGetString(GL_RENDERER), (const char*)glGetString(GL_VERSION));
+	if (s_atlas_cache_enabled)
+		s_atlas_cache.open(s_atlas_cache_filename.c_str(), s_atlas_driver_hash);
+	int num_cached = 0;
+	int num_compiled = 0;
+	int num_unchanged = 0;
 
 	//compile shaders
 	std::string shaders = s_shaders_atlas[""];
@@ -231,17 +332,12 @@ bool Shader::LoadAtlas(const char* filename)
 		std::string macros = "";
 		if(pos3 != std::string::npos)
 			macros = line.substr(pos3+1);
-		std::string vs_code = s_shaders_atlas[vs_filename];
-		std::string fs_code = s_shaders_atlas[fs_filename];
-		if(!vs_code.size() || !fs_code.size())
+		if(!s_shaders_atlas[vs_filename].size() || !s_shaders_atlas[fs_filename].size())
 		{
 			std::cout << " * Error in shader atlas, couldnt find files for " << name << std::endl;
 			continue;
 		}
 
-		vs_code = macros + "\n" + vs_code;
-		fs_code = macros + "\n" + fs_code;
-
 		Shader* shader = NULL;
 		auto it = s_Shaders.find( name );
 		if(it == s_Shaders.end())
@@ -251,24 +347,254 @@ bool Shader::LoadAtlas(const char* filename)
 		}
 		else
 			shader = it->second;
-	
-		if (!shader->compileFromMemory(vs_code,fs_code))
+
+		//nothing it uses has changed, neither the program nor its variants are touched
+		bool same_line = shader->from_atlas && shader->vs_filename == vs_filename && shader->ps_filename == fs_filename && shader->macros == macros;
+		if (same_line && (shader->compiled || shader->pending) && !changed.count(vs_filename) && !changed.count(fs_filename))
 		{
-			delete shader;
-			std::cout << " * Compilation error in shader at atlas: " << name << std::endl;
-            return false; //stop here
+			num_unchanged += 1 + (int)shader->variants.size();
 			continue;
 		}
 
 		shader->vs_filename = vs_filename;
 		shader->ps_filename = fs_filename;
+		shader->macros = macros;
 		shader->from_atlas = true;
-		std::cout << " + Shader from atlas: " << name << std::endl;
+		shader->atlas_name = name;
+		int result = shader->loadAtlasProgram();
+		if (result == ATLAS_PROGRAM_CACHED)
+		{
+			num_cached++;
+			std::cout << " + Shader from atlas: " << name << std::endl;
+		}
+		else if (result == ATLAS_PROGRAM_COMPILING)
+			num_compiled++;
+		else
+			num_unchanged++;
+
+		//the variants in use are built again with the new code
+		for (auto v = shader->variants.begin(); v != shader->variants.end(); ++v)
+		{
+			Shader* variant = v->second;
+			variant->vs_filename = vs_filename;
+			variant->ps_filename = fs_filename;
+			variant->macros = macros;
+			result = variant->loadAtlasProgram();
+			if (result == ATLAS_PROGRAM_CACHED)
+				num_cached++;
+			else if (result == ATLAS_PROGRAM_COMPILING)
+				num_compiled++;
+			else
+				num_unchanged++;
+		}
 	}
 
+	//if the atlas has changed the cache only keeps the programs in use when it is written again
+	s_atlas_prune_cache = num_compiled > 0;
+	if (!first_load)
+	{
+		std::cout << " + Shader atlas reloaded: " << num_unchanged << " programs unchanged, changed blocks:";
+		for (auto it = changed.begin(); it != changed.end(); ++it)
+			std::cout << " " << (it->empty() ? "(list)" : *it);
+		std::cout << std::endl;
+	}
+	if (s_atlas_cache_enabled)
+		std::cout << " + Shader atlas: " << num_cached << " programs from " << s_atlas_cache_filename << ", " << num_compiled << " to compile" << std::endl;
+
+	if (!use_async_compile)
+	{
+		for (auto it = s_Shaders.begin(); it != s_Shaders.end(); ++it)
+		{
+			if (it->second->pending && !finishAtlasShader(it->second))
+				return false; //stop here
+			for (auto v = it->second->variants.begin(); v != it->second->variants.end(); ++v)
+				if (v->second->pending)
+					finishAtlasShader(v->second);
+		}
+		updatePending(); //writes the cache
+	}
+	else if (num_compiled)
+		std::cout << " + Shader atlas: compiling " << num_compiled << (s_parallel_compile ? " programs in parallel" : " programs over the next frames") << std::endl;
+
 	return true;
 }
 
+//after the #version line, it must be the first one
+static std::string addDefines(const std::string& code, const std::string& defines)
+{
+	if (defines.empty())
+		return code;
+	size_t pos = code.find("#version");
+	if (pos == std::string::npos)
+		return defines + code;
+	pos = code.find('\n', pos);
+	if (pos == std::string::npos)
+		return code + "\n" + defines;
+	return code.substr(0, pos + 1) + defines + code.substr(pos + 1);
+}
+
+static const char* s_feature_defines[SHADER_NUM_FEATURES] = { "HAS_NORMAL_MAP", "HAS_OMR_MAP", "HAS_EMISSIVE_MAP", "USE_PBR", "FIRST_PASS", "LAST_PASS" };
+
+std::string Shader::getFeatureDefines(unsigned int features)
+{
+	std::string defines;
+	for (int i = 0; i < SHADER_NUM_FEATURES; ++i)
+		if (features & (1 << i))
+			defines += std::string("#define ") + s_feature_defines[i] + "\n";
+	return defines;
+}
+
+int Shader::loadAtlasProgram()
+{
+	std::string defines = getFeatureDefines(features);
+	std::string vs_code = macros + "\n" + addDefines(s_shaders_atlas[vs_filename], defines);
+	std::string fs_code = macros + "\n" + addDefines(s_shaders_atlas[ps_filename], defines);
+	unsigned long long key = hashShaderSource(vs_code, fs_code, s_atlas_driver_hash);
+	if (key == cache_key && (compiled || pending))
+		return ATLAS_PROGRAM_UNCHANGED; //the expanded code is the same, an edit that was undone or only in the list
+
+	cancelCompile(); //from a previous reload that has not finished
+	cache_key = key;
+	const sShaderCacheEntry* entry = s_atlas_cache.find(cache_key);
+	if (entry && loadBinary(entry->format, s_atlas_cache.getData(entry), entry->size))
+		return ATLAS_PROGRAM_CACHED;
+
+	//the old program (if any) is used until the new one is linked
+	pending = true;
+	pending_vs_code = vs_code;
+	pending_fs_code = fs_code;
+	if (s_parallel_compile || !use_async_compile)
+		submitCompile();
+	return ATLAS_PROGRAM_COMPILING;
+}
+
+Shader* Shader::GetVariant(const char* name, unsigned int features)
+{
+	auto it = s_Shaders.find(name);
+	if (it == s_Shaders.end())
+		return NULL;
+	Shader* base = it->second;
+	if (!features || !base->from_atlas)
+		return Get(name);
+
+	Shader* variant = NULL;
+	auto v = base->variants.find(features);
+	if (v != base->variants.end())
+		variant = v->second;
+	else
+	{
+		variant = new Shader();
+		variant->vs_filename = base->vs_filename;
+		variant->ps_filename = base->ps_filename;
+		variant->macros = base->macros;
+		variant->from_atlas = true;
+		variant->features = features;
+		variant->atlas_name = base->atlas_name + " [" + getFeatureDefines(features) + "]";
+		for (size_t i = 0; i < variant->atlas_name.size(); ++i)
+			if (variant->atlas_name[i] == '\n')
+				variant->atlas_name[i] = ' ';
+		base->variants[features] = variant;
+		if (variant->loadAtlasProgram() == ATLAS_PROGRAM_COMPILING && !use_async_compile)
+			finishAtlasShader(variant);
+	}
+
+	return variant->compiled ? variant : Get(name); //the one without features while it compiles
+}
+
+bool Shader::finishAtlasShader(Shader* shader)
+{
+	if (!shader->pending_program)
+		shader->submitCompile();
+	if (!shader->finishCompile())
+	{
+		std::cout << " * Compilation error in shader at atlas: " << shader->atlas_name << std::endl;
+		return false;
+	}
+	std::cout << " + Shader from atlas: " << shader->atlas_name << std::endl;
+
+	sShaderBinary binary;
+	binary.key = shader->cache_key;
+	if (s_atlas_cache_enabled && shader->getBinary(binary.format, binary.data))
+	{
+		s_atlas_binaries.push_back(binary);
+		s_atlas_cache_dirty = true;
+	}
+	return true;
+}
+
+int Shader::updatePending()
+{
+	long start = getTime();
+
+	//the atlas was saved, only the programs that use the blocks that changed are compiled
+	if (watch_atlas && !s_shader_atlas_filename.empty() && start - s_atlas_last_check > SHADER_ATLAS_WATCH_INTERVAL)
+	{
+		s_atlas_last_check = start;
+		time_t modified;
+		long size;
+		if (getFileInfo(s_shader_atlas_filename.c_str(), modified, size) && (modified != s_atlas_modified || size != s_atlas_size))
+			LoadAtlas(s_shader_atlas_filename.c_str());
+	}
+
+	int num_pending = 0;
+	auto update = [&](Shader* shader) {
+		if (!shader->pending)
+			return;
+		//with the extension the driver compiles them in its threads, if not one by one while there is time in this frame
+		bool ready = s_parallel_compile ? shader->isCompileDone() : getTime() - start < SHADER_COMPILE_FRAME_BUDGET;
+		if (ready)
+			finishAtlasShader(shader); //if it fails the old program (or the fallback) stays
+		else
+			num_pending++;
+	};
+	for (auto it = s_Shaders.begin(); it != s_Shaders.end(); ++it)
+	{
+		update(it->second);
+		for (auto v = it->second->variants.begin(); v != it->second->variants.end(); ++v)
+			update(v->second);
+	}
+
+	if (!num_pending && s_atlas_cache_dirty)
+		writeAtlasCache();
+	return num_pending;
+}
+
+void Shader::writeAtlasCache()
+{
+	//the programs in use, the ones of the file are kept unless the atlas has changed since then
+	std::set<unsigned long long> keys;
+	for (auto it = s_Shaders.begin(); it != s_Shaders.end(); ++it)
+	{
+		keys.insert(it->second->cache_key);
+		for (auto v = it->second->variants.begin(); v != it->second->variants.end(); ++v)
+			keys.insert(v->second->cache_key);
+	}
+
+	std::vector<sShaderBinary> binaries;
+	std::set<unsigned long long> written;
+	for (size_t i = 0; i < s_atlas_binaries.size(); ++i)
+		if (written.insert(s_atlas_binaries[i].key).second)
+			binaries.push_back(s_atlas_binaries[i]);
+	for (int i = 0; i < s_atlas_cache.getNumEntries(); ++i)
+	{
+		const sShaderCacheEntry* entry = s_atlas_cache.getEntry(i);
+		if ((s_atlas_prune_cache && !keys.count(entry->key)) || !written.insert(entry->key).second)
+			continue;
+		sShaderBinary binary;
+		binary.key = entry->key;
+		binary.format = entry->format;
+		binary.data.assign(s_atlas_cache.getData(entry), s_atlas_cache.getData(entry) + entry->size);
+		binaries.push_back(binary);
+	}
+
+	s_atlas_cache.close(); //before writing over the mapped file
+	writeShaderCache(s_atlas_cache_filename.c_str(), s_atlas_driver_hash, binaries);
+	s_atlas_cache.open(s_atlas_cache_filename.c_str(), s_atlas_driver_hash);
+	s_atlas_binaries.clear();
+	s_atlas_cache_dirty = false;
+	s_atlas_prune_cache = false;
+}
+
 bool Shader::compile()
 {
 	assert(!compiled && "Shader already compiled" );
@@ -296,6 +622,14 @@ bool Shader::hasInfoLog() const
 // ******************************************
 
 bool Shader::compileFromMemory(const std::string& vsm, const std::string& psm)
+{
+	pending_vs_code = vsm;
+	pending_fs_code = psm;
+	submitCompile();
+	return finishCompile();
+}
+
+void Shader::submitCompile()
 {
 	if (glCreateProgram == 0)
 	{
@@ -303,36 +637,69 @@ bool Shader::compileFromMemory(const std::string& vsm, const std::string& psm)
 		exit(0);
 	}
 
-	program = glCreateProgram();
+	pending_program = glCreateProgram();
+	assert (glGetError() == GL_NO_ERROR);
+
+	//the status is not asked here, so the driver can compile and link them in its threads
+	pending_vs = createShaderObject(GL_VERTEX_SHADER, pending_vs_code);
+	pending_fs = createShaderObject(GL_FRAGMENT_SHADER, pending_fs_code);
+	glAttachShader(pending_program, pending_vs);
+	glAttachShader(pending_program, pending_fs);
 	assert (glGetError() == GL_NO_ERROR);
 
-	if (!createVertexShaderObject(vsm))
+	if (s_num_binary_formats > 0)
+		glProgramParameteri(pending_program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	glLinkProgram(pending_program);
+	assert (glGetError() == GL_NO_ERROR);
+	pending = true;
+}
+
+bool Shader::isCompileDone()
+{
+	if (!pending_program)
+		return false;
+	GLint done = 1;
+	glGetProgramiv(pending_program, GL_COMPLETION_STATUS_KHR, &done);
+	return done != 0;
+}
+
+bool Shader::finishCompile()
+{
+	if (!checkShaderObject(pending_vs, pending_vs_code))
 	{
 		printf("Vertex shader compilation failed\n");
+		cancelCompile();
 		return false;
 	}
 
-	if (!createFragmentShaderObject(psm))
+	if (!checkShaderObject(pending_fs, pending_fs_code))
 	{
 		printf("Fragment shader compilation failed\n");
+		cancelCompile();
 		return false;
 	}
 
-	glLinkProgram(program);
-	assert (glGetError() == GL_NO_ERROR);
-
 	GLint linked=0;
     
-	glGetProgramiv(program,GL_LINK_STATUS,&linked);
+	glGetProgramiv(pending_program,GL_LINK_STATUS,&linked);
 	assert(glGetError() == GL_NO_ERROR);
 
 	if (!linked)
 	{
-		saveProgramInfoLog(program);
-		release();
+		saveProgramInfoLog(pending_program);
+		cancelCompile();
 		return false;
 	}
 
+	//replaces the old program
+	GLuint new_program = pending_program, new_vs = pending_vs, new_fs = pending_fs;
+	pending_program = pending_vs = pending_fs = 0;
+	cancelCompile();
+	release();
+	program = new_program;
+	vs = new_vs;
+	fs = new_fs;
+
 #ifdef _DEBUG
 	validate();
 #endif
@@ -342,6 +709,57 @@ bool Shader::compileFromMemory(const std::string& vsm, const std::string& psm)
 	return true;
 }
 
+void Shader::cancelCompile()
+{
+	if (pending_vs)
+		glDeleteShader(pending_vs);
+	if (pending_fs)
+		glDeleteShader(pending_fs);
+	if (pending_program)
+		glDeleteProgram(pending_program);
+	pending_vs = pending_fs = pending_program = 0;
+	pending_vs_code.clear();
+	pending_fs_code.clear();
+	pending = false;
+}
+
+bool Shader::loadBinary(unsigned int format, const void* data, int size)
+{
+	GLuint new_program = glCreateProgram();
+	glProgramBinary(new_program, format, data, size);
+
+	GLint linked = 0;
+	glGetProgramiv(new_program, GL_LINK_STATUS, &linked);
+	glGetError(); //an unknown format is an error, but it only means it has to be compiled
+	if (!linked)
+	{
+		glDeleteProgram(new_program);
+		return false;
+	}
+
+	release();
+	program = new_program;
+	compiled = true;
+	return true;
+}
+
+bool Shader::getBinary(unsigned int& format, std::vector<unsigned char>& data)
+{
+	GLint size = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &size);
+	if (size <= 0)
+		return false;
+
+	data.resize(size);
+	GLenum binary_format = 0;
+	glGetProgramBinary(program, size, &size, &binary_format, &data[0]);
+	if (glGetError() != GL_NO_ERROR || size <= 0)
+		return false;
+	data.resize(size);
+	format = binary_format;
+	return true;
+}
+
 bool Shader::validate()
 {
 	glValidateProgram(program);
@@ -361,19 +779,9 @@ bool Shader::validate()
 	return true;
 }
 
-bool Shader::createVertexShaderObject(const std::string& shader)
-{
-	return createShaderObject(GL_VERTEX_SHADER,vs,shader);
-}
-
-bool Shader::createFragmentShaderObject(const std::string& shader)
-{
-	return createShaderObject(GL_FRAGMENT_SHADER,fs,shader);
-}
-
-bool Shader::createShaderObject(unsigned int type, GLuint& handle, const std::string& code)
+GLuint Shader::createShaderObject(unsigned int type, const std::string& code)
 {
-	handle = glCreateShader(type);
+	GLuint handle = glCreateShader(type);
 	assert( glGetError() == GL_NO_ERROR );
     
 	std::string prefix = "";//"#define DESKTOP\n";
@@ -386,6 +794,11 @@ bool Shader::createShaderObject(unsigned int type, GLuint& handle, const std::st
 	glCompileShader(handle);
 	assert( glGetError() == GL_NO_ERROR );
 
+	return handle;
+}
+
+bool Shader::checkShaderObject(GLuint handle, const std::string& code)
+{
 	GLint compile=0;
 	glGetShaderiv(handle,GL_COMPILE_STATUS,&compile);
 	assert( glGetError() == GL_NO_ERROR );
@@ -395,16 +808,13 @@ bool Shader::createShaderObject(unsigned int type, GLuint& handle, const std::st
 	{
 		saveShaderInfoLog(handle);
         std::cout << "Shader code:\n " << std::endl;
-		std::vector<std::string> lines = split( fullcode, '\n' );
+		std::vector<std::string> lines = split( code, '\n' );
 		for( size_t i = 0; i < lines.size(); ++i)
 			std::cout << i << "  " << lines[i] << std::endl;
 
 		return false;
 	}
 
-	glAttachShader(program,handle);
-	assert( glGetError() == GL_NO_ERROR );
-
 	return true;
 }
 
@@ -433,6 +843,8 @@ void Shader::release()
 	}
 
 	locations.clear();
+	if (current == this)
+		current = NULL; //so enable binds the next program
 
 	compiled = false;
 }
@@ -444,6 +856,7 @@ void Shader::enable()
 		return;
 
 	current = this;
+	RenderStats::add(STAT_SHADER_SWITCHES);
 
 	glUseProgram(program);
     GLuint err = glGetError();
@@ -564,6 +977,7 @@ int Shader::getUniformLocation(const char* varname)
 
 void Shader::setTexture(const char* varname, Texture* tex, int slot)
 {
+	RenderStats::add(STAT_TEXTURE_BINDS);
 	glActiveTexture(GL_TEXTURE0 + slot);
 	glBindTexture(tex->texture_type, tex->texture_id);
 	setUniform1(varname, slot);
@@ -585,6 +999,7 @@ void Shader::setUniform1(const char* varname, bool input1)
 {
 	GLint loc = getLocation(varname, &locations);
 	CHECK_SHADER_VAR(loc, varname);
+	RenderStats::add(STAT_UNIFORMS);
 	glUniform1i(loc, input1);
 	assert(glGetError() == GL_NO_ERROR);
 }
@@ -593,6 +1008,7 @@ void Shader::setUniform1(const char* varname, int input1)
 {
 	GLint loc = getLocation(varname, &locations);
 	CHECK_SHADER_VAR(loc,varname);
+	RenderStats::add(STAT_UNIFORMS);
 	glUniform1i(loc, input1);
 	assert (glGetError() == GL_NO_ERROR);
 }
@@ -601,6 +1017,7 @@ void Shader::setUniform2(const char* varname, int input1, int input2)
 {
 	GLint loc = getLocation(varname, &locations);
 	CHECK_SHADER_VAR(loc,varname);
+	RenderStats::add(STAT_UNIFORMS);
 	glUniform2i(loc, input1, input2);
 	assert (glGetError() == GL_NO_ERROR);
 }
@@ -609,6 +1026,7 @@ void Shader::setUniform3(const char* varname, int input1, int input2, int input3
 {
 	GLint loc = getLocation(varname, &locations);
 	CHECK_SHADER_VAR(loc,varname);
+	RenderStats::add(STAT_UNIFORMS);
 	glUniform3i(loc, input1, input2, input3);
 	assert (glGetError() == GL_NO_ERROR);
 }
@@ -617,6 +1035,7 @@ void Shader::setUniform4(const char* varname, const int input1, const int input2
 {
 	GLint loc = getLocation(varname, &locations);
 	CHECK_SHADER_VAR(loc,varname);
+	RenderStats::add(STAT_UNIFORMS);
 	glUniform4i(loc, input1, input2, input3, input4);
 	assert (glGetError() == GL_NO_ERROR);
 }
@@ -625,6 +1044,7 @@ void Shader::setUniform1Array(const char* varname, const int* input, const int c
 {
 	GLint loc = getLocation(varname, &locations);
 	CHECK_SHADER_VAR(loc,varname);
+	RenderStats::add(STAT_UNIFORMS);
 	glUniform1iv(loc,count,input);
 	assert (glGetError() == GL_NO_ERROR);
 }
@@ -633,6 +1053,7 @@ void Shader::setUniform2Array(const char* varname, const int* input, const int c
 {
 	GLint loc = getLocation(varname, &locations);
 	CHECK_SHADER_VAR(loc,varname);
+	RenderStats::add(STAT_UNIFORMS);
 	glUniform2iv(loc,count,input);
 	assert (glGetError() == GL_NO_ERROR);
 }
@@ -641,6 +1062,7 @@ void Shader::setUniform3Array(const char* varname, const int* input, const int c
 {
 	GLint loc = getLocation(varname, &locations);
 	CHECK_SHADER_VAR(loc,varname);
+	RenderStats::add(STAT_UNIFORMS);
 	glUniform3iv(loc,count,input);
 	assert (glGetError() == GL_NO_ERROR);
 }
@@ -649,6 +1071,7 @@ void Shader::setUniform4Array(const char* varname, const int* input, const int c
 {
 	GLint loc = getLocation(varname, &locations);
 	CHECK_SHADER_VAR(loc,varname);
+	RenderStats::add(STAT_UNIFORMS);
 	glUniform4iv(loc,count,input);
 	assert (glGetError() == GL_NO_ERROR);
 }
@@ -657,6 +1080,7 @@ void Shader::setUniform1(const char* varname, const float input1)
 {
 	GLint loc = getLocation(varname, &locations);
 	CHECK_SHADER_VAR(loc,varname);
+	RenderStats::add(STAT_UNIFORMS);
 	glUniform1f(loc, input1);
 	assert (glGetError() == GL_NO_ERROR);
 }
@@ -665,6 +1089,7 @@ void Shader::setUniform2(const char* varname, const float input1, const float in
 {
 	GLint loc = getLocation(varname, &locations);
 	CHECK_SHADER_VAR(loc,varname);
+	RenderStats::add(STAT_UNIFORMS);
 	glUniform2f(loc, input1, input2);
 	assert (glGetError() == GL_NO_ERROR);
 }
@@ -673,6 +1098,7 @@ void Shader::setUniform3(const char* varname, const float input1, const float in
 {
 	GLint loc = getLocation(varname, &locations);
 	CHECK_SHADER_VAR(loc,varname);
+	RenderStats::add(STAT_UNIFORMS);
 	glUniform3f(loc, input1, input2, input3);
 	assert (glGetError() == GL_NO_ERROR);
 }
@@ -681,6 +1107,7 @@ void Shader::setUniform4(const char* varname, const float input1, const float in
 {
 	GLint loc = getLocation(varname, &locations);
 	CHECK_SHADER_VAR(loc,varname);
+	RenderStats::add(STAT_UNIFORMS);
 	glUniform4f(loc, input1, input2, input3, input4);
 	checkGLErrors();
 }
@@ -689,6 +1116,7 @@ void Shader::setUniform1Array(const char* varname, const float* input, const int
 {
 	GLint loc = getLocation(varname, &locations);
 	CHECK_SHADER_VAR(loc,varname);
+	RenderStats::add(STAT_UNIFORMS);
 	glUniform1fv(loc,count,input);
 	assert (glGetError() == GL_NO_ERROR);
 }
@@ -697,6 +1125,7 @@ void Shader::setUniform2Array(const char* varname, const float* input, const int
 {
 	GLint loc = getLocation(varname, &locations);
 	CHECK_SHADER_VAR(loc,varname);
+	RenderStats::add(STAT_UNIFORMS);
 	glUniform2fv(loc,count,input);
 	assert (glGetError() == GL_NO_ERROR);
 }
@@ -705,6 +1134,7 @@ void Shader::setUniform3Array(const char* varname, const float* input, const int
 {
 	GLint loc = getLocation(varname, &locations);
 	CHECK_SHADER_VAR(loc,varname);
+	RenderStats::add(STAT_UNIFORMS);
 	glUniform3fv(loc,count,input);
 	assert (glGetError() == GL_NO_ERROR);
 }
@@ -713,6 +1143,7 @@ void Shader::setUniform4Array(const char* varname, const float* input, const int
 {
 	GLint loc = getLocation(varname, &locations);
 	CHECK_SHADER_VAR(loc,varname);
+	RenderStats::add(STAT_UNIFORMS);
 	glUniform4fv(loc,count,input);
 	assert (glGetError() == GL_NO_ERROR);
 }
@@ -721,6 +1152,7 @@ void Shader::setMatrix44(const char* varname, const float* m)
 {
 	GLint loc = getLocation(varname, &locations);
 	CHECK_SHADER_VAR(loc,varname);
+	RenderStats::add(STAT_UNIFORMS);
 	glUniformMatrix4fv(loc, 1, GL_FALSE, m);
 	assert (glGetError() == GL_NO_ERROR);
 }
@@ -729,6 +1161,7 @@ void Shader::setMatrix44( const char* varname, const Matrix44 &m )
 {
 	GLint loc = getLocation(varname, &locations);
 	CHECK_SHADER_VAR(loc,varname);
+	RenderStats::add(STAT_UNIFORMS);
 	glUniformMatrix4fv(loc, 1, GL_FALSE, m.m);
 	assert (glGetError() == GL_NO_ERROR);
 }
@@ -737,6 +1170,7 @@ void Shader::setMatrix44Array( const char* varname, Matrix44* m_array, int num )
 {
 	GLint loc = getLocation(varname, &locations);
 	CHECK_SHADER_VAR(loc, varname);
+	RenderStats::add(STAT_UNIFORMS);
 	glUniformMatrix4fv(loc, num, GL_FALSE, (GLfloat*)m_array);
 	assert(glGetError() == GL_NO_ERROR);
 }
@@ -781,6 +1215,22 @@ void Shader::init()
 		IMPORT_GLEXT( glUniform4fv );
 		IMPORT_GLEXT( glUniformMatrix4fv );
 	#endif
+
+		//GL 4.1 or ARB_get_program_binary, older drivers complain about the enum
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &s_num_binary_formats);
+		if (glGetError() != GL_NO_ERROR)
+			s_num_binary_formats = 0;
+	#ifdef USE_GLEW
+		if (!GLEW_ARB_get_program_binary)
+			s_num_binary_formats = 0;
+	#endif
+
+		//the driver compiles in its own threads and glGetProgramiv can ask if it has finished
+		s_parallel_compile = isGLExtensionSupported("GL_KHR_parallel_shader_compile") || isGLExtensionSupported("GL_ARB_parallel_shader_compile");
+		typedef void (APIENTRY * glMaxShaderCompilerThreads_func)(GLuint count);
+		glMaxShaderCompilerThreads_func glMaxShaderCompilerThreads = s_parallel_compile ? (glMaxShaderCompilerThreads_func)getGLProcAddress("glMaxShaderCompilerThreadsKHR") : NULL;
+		if (glMaxShaderCompilerThreads)
+			glMaxShaderCompilerThreads(0xFFFFFFFF); //as many as the driver wants
 	}
 	
 	firsttime = false;
@@ -854,6 +1304,24 @@ Shader* Shader::getDefaultShader(std::string name)
 				gl_FragColor = color;\n\
 			}";
 	}
+	else if (name == "fallback") //used by the atlas shaders until they are compiled, the meshes in one color
+	{
+		vs = "attribute vec3 a_vertex;\n\
+			uniform mat4 u_model;\n\
+			uniform mat4 u_viewprojection;\n\
+			uniform bool u_quantized;\n\
+			uniform vec3 u_quantize_min;\n\
+			uniform vec3 u_quantize_range;\n\
+			void main()\n\
+			{\n\
+				vec3 position = u_quantized ? u_quantize_min + a_vertex * u_quantize_range : a_vertex;\n\
+				gl_Position = u_viewprojection * u_model * vec4(position, 1.0);\n\
+			}";
+		fs = "uniform vec4 u_color;\n\
+			void main() {\n\
+				gl_FragColor = vec4(u_color.xyz * 0.5, u_color.a);\n\
+			}";
+	}
 	else if (name == "screen") //draws a quad fullscreen
 	{
 		vs = "attribute vec3 a_vertex; \
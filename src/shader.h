@@ -20,6 +20,17 @@
 
 class Texture;
 
+//features of a material or a pass, each one is a #define in the code of the atlas shaders so they do not branch on uniforms
+enum eShaderFeature {
+	SHADER_NORMAL_MAP = 1 << 0,		//HAS_NORMAL_MAP
+	SHADER_OMR_MAP = 1 << 1,		//HAS_OMR_MAP
+	SHADER_EMISSIVE_MAP = 1 << 2,	//HAS_EMISSIVE_MAP
+	SHADER_PBR = 1 << 3,			//USE_PBR, phong if not
+	SHADER_FIRST_PASS = 1 << 4,		//FIRST_PASS of the multipass, ambient and emissive
+	SHADER_LAST_PASS = 1 << 5,		//LAST_PASS of the multipass, reflections
+	SHADER_NUM_FEATURES = 6
+};
+
 class Shader
 {
 	int last_slot;
@@ -40,6 +51,7 @@ public:
 
 	//internal functions
 	virtual bool compileFromMemory(const std::string& vsm, const std::string& psm);
+	bool isPending() const { return pending; } //a new version is being compiled
 	virtual void release();
 	virtual void enable();
 	virtual void disable();
@@ -114,7 +126,21 @@ public:
 
 	//this is a way to load a single file that contains all the shaders 
 	//to know more about the file format, it is based in this https://github.com/jagenjo/rendeer.js/tree/master/guides#the-shaders but with tiny differences
+	//the linked programs are stored next to the atlas (shader_atlas.txt.pbin) and used the next time if the code and the driver are the same
+	//the programs that are not in the cache are compiled while the app runs (unless use_async_compile is false), Get returns the fallback until they are linked
+	//loading it again only compiles the programs whose blocks (or the blocks they #include) have changed
 	static bool LoadAtlas(const char* filename);
+	static int updatePending(); //call it every frame, finishes the programs compiled by LoadAtlas. returns how many are left
+	static bool use_program_cache;
+	static bool use_async_compile;
+	static bool watch_atlas; //updatePending loads the atlas again when the file is saved
+
+	//the atlas shader compiled with the defines of those features (eShaderFeature), the first time they are asked for.
+	//while it compiles the shader without features is returned
+	static Shader* GetVariant(const char* name, unsigned int features);
+	static std::string getFeatureDefines(unsigned int features);
+	unsigned int features;
+	std::map<unsigned int, Shader*> variants; //of this atlas shader, by features
 	static std::string s_shader_atlas_filename;
 	static std::map<std::string, std::string> s_shaders_atlas; //stores strings, no shaders
 
@@ -128,14 +154,38 @@ protected:
 	std::string macros;
 	bool from_atlas;
 
-	bool createVertexShaderObject(const std::string& shader);
-	bool createFragmentShaderObject(const std::string& shader);
-	bool createShaderObject(unsigned int type, GLuint& handle, const std::string& shader);
+	GLuint createShaderObject(unsigned int type, const std::string& shader); //compiles it but does not wait
+	bool checkShaderObject(GLuint handle, const std::string& shader);
 	void saveShaderInfoLog(GLuint obj);
 	void saveProgramInfoLog(GLuint obj);
 
 	bool validate();
 
+	//program binaries, false if the driver does not accept that one (it changed) or cannot give it
+	bool loadBinary(unsigned int format, const void* data, int size);
+	bool getBinary(unsigned int& format, std::vector<unsigned char>& data);
+	static int s_num_binary_formats; //0 if program binaries are not supported
+
+	//the new program is linked apart, the old one is used until it is ready
+	void submitCompile(); //of pending_vs_code and pending_fs_code
+	bool isCompileDone(); //without blocking, only with GL_KHR_parallel_shader_compile
+	bool finishCompile(); //waits for it, false if it failed (the old program stays)
+	void cancelCompile();
+	enum { ATLAS_PROGRAM_UNCHANGED, ATLAS_PROGRAM_CACHED, ATLAS_PROGRAM_COMPILING };
+	int loadAtlasProgram(); //from the program cache or starts compiling it, nothing if its code is the same
+	static bool finishAtlasShader(Shader* shader);
+	static void writeAtlasCache();
+	static bool s_parallel_compile;
+
+	bool pending;
+	GLuint pending_vs;
+	GLuint pending_fs;
+	GLuint pending_program;
+	std::string pending_vs_code;
+	std::string pending_fs_code;
+	unsigned long long cache_key; //in the program cache
+	std::string atlas_name;
+
 	GLuint vs;
 	GLuint fs;
 	GLuint program;
@@ -0,0 +1,134 @@
+#include "shadercache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+ShaderCacheFile::ShaderCacheFile()
+{
+	header = NULL;
+	entries = NULL;
+}
+
+bool ShaderCacheFile::open(const char* filename, unsigned long long driver_hash)
+{
+	close();
+	if (!file.open(filename))
+		return false;
+
+	const sShaderCacheHeader* h = (const sShaderCacheHeader*)file.data;
+	if (file.size < sizeof(sShaderCacheHeader) || memcmp(h->magic, SHADER_CACHE_MAGIC, 4) != 0)
+	{
+		file.close();
+		return false;
+	}
+	if (h->version != SHADER_CACHE_VERSION || h->driver_hash != driver_hash)
+	{
+		file.close();
+		return false; //stale, it will be written again
+	}
+
+	const sShaderCacheEntry* table = (const sShaderCacheEntry*)(file.data + sizeof(sShaderCacheHeader));
+	bool valid = h->file_size == file.size && sizeof(sShaderCacheHeader) + (size_t)h->num_entries * sizeof(sShaderCacheEntry) <= file.size;
+	for (unsigned int i = 0; i < h->num_entries && valid; ++i)
+		valid = table[i].size > 0 && (size_t)table[i].offset + table[i].size <= file.size;
+	if (!valid)
+	{
+		std::cout << "[WARN] shader cache is truncated or corrupted: " << filename << std::endl;
+		file.close();
+		return false;
+	}
+
+	header = h;
+	entries = table;
+	return true;
+}
+
+void ShaderCacheFile::close()
+{
+	header = NULL;
+	entries = NULL;
+	file.close();
+}
+
+const sShaderCacheEntry* ShaderCacheFile::find(unsigned long long key) const
+{
+	//a few dozens of programs, no need for anything better
+	for (int i = 0; i < getNumEntries(); ++i)
+		if (entries[i].key == key)
+			return &entries[i];
+	return NULL;
+}
+
+const unsigned char* ShaderCacheFile::getData(const sShaderCacheEntry* entry) const
+{
+	return file.data + entry->offset;
+}
+
+unsigned long long hashDriver(const char* vendor, const char* renderer, const char* version)
+{
+	const char* strings[3] = { vendor, renderer, version };
+	unsigned long long hash = 0;
+	for (int i = 0; i < 3; ++i)
+		if (strings[i])
+			hash = hashMemory64(strings[i], strlen(strings[i]) + 1, hash); //with the \0 so "ab"+"c" differs from "a"+"bc"
+	return hash;
+}
+
+unsigned long long hashShaderSource(const std::string& vs_code, const std::string& fs_code, unsigned long long driver_hash)
+{
+	unsigned long long hash = hashMemory64(vs_code.c_str(), vs_code.size() + 1, driver_hash);
+	return hashMemory64(fs_code.c_str(), fs_code.size() + 1, hash);
+}
+
+bool writeShaderCache(const char* filename, unsigned long long driver_hash, const std::vector<sShaderBinary>& binaries)
+{
+	FILE* f = fopen(filename, "wb");
+	if (!f)
+	{
+		std::cout << "[WARN] cannot write shader cache: " << filename << std::endl;
+		return false;
+	}
+
+	sShaderCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, SHADER_CACHE_MAGIC, 4);
+	header.version = SHADER_CACHE_VERSION;
+	header.driver_hash = driver_hash;
+	header.num_entries = (unsigned int)binaries.size();
+
+	//the binaries go after the table, aligned
+	std::vector<sShaderCacheEntry> table(binaries.size());
+	unsigned int offset = sizeof(sShaderCacheHeader) + (unsigned int)(table.size() * sizeof(sShaderCacheEntry));
+	for (size_t i = 0; i < binaries.size(); ++i)
+	{
+		offset = (offset + SHADER_CACHE_ALIGNMENT - 1) / SHADER_CACHE_ALIGNMENT * SHADER_CACHE_ALIGNMENT;
+		sShaderCacheEntry& entry = table[i];
+		memset(&entry, 0, sizeof(entry));
+		entry.key = binaries[i].key;
+		entry.format = binaries[i].format;
+		entry.offset = offset;
+		entry.size = (unsigned int)binaries[i].data.size();
+		offset += entry.size;
+	}
+	header.file_size = offset;
+
+	bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+	if (ok && table.size())
+		ok = fwrite(&table[0], sizeof(sShaderCacheEntry), table.size(), f) == table.size();
+	const char padding[SHADER_CACHE_ALIGNMENT] = { 0 };
+	for (size_t i = 0; i < binaries.size() && ok; ++i)
+	{
+		long pos = ftell(f);
+		if (pos < (long)table[i].offset)
+			fwrite(padding, table[i].offset - pos, 1, f);
+		ok = fwrite(&binaries[i].data[0], binaries[i].data.size(), 1, f) == 1;
+	}
+	fclose(f);
+	if (!ok)
+	{
+		std::cout << "[WARN] cannot write shader cache: " << filename << std::endl;
+		remove(filename);
+	}
+	return ok;
+}
@@ -0,0 +1,67 @@
+/*  Linked programs of the shader atlas (.pbin next to the atlas), so the next launch does not compile them again.
+	Every entry is the blob given by glGetProgramBinary, found by a hash of the final vertex and fragment code
+	(macros included) and of the driver that made it. If the atlas or the driver change the entries do not match
+	and the shaders are compiled from source as always, then the file is written again.
+	It does not depend on OpenGL, Shader does the calls.
+*/
+#pragma once
+
+#include "mappedfile.h"
+
+#include <string>
+#include <vector>
+
+#define SHADER_CACHE_MAGIC "PBIN"
+#define SHADER_CACHE_VERSION 1
+#define SHADER_CACHE_EXTENSION ".pbin"
+#define SHADER_CACHE_ALIGNMENT 16
+
+struct sShaderCacheEntry {
+	unsigned long long key;		//hashShaderSource
+	unsigned int format;		//the binaryFormat of the driver
+	unsigned int offset;		//from the start of the file
+	unsigned int size;
+	unsigned int padding;
+};
+
+struct sShaderCacheHeader {
+	char magic[4];
+	int version;
+	unsigned long long driver_hash;	//of vendor, renderer and version strings
+	unsigned int num_entries;		//the table follows the header
+	unsigned int file_size;
+};
+
+//a program to write in the cache
+struct sShaderBinary {
+	unsigned long long key;
+	unsigned int format;
+	std::vector<unsigned char> data;
+};
+
+//a .pbin opened with mmap, the binaries point inside the mapping
+class ShaderCacheFile
+{
+public:
+	ShaderCacheFile();
+
+	//validates magic, version and sizes. it is not opened if it was made by another driver
+	bool open(const char* filename, unsigned long long driver_hash);
+	void close();
+	bool isOpen() const { return header != NULL; }
+	int getNumEntries() const { return header ? header->num_entries : 0; }
+
+	const sShaderCacheEntry* find(unsigned long long key) const; //NULL if that code is not in the cache
+	const sShaderCacheEntry* getEntry(int index) const { return &entries[index]; }
+	const unsigned char* getData(const sShaderCacheEntry* entry) const;
+
+private:
+	MappedFile file;
+	const sShaderCacheHeader* header;
+	const sShaderCacheEntry* entries;
+};
+
+unsigned long long hashDriver(const char* vendor, const char* renderer, const char* version);
+unsigned long long hashShaderSource(const std::string& vs_code, const std::string& fs_code, unsigned long long driver_hash);
+
+bool writeShaderCache(const char* filename, unsigned long long driver_hash, const std::vector<sShaderBinary>& binaries);
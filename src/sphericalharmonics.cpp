@@ -1,5 +1,12 @@
 #include "sphericalharmonics.h"
 
+#include <map>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+
 //system axis
 Vector3 cubemapFaceNormals[6][3] = {
     {{0, 0, -1} ,{0, -1, 0},{1, 0, 0} },  // posx
@@ -40,9 +47,8 @@ float texelSolidAngle(float aU, float aV, float width, float height) {
     return angle;
 }
 
-// give me a cubemap, its size and number of channels
-// and i'll give you spherical harmonics
-SphericalHarmonics computeSH( FloatImage images[], bool degamma ) {
+// reference implementation: evaluates the solid angle and the weights for every texel
+SphericalHarmonics computeSHReference( FloatImage images[], bool degamma ) {
 	assert(images[0].width == images[0].height && images[0].width != 0 && "Image is not square");
     int size = images[0].width;
     int channels = 3;
@@ -123,3 +129,233 @@ SphericalHarmonics computeSH( FloatImage images[], bool degamma ) {
         linear_sh.coeffs[i] = sh.coeffs[i] * (4 * PI / weightAccum);
     return linear_sh;
 }
+
+// tables are shared by every probe of the same resolution
+std::map<int, SHProjectionTable*> sSHTables;
+std::mutex sSHTablesMutex;
+
+const SHProjectionTable& getSHProjectionTable(int size)
+{
+	std::lock_guard<std::mutex> lock(sSHTablesMutex);
+	auto it = sSHTables.find(size);
+	if (it != sSHTables.end())
+		return *it->second;
+
+	SHProjectionTable* table = new SHProjectionTable();
+	table->size = size;
+	int face_texels = size * size;
+	table->num_texels = ((6 * face_texels + SH_LANES - 1) / SH_LANES) * SH_LANES;
+	for (int k = 0; k < sh_length; ++k)
+		table->basis[k].assign(table->num_texels, 0.0f);
+
+	//summed in float and in the same order than the reference, so both normalize by the same value
+	float weightAccum = 0;
+	for (int index = 0; index < 6; ++index)
+	{
+		for (int v = 0; v < size; v++) {
+			for (int u = 0; u < size; u++)
+			{
+				//same direction and solid angle than the reference
+				float fU = (2.0 * u / (size - 1.0)) - 1.0;
+				float fV = (2.0 * v / (size - 1.0)) - 1.0;
+				Vector3 dir = normalize(cubemapFaceNormals[index][0] * fU + cubemapFaceNormals[index][1] * fV + cubemapFaceNormals[index][2]);
+				float weight = texelSolidAngle(u, v, size, size);
+
+				float dx = dir.x;
+				float dy = dir.y;
+				float dz = dir.z;
+				int i = index * face_texels + v * size + u;
+
+				// forsyths weights folded with the basis
+				table->basis[0][i] = weight * 4 / 17;
+				table->basis[1][i] = weight * 8 / 17 * dy;
+				table->basis[2][i] = weight * 8 / 17 * dz;
+				table->basis[3][i] = weight * 8 / 17 * dx;
+				table->basis[4][i] = weight * 15 / 17 * dx * dy;
+				table->basis[5][i] = weight * 15 / 17 * dy * dz;
+				table->basis[6][i] = weight * 5 / 68 * (3.0f * dz * dz - 1.0f);
+				table->basis[7][i] = weight * 15 / 17 * dx * dz;
+				table->basis[8][i] = weight * 15 / 68 * (dx * dx - dy * dy);
+
+				weightAccum += weight * 3.0f;
+			}
+		}
+	}
+	table->norm = 4 * PI / weightAccum;
+
+	sSHTables[size] = table;
+	return *table;
+}
+
+// splits the six faces in three planar channels, the padding stays at zero
+static void deinterleaveCubemap(const SHProjectionTable& table, FloatImage images[], bool degamma, float* r, float* g, float* b)
+{
+	int face_texels = table.size * table.size;
+	for (int index = 0; index < 6; ++index)
+	{
+		FloatImage& face = images[index];
+		assert((int)face.width == table.size && (int)face.height == table.size && "All faces must have the same size");
+		const float* pixels = face.data;
+		int channels = face.num_channels;
+		int offset = index * face_texels;
+		for (int i = 0; i < face_texels; ++i)
+		{
+			const float* p = pixels + i * channels;
+			r[offset + i] = p[0];
+			g[offset + i] = p[1];
+			b[offset + i] = p[2];
+		}
+		if (degamma)
+			for (int i = offset; i < offset + face_texels; ++i)
+			{
+				r[i] = powf(r[i], 2.2f);
+				g[i] = powf(g[i], 2.2f);
+				b[i] = powf(b[i], 2.2f);
+			}
+	}
+	for (int i = 6 * face_texels; i < table.num_texels; ++i)
+		r[i] = g[i] = b[i] = 0.0f;
+}
+
+// dot product of every basis with every channel, using SH_LANES partial sums so the compiler can vectorize it
+static void projectCubemap(const SHProjectionTable& table, const float* r, const float* g, const float* b, SphericalHarmonics& sh)
+{
+	int n = table.num_texels;
+	for (int k = 0; k < sh_length; ++k)
+	{
+		const float* basis = table.basis[k].data();
+		float acc_r[SH_LANES] = { 0 };
+		float acc_g[SH_LANES] = { 0 };
+		float acc_b[SH_LANES] = { 0 };
+		for (int i = 0; i < n; i += SH_LANES)
+		{
+			for (int l = 0; l < SH_LANES; ++l)
+			{
+				float w = basis[i + l];
+				acc_r[l] += w * r[i + l];
+				acc_g[l] += w * g[i + l];
+				acc_b[l] += w * b[i + l];
+			}
+		}
+		Vector3 sum;
+		for (int l = 0; l < SH_LANES; ++l)
+			sum += Vector3(acc_r[l], acc_g[l], acc_b[l]);
+		sh.coeffs[k] = sum * table.norm;
+	}
+}
+
+// give me a cubemap, its size and number of channels
+// and i'll give you spherical harmonics
+SphericalHarmonics computeSH( FloatImage images[], bool degamma ) {
+	assert(images[0].width == images[0].height && images[0].width != 0 && "Image is not square");
+	const SHProjectionTable& table = getSHProjectionTable(images[0].width);
+	std::vector<float> channels(table.num_texels * 3);
+	float* r = &channels[0];
+	float* g = r + table.num_texels;
+	float* b = g + table.num_texels;
+
+	SphericalHarmonics sh;
+	deinterleaveCubemap(table, images, degamma, r, g, b);
+	projectCubemap(table, r, g, b, sh);
+	return sh;
+}
+
+void computeSHBatch( FloatImage* images, int num_probes, SphericalHarmonics* result, bool degamma, int num_threads )
+{
+	if (num_probes <= 0)
+		return;
+	assert(images[0].width == images[0].height && images[0].width != 0 && "Image is not square");
+	const SHProjectionTable& table = getSHProjectionTable(images[0].width);
+
+	if (num_threads <= 0)
+		num_threads = std::thread::hardware_concurrency();
+	if (num_threads <= 0)
+		num_threads = 1;
+	if (num_threads > num_probes)
+		num_threads = num_probes;
+
+	std::atomic<int> next_probe(0);
+	auto worker = [&]() {
+		std::vector<float> channels(table.num_texels * 3);
+		float* r = &channels[0];
+		float* g = r + table.num_texels;
+		float* b = g + table.num_texels;
+		int i;
+		while ((i = next_probe++) < num_probes)
+		{
+			deinterleaveCubemap(table, images + i * 6, degamma, r, g, b);
+			projectCubemap(table, r, g, b, result[i]);
+		}
+	};
+
+	std::vector<std::thread> threads;
+	for (int i = 1; i < num_threads; ++i)
+		threads.push_back(std::thread(worker));
+	worker(); //the calling thread works too
+	for (size_t i = 0; i < threads.size(); ++i)
+		threads[i].join();
+}
+
+//milliseconds, not using getTime so the offline baker can link this file without SDL
+static long shTime()
+{
+	return (long)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+bool benchmarkSH( int size, int num_probes )
+{
+	std::vector<FloatImage> images(num_probes * 6);
+	for (size_t i = 0; i < images.size(); ++i)
+	{
+		images[i].resize(size, size, 3);
+		for (int j = 0; j < size * size * 3; ++j)
+			images[i].data[j] = random(4.0f); //hdr range
+	}
+
+	std::vector<SphericalHarmonics> reference(num_probes);
+	std::vector<SphericalHarmonics> fast(num_probes);
+	std::vector<SphericalHarmonics> batch(num_probes);
+	getSHProjectionTable(size); //do not measure the table creation
+
+	long time = shTime();
+	for (int i = 0; i < num_probes; ++i)
+		reference[i] = computeSHReference(&images[i * 6]);
+	long reference_time = shTime() - time;
+
+	time = shTime();
+	for (int i = 0; i < num_probes; ++i)
+		fast[i] = computeSH(&images[i * 6]);
+	long fast_time = shTime() - time;
+
+	time = shTime();
+	computeSHBatch(&images[0], num_probes, &batch[0]);
+	long batch_time = shTime() - time;
+
+	//error relative to the DC term, higher bands of random data are mostly cancellation noise
+	float max_error = 0;
+	for (int i = 0; i < num_probes; ++i)
+		for (int k = 0; k < sh_length; ++k)
+			for (int c = 0; c < 3; ++c)
+			{
+				float ref = reference[i].coeffs[k].v[c];
+				float scale = fabsf(reference[i].coeffs[0].v[c]);
+				if (scale < 1.0f)
+					scale = 1.0f;
+				float error = fabsf(fast[i].coeffs[k].v[c] - ref) / scale;
+				float batch_error = fabsf(batch[i].coeffs[k].v[c] - ref) / scale;
+				if (error > max_error)
+					max_error = error;
+				if (batch_error > max_error)
+					max_error = batch_error;
+			}
+
+	std::cout << " + SH projection " << num_probes << " probes of " << size << "x" << size << std::endl;
+	std::cout << "   reference: " << reference_time << "ms, tables: " << fast_time << "ms, batch (" << std::thread::hardware_concurrency() << " threads): " << batch_time << "ms" << std::endl;
+	std::cout << "   max relative error: " << max_error << std::endl;
+	if (max_error > 1e-5)
+	{
+		std::cout << "[ERROR] SH projection differs from the reference" << std::endl;
+		return false;
+	}
+	return true;
+}
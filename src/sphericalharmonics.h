@@ -1,7 +1,7 @@
 #pragma once
 
 #include "framework.h"
-#include "texture.h"
+#include "image.h"
 
 extern Vector3 cubemapFaceNormals[6][3]; //(x,y,z)
 
@@ -9,4 +9,29 @@ struct SphericalHarmonics {
 	Vector3 coeffs[9];
 };
 
+//precomputed data to project a cubemap of a given resolution into SH
+//stored as SoA: basis[k] holds (forsyth weight * solid angle * Yk(dir)) for every texel of the 6 faces
+//the texel count is padded to a multiple of SH_LANES with zero weights so the kernel has no tail
+#define SH_LANES 8
+
+struct SHProjectionTable {
+	int size;			//face resolution
+	int num_texels;		//6 * size * size, padded to SH_LANES
+	std::vector<float> basis[9];
+	float norm;			//4*PI / accumulated weight
+};
+
+//returns the table for that resolution, building it the first time
+const SHProjectionTable& getSHProjectionTable(int size);
+
+//give me a cubemap (6 square FloatImages) and i'll give you spherical harmonics
 SphericalHarmonics computeSH( FloatImage images[], bool degamma = false);
+
+//original per texel implementation, kept as reference to validate computeSH
+SphericalHarmonics computeSHReference( FloatImage images[], bool degamma = false);
+
+//projects num_probes cubemaps in parallel, images must contain 6 consecutive faces per probe
+void computeSHBatch( FloatImage* images, int num_probes, SphericalHarmonics* result, bool degamma = false, int num_threads = 0);
+
+//compares computeSH against the reference on random cubemaps and prints the timings, returns false if the error is above 1e-5
+bool benchmarkSH( int size = 64, int num_probes = 64 );
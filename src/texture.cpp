@@ -8,16 +8,13 @@
 
 #include "mesh.h"
 #include "shader.h"
-#include "extra/picopng.h"
-#include "extra/jpgd.h"
+#include "jobsystem.h"
+#include "imagedecode.h"
+#include "renderstats.h"
 #include <cassert>
 
-#define STB_IMAGE_IMPLEMENTATION
-//#include "extra/stb_image.h"
 //#include "engine/application.h"
 
-#include "extra/stb_image.h"
-
 #ifdef USE_SKIA
 
 #define SK_CPU_LENDIAN 1
@@ -58,9 +55,15 @@ Vector4 Image::getPixelInterpolatedHigh(float x, float y, bool repeat) {
 
 
 std::map<std::string, Texture*> Texture::sTexturesLoaded;
+std::map<unsigned long long, Texture*> Texture::sTexturesByHash;
+std::map<std::string, Texture*> Texture::sTextureAliases;
 int Texture::default_mag_filter = GL_LINEAR;
 int Texture::default_min_filter = GL_LINEAR_MIPMAP_LINEAR;
 FBO* Texture::global_fbo = NULL;
+bool Texture::use_cooked_textures = true;
+bool Texture::use_streaming = true;
+int Texture::streaming_budget = 256;
+long Texture::streaming_frame = 0;
 
 Texture::Texture()
 {
@@ -71,6 +74,7 @@ Texture::Texture()
 	mipmaps = false;
 	format = 0;
 	type = 0;
+	internal_format = 0;
 	texture_type = GL_TEXTURE_2D;
 }
 
@@ -93,6 +97,11 @@ Texture::~Texture()
 
 void Texture::clear()
 {
+	cancelJob();
+	delete stream_file;
+	stream_file = NULL;
+	resident_level = 0;
+
 	glBindTexture(this->texture_type, 0);
 
 	//external textures are handled by an outside system (like Android OS)
@@ -101,6 +110,20 @@ void Texture::clear()
 
 	stdlog("Destroy texture: " + filename );
 	texture_id = 0;
+	VRAM::untrack(this);
+
+	if (content_hash)
+	{
+		auto it = sTexturesByHash.find(content_hash);
+		if (it != sTexturesByHash.end() && it->second == this)
+			sTexturesByHash.erase(it);
+		content_hash = 0;
+		for (auto it = sTextureAliases.begin(); it != sTextureAliases.end();)
+			if (it->second == this)
+				it = sTextureAliases.erase(it);
+			else
+				++it;
+	}
 
 	if (filename.size())
 	{
@@ -129,11 +152,18 @@ void Texture::Release()
 
 void Texture::debugInMenu()
 {
-	#ifdef IMGUI
+	#ifndef SKIP_IMGUI
 	if (this == NULL)
 		return;
 	this->bind();
 		ImGui::Image((void*)(intptr_t)texture_id, ImVec2(50, 50));
+	if (stream_file)
+	{
+		const sTexCacheLevel& level = stream_file->header->levels[resident_level];
+		ImGui::SameLine();
+		ImGui::Text("Mip %d/%d (%dx%d)%s\nRequired: %d\nVRAM: %d KB", resident_level, stream_file->header->num_levels - 1,
+			level.width, level.height, job ? " streaming" : "", required_level, (int)(getStreamingBytes(resident_level) / 1024));
+	}
 	#endif
 }
 
@@ -219,62 +249,172 @@ Texture* Texture::Find(const char* filename)
 	auto it = sTexturesLoaded.find(filename);
 	if (it != sTexturesLoaded.end())
 		return it->second;
+	it = sTextureAliases.find(filename);
+	if (it != sTextureAliases.end())
+		return it->second;
 	return NULL;
 }
 
-Texture* Texture::Get(const char* filename, bool mipmaps, bool wrap)
+Texture* Texture::Get(const char* filename, bool mipmaps, bool wrap, eTextureUsage usage)
 {
 	//load it
 	Texture* texture = Find(filename);
 	if (texture)
 		return texture;
 
+	//the same image under another name
+	unsigned long long file_hash = hashImageFile(filename);
+	unsigned long long hash = file_hash ? hashContent(file_hash, usage, mipmaps, wrap) : 0;
+	texture = hash ? GetDuplicate(hash, filename) : NULL;
+	if (texture)
+		return texture;
+
 	texture = new Texture();
-	if (!texture->load(filename, mipmaps, wrap))
+	if (!texture->load(filename, mipmaps, wrap, GL_UNSIGNED_BYTE, usage))
 	{
 		delete texture;
 		return NULL;
 	}
+	if (hash)
+		texture->registerHash(hash);
 
 	return texture;
 }
 
-bool Texture::load(const char* filename, bool mipmaps, bool wrap, unsigned int type)
+unsigned long long Texture::hashContent(const void* bytes, size_t size, eTextureUsage usage, bool mipmaps, bool wrap)
+{
+	return hashContent(hashMemory64(bytes, size), usage, mipmaps, wrap);
+}
+
+unsigned long long Texture::hashContent(unsigned long long file_hash, eTextureUsage usage, bool mipmaps, bool wrap)
+{
+	int params[3] = { usage, mipmaps, wrap };
+	return hashMemory64(params, sizeof(params), file_hash);
+}
+
+unsigned long long Texture::hashImageFile(const char* filename)
+{
+	MappedFile file;
+	if (!file.open(filename))
+		return 0;
+	return hashMemory64(file.data, file.size);
+}
+
+Texture* Texture::GetDuplicate(unsigned long long hash, const char* name)
+{
+	auto it = sTexturesByHash.find(hash);
+	if (it == sTexturesByHash.end())
+		return NULL;
+	Texture* texture = it->second;
+	texture->num_duplicates++;
+	if (*name && !sTexturesLoaded.count(name))
+		sTextureAliases[name] = texture;
+	stdlog(std::string(" + Texture shared: ") + (*name ? name : "unnamed") + " is " + texture->filename);
+	return texture;
+}
+
+void Texture::registerHash(unsigned long long hash)
+{
+	content_hash = hash;
+	sTexturesByHash[hash] = this;
+}
+
+void Texture::getDuplicateStats(int& count, size_t& bytes)
+{
+	count = 0;
+	bytes = 0;
+	for (auto it : sTexturesByHash)
+	{
+		count += it.second->num_duplicates;
+		bytes += it.second->num_duplicates * it.second->getVRAMSize();
+	}
+}
+
+size_t Texture::getVRAMSize()
+{
+	if (stream_file)
+		return getStreamingBytes(resident_level);
+
+	//the sized formats say what is stored, if not it is what was uploaded
+	int pixel_size = 0;
+	switch (internal_format)
+	{
+		case GL_RGBA32F: pixel_size = 16; break;
+		case GL_RGB32F: pixel_size = 12; break;
+		case GL_RGBA16F: pixel_size = 8; break;
+		case GL_RGB16F: pixel_size = 6; break;
+		case GL_RGBA8: case GL_R32F: case GL_RG16F: case GL_DEPTH_COMPONENT24: case GL_DEPTH_COMPONENT32: case GL_DEPTH24_STENCIL8: pixel_size = 4; break;
+		case GL_RGB8: pixel_size = 3; break;
+		case GL_R16F: case GL_DEPTH_COMPONENT16: pixel_size = 2; break;
+		case GL_R8: pixel_size = 1; break;
+	}
+	if (!pixel_size)
+	{
+		int channels = format == GL_RGBA ? 4 : format == GL_RGB ? 3 : format == GL_RG ? 2 : 1;
+		int channel_size = type == GL_FLOAT || type == GL_UNSIGNED_INT || type == GL_INT ? 4 : type == GL_HALF_FLOAT || type == GL_UNSIGNED_SHORT || type == GL_SHORT ? 2 : 1;
+		pixel_size = channels * channel_size;
+	}
+	size_t bytes = (size_t)width * height * (depth > 1 ? depth : 1) * pixel_size;
+	if (internal_format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT)
+		bytes = (size_t)width * height / 2;
+	else if (internal_format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT || internal_format == GL_COMPRESSED_RG_RGTC2)
+		bytes = (size_t)width * height;
+	if (texture_type == GL_TEXTURE_CUBE_MAP)
+		bytes *= 6;
+	if (mipmaps)
+		bytes = bytes * 4 / 3;
+	return bytes;
+}
+
+void Texture::updateVRAM()
+{
+	if (texture_id)
+		VRAM::track(this, vram_category, getVRAMSize(), filename);
+}
+
+void Texture::setVRAMCategory(eVRAMCategory category)
+{
+	vram_category = category;
+	updateVRAM();
+}
+
+bool Texture::load(const char* filename, bool mipmaps, bool wrap, unsigned int type, eTextureUsage usage)
 {
-	std::string str = filename;
-	std::string ext = str.substr(str.size() - 4, 4);
 	Image* image = NULL;
 	double time = getTime();
 
 	std::cout << " + Texture loading: " << filename << " ... ";
 
 	image = new Image();
-	bool found = false;
-
-	if (ext == ".tga" || ext == ".TGA")
-		found = image->loadTGA(filename);
-	else if (ext == ".png" || ext == ".PNG")
-		found = image->loadPNG(filename);
-	else if (ext == ".jpg" || ext == ".JPG" || ext == "JPEG" || ext == "jpeg")
-		found = image->loadJPG(filename);
+	TextureCacheFile* cooked = new TextureCacheFile();
+	bool found;
+	if (use_cooked_textures && mipmaps && type == GL_UNSIGNED_BYTE)
+		found = openCooked(filename, usage, supportsBlockCompression(usage), *cooked, image);
 	else
-	{
-		std::cout << "[ERROR]: unsupported format" << std::endl;
-		return false; //unsupported file type
-	}
+		found = image->load(filename);
 
-	if (!found) //file not found
+	if (!found) //file not found or unsupported file type
 	{
 		std::cout << " [ERROR]: Texture not found " << std::endl;
+		delete cooked;
+		delete image;
 		return false;
 	}
 
-	loadFromImage(image,mipmaps,wrap,type);
+	bool is_cooked = cooked->header != NULL;
+	if (is_cooked)
+		uploadCooked(cooked, wrap);
+	else
+	{
+		delete cooked;
+		loadFromImage(image, mipmaps, wrap, type);
+	}
 	this->filename = filename;
 	setName(filename);
 
-	std::cout << "[OK] Size: " << width << "x" << height << " Time: " << (getTime() - time) * 0.001 << "sec" << std::endl;
+	std::cout << "[OK] Size: " << width << "x" << height << (is_cooked ? " cooked" : "") << " Time: " << (getTime() - time) * 0.001 << "sec" << std::endl;
 	this->image.clear();
+	delete image;
 	return true;
 }
 
@@ -299,6 +439,363 @@ void Texture::loadFromImage(Image* image, bool mipmaps, bool wrap, unsigned int
 	glBindTexture(GL_TEXTURE_2D, 0);
 }
 
+Texture* Texture::GetAsync(const char* filename, const Vector4ub& placeholder, bool mipmaps, bool wrap, eTextureUsage usage, unsigned long long file_hash)
+{
+	Texture* texture = Find(filename);
+	if (texture)
+		return texture;
+	if (!JobSystem::num_workers)
+		return Get(filename, mipmaps, wrap, usage);
+
+	//the same image under another name, when the caller already knows the hash of the file
+	unsigned long long hash = file_hash ? hashContent(file_hash, usage, mipmaps, wrap) : 0;
+	texture = hash ? GetDuplicate(hash, filename) : NULL;
+	if (texture)
+		return texture;
+
+	//registered now so nobody else loads it again
+	texture = new Texture();
+	texture->createPlaceholder(placeholder);
+	texture->setName(filename);
+	if (hash)
+		texture->registerHash(hash);
+
+	std::string name = filename;
+	Image* image = new Image();
+	TextureCacheFile* cooked = new TextureCacheFile();
+	bool use_cooked = use_cooked_textures && mipmaps;
+	bool compress = use_cooked && supportsBlockCompression(usage);
+	sTextureJob* job = texture->startJob();
+	bool hash_file = !hash;
+	JobSystem::run([job, image, cooked, name, use_cooked, usage, compress, hash_file]() {
+		if (hash_file)
+			job->file_hash = hashImageFile(name.c_str());
+		bool found = use_cooked ? openCooked(name.c_str(), usage, compress, *cooked, image) : image->load(name.c_str());
+		if (!found)
+			image->width = 0;
+	}, [job, image, cooked, name, mipmaps, wrap, usage]() {
+		unsigned long long file_hash = job->file_hash;
+		Texture* texture = finishJob(job); //NULL if it was destroyed while loading
+		//too late to share it, but the next ones with this content will get this one
+		unsigned long long hash = file_hash ? hashContent(file_hash, usage, mipmaps, wrap) : 0;
+		if (texture && hash && !sTexturesByHash.count(hash))
+			texture->registerHash(hash);
+		if (texture && cooked->header)
+		{
+			texture->uploadCooked(cooked, wrap);
+			delete image;
+			return;
+		}
+		if (texture && image->width)
+			texture->uploadFromPBO(image, mipmaps, wrap);
+		else if (texture)
+			std::cout << "[ERROR] Texture not found: " << name << std::endl;
+		delete cooked;
+		delete image;
+	});
+	return texture;
+}
+
+sTextureJob* Texture::startJob()
+{
+	assert(!job && "the texture already has a job");
+	job = new sTextureJob();
+	job->texture = this;
+	return job;
+}
+
+Texture* Texture::finishJob(sTextureJob* job)
+{
+	Texture* texture = job->texture;
+	if (texture)
+		texture->job = NULL;
+	delete job->file;
+	delete job;
+	return texture;
+}
+
+void Texture::cancelJob()
+{
+	if (!job)
+		return;
+	//a job still running finds out when it finishes, a worker could be reading the file
+	job->texture = NULL;
+	job->file = stream_file;
+	stream_file = NULL;
+	job = NULL;
+}
+
+bool Texture::openCooked(const char* filename, eTextureUsage usage, bool compress, TextureCacheFile& file, Image* image)
+{
+	//the image is hashed every time, reading it is much faster than decoding it
+	unsigned int hash = 2166136261u;
+	if (!hashFile(filename, hash))
+		return false;
+	std::string cooked_filename = getTexCacheFilename(filename, usage);
+	if (file.open(cooked_filename.c_str(), hash))
+	{
+		if (file.header->usage == usage && (compress || file.header->format == TEX_RGBA8))
+			return true;
+		file.close(); //cooked for another usage or for a GPU with block compression
+	}
+
+	if (!image->load(filename))
+		return false;
+	eTexCacheFormat format = chooseTexCacheFormat(image->data, image->width, image->height, image->num_channels, usage, compress);
+	if (!writeTextureCache(cooked_filename.c_str(), image->data, image->width, image->height, image->num_channels, usage, format, true, hash) ||
+		!file.open(cooked_filename.c_str(), hash))
+		return true; //uploaded from the image as before
+	image->clear();
+	return true;
+}
+
+bool Texture::supportsBlockCompression(eTextureUsage usage)
+{
+	static int s3tc = -1;
+	static int rgtc = -1; //BC5, without it the normal maps are cooked as RGBA8
+	if (s3tc == -1)
+	{
+		s3tc = isGLExtensionSupported("GL_EXT_texture_compression_s3tc") ? 1 : 0;
+		rgtc = isGLExtensionSupported("GL_ARB_texture_compression_rgtc") || isGLExtensionSupported("GL_EXT_texture_compression_rgtc") ? 1 : 0;
+	}
+	return (usage == TEXTURE_NORMAL ? rgtc : s3tc) == 1;
+}
+
+void Texture::uploadCooked(TextureCacheFile* file, bool wrap)
+{
+	const sTexCacheHeader* header = file->header;
+	unsigned int formats[] = { GL_RGBA, GL_COMPRESSED_RGB_S3TC_DXT1_EXT, GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, GL_COMPRESSED_RG_RGTC2 };
+
+	//width and height are the ones of level 0 even if it is not resident
+	this->width = (float)header->width;
+	this->height = (float)header->height;
+	this->depth = 0;
+	this->format = header->format == TEX_BC5 ? GL_RG : GL_RGBA;
+	this->type = GL_UNSIGNED_BYTE;
+	this->internal_format = formats[header->format];
+	this->texture_type = GL_TEXTURE_2D;
+	this->mipmaps = header->num_levels > 1;
+	this->wrapS = this->wrapT = (this->mipmaps && wrap) ? GL_REPEAT : GL_CLAMP_TO_EDGE;
+
+	//the small levels first, the rest are streamed when something needs them
+	int level = 0;
+	if (use_streaming)
+		while (level < header->num_levels - 1 && (header->levels[level].width > TEXTURE_STREAMING_MIN_SIZE || header->levels[level].height > TEXTURE_STREAMING_MIN_SIZE))
+			level++;
+
+	cancelJob();
+	delete stream_file;
+	stream_file = file;
+	resident_level = header->num_levels; //nothing uploaded yet
+	setResidentLevel(level);
+	if (level == 0) //already complete
+	{
+		delete stream_file;
+		stream_file = NULL;
+	}
+	required_level = level;
+	budget_level = level;
+}
+
+void Texture::setResidentLevel(int level)
+{
+	const sTexCacheHeader* header = stream_file->header;
+	if (level == resident_level)
+		return;
+
+	//a new object, the levels of a texture can not be removed and the storage could be immutable
+	GLuint new_id;
+	glGenTextures(1, &new_id);
+	glBindTexture(GL_TEXTURE_2D, new_id);
+	for (int i = level; i < header->num_levels; ++i)
+	{
+		const sTexCacheLevel& data = header->levels[i];
+		if (header->format == TEX_RGBA8)
+			glTexImage2D(GL_TEXTURE_2D, i - level, GL_RGBA, data.width, data.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, stream_file->getLevel(i));
+		else
+			glCompressedTexImage2D(GL_TEXTURE_2D, i - level, this->internal_format, data.width, data.height, 0, data.size, stream_file->getLevel(i));
+	}
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, header->num_levels - 1 - level);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, Texture::default_mag_filter);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, this->mipmaps ? Texture::default_min_filter : GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrapS);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrapT);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	assert(checkGLErrors() && "Error uploading cooked texture");
+
+	if (texture_id)
+		glDeleteTextures(1, &texture_id);
+	texture_id = new_id;
+	resident_level = level;
+	updateVRAM();
+}
+
+size_t Texture::getStreamingBytes(int level)
+{
+	size_t bytes = 0;
+	for (int i = level; i < stream_file->header->num_levels; ++i)
+		bytes += stream_file->header->levels[i].size;
+	return bytes;
+}
+
+void Texture::requestResolution(float pixels)
+{
+	if (!stream_file)
+		return;
+
+	//the finest level that is not bigger than twice the pixels covered
+	const sTexCacheHeader* header = stream_file->header;
+	int size = header->width > header->height ? header->width : header->height;
+	int level = 0;
+	while (level < header->num_levels - 1 && size * 0.5f >= pixels)
+	{
+		size /= 2;
+		level++;
+	}
+	if (last_used_frame != streaming_frame || level < required_level)
+		required_level = level;
+	last_used_frame = streaming_frame;
+}
+
+void Texture::updateStreaming()
+{
+	std::vector<Texture*> streamed;
+	size_t resident_bytes = 0;
+	for (auto it : sTexturesLoaded)
+		if (it.second->stream_file)
+		{
+			Texture* texture = it.second;
+			streamed.push_back(texture);
+			resident_bytes += texture->getStreamingBytes(texture->resident_level);
+		}
+
+	//the level every texture wants: the required one if it was seen this frame, the one it has if not
+	std::vector<int> desired(streamed.size());
+	size_t desired_bytes = 0;
+	for (size_t i = 0; i < streamed.size(); ++i)
+	{
+		Texture* texture = streamed[i];
+		bool visible = texture->last_used_frame == streaming_frame;
+		desired[i] = !use_streaming ? 0 : (visible ? texture->required_level : texture->resident_level);
+		desired_bytes += texture->getStreamingBytes(desired[i]);
+	}
+
+	//over the budget: drop levels, first of the textures not seen for longer, then the biggest level of the visible ones
+	size_t budget = (size_t)streaming_budget * 1024 * 1024;
+	while (desired_bytes > budget)
+	{
+		int best = -1;
+		for (size_t i = 0; i < streamed.size(); ++i)
+		{
+			Texture* texture = streamed[i];
+			const sTexCacheHeader* header = texture->stream_file->header;
+			const sTexCacheLevel& level = header->levels[desired[i]];
+			if (level.width <= TEXTURE_STREAMING_MIN_SIZE && level.height <= TEXTURE_STREAMING_MIN_SIZE)
+				continue;
+			if (best == -1)
+			{
+				best = (int)i;
+				continue;
+			}
+			Texture* current = streamed[best];
+			bool visible = texture->last_used_frame == streaming_frame;
+			bool current_visible = current->last_used_frame == streaming_frame;
+			if (visible != current_visible)
+			{
+				if (!visible)
+					best = (int)i;
+			}
+			else if (!visible ? texture->last_used_frame < current->last_used_frame : level.size > current->stream_file->header->levels[desired[best]].size)
+				best = (int)i;
+		}
+		if (best == -1)
+			break;
+		desired_bytes -= streamed[best]->stream_file->header->levels[desired[best]].size;
+		desired[best]++;
+	}
+
+	//drops are applied now, loads are read by a worker and uploaded when ready, a few every frame
+	int uploads = 0;
+	for (size_t i = 0; i < streamed.size(); ++i)
+	{
+		Texture* texture = streamed[i];
+		texture->budget_level = desired[i];
+		if (desired[i] > texture->resident_level)
+			texture->setResidentLevel(desired[i]);
+		else if (desired[i] < texture->resident_level && !texture->job && uploads < TEXTURE_STREAMING_UPLOADS)
+		{
+			uploads++;
+			int level = desired[i];
+			sTextureJob* job = texture->startJob();
+			TextureCacheFile* file = texture->stream_file;
+			int resident = texture->resident_level;
+			JobSystem::run([file, level, resident]() {
+				file->prefetch(level, resident);
+			}, [job, level]() {
+				Texture* texture = finishJob(job); //NULL if it was cleared while reading
+				if (!texture || !texture->stream_file)
+					return;
+				//the budget may have dropped it (or it is not seen anymore) while reading
+				int target = level > texture->budget_level ? level : texture->budget_level;
+				if (target < texture->resident_level)
+					texture->setResidentLevel(target);
+			});
+		}
+	}
+
+	streaming_frame++;
+}
+
+void Texture::createPlaceholder(const Vector4ub& color)
+{
+	Uint8 data[4] = { color.x, color.y, color.z, color.w };
+	create(1, 1, GL_RGBA, GL_UNSIGNED_BYTE, false, data);
+}
+
+void Texture::uploadFromPBO(Image* image, bool mipmaps, bool wrap)
+{
+	size_t bytes = image->width * image->height * image->num_channels;
+
+	//one buffer for every upload, orphaned each time so it never waits for the previous copy
+	static GLuint pbo = 0;
+	if (pbo == 0)
+		glGenBuffers(1, &pbo);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+	glBufferData(GL_PIXEL_UNPACK_BUFFER, bytes, NULL, GL_STREAM_DRAW);
+	Uint8* data = image->data;
+	void* mapped = glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
+	if (mapped)
+	{
+		memcpy(mapped, image->data, bytes);
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		data = NULL; //offset 0 of the bound buffer
+	}
+	else
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	//same id, so whoever has the placeholder gets the real texture. not create() because clear() would unregister it
+	this->width = (float)image->width;
+	this->height = (float)image->height;
+	this->depth = 0;
+	this->format = image->num_channels == 3 ? GL_RGB : GL_RGBA;
+	this->type = GL_UNSIGNED_BYTE;
+	this->internal_format = 0;
+	this->texture_type = GL_TEXTURE_2D;
+	this->mipmaps = mipmaps && isPowerOfTwo(image->width) && isPowerOfTwo(image->height);
+	if (texture_id == 0)
+		glGenTextures(1, &texture_id);
+	upload(format, type, this->mipmaps, data);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	if (!data && this->mipmaps)
+		generateMipmaps();
+
+	glBindTexture(this->texture_type, texture_id);
+	glTexParameteri(this->texture_type, GL_TEXTURE_WRAP_S, (this->mipmaps && wrap) ? GL_REPEAT : GL_CLAMP_TO_EDGE);
+	glTexParameteri(this->texture_type, GL_TEXTURE_WRAP_T, (this->mipmaps && wrap) ? GL_REPEAT : GL_CLAMP_TO_EDGE);
+	glBindTexture(this->texture_type, 0);
+}
+
 void Texture::upload(Image* img)
 {
 	create(img->width, img->height, img->num_channels == 3 ? GL_RGB : GL_RGBA, GL_UNSIGNED_BYTE, true, img->data);
@@ -340,6 +837,7 @@ void Texture::upload( unsigned int format, unsigned int type, bool mipmaps, Uint
 
 	glBindTexture(this->texture_type, 0);
 	assert(checkGLErrors() && "Error uploading texture");
+	updateVRAM();
 }
 
 /*
@@ -413,6 +911,8 @@ void Texture::uploadCubemap(unsigned int format, unsigned int t, bool mips, Uint
 
 	glBindTexture(this->texture_type, 0);
 	assert(glGetError() == GL_NO_ERROR && "Error creating texture");
+	if (level == 0)
+		updateVRAM();
 }
 
 //special function to upload texture arrays, a special type of texture that has layers
@@ -487,6 +987,7 @@ void Texture::uploadAsArray(unsigned int texture_size, bool mipmaps)
 
 	if (num_columns > 1)
 		delete[] data;
+	updateVRAM();
 	#endif
 }
 
@@ -494,6 +995,7 @@ void Texture::uploadAsArray(unsigned int texture_size, bool mipmaps)
 void Texture::bind()
 {
 	//glEnable(this->texture_type); //enable the textures 
+	RenderStats::add(STAT_TEXTURE_BINDS);
 	glBindTexture(this->texture_type, texture_id );	//enable the id of the texture we are going to use
 }
 
@@ -734,6 +1236,19 @@ bool Image::loadTGA(const char* filename)
 #include <iostream>
 #include <fstream>
 
+bool Image::load(const char* filename)
+{
+	std::string str = filename;
+	std::string ext = str.size() > 4 ? str.substr(str.size() - 4, 4) : "";
+	if (ext == ".tga" || ext == ".TGA")
+		return loadTGA(filename);
+	else if (ext == ".png" || ext == ".PNG")
+		return loadPNG(filename);
+	else if (ext == ".jpg" || ext == ".JPG" || ext == "JPEG" || ext == "jpeg")
+		return loadJPG(filename);
+	return false;
+}
+
 bool Image::loadPNG(const char* filename, bool flip_y)
 {
 	std::vector<unsigned char> buffer;
@@ -765,20 +1280,14 @@ bool Image::loadPNG(std::vector<unsigned char>& buffer, bool flip_y)
         data = new unsigned char[nSize];
         memcpy(data, pSrc, nSize);
     }
-#else
-    std::vector<unsigned char> out_image;
-
-	if (decodePNG(out_image, width, height, buffer.empty() ? 0 : &buffer[0], (unsigned long)buffer.size(), true) != 0)
-		return false;
-
-	data = new Uint8[out_image.size()];
-	memcpy(data, &out_image[0], out_image.size());
-	num_channels = 4;
-#endif
 
 	//flip pixels in Y
 	if (flip_y)
 		flipY();
+#else
+	if (buffer.empty() || !fromDecoded(&buffer[0], buffer.size(), flip_y))
+		return false;
+#endif
 
 	return true;
 }
@@ -832,26 +1341,29 @@ bool Image::loadJPG(std::vector<unsigned char>& buffer, bool flip_y)
         data = new unsigned char[nSize];
         memcpy(data, pSrc, nSize);
     }
-#else
-	//stb_image
-	unsigned char* image_data = stbi_load_from_memory( (stbi_uc*) &buffer[0], (unsigned long)buffer.size(), &width, &height, &channels, STBI_rgb);
-	if (!image_data)
-		return false;
-	this->width = (unsigned int)width;
-	this->height = (unsigned int)height;
-	this->num_channels = 3;// (unsigned int)channels;
-
-	//clone
-	data = new unsigned char[width * height * this->num_channels];
-	memcpy(data, image_data, width * height * this->num_channels);
-
-	stbi_image_free(image_data);
-#endif
 
 	//flip pixels in Y
 	if (flip_y)
 		flipY();
+#else
+	if (buffer.empty() || !fromDecoded(&buffer[0], buffer.size(), flip_y))
+		return false;
+#endif
+
+	return true;
+}
 
+bool Image::fromDecoded(const unsigned char* bytes, size_t size, bool flip_y)
+{
+	sDecodedImage decoded;
+	if (!ImageDecoder::decode(bytes, size, flip_y, decoded))
+		return false;
+	freeData();
+	data = decoded.data;
+	free_data = decoded.free_data;
+	width = decoded.width;
+	height = decoded.height;
+	num_channels = decoded.num_channels;
 	return true;
 }
 
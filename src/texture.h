@@ -6,6 +6,9 @@
 
 #include "includes.h"
 #include "framework.h"
+#include "image.h"
+#include "texturecache.h"
+#include "vram.h"
 #include <map>
 #include <string>
 #include <cassert>
@@ -22,80 +25,28 @@ class Texture;
 #define GL_RGBA16F 0x881A
 #endif
 
-#ifndef GL_TEXTURE_EXTERNAL_OES
-	#define GL_TEXTURE_EXTERNAL_OES 0x8D65
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+	#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+	#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+#ifndef GL_COMPRESSED_RG_RGTC2
+	#define GL_COMPRESSED_RG_RGTC2 0x8DBD
 #endif
 
-//Simple class to handle images (stores RGBA always)
-template <typename T> class tImage
-{
-public:
-	unsigned int width;
-	unsigned int height;
-	unsigned int num_channels; //bits per pixel
-	bool origin_topleft;
-	T* data; //bytes with the pixel information
-
-	tImage() { width = height = 0; data = NULL; num_channels = 3; }
-	tImage(int w, int h, int num_channels = 3) { data = NULL; resize(w, h, num_channels); }
-	~tImage() { if (data) delete[]data; data = NULL; }
-
-	void resize(int w, int h, int num_channels = 3) { if (data) delete[] data; width = w; height = h; this->num_channels = num_channels; data = new T[w * h * num_channels]; memset(data, 0, w * h * sizeof(T) * num_channels); }
-	void clear() { if (data) delete[]data; data = NULL; width = height = 0; }
-	void flipY();
-};
+#define TEXTURE_STREAMING_MIN_SIZE 128	//levels of this size or smaller are always in VRAM
+#define TEXTURE_STREAMING_UPLOADS 2		//textures that start streaming in every frame
 
-class Image : public tImage<uint8>
-{
-public:
-	Color getPixel(int x, int y) {
-		assert(x >= 0 && x < (int)width && y >= 0 && y < (int)height && "reading of memory");
-		int pos = y*width* num_channels + x* num_channels;
-		return Color(data[pos], data[pos + 1], data[pos + 2], num_channels == 4 ? 255 : data[pos + 3]);
-	};
-	void setPixel(int x, int y, Color v) {
-		assert(x >= 0 && x < (int)width && y >= 0 && y < (int)height && "writing of memory");
-		int pos = y*width*num_channels + x* num_channels;
-		data[pos] = v.x; data[pos + 1] = v.y; data[pos + 2] = v.z; if (num_channels == 4) data[pos + 3] = v.w;
-	};
-
-	Color getPixelInterpolated(float x, float y, bool repeat = false);
-	Vector4 getPixelInterpolatedHigh(float x, float y, bool repeat = false); //returns a Vector4 (floats)
-
-	void fromTexture(Texture* texture);
-	void fromScreen(int width, int height);
-
-	bool loadTGA(const char* filename);
-	bool loadPNG(const char* filename, bool flip_y = true);
-	bool loadPNG(std::vector<unsigned char>& buffer, bool flip_y = false);
-	bool loadJPG(const char* filename, bool flip_y = false);
-	bool loadJPG(std::vector<unsigned char>& buffer, bool flip_y = false);
-	bool saveTGA(const char* filename, bool flip_y = false);
-};
+#ifndef GL_TEXTURE_EXTERNAL_OES
+	#define GL_TEXTURE_EXTERNAL_OES 0x8D65
+#endif
 
-class FloatImage : public tImage<float>
-{
-public:
-	//~FloatImage(); //no need, the tImage dtor is valid
-
-	Vector4 getPixel(int x, int y) {
-		assert(x >= 0 && x < (int)width&& y >= 0 && y < (int)height && "reading of memory");
-		int pos = y * width * num_channels + x * num_channels;
-		return Vector4(data[pos], data[pos + 1], data[pos + 2], num_channels == 3 ? 1 : data[pos + 3]);
-	};
-	void setPixel(int x, int y, Vector4 v) {
-		assert(x >= 0 && x < (int)width&& y >= 0 && y < (int)height && "writing of memory");
-		int pos = y * width * num_channels + x * num_channels;
-		data[pos] = v.x; data[pos + 1] = v.y; data[pos + 2] = v.z;
-		if(num_channels == 4)
-			data[pos + 3] = v.w;
-	};
-	void fromTexture(Texture* texture);
-	bool loadIBIN(const char* filename);
-	bool saveIBIN(const char* filename);
+//a worker job that ends uploading to a texture, which can be destroyed before the job finishes (see Texture::startJob)
+struct sTextureJob {
+	Texture* texture;		//NULL once the texture has been cleared
+	TextureCacheFile* file;	//the stream file of a cleared texture, the worker may still be reading it
+	unsigned long long file_hash;	//Texture::hashImageFile computed by the worker, 0 if it was given or not found
 };
 
-
 // TEXTURE CLASS
 class Texture
 {
@@ -103,11 +54,17 @@ public:
 	static int default_mag_filter;
 	static int default_min_filter;
 	static FBO* global_fbo;
+	static bool use_cooked_textures; //load the images from a .tbin with the mips, cooking it the first time
+	static bool use_streaming;		//cooked textures start with the small mips and stream the rest when they are seen
+	static int streaming_budget;	//MB of VRAM for the streamed textures
+	static long streaming_frame;
 
 	//a general struct to store all the information about a TGA file
 
 	//textures manager
 	static std::map<std::string, Texture*> sTexturesLoaded;
+	static std::map<unsigned long long, Texture*> sTexturesByHash; //by the bytes of the png/jpg, shared by every prefab that ships them
+	static std::map<std::string, Texture*> sTextureAliases; //other files found to be one of the loaded textures
 
 	GLuint texture_id; // GL id to identify the texture in opengl, every texture must have its own id
 	float width;
@@ -120,6 +77,7 @@ public:
 	unsigned int internal_format;
 	unsigned int texture_type; //GL_TEXTURE_2D, GL_TEXTURE_CUBE, GL_TEXTURE_2D_ARRAY
 	bool mipmaps;
+	eVRAMCategory vram_category = VRAM_TEXTURES; //the FBOs change it for their textures
 
 	unsigned int wrapS;
 	unsigned int wrapT;
@@ -127,6 +85,18 @@ public:
 	//original data info
 	Image image;
 
+	//mip streaming (cooked textures only): the levels of stream_file from resident_level are in VRAM
+	TextureCacheFile* stream_file = NULL;
+	int resident_level = 0;
+	int required_level = 0;		//finest level needed by the visible objects of this frame
+	int budget_level = 0;		//finest level the budget allowed in the last updateStreaming, a read in flight does not go past it
+	long last_used_frame = -1;
+	sTextureJob* job = NULL;		//loading or streaming in a worker, one at a time
+
+	//deduplication: hash of the source bytes and times it has been returned instead of loading the same image again
+	unsigned long long content_hash = 0;
+	int num_duplicates = 0;
+
 	Texture();
 	Texture(unsigned int width, unsigned int height, unsigned int format = GL_RGB, unsigned int type = GL_UNSIGNED_BYTE, bool mipmaps = true, Uint8* data = NULL, unsigned int internal_format = 0);
 	Texture(Image* img);
@@ -158,17 +128,57 @@ public:
 	void operator = (const Texture& tex) { assert("textures cannot be cloned like this!");  }
 
 	//load without using the manager
-	bool load(const char* filename, bool mipmaps = true, bool wrap = true, unsigned int type = GL_UNSIGNED_BYTE);
+	bool load(const char* filename, bool mipmaps = true, bool wrap = true, unsigned int type = GL_UNSIGNED_BYTE, eTextureUsage usage = TEXTURE_COLOR);
 	void loadFromImage(Image* image, bool mipmaps = true, bool wrap = true, unsigned int type = GL_UNSIGNED_BYTE);
 
+	//for async loading: a 1x1 texture of that color until the real one is uploaded, keeping the same id and name
+	void createPlaceholder(const Vector4ub& color);
+	//like loadFromImage but the pixels go through a pixel buffer object, so the driver copies them to VRAM without stalling
+	void uploadFromPBO(Image* image, bool mipmaps = true, bool wrap = true);
+	//a cooked texture, compressed levels with glCompressedTexImage2D. keeps the name like uploadFromPBO.
+	//takes the file: if the texture is streamed only the small levels are uploaded and it is kept to read the rest
+	void uploadCooked(TextureCacheFile* file, bool wrap = true);
+
+	//streaming: the object that uses the texture covers that many pixels of the screen this frame
+	void requestResolution(float pixels);
+	//a new texture object with the levels from level (dropped ones are freed)
+	void setResidentLevel(int level);
+	size_t getStreamingBytes(int level); //VRAM of the levels from level
+	//once per frame: streams in the levels requested and drops levels to stay under the budget
+	static void updateStreaming();
+
+	//any thread: maps the .tbin of an image, cooking it first if it is missing or stale.
+	//if it cannot be written the decoded image is left in image. false if the image cannot be read
+	static bool openCooked(const char* filename, eTextureUsage usage, bool compress, TextureCacheFile& file, Image* image);
+	static bool supportsBlockCompression(eTextureUsage usage = TEXTURE_COLOR); //S3TC, RGTC for normal maps. main thread
+
 	//load using the manager (caching loaded ones to avoid reloading them)
-	static Texture* Get(const char* filename, bool mipmaps = true, bool wrap = true);
+	static Texture* Get(const char* filename, bool mipmaps = true, bool wrap = true, eTextureUsage usage = TEXTURE_COLOR);
 	static Texture* Find(const char* filename);
+	//async jobs: the done of the job calls finishJob and only touches the texture it returns
+	sTextureJob* startJob();
+	static Texture* finishJob(sTextureJob* job); //main thread, NULL if the texture was cleared meanwhile
+	void cancelJob(); //the job keeps the stream file and does nothing when it ends
+	//returns at once with a placeholder, the image is decoded by a worker and uploaded later (see JobSystem)
+	//file_hash is the hashImageFile of the file if the caller read it in a worker, otherwise the worker hashes it
+	static Texture* GetAsync(const char* filename, const Vector4ub& placeholder = Vector4ub(255, 255, 255, 255), bool mipmaps = true, bool wrap = true, eTextureUsage usage = TEXTURE_COLOR, unsigned long long file_hash = 0);
 	void setName(const char* name) {
 		filename = name;
 		sTexturesLoaded[filename] = this;
+		VRAM::rename(this, filename);
 	}
 
+	//deduplication by content: the key mixes the encoded image with how it is uploaded
+	static unsigned long long hashContent(const void* bytes, size_t size, eTextureUsage usage = TEXTURE_COLOR, bool mipmaps = true, bool wrap = true);
+	static unsigned long long hashContent(unsigned long long file_hash, eTextureUsage usage = TEXTURE_COLOR, bool mipmaps = true, bool wrap = true);
+	static unsigned long long hashImageFile(const char* filename); //the bytes of the file, 0 if it cannot be read. any thread
+	static Texture* GetDuplicate(unsigned long long hash, const char* name); //the texture with that content if any, counting the reuse
+	void registerHash(unsigned long long hash);
+	static void getDuplicateStats(int& count, size_t& bytes); //textures reused and the VRAM they would have taken
+	size_t getVRAMSize(); //estimated from the format, with the mips and only the resident levels of streamed textures
+	void updateVRAM(); //registers getVRAMSize in VRAM, after every upload
+	void setVRAMCategory(eVRAMCategory category);
+
 	void generateMipmaps();
 
 	//show the texture on the current viewport
@@ -0,0 +1,406 @@
+#include "texturecache.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#define TEX_CACHE_GAMMA 2.2f //same as the shaders
+
+TextureCacheFile::TextureCacheFile()
+{
+	header = NULL;
+}
+
+bool TextureCacheFile::open(const char* filename, unsigned int source_hash)
+{
+	header = NULL;
+	if (!file.open(filename))
+		return false;
+
+	const sTexCacheHeader* h = (const sTexCacheHeader*)file.data;
+	if (file.size < sizeof(sTexCacheHeader) || memcmp(h->magic, TEX_CACHE_MAGIC, 4) != 0)
+	{
+		file.close();
+		return false;
+	}
+	if (h->version != TEX_CACHE_VERSION || h->format < TEX_RGBA8 || h->format > TEX_BC5)
+	{
+		std::cout << "[WARN] cooked texture version not supported: " << filename << std::endl;
+		file.close();
+		return false;
+	}
+	bool valid = h->file_size == file.size && h->num_levels > 0 && h->num_levels <= TEX_CACHE_MAX_LEVELS;
+	for (int i = 0; i < h->num_levels && valid; ++i)
+	{
+		const sTexCacheLevel& level = h->levels[i];
+		valid = level.width > 0 && level.height > 0 && (size_t)level.offset + level.size <= file.size &&
+			level.size == getTexCacheLevelSize((eTexCacheFormat)h->format, level.width, level.height);
+	}
+	if (!valid)
+	{
+		std::cout << "[WARN] cooked texture is truncated or corrupted: " << filename << std::endl;
+		file.close();
+		return false;
+	}
+	if (source_hash && h->source_hash != source_hash)
+	{
+		file.close();
+		return false; //stale, the image has changed since it was cooked
+	}
+
+	header = h;
+	return true;
+}
+
+void TextureCacheFile::close()
+{
+	header = NULL;
+	file.close();
+}
+
+const unsigned char* TextureCacheFile::getLevel(int level) const
+{
+	return file.data + header->levels[level].offset;
+}
+
+void TextureCacheFile::prefetch(int first_level, int last_level) const
+{
+	volatile unsigned char sum = 0;
+	for (int i = first_level; i < last_level; ++i)
+		for (unsigned int offset = 0; offset < header->levels[i].size; offset += 4096)
+			sum += file.data[header->levels[i].offset + offset];
+}
+
+unsigned int getTexCacheLevelSize(eTexCacheFormat format, int width, int height)
+{
+	unsigned int blocks = ((width + 3) / 4) * ((height + 3) / 4);
+	if (format == TEX_BC1)
+		return blocks * 8;
+	if (format == TEX_BC3 || format == TEX_BC5)
+		return blocks * 16;
+	return width * height * 4;
+}
+
+std::string getTexCacheFilename(const char* image_filename, eTextureUsage usage)
+{
+	const char* suffixes[] = { "", ".data", ".normal" };
+	return std::string(image_filename) + (usage >= TEXTURE_COLOR && usage <= TEXTURE_NORMAL ? suffixes[usage] : "") + TEX_CACHE_EXTENSION;
+}
+
+eTexCacheFormat chooseTexCacheFormat(const unsigned char* pixels, int width, int height, int num_channels, eTextureUsage usage, bool compress)
+{
+	if (!compress || width % 4 || height % 4)
+		return TEX_RGBA8;
+	if (usage == TEXTURE_NORMAL)
+		return TEX_BC5;
+	if (num_channels == 4)
+		for (int i = 0; i < width * height; ++i)
+			if (pixels[i * 4 + 3] != 255)
+				return TEX_BC3;
+	return TEX_BC1;
+}
+
+static std::vector<float> buildGammaTable()
+{
+	std::vector<float> table(256);
+	for (int i = 0; i < 256; ++i)
+		table[i] = pow(i / 255.0f, TEX_CACHE_GAMMA);
+	return table;
+}
+
+static inline unsigned char toByte(float value)
+{
+	value = value * 255.0f + 0.5f;
+	return value < 0.0f ? 0 : (value > 255.0f ? 255 : (unsigned char)value);
+}
+
+void downsampleTexture(const unsigned char* src, int width, int height, unsigned char* dst, eTextureUsage usage)
+{
+	static const std::vector<float> to_linear = buildGammaTable();
+	int dst_width = width > 1 ? width / 2 : 1;
+	int dst_height = height > 1 ? height / 2 : 1;
+
+	for (int y = 0; y < dst_height; ++y)
+		for (int x = 0; x < dst_width; ++x)
+		{
+			//the 2x2 texels, repeating the last row or column on odd sizes
+			int x0 = x * 2, y0 = y * 2;
+			int x1 = x0 + 1 < width ? x0 + 1 : x0;
+			int y1 = y0 + 1 < height ? y0 + 1 : y0;
+			const unsigned char* texels[4] = { src + (y0 * width + x0) * 4, src + (y0 * width + x1) * 4,
+				src + (y1 * width + x0) * 4, src + (y1 * width + x1) * 4 };
+
+			float sum[4] = { 0, 0, 0, 0 };
+			for (int i = 0; i < 4; ++i)
+				for (int c = 0; c < 4; ++c)
+				{
+					float value = texels[i][c] / 255.0f;
+					if (usage == TEXTURE_COLOR && c < 3)
+						value = to_linear[texels[i][c]];
+					else if (usage == TEXTURE_NORMAL && c < 3)
+						value = value * 2.0f - 1.0f;
+					sum[c] += value * 0.25f;
+				}
+
+			unsigned char* texel = dst + (y * dst_width + x) * 4;
+			if (usage == TEXTURE_NORMAL)
+			{
+				float length = sqrt(sum[0] * sum[0] + sum[1] * sum[1] + sum[2] * sum[2]);
+				for (int c = 0; c < 3; ++c)
+					texel[c] = toByte((length > 0.0f ? sum[c] / length : 0.0f) * 0.5f + 0.5f);
+			}
+			else
+				for (int c = 0; c < 3; ++c)
+					texel[c] = toByte(usage == TEXTURE_COLOR ? pow(sum[c], 1.0f / TEX_CACHE_GAMMA) : sum[c]);
+			texel[3] = toByte(sum[3]);
+		}
+}
+
+static inline int quantize(float value, int max)
+{
+	int q = (int)(value * max / 255.0f + 0.5f);
+	return q < 0 ? 0 : (q > max ? max : q);
+}
+
+static unsigned short packColor565(const float* color)
+{
+	return (quantize(color[0], 31) << 11) | (quantize(color[1], 63) << 5) | quantize(color[2], 31);
+}
+
+static void unpackColor565(unsigned short value, float* color)
+{
+	int r = (value >> 11) & 31, g = (value >> 5) & 63, b = value & 31;
+	color[0] = (r << 3) | (r >> 2);
+	color[1] = (g << 2) | (g >> 4);
+	color[2] = (b << 3) | (b >> 2);
+}
+
+//BC1 color block: the endpoints are the extremes along the principal axis of the texels
+static void encodeColorBlock(const unsigned char* block, unsigned char* result)
+{
+	float mean[3] = { 0, 0, 0 };
+	for (int i = 0; i < 16; ++i)
+		for (int c = 0; c < 3; ++c)
+			mean[c] += block[i * 4 + c] / 16.0f;
+	float cov[6] = { 0, 0, 0, 0, 0, 0 }; //xx xy xz yy yz zz
+	for (int i = 0; i < 16; ++i)
+	{
+		float d[3] = { block[i * 4] - mean[0], block[i * 4 + 1] - mean[1], block[i * 4 + 2] - mean[2] };
+		cov[0] += d[0] * d[0]; cov[1] += d[0] * d[1]; cov[2] += d[0] * d[2];
+		cov[3] += d[1] * d[1]; cov[4] += d[1] * d[2]; cov[5] += d[2] * d[2];
+	}
+	float axis[3] = { 1, 1, 1 };
+	for (int iteration = 0; iteration < 8; ++iteration)
+	{
+		float v[3] = { cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2],
+			cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2],
+			cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2] };
+		float length = sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+		if (length < 1e-6f)
+			break;
+		for (int c = 0; c < 3; ++c)
+			axis[c] = v[c] / length;
+	}
+
+	int min_texel = 0, max_texel = 0;
+	float min_dot = 1e20f, max_dot = -1e20f;
+	for (int i = 0; i < 16; ++i)
+	{
+		float dot = block[i * 4] * axis[0] + block[i * 4 + 1] * axis[1] + block[i * 4 + 2] * axis[2];
+		if (dot < min_dot) { min_dot = dot; min_texel = i; }
+		if (dot > max_dot) { max_dot = dot; max_texel = i; }
+	}
+
+	//moved a little inside, the extremes are rarely the best endpoints
+	float endpoints[2][3];
+	for (int c = 0; c < 3; ++c)
+	{
+		float low = block[min_texel * 4 + c], high = block[max_texel * 4 + c];
+		float inset = (high - low) / 16.0f;
+		endpoints[0][c] = high - inset;
+		endpoints[1][c] = low + inset;
+	}
+	unsigned short color0 = packColor565(endpoints[0]);
+	unsigned short color1 = packColor565(endpoints[1]);
+	if (color0 < color1) //color0 > color1 selects the 4 colors mode
+	{
+		unsigned short tmp = color0;
+		color0 = color1;
+		color1 = tmp;
+	}
+
+	unsigned int indices = 0;
+	if (color0 != color1)
+	{
+		float palette[4][3];
+		unpackColor565(color0, palette[0]);
+		unpackColor565(color1, palette[1]);
+		for (int c = 0; c < 3; ++c)
+		{
+			palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3.0f;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3.0f;
+		}
+		for (int i = 0; i < 16; ++i)
+		{
+			int best = 0;
+			float best_dist = 1e20f;
+			for (int j = 0; j < 4; ++j)
+			{
+				float d[3] = { block[i * 4] - palette[j][0], block[i * 4 + 1] - palette[j][1], block[i * 4 + 2] - palette[j][2] };
+				float dist = d[0] * d[0] + d[1] * d[1] + d[2] * d[2];
+				if (dist < best_dist) { best_dist = dist; best = j; }
+			}
+			indices |= best << (i * 2);
+		}
+	}
+
+	result[0] = color0 & 0xFF; result[1] = color0 >> 8;
+	result[2] = color1 & 0xFF; result[3] = color1 >> 8;
+	for (int i = 0; i < 4; ++i)
+		result[4 + i] = (indices >> (i * 8)) & 0xFF;
+}
+
+//BC4 block of one channel (the alpha of BC3 and each channel of BC5), 8 values between the min and the max
+static void encodeChannelBlock(const unsigned char* block, int channel, unsigned char* result)
+{
+	int low = 255, high = 0;
+	for (int i = 0; i < 16; ++i)
+	{
+		int value = block[i * 4 + channel];
+		low = value < low ? value : low;
+		high = value > high ? value : high;
+	}
+	result[0] = high;
+	result[1] = low;
+
+	unsigned long long indices = 0;
+	if (high != low)
+	{
+		float palette[8] = { (float)high, (float)low };
+		for (int j = 2; j < 8; ++j)
+			palette[j] = ((8 - j) * high + (j - 1) * low) / 7.0f;
+		for (int i = 0; i < 16; ++i)
+		{
+			int best = 0;
+			float best_dist = 1e20f;
+			for (int j = 0; j < 8; ++j)
+			{
+				float dist = fabs(block[i * 4 + channel] - palette[j]);
+				if (dist < best_dist) { best_dist = dist; best = j; }
+			}
+			indices |= (unsigned long long)best << (i * 3);
+		}
+	}
+	for (int i = 0; i < 6; ++i)
+		result[2 + i] = (indices >> (i * 8)) & 0xFF;
+}
+
+void compressTexture(const unsigned char* rgba, int width, int height, eTexCacheFormat format, std::vector<unsigned char>& result)
+{
+	result.resize(getTexCacheLevelSize(format, width, height));
+	if (format == TEX_RGBA8)
+	{
+		memcpy(&result[0], rgba, result.size());
+		return;
+	}
+
+	unsigned char* output = &result[0];
+	unsigned char block[16 * 4];
+	for (int by = 0; by < height; by += 4)
+		for (int bx = 0; bx < width; bx += 4)
+		{
+			for (int y = 0; y < 4; ++y)
+				for (int x = 0; x < 4; ++x)
+				{
+					int sx = bx + x < width ? bx + x : width - 1;
+					int sy = by + y < height ? by + y : height - 1;
+					memcpy(block + (y * 4 + x) * 4, rgba + (sy * width + sx) * 4, 4);
+				}
+
+			if (format == TEX_BC1)
+				encodeColorBlock(block, output);
+			else if (format == TEX_BC3)
+			{
+				encodeChannelBlock(block, 3, output);
+				encodeColorBlock(block, output + 8);
+			}
+			else
+			{
+				encodeChannelBlock(block, 0, output);
+				encodeChannelBlock(block, 1, output + 8);
+			}
+			output += format == TEX_BC1 ? 8 : 16;
+		}
+}
+
+bool writeTextureCache(const char* filename, const unsigned char* pixels, int width, int height, int num_channels,
+	eTextureUsage usage, eTexCacheFormat format, bool mipmaps, unsigned int source_hash)
+{
+	//every level is computed from the previous one in RGBA8
+	std::vector<unsigned char> level(width * height * 4);
+	for (int i = 0; i < width * height; ++i)
+	{
+		for (int c = 0; c < 3; ++c)
+			level[i * 4 + c] = pixels[i * num_channels + (c < num_channels ? c : 0)];
+		level[i * 4 + 3] = num_channels == 4 ? pixels[i * 4 + 3] : 255;
+	}
+
+	FILE* f = fopen(filename, "wb");
+	if (!f)
+	{
+		std::cout << "[WARN] cannot write cooked texture: " << filename << std::endl;
+		return false;
+	}
+
+	sTexCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, TEX_CACHE_MAGIC, 4);
+	header.version = TEX_CACHE_VERSION;
+	header.format = format;
+	header.usage = usage;
+	header.width = width;
+	header.height = height;
+	header.source_hash = source_hash;
+	bool ok = fwrite(&header, sizeof(header), 1, f) == 1; //written again at the end with the levels
+
+	const char padding[TEX_CACHE_ALIGNMENT] = { 0 };
+	std::vector<unsigned char> next;
+	std::vector<unsigned char> encoded;
+	int level_width = width, level_height = height;
+	while (ok && header.num_levels < TEX_CACHE_MAX_LEVELS)
+	{
+		long pos = ftell(f);
+		if (pos % TEX_CACHE_ALIGNMENT)
+			fwrite(padding, TEX_CACHE_ALIGNMENT - pos % TEX_CACHE_ALIGNMENT, 1, f);
+
+		compressTexture(&level[0], level_width, level_height, format, encoded);
+		sTexCacheLevel& info = header.levels[header.num_levels++];
+		info.offset = ftell(f);
+		info.size = encoded.size();
+		info.width = level_width;
+		info.height = level_height;
+		ok = fwrite(&encoded[0], encoded.size(), 1, f) == 1;
+
+		if (!mipmaps || (level_width == 1 && level_height == 1))
+			break;
+		int next_width = level_width > 1 ? level_width / 2 : 1;
+		int next_height = level_height > 1 ? level_height / 2 : 1;
+		next.resize(next_width * next_height * 4);
+		downsampleTexture(&level[0], level_width, level_height, &next[0], usage);
+		level.swap(next);
+		level_width = next_width;
+		level_height = next_height;
+	}
+
+	header.file_size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	ok = ok && fwrite(&header, sizeof(header), 1, f) == 1;
+	fclose(f);
+	if (!ok)
+	{
+		std::cout << "[WARN] cannot write cooked texture: " << filename << std::endl;
+		remove(filename);
+	}
+	return ok;
+}
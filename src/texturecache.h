@@ -0,0 +1,89 @@
+/*  Cooked textures (.tbin next to the source image, one per usage), so the png/jpg does not need to be decoded again.
+	A header with the offset of every mip level and the levels one after the other, aligned to 16 bytes,
+	ready to be uploaded from the mapped file. The mips are computed on the CPU (color textures are averaged
+	in linear space) and can be block compressed: BC1 for opaque colors, BC3 with alpha and BC5 for normal maps.
+	It does not depend on OpenGL, the formats are translated by Texture::uploadCooked.
+*/
+#pragma once
+
+#include "mappedfile.h"
+
+#include <string>
+#include <vector>
+
+#define TEX_CACHE_MAGIC "TBIN"
+#define TEX_CACHE_VERSION 1
+#define TEX_CACHE_EXTENSION ".tbin"
+#define TEX_CACHE_ALIGNMENT 16
+#define TEX_CACHE_MAX_LEVELS 16
+
+enum eTexCacheFormat {
+	TEX_RGBA8 = 0,
+	TEX_BC1 = 1,	//RGB, 8 bytes every 4x4 block
+	TEX_BC3 = 2,	//RGBA, 16 bytes every 4x4 block
+	TEX_BC5 = 3		//RG, 16 bytes every 4x4 block. the shader rebuilds the z of the normal
+};
+
+//how the texels are used, changes how the mips are filtered and the format chosen
+enum eTextureUsage {
+	TEXTURE_COLOR = 0,	//gamma encoded, averaged in linear space
+	TEXTURE_DATA = 1,	//metalness, roughness, occlusion...
+	TEXTURE_NORMAL = 2	//normal maps, renormalized in every level
+};
+
+struct sTexCacheLevel {
+	unsigned int offset;	//from the start of the file
+	unsigned int size;
+	int width;
+	int height;
+};
+
+struct sTexCacheHeader {
+	char magic[4];
+	int version;
+	int format;				//eTexCacheFormat
+	int usage;				//eTextureUsage
+	int width;
+	int height;
+	int num_levels;
+	unsigned int source_hash;	//of the image it was cooked from
+	unsigned int file_size;
+	sTexCacheLevel levels[TEX_CACHE_MAX_LEVELS];
+};
+
+//a .tbin opened with mmap, the levels point inside the mapping
+class TextureCacheFile
+{
+public:
+	const sTexCacheHeader* header;
+
+	TextureCacheFile();
+
+	//validates magic, version and sizes. if source_hash is not 0 it must match the one in the file
+	bool open(const char* filename, unsigned int source_hash = 0);
+	void close();
+	const unsigned char* getLevel(int level) const;
+	void prefetch(int first_level, int last_level) const; //reads the pages of [first_level, last_level) so the upload does not wait for the disk
+
+private:
+	MappedFile file;
+};
+
+//the usage changes the mips and the format, so each one has its own file: <image>.tbin for colors, <image>.data.tbin...
+std::string getTexCacheFilename(const char* image_filename, eTextureUsage usage);
+
+//the format used for an image of that usage, compress is false when the GPU does not support block compression
+eTexCacheFormat chooseTexCacheFormat(const unsigned char* pixels, int width, int height, int num_channels, eTextureUsage usage, bool compress);
+
+//computes the mip chain (only level 0 if mipmaps is false), encodes it and writes the file
+bool writeTextureCache(const char* filename, const unsigned char* pixels, int width, int height, int num_channels,
+	eTextureUsage usage, eTexCacheFormat format, bool mipmaps, unsigned int source_hash);
+
+//next level of an RGBA8 image, half the size (at least 1)
+void downsampleTexture(const unsigned char* src, int width, int height, unsigned char* dst, eTextureUsage usage);
+
+//encodes an RGBA8 image in 4x4 blocks, the last blocks repeat the border texels
+void compressTexture(const unsigned char* rgba, int width, int height, eTexCacheFormat format, std::vector<unsigned char>& result);
+
+//bytes of a level of that size
+unsigned int getTexCacheLevelSize(eTexCacheFormat format, int width, int height);
@@ -12,6 +12,8 @@
 #include "camera.h"
 #include "shader.h"
 #include "mesh.h"
+#include "headless.h"
+#include "vram.h"
 
 #include "extra/stb_easy_font.h"
 
@@ -50,9 +52,25 @@ float * snapshot()
 //this function is used to access OpenGL Extensions (special features not supported by all cards)
 void* getGLProcAddress(const char* name)
 {
+	if (Headless::active)
+		return Headless::getProcAddress(name);
 	return SDL_GL_GetProcAddress(name);
 }
 
+bool isGLExtensionSupported(const char* name)
+{
+	if (!Headless::active)
+		return SDL_GL_ExtensionSupported(name) == SDL_TRUE;
+
+	//the headless context is a compatibility one, the whole list is still there
+	const char* extensions = (const char*)glGetString(GL_EXTENSIONS);
+	size_t length = strlen(name);
+	for (const char* found = extensions ? strstr(extensions, name) : NULL; found; found = strstr(found + length, name))
+		if ((found == extensions || found[-1] == ' ') && (found[length] == ' ' || found[length] == 0))
+			return true;
+	return false;
+}
+
 //Retrieve the current path of the application
 #ifdef __APPLE__
 #include "CoreFoundation/CoreFoundation.h"
@@ -307,10 +325,11 @@ std::string getGPUStats()
 		nCurAvailMemoryInKB = 0;
 	}
 
-	std::string str = "FPS: " + std::to_string(Application::instance->fps) + " DCS: " + std::to_string(Mesh::num_meshes_rendered) + " Tris: " + std::to_string(long(Mesh::num_triangles_rendered * 0.001)) + "Ks  VRAM: " + std::to_string(int((nTotalMemoryInKB-nCurAvailMemoryInKB) * 0.001)) + "MBs / " + std::to_string(int(nTotalMemoryInKB * 0.001)) + "MBs";
-	Mesh::num_meshes_rendered = 0;
-	Mesh::num_triangles_rendered = 0;
-	return str;
+	//ours is counted on any driver, the NVX extension only adds what the whole GPU has
+	std::string str = "FPS: " + std::to_string(Application::instance->fps) + " DCS: " + std::to_string(Mesh::num_meshes_rendered) + " Tris: " + std::to_string(long(Mesh::num_triangles_rendered * 0.001)) + "Ks  VRAM: " + std::to_string(int(VRAM::getTotal() / (1024 * 1024))) + "MBs";
+	if (nTotalMemoryInKB)
+		str += " (GPU " + std::to_string(int((nTotalMemoryInKB-nCurAvailMemoryInKB) * 0.001)) + "MBs / " + std::to_string(int(nTotalMemoryInKB * 0.001)) + "MBs)";
+	return str; //the counters are reset by RenderStats::newFrame
 }
 
 Mesh* grid = NULL;
@@ -26,6 +26,10 @@ bool drawText(float x, float y, std::string text, Vector3 c, float scale = 1);
 //check opengl errors
 bool checkGLErrors();
 
+//opengl functions and extensions of the current context, with SDL or the headless one
+void* getGLProcAddress(const char* name);
+bool isGLExtensionSupported(const char* name);
+
 //returns the current path
 std::string getPath();
 
@@ -0,0 +1,138 @@
+#include "vram.h"
+#include "includes.h"
+
+#include <algorithm>
+#include <map>
+
+#define VRAM_MENU_ASSETS 50 //biggest ones listed by category
+
+int VRAM::budget = 0;
+
+static std::map<const void*, sVRAMEntry> s_entries;
+static size_t s_category_bytes[NUM_VRAM_CATEGORIES] = { 0 };
+static int s_category_entries[NUM_VRAM_CATEGORIES] = { 0 };
+static size_t s_total = 0;
+static bool s_over_budget = false;
+
+static const char* s_category_names[NUM_VRAM_CATEGORIES] = { "Textures", "Render targets", "Meshes", "Other" };
+
+static void checkBudget()
+{
+	size_t budget_bytes = (size_t)VRAM::budget * 1024 * 1024;
+	bool over = budget_bytes && s_total > budget_bytes;
+	//once every time it goes over, not on every allocation
+	if (over && !s_over_budget)
+		std::cout << "[WARN] VRAM budget exceeded: " << (int)(s_total / (1024 * 1024)) << " MB of " << VRAM::budget << " MB" << std::endl;
+	s_over_budget = over;
+}
+
+void VRAM::track(const void* owner, eVRAMCategory category, size_t bytes, const std::string& name)
+{
+	if (!bytes)
+	{
+		untrack(owner);
+		return;
+	}
+
+	auto it = s_entries.find(owner);
+	if (it == s_entries.end())
+	{
+		sVRAMEntry entry;
+		entry.owner = owner;
+		entry.category = category;
+		entry.bytes = 0;
+		it = s_entries.insert(std::make_pair(owner, entry)).first;
+		s_category_entries[category]++;
+	}
+	sVRAMEntry& entry = it->second;
+	s_category_bytes[entry.category] -= entry.bytes;
+	s_total -= entry.bytes;
+	if (entry.category != category)
+	{
+		s_category_entries[entry.category]--;
+		s_category_entries[category]++;
+	}
+
+	entry.category = category;
+	entry.bytes = bytes;
+	entry.name = name;
+	s_category_bytes[category] += bytes;
+	s_total += bytes;
+	checkBudget();
+}
+
+void VRAM::untrack(const void* owner)
+{
+	auto it = s_entries.find(owner);
+	if (it == s_entries.end())
+		return;
+	s_category_bytes[it->second.category] -= it->second.bytes;
+	s_category_entries[it->second.category]--;
+	s_total -= it->second.bytes;
+	s_entries.erase(it);
+	checkBudget();
+}
+
+void VRAM::rename(const void* owner, const std::string& name)
+{
+	auto it = s_entries.find(owner);
+	if (it != s_entries.end())
+		it->second.name = name;
+}
+
+size_t VRAM::getTotal()
+{
+	return s_total;
+}
+
+size_t VRAM::getCategory(eVRAMCategory category)
+{
+	return s_category_bytes[category];
+}
+
+int VRAM::getNumEntries(eVRAMCategory category)
+{
+	return s_category_entries[category];
+}
+
+void VRAM::getEntries(std::vector<sVRAMEntry>& entries)
+{
+	entries.clear();
+	entries.reserve(s_entries.size());
+	for (auto it : s_entries)
+		entries.push_back(it.second);
+	std::sort(entries.begin(), entries.end(), [](const sVRAMEntry& a, const sVRAMEntry& b) { return a.bytes > b.bytes; });
+}
+
+const char* VRAM::getCategoryName(eVRAMCategory category)
+{
+	return s_category_names[category];
+}
+
+void VRAM::renderInMenu()
+{
+#ifndef SKIP_IMGUI
+	ImGui::Text("Tracked: %.1f MB", s_total / (1024.0 * 1024.0));
+	ImGui::SliderInt("Budget (MB, 0 none)", &budget, 0, 4096);
+	if (budget)
+		ImGui::ProgressBar(std::min(1.0f, (float)(s_total / (budget * 1024.0 * 1024.0))), ImVec2(-1, 0), s_over_budget ? "over budget" : NULL);
+
+	std::vector<sVRAMEntry> entries;
+	for (int i = 0; i < NUM_VRAM_CATEGORIES; ++i)
+	{
+		if (!ImGui::TreeNode(s_category_names[i], "%s: %.1f MB (%d)", s_category_names[i], s_category_bytes[i] / (1024.0 * 1024.0), s_category_entries[i]))
+			continue;
+		if (entries.empty())
+			getEntries(entries);
+		int shown = 0;
+		for (size_t j = 0; j < entries.size() && shown < VRAM_MENU_ASSETS; ++j)
+		{
+			if (entries[j].category != i)
+				continue;
+			ImGui::Text("%8.1f KB  %s", entries[j].bytes / 1024.0, entries[j].name.size() ? entries[j].name.c_str() : "(unnamed)");
+			shown++;
+		}
+		ImGui::TreePop();
+	}
+#endif
+}
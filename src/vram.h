@@ -0,0 +1,44 @@
+/*  Accounting of the video memory used by our own allocations, it does not need any driver extension so it works
+	the same on every GPU and on software GL. Every texture, render target and mesh registers its size when it is
+	uploaded (computed from the format, the mips and the buffer sizes) and removes it when it is freed.
+	The totals by category and the biggest assets are shown in the debug menu, with an optional budget that
+	warns when it is exceeded. Main thread only, like the GL calls that allocate the memory.
+*/
+#pragma once
+
+#include <string>
+#include <vector>
+
+enum eVRAMCategory {
+	VRAM_TEXTURES = 0,
+	VRAM_RENDER_TARGETS,	//the textures of the FBOs
+	VRAM_MESHES,
+	VRAM_OTHER,
+	NUM_VRAM_CATEGORIES
+};
+
+struct sVRAMEntry {
+	const void* owner;
+	int category;			//eVRAMCategory
+	size_t bytes;
+	std::string name;
+};
+
+class VRAM
+{
+public:
+	static int budget;		//MB, 0 for no budget
+
+	//registers (or updates) the memory of an object, 0 bytes removes it
+	static void track(const void* owner, eVRAMCategory category, size_t bytes, const std::string& name);
+	static void untrack(const void* owner);
+	static void rename(const void* owner, const std::string& name); //if it is tracked
+
+	static size_t getTotal();
+	static size_t getCategory(eVRAMCategory category);
+	static int getNumEntries(eVRAMCategory category);
+	static void getEntries(std::vector<sVRAMEntry>& entries); //sorted by size, the biggest first
+	static const char* getCategoryName(eVRAMCategory category);
+
+	static void renderInMenu();
+};